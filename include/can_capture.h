@@ -0,0 +1,134 @@
+// Capture of every received and sent CAN frame to compact binary logs in
+// LittleFS, for reproducing field incidents off the device.
+//
+// Off by default. While enabled, canCaptureFrame() encodes each frame into
+// a RAM buffer (no flash access on the frame path) and canCaptureService()
+// appends the buffer to /can0.bin from loop() every CAPTURE_FLUSH_INTERVAL
+// or once it is half full. When /can0.bin would grow past CAPTURE_FILE_SIZE
+// the files rotate: /can0.bin becomes /can1.bin and so on, and the oldest
+// of the CAPTURE_FILES is deleted. Enabling the capture always starts a
+// new file. Frames arriving while the buffer is full are counted as dropped.
+//
+// Only loop() touches the flash: starting, stopping, clearing and an early
+// flush are requested by the web handlers and carried out by the next
+// canCaptureService(). A download serves what is in flash, so the newest
+// file lacks the frames still buffered unless a flush or stop came first.
+//
+// File layout (little-endian): a CaptureFileHeader, then records of
+//
+//   1 byte   flags: bit 7 sent by us, bit 6 extended ID, bit 5 remote
+//            frame, bits 0-3 DLC
+//   1-5 bytes  microseconds since the previous record (the first record:
+//            since baseMicros), unsigned LEB128
+//   4 bytes  29-bit ID (2 bytes, 11-bit, for a standard frame)
+//   DLC bytes  payload
+//
+// A poll answer takes 14 bytes. canCaptureDecode() reads the records back;
+// the replay program ([env:replay]) feeds them through the frame parser.
+//
+// HTTP:
+//   GET  /capture             state and file sizes as JSON
+//   POST /capture             enabled=on|off, clear=1 deletes every file,
+//                             flush=1 writes out the buffer
+//   GET  /capture.bin?file=N  downloads file N (0 is the newest) as it is in flash
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "can_driver.h"
+
+const uint8_t CAPTURE_FILES = 4;
+const uint32_t CAPTURE_FILE_SIZE = 64 * 1024;
+const uint16_t CAPTURE_BUFFER_SIZE = 1024;
+const unsigned long CAPTURE_FLUSH_INTERVAL = 2000;  // ms
+// Longest encoded record: flags, 5-byte delta, 4-byte ID, 8 data bytes.
+const uint8_t CAPTURE_MAX_RECORD = 18;
+
+const uint8_t CAPTURE_FLAG_TX = 0x80;
+const uint8_t CAPTURE_FLAG_EXTENDED = 0x40;
+const uint8_t CAPTURE_FLAG_REMOTE = 0x20;
+const uint8_t CAPTURE_DLC_MASK = 0x0F;
+
+struct __attribute__((packed)) CaptureFileHeader {
+  char magic[4];        // "R48C"
+  uint8_t version;      // 1
+  uint8_t headerSize;   // sizeof(CaptureFileHeader), records start here
+  uint16_t reserved;
+  uint32_t baseMicros;  // micros() the first record's delta counts from
+  uint32_t baseMillis;  // millis() at the same moment, to match /log timestamps
+};
+
+// One decoded record.
+struct CaptureRecord {
+  bool sent;
+  unsigned long id;      // CAN_EXTENDED_FLAG in bit 31 for an extended frame, bit 30 for a remote frame
+  uint32_t deltaMicros;
+  byte len;
+  byte data[8];
+};
+
+struct CaptureStats {
+  bool enabled;
+  uint32_t records;   // frames captured since boot
+  uint32_t dropped;   // frames lost because the RAM buffer was full
+  uint32_t rotations;
+  uint16_t buffered;  // bytes waiting to be written
+};
+
+/**
+ * @brief Resets the capture state (capture off). Call once from setup() after LittleFS.begin().
+ */
+void canCaptureBegin();
+
+/**
+ * @brief Starts capturing to a new file, or stops and writes out the buffer, on the next canCaptureService().
+ */
+void canCaptureEnable(bool enable);
+
+/**
+ * @brief Deletes every capture file and the buffer on the next canCaptureService() that no download is running
+ * in; a running capture continues in a new file.
+ */
+void canCaptureClear();
+
+/**
+ * @brief Writes out the buffer on the next canCaptureService().
+ */
+void canCaptureFlush();
+
+/**
+ * @brief Records one frame if capturing. Cheap enough for the frame path: encodes into RAM only.
+ * @param sent true for a frame we sent, false for a received one.
+ * @param id The ID, with CAN_EXTENDED_FLAG set for an extended frame.
+ */
+void canCaptureFrame(bool sent, unsigned long id, byte len, const byte *data);
+
+/**
+ * @brief Carries out the requested start, stop, clear and flush, and writes the buffer to flash when due. Call
+ * from loop().
+ */
+void canCaptureService();
+
+CaptureStats canCaptureGetStats();
+
+/**
+ * @brief Decodes the record at `offset` and advances `offset` past it.
+ * @return false at the end of the data or on a truncated or malformed record.
+ */
+bool canCaptureDecode(const uint8_t *data, size_t length, size_t &offset, CaptureRecord &record);
+
+/**
+ * @brief Answers GET /capture.
+ */
+void canCaptureHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /capture.
+ */
+void canCaptureHandleControl(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers GET /capture.bin.
+ */
+void canCaptureHandleDownload(AsyncWebServerRequest *request);
@@ -0,0 +1,78 @@
+// Interface between the controller and the CAN hardware.
+//
+// Everything above this interface (receive ring, acceptance filters,
+// polling, commands) is backend-agnostic. Two backends implement it:
+//
+//   Mcp2515Driver   (can_mcp2515.h)   MCP2515 over SPI, as on the ESP8266
+//   SocketCanDriver (can_socketcan.h) a Linux SocketCAN interface such as
+//                                     can0, or vcan0 for testing
+//
+// The sketch picks one at compile time (R48_SOCKETCAN, see platformio.ini).
+// Only extended frames are sent; frame IDs use bit 31 as the extended
+// flag, which is the convention of both mcp_can and SocketCAN.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Extended frame flag in CanFrame::id.
+const unsigned long CAN_EXTENDED_FLAG = 0x80000000UL;
+
+// A received CAN frame (bit 31 of id flags an extended frame).
+struct CanFrame {
+  unsigned long id;
+  unsigned long timestamp; // millis() when the frame was taken out of the driver
+  byte len;
+  byte data[8];
+};
+
+// Receive-side counters kept by a backend.
+struct CanDriverStats {
+  uint32_t interrupts;  // MCP2515: INT falling edges; SocketCAN: receive batches that returned frames
+  uint32_t hwOverflows; // frames lost before the driver could read them (MCP2515: overflows, each one or more frames)
+};
+
+class CanDriver {
+public:
+  virtual ~CanDriver() {}
+
+  /**
+   * @brief Starts the controller at 125 kbit/s in normal mode.
+   * @return false if the hardware could not be initialised.
+   */
+  virtual bool begin() = 0;
+
+  /**
+   * @brief Queues an extended frame for transmission.
+   * @param id The 29-bit ID.
+   * @return false if the frame could not be queued.
+   */
+  virtual bool send(unsigned long id, byte len, const byte *data) = 0;
+
+  /**
+   * @brief Cheap check whether a frame may be waiting; when false, read() need not be called.
+   */
+  virtual bool rxPending() = 0;
+
+  /**
+   * @brief Takes the next received frame (timestamp is left to the caller).
+   * @return false when no frame is waiting.
+   */
+  virtual bool read(CanFrame &frame) = 0;
+
+  /**
+   * @brief Counts frames the hardware dropped since the last call; called once
+   * after every drain, however it ended. Backends that learn of drops while
+   * reading need not override it.
+   */
+  virtual void checkOverflow() {}
+
+  /**
+   * @brief Installs acceptance filters in the MCP2515's layout: filters 0-1 are
+   * compared under masks[0], filters 2-5 under masks[1]; a frame passes if any
+   * filter of matching format (extended[i]) accepts it.
+   */
+  virtual void setFilters(const unsigned long masks[2], const unsigned long filters[6], const bool extended[6]) = 0;
+
+  virtual CanDriverStats stats() = 0;
+};
@@ -0,0 +1,63 @@
+// Acceptance mask/filter configuration.
+//
+// The controller registers every CAN ID it actually consumes (optionally with
+// a "don't care" mask for ID ranges). canFilterService() compiles that set into
+// the two masks and six filters of the MCP2515, so frames nobody parses are
+// rejected in hardware and never cross the SPI bus. The SocketCAN backend
+// installs the same six filters in the kernel. The compiled filters
+// accept a superset of the registered IDs when there are more entries than
+// filter slots, so frame handlers must still check the ID in software.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "can_driver.h"
+
+// Maximum number of ID entries that can be registered at the same time.
+const uint8_t CAN_FILTER_MAX_ENTRIES = 16;
+
+// Mask value meaning "every one of the 29 ID bits must match".
+const unsigned long CAN_FILTER_EXACT = 0x1FFFFFFF;
+
+/**
+ * @brief Binds the filter subsystem to the CAN driver.
+ */
+void canFilterBegin(CanDriver &driver);
+
+/**
+ * @brief Registers an extended ID (or an ID range) the controller consumes.
+ * @param id The CAN ID, with or without the extended flag in bit 31.
+ * @param mask The ID bits that must match, CAN_FILTER_EXACT for a single ID.
+ * @return false when the entry table is full.
+ */
+bool canFilterAdd(unsigned long id, unsigned long mask = CAN_FILTER_EXACT);
+
+/**
+ * @brief Removes an entry previously registered with the same id and mask.
+ */
+bool canFilterRemove(unsigned long id, unsigned long mask = CAN_FILTER_EXACT);
+
+/**
+ * @brief Accepts every frame on the bus (standard and extended) for debugging.
+ */
+void canFilterSetPromiscuous(bool on);
+bool canFilterIsPromiscuous();
+
+/**
+ * @brief Reprograms the filters when the entry set or the mode changed.
+ *
+ * Cheap when nothing changed, so it is called on every loop() pass.
+ */
+void canFilterService();
+
+/**
+ * @brief Times the filters were written to the driver. On the MCP2515 each write
+ * passes through configuration mode, which drops the frames on the bus meanwhile.
+ */
+uint32_t canFilterReprograms();
+
+/**
+ * @brief Writes the currently programmed masks and filters as a JSON object.
+ */
+String canFilterToJson();
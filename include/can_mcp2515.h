@@ -0,0 +1,42 @@
+// CAN driver backend for an MCP2515 on SPI, through the mcp_can library.
+//
+// The MCP2515 pulls its INT pin low while either of its two receive buffers
+// holds a frame. The ISR only latches that event: on the ESP8266 the SPI
+// driver and the mcp_can library live in flash and must not be called from
+// interrupt context (the flash cache is switched off during file system and
+// WiFi config writes). rxPending() reports the latched event (or INT still
+// being low), and read() then takes the frames out over SPI from loop().
+
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <mcp_can.h>
+
+#include "can_driver.h"
+
+class Mcp2515Driver : public CanDriver {
+public:
+  /**
+   * @param can The mcp_can instance for the chip's CS pin.
+   * @param csPin The same CS pin, for the transfers mcp_can has no call for.
+   * @param intPin The ESP pin wired to the MCP2515 INT output.
+   */
+  Mcp2515Driver(MCP_CAN &can, uint8_t csPin, uint8_t intPin) : can(can), csPin(csPin), intPin(intPin) {}
+
+  bool begin() override;
+  bool send(unsigned long id, byte len, const byte *data) override;
+  bool rxPending() override;
+  bool read(CanFrame &frame) override;
+  void checkOverflow() override;
+  void setFilters(const unsigned long masks[2], const unsigned long filters[6], const bool extended[6]) override;
+  CanDriverStats stats() override;
+
+private:
+  void clearErrorFlags(uint8_t flags);
+
+  MCP_CAN &can;
+  uint8_t csPin;
+  uint8_t intPin;
+  uint32_t hwOverflows = 0;
+};
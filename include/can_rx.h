@@ -0,0 +1,56 @@
+// Receive ring between the CAN driver and the frame handlers.
+//
+// canRxService() moves every frame the driver has waiting (the MCP2515's two
+// hardware buffers, or a batch from the SocketCAN socket) into a fixed-size
+// single-producer/single-consumer ring in one go, and the consumer side pops
+// frames in batches. It asks the driver first whether anything is pending,
+// which for the MCP2515 is the latched INT interrupt, so an idle bus costs
+// no SPI traffic.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "can_driver.h"
+
+// Number of slots in the receive ring. Must be a power of two.
+const uint8_t CAN_RX_RING_SIZE = 32;
+
+// Counters used to prove that no frame is lost under load.
+struct CanRxStats {
+  uint32_t interrupts;  // driver wake-ups (see CanDriverStats)
+  uint32_t received;    // frames moved from the driver into the ring
+  uint32_t overruns;    // frames dropped because the ring was full
+  uint8_t highWater;    // highest ring fill level observed
+  uint32_t hwOverflows; // frames the driver lost (see CanDriverStats)
+};
+
+/**
+ * @brief Resets the ring.
+ * @param driver The started CAN driver to drain.
+ */
+void canRxBegin(CanDriver &driver);
+
+/**
+ * @brief Producer side: drains the frames waiting in the driver into the ring.
+ *
+ * Does nothing beyond driver.rxPending() when no frame is waiting, so it is
+ * cheap enough to call on every loop() pass and after each transmit.
+ */
+void canRxService();
+
+/**
+ * @brief Consumer side: pops the oldest frame from the ring.
+ * @return false when the ring is empty.
+ */
+bool canRxPop(CanFrame &frame);
+
+/**
+ * @brief Number of frames currently waiting in the ring.
+ */
+uint8_t canRxPending();
+
+/**
+ * @brief Snapshot of the receive counters.
+ */
+CanRxStats canRxGetStats();
@@ -0,0 +1,58 @@
+// CAN driver backend for a Linux SocketCAN interface (can0, or vcan0 for testing).
+//
+// The raw socket is non-blocking. read() serves frames from a batch that is
+// refilled with one recvmmsg() call of up to SOCKETCAN_BATCH frames, so at
+// high frame rates the system call is shared by the whole batch. The
+// acceptance filters run in the kernel (CAN_RAW_FILTER), and SO_RXQ_OVFL
+// reports frames dropped because the socket's receive buffer was full.
+//
+// The bit rate belongs to the interface, not to this driver:
+//   ip link set can0 type can bitrate 125000 && ip link set can0 up
+
+#pragma once
+
+#ifdef __linux__
+
+#include <Arduino.h>
+#include <linux/can.h>
+#include <sys/socket.h>
+
+#include "can_driver.h"
+
+// Most frames taken from the socket by one recvmmsg() call.
+const uint8_t SOCKETCAN_BATCH = 16;
+
+class SocketCanDriver : public CanDriver {
+public:
+  /**
+   * @param interfaceName The network interface, e.g. "can0" or "vcan0".
+   */
+  explicit SocketCanDriver(const char *interfaceName) : interfaceName(interfaceName) {}
+  ~SocketCanDriver() override;
+
+  bool begin() override;
+  bool send(unsigned long id, byte len, const byte *data) override;
+  bool rxPending() override;
+  bool read(CanFrame &frame) override;
+  void setFilters(const unsigned long masks[2], const unsigned long filters[6], const bool extended[6]) override;
+  CanDriverStats stats() override;
+
+private:
+  bool fillBatch();
+
+  const char *interfaceName;
+  int fd = -1;
+
+  struct can_frame frames[SOCKETCAN_BATCH];
+  struct mmsghdr messages[SOCKETCAN_BATCH];
+  struct iovec vectors[SOCKETCAN_BATCH];
+  char control[SOCKETCAN_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+  uint8_t batchCount = 0;
+  uint8_t batchNext = 0;
+
+  uint32_t batches = 0;
+  uint32_t dropCount = 0;  // the kernel's cumulative drop counter, as last reported
+  uint32_t hwOverflows = 0;
+};
+
+#endif
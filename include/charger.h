@@ -0,0 +1,130 @@
+// On-device CC/CV battery charge controller driving the online setpoints.
+//
+// Runs a fixed-rate loop (every CHARGER_PERIOD) on the bank's measured
+// output voltage and current and writes the online voltage and online
+// current limit of every tracked rectifier through the command queue.
+// Stages:
+//
+//   cc          the bank current is held at ccCurrent by a PI loop on the
+//               online current limit; the voltage setpoint is cvVoltage
+//   cv          once the voltage reaches cvVoltage it is held there by a PI
+//               trim of the voltage setpoint (compensating the rectifiers'
+//               calibration and cable drop) until the current falls to
+//               tailCurrent
+//   absorption  cvVoltage is held for absorptionTime more seconds
+//   float       floatVoltage is held until the charger is stopped
+//
+// The current limit stays at ccCurrent after the cc stage. While running,
+// the voltage and current of every unit are polled at least every
+// CHARGER_INPUT_PERIOD; a step only runs on inputs younger than
+// CHARGER_MAX_INPUT_AGE, and after CHARGER_STALE_TIMEOUT without fresh
+// inputs (or with no rectifier left) the charger falls back to floatVoltage
+// at the lowest current limit and stops in the fault stage.
+//
+// Setpoints are only written when they moved by CHARGER_VOLTAGE_DEADBAND /
+// CHARGER_CURRENT_DEADBAND since the last write, or the set of units
+// changed. While the charger runs it owns the online settings: manual
+// writes of them are refused.
+//
+// HTTP:
+//   GET  /charger   state, configuration, inputs and outputs as JSON
+//   POST /charger   action=start|stop, and any of cc_current, cv_voltage,
+//                   tail_current, absorption_time, float_voltage
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+const unsigned long CHARGER_PERIOD = 500;             // ms between two control steps
+const unsigned long CHARGER_INPUT_PERIOD = 250;       // poll period of voltage and current while running
+const unsigned long CHARGER_MAX_INPUT_AGE = 1000;     // ms; older inputs skip the step
+const unsigned long CHARGER_STALE_TIMEOUT = 5000;     // ms without a step before the fault fallback
+const float CHARGER_VOLTAGE_DEADBAND = 0.02f;         // V
+const float CHARGER_CURRENT_DEADBAND = 0.2f;          // A, of the bank
+const float CHARGER_CV_ENTRY_MARGIN = 0.05f;          // V below cvVoltage that ends the cc stage
+const float CHARGER_MAX_VOLTAGE_TRIM = 0.5f;          // V the PI trim may add to or take from the target
+const uint8_t CHARGER_TAIL_STEPS = 4;                 // consecutive steps below tailCurrent that end the cv stage
+
+// PI gains. Current loop: amps of limit per amp of error (and per amp-second);
+// voltage loop: volts of setpoint per volt of error (and per volt-second).
+const float CHARGER_CURRENT_KP = 0.3f;
+const float CHARGER_CURRENT_KI = 0.6f;
+const float CHARGER_VOLTAGE_KP = 0.5f;
+const float CHARGER_VOLTAGE_KI = 0.5f;
+
+enum ChargerStage : uint8_t {
+  CHARGER_OFF,
+  CHARGER_CC,
+  CHARGER_CV,
+  CHARGER_ABSORPTION,
+  CHARGER_FLOAT,
+  CHARGER_FAULT
+};
+
+struct ChargerConfig {
+  float ccCurrent;          // A, bank total
+  float cvVoltage;          // V
+  float tailCurrent;        // A, bank total
+  uint32_t absorptionTime;  // s
+  float floatVoltage;       // V
+};
+
+struct ChargerStatus {
+  ChargerStage stage;
+  unsigned long stageMs;    // time in the current stage
+  float voltage;            // last inputs used by a step
+  float current;
+  float setpointVoltage;    // last outputs computed
+  float currentLimit;       // A per unit
+  uint32_t steps;
+  uint32_t skippedSteps;    // steps skipped on stale inputs
+  uint32_t writes;          // setpoint writes queued
+};
+
+/**
+ * @brief Loads the default configuration (charger off). Call once from setup().
+ */
+void chargerBegin();
+
+/**
+ * @brief Runs a control step when CHARGER_PERIOD has elapsed. Call from loop().
+ */
+void chargerService();
+
+/**
+ * @brief Starts charging from the cc stage.
+ * @return false if there is no rectifier to drive.
+ */
+bool chargerStart();
+
+/**
+ * @brief Stops charging; the online setpoints keep their last values.
+ */
+void chargerStop();
+
+/**
+ * @brief True while the charger owns the online setpoints (any stage but off and fault).
+ */
+bool chargerRunning();
+
+/**
+ * @brief Checks a configuration: voltages within the online voltage range, float not above cv,
+ * tail current below the cc current.
+ */
+bool chargerConfigValid(const ChargerConfig &config);
+
+const ChargerConfig &chargerGetConfig();
+void chargerSetConfig(const ChargerConfig &config);
+ChargerStatus chargerGetStatus();
+const char *chargerStageName(ChargerStage stage);
+
+/**
+ * @brief Answers GET /charger.
+ */
+void chargerHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /charger.
+ */
+void chargerHandleControl(AsyncWebServerRequest *request);
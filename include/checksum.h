@@ -0,0 +1,20 @@
+// Checksums of the records kept in flash (energy journal, config store).
+
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as zlib), bitwise: the records are small and written rarely.
+ */
+inline uint32_t checksumCrc32(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,79 @@
+// Bounded queue of setting writes, filled by the HTTP handlers and drained
+// by loop().
+//
+// The web server callbacks only validate and enqueue; the CAN frames are
+// sent from loop(), at most one every COMMAND_QUEUE_TICK, so SPI access to
+// the MCP2515 never happens from the async web server context.
+//
+// Writes are coalesced per (unit, setting): a write to a setting that is
+// still queued replaces the queued value. After a frame is sent the entry
+// stays in the queue as a cool-down marker, and a newer value for the same
+// setting is held back until the cool-down has passed, so a slider sending
+// 20 updates per second costs a handful of frames carrying the latest value.
+// Permanent settings cool down longer, sparing the rectifier's EEPROM.
+// A write to R48_BROADCAST_ADDRESS goes to every rectifier in one frame.
+
+#pragma once
+
+#include <Arduino.h>
+#include "r48_registers.h"
+
+// Number of (unit, setting) pairs that can be queued or cooling down at once.
+const uint8_t COMMAND_QUEUE_SIZE = 16;
+// Minimum time between two command frames.
+const unsigned long COMMAND_QUEUE_TICK = 20;
+// Minimum time between two writes of the same online / permanent setting of a unit.
+const unsigned long COMMAND_ONLINE_REWRITE_GAP = 100;
+const unsigned long COMMAND_PERMANENT_REWRITE_GAP = 1000;
+// Number of times a frame the CAN driver refused is retried before the write is dropped.
+const uint8_t COMMAND_SEND_RETRIES = 2;
+
+enum CommandQueueResult {
+  COMMAND_QUEUED,
+  COMMAND_COALESCED,   // replaced the value of a write still waiting in the queue
+  COMMAND_INVALID,     // value outside the setting's range
+  COMMAND_QUEUE_FULL
+};
+
+// Sends one frame to the bus, returns false if the CAN driver could not queue it.
+typedef bool (*CommandSendFunction)(unsigned long id, byte data[8]);
+
+struct CommandQueueStats {
+  uint32_t queued;
+  uint32_t coalesced;
+  uint32_t sent;
+  uint32_t dropped;    // refused by the CAN driver COMMAND_SEND_RETRIES + 1 times
+  uint32_t rejected;   // queue full
+};
+
+/**
+ * @brief Sets the function that puts the frames on the bus.
+ */
+void commandQueueBegin(CommandSendFunction send);
+
+/**
+ * @brief Queues a write of a setting to one unit, or to every unit with R48_BROADCAST_ADDRESS.
+ */
+CommandQueueResult commandQueuePush(byte unit, R48SettingId setting, float value);
+
+/**
+ * @brief True if writes of all the settings to the unit would be taken, so a caller can queue them all or none.
+ */
+bool commandQueueHasRoom(byte unit, const R48SettingId *settings, uint8_t count);
+
+/**
+ * @brief Sends the next due write when COMMAND_QUEUE_TICK has elapsed. Call from loop().
+ */
+void commandQueueService();
+
+/**
+ * @brief True while a write of the setting to the unit waits to be sent.
+ */
+bool commandQueueWaiting(byte unit, R48SettingId setting);
+
+/**
+ * @brief Number of writes waiting to be sent (cool-down markers excluded).
+ */
+uint8_t commandQueuePending();
+
+CommandQueueStats commandQueueGetStats();
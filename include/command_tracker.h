@@ -0,0 +1,97 @@
+// Read-back confirmation of permanent commands.
+//
+// A permanent setting is written to the rectifier's EEPROM, which takes a
+// moment. Instead of locking the controller for a fixed time after such a
+// write, the written register is read back on a short backoff schedule
+// (COMMAND_VERIFY_FIRST_DELAY, then doubling) until the rectifier reports
+// the written value. The command is confirmed as soon as it does, and
+// failed when COMMAND_VERIFY_ATTEMPTS read-backs went unanswered or kept
+// returning another value.
+//
+// Only the read-backs belong to the tracker; the measurement polling runs
+// on unaffected while a command is being confirmed.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Maximum number of commands tracked at once (e.g. one setting sent to every unit).
+const uint8_t COMMAND_TRACKER_MAX = 8;
+// Delay before the first read-back; every later one waits twice as long as the previous.
+const unsigned long COMMAND_VERIFY_FIRST_DELAY = 250;
+// Number of read-backs before a command is reported as failed.
+const uint8_t COMMAND_VERIFY_ATTEMPTS = 5;
+// How long the answer to the last read-back is waited for.
+const unsigned long COMMAND_VERIFY_ANSWER_TIMEOUT = 500;
+
+enum CommandState : uint8_t {
+  COMMAND_FREE,             // not tracked
+  COMMAND_PENDING,
+  COMMAND_CONFIRMED,
+  COMMAND_FAILED
+};
+
+enum CommandResult {
+  COMMAND_RESULT_NONE,      // nothing sent yet, or still being confirmed
+  COMMAND_RESULT_CONFIRMED, // every command of the last batch was read back
+  COMMAND_RESULT_FAILED     // at least one command of the last batch was not confirmed
+};
+
+// Sends a read request for a register of one unit, returns false if the frame could not be queued.
+typedef bool (*CommandReadFunction)(byte unit, byte registerNo);
+
+/**
+ * @brief Sets the function used to send the read-backs.
+ */
+void commandTrackerBegin(CommandReadFunction read);
+
+/**
+ * @brief Starts confirming a command that was just sent.
+ * @param unit The rectifier address the command was sent to.
+ * @param registerNo The register written (byte 3 of the frame).
+ * @param value The 4 value bytes of the frame, as sent.
+ * @param isFloat true if the value is a float, compared with a small tolerance;
+ *                otherwise the bytes must match exactly.
+ * @return false if the tracker is full.
+ */
+bool commandTrackerAdd(byte unit, byte registerNo, const byte value[4], bool isFloat);
+
+/**
+ * @brief Sends the read-backs that are due and fails the expired commands. Call from loop().
+ */
+void commandTrackerService();
+
+/**
+ * @brief Matches an answer to a pending read-back.
+ * @return true if the answer was a read-back (it is then consumed by the tracker).
+ */
+bool commandTrackerOnResponse(byte unit, byte registerNo, const byte value[4]);
+
+/**
+ * @brief True while at least one command is waiting for confirmation.
+ */
+bool commandTrackerPending();
+
+/**
+ * @brief Number of commands waiting for confirmation.
+ */
+uint8_t commandTrackerPendingCount();
+
+/**
+ * @brief State of the command last sent to a register of a unit.
+ * @param since Commands sent before this millis() count as COMMAND_FREE.
+ */
+CommandState commandTrackerState(byte unit, byte registerNo, unsigned long since);
+
+/**
+ * @brief Upper bound of the time until every pending command is confirmed or failed, in milliseconds.
+ */
+unsigned long commandTrackerRemaining();
+
+CommandResult commandTrackerResult();
+const char *commandResultName(CommandResult result);
+
+/**
+ * @brief Lists the tracked commands as JSON, for the /commands endpoint.
+ */
+String commandTrackerToJson();
@@ -0,0 +1,138 @@
+// Configuration kept in flash, and the state the controller boots from.
+//
+// One ConfigBlob holds the settings that used to be compile-time constants
+// (WiFi credentials and mode, the poll periods, the safe range of every
+// float setting) together with a cache of the last measurements of every
+// rectifier and the online setpoints being kept alive. At boot it is read
+// in one go, so /data lists the units with their last values before the
+// first CAN round trip, and the online setpoints are written again before
+// the rectifiers let them lapse.
+//
+// The blob is stored in two slots, /config0.bin and /config1.bin. Every
+// write goes to the slot not holding the newest blob, with the next
+// sequence number, and the loader takes the valid slot with the highest
+// sequence: a write cut by a power loss leaves the previous blob in place.
+// A slot is valid if magic, version, size and CRC-32 match; with no valid
+// slot the sketch's defaults apply. A blob of another version is ignored,
+// so a layout change starts from the defaults.
+//
+// Writes happen from loop(): right after a change through /config, when the
+// kept setpoints changed (at most every CONFIG_STORE_SETPOINT_GAP), and
+// every CONFIG_STORE_STATE_INTERVAL while rectifiers are tracked. A write
+// that fails is tried again every CONFIG_STORE_RETRY_DELAY until one makes
+// it to flash; until then the newest blob in flash is the previous one. The safe
+// ranges apply at once, the poll periods through the change callback, and
+// the WiFi settings from the next connection attempt (restart=1 applies
+// them right away). The MCP2515 pins and the bus speed stay compile-time:
+// the CAN driver is built before setup(), and the R48 bus runs at 125 kbit/s.
+//
+// HTTP:
+//   GET  /config   the configuration (passwords only as set or not), where it
+//                  came from, and the write counters
+//   POST /config   any of wifi_mode=station|ap, ssid, password, ap_ssid,
+//                  ap_password, poll_<measurement> (ms, e.g.
+//                  poll_output_current), <setting>_min and <setting>_max
+//                  (e.g. online_voltage_max), reset=1 (back to the
+//                  defaults first), restart=1. 400 with an error per invalid
+//                  field, nothing changed
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "r48_registers.h"
+#include "rectifiers.h"
+#include "setpoint_keepalive.h"
+
+const uint8_t CONFIG_STORE_VERSION = 1;
+const unsigned long CONFIG_STORE_STATE_INTERVAL = 300000;  // ms between two writes of the measurements
+const unsigned long CONFIG_STORE_SETPOINT_GAP = 60000;     // ms between two writes for changed setpoints
+const unsigned long CONFIG_STORE_MIN_POLL_PERIOD = 50;
+const unsigned long CONFIG_STORE_MAX_POLL_PERIOD = 3600000;
+// ms before a failed write is tried again.
+const unsigned long CONFIG_STORE_RETRY_DELAY = 1000;
+// Time left for the answer to go out before restart=1 restarts.
+const unsigned long CONFIG_STORE_RESTART_DELAY = 500;
+
+// Little-endian, floats in IEEE 754 single precision; strings NUL-terminated.
+struct __attribute__((packed)) ConfigValues {
+  uint8_t wifiApMode;                       // 1 = open ap_ssid instead of joining ssid
+  char ssid[33];
+  char password[65];
+  char apSsid[33];
+  char apPassword[65];
+  uint32_t pollPeriods[MEASUREMENT_COUNT];  // ms, by measurement slot
+  float settingMin[SETTING_COUNT];          // safe ranges of the float settings
+  float settingMax[SETTING_COUNT];
+};
+
+struct __attribute__((packed)) ConfigCachedUnit {
+  uint8_t address;
+  uint8_t validMask;
+  float values[MEASUREMENT_COUNT];
+};
+
+struct __attribute__((packed)) ConfigCachedSetpoint {
+  uint8_t unit;
+  uint8_t setting;   // R48SettingId of an online setting
+  float value;
+};
+
+struct __attribute__((packed)) ConfigBlob {
+  char magic[4];     // "R48C"
+  uint8_t version;   // CONFIG_STORE_VERSION
+  uint8_t reserved;
+  uint16_t size;     // sizeof(ConfigBlob)
+  uint32_t sequence; // +1 with every write
+  ConfigValues config;
+  uint8_t unitCount;
+  uint8_t setpointCount;
+  ConfigCachedUnit units[MAX_RECTIFIERS];
+  ConfigCachedSetpoint setpoints[SETPOINT_KEEPALIVE_MAX];
+  uint32_t crc;      // CRC-32 of everything before it
+};
+
+struct ConfigStoreStats {
+  bool fromFlash;    // false while running on the defaults
+  uint8_t slot;      // slot of the newest blob
+  uint32_t sequence; // sequence of the newest blob
+  uint32_t writes;
+  uint32_t writeErrors;
+};
+
+// Called from loop() after the configuration changed through /config.
+typedef void (*ConfigChangeFunction)();
+
+/**
+ * @brief Loads the newest valid blob, or starts from `defaults`, and applies the safe ranges.
+ *
+ * The safe ranges of `defaults` are ignored: the defaults are the ranges of R48_SETTINGS.
+ * Mount LittleFS first.
+ */
+void configStoreBegin(const ConfigValues &defaults, ConfigChangeFunction onChange);
+
+const ConfigValues &configStoreGet();
+
+/**
+ * @brief Puts the cached rectifiers in the table and queues the cached online setpoints.
+ *
+ * Call once the rectifier table and the command queue are set up.
+ */
+void configStoreRestoreState();
+
+/**
+ * @brief Writes the blob when due and runs the change callback. Call from loop().
+ */
+void configStoreService();
+
+ConfigStoreStats configStoreGetStats();
+
+/**
+ * @brief Answers GET /config.
+ */
+void configStoreHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /config.
+ */
+void configStoreHandleControl(AsyncWebServerRequest *request);
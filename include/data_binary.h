@@ -0,0 +1,84 @@
+// Fixed-layout binary telemetry for machine consumers, served by /data.bin.
+//
+// The same values as /data, without the decimal rounding: raw IEEE 754
+// floats, the age of every value in ms and status flags. A frame is encoded
+// straight from the rectifier table on each request, a few hundred bytes
+// with no text formatting.
+//
+// Frame layout, little-endian:
+//
+//   DataBinaryHeader               headerSize bytes
+//   DataBinaryUnit x unitCount     unitSize bytes each
+//
+// A decoder must take headerSize and unitSize from the header and skip any
+// bytes it does not know: later versions only append fields, and bump
+// version when a field changes meaning. tools/r48_data_bin.py is a
+// reference decoder.
+//
+// sequence is the /data version (its ETag), so a poller can tell whether
+// anything changed since its last frame.
+//
+// HTTP:
+//   GET /data.bin                      one frame
+//   GET /data.bin?interval=ms&count=n  a chunked stream of frames, one every
+//                                      interval ms (at least
+//                                      DATA_BINARY_MIN_INTERVAL), n frames or
+//                                      until the client disconnects (count=0).
+//                                      400 unless both are whole numbers.
+//                                      On the ESP8266 the web server retries a
+//                                      waiting stream on its poll tick, about
+//                                      every 500 ms, hence the minimum.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "rectifiers.h"
+
+const uint8_t DATA_BINARY_VERSION = 1;
+const unsigned long DATA_BINARY_MIN_INTERVAL = 500;  // ms between streamed frames
+// Streams served at the same time; more get a 503.
+const uint8_t DATA_BINARY_MAX_STREAMS = 2;
+// Age of a value that was never received.
+const uint32_t DATA_BINARY_NO_AGE = 0xFFFFFFFF;
+
+// Status flags.
+const uint16_t DATA_BINARY_COMMAND_PENDING = 0x0001;  // setting writes are being confirmed
+const uint16_t DATA_BINARY_COMMAND_FAILED = 0x0002;   // the last batch of writes was not confirmed
+const uint16_t DATA_BINARY_CHARGER_RUNNING = 0x0004;  // the charger owns the online setpoints
+
+struct __attribute__((packed)) DataBinaryHeader {
+  char magic[4];            // "R48T"
+  uint8_t version;          // DATA_BINARY_VERSION
+  uint8_t headerSize;       // sizeof(DataBinaryHeader)
+  uint8_t unitSize;         // sizeof(DataBinaryUnit)
+  uint8_t unitCount;
+  uint32_t sequence;        // /data version
+  uint32_t uptimeMs;        // millis() when the frame was encoded
+  uint16_t flags;           // DATA_BINARY_*
+  uint16_t remainingSeconds;// until the pending writes are confirmed or given up
+  float bank[MEASUREMENT_COUNT];  // bank totals in MeasurementType order: voltages and limit averaged, current summed, hottest temperature
+};
+
+struct __attribute__((packed)) DataBinaryUnit {
+  uint8_t address;
+  uint8_t validMask;        // bit n set once values[n] was received
+  uint8_t reserved[2];
+  float values[MEASUREMENT_COUNT];   // in MeasurementType order
+  uint32_t ageMs[MEASUREMENT_COUNT]; // DATA_BINARY_NO_AGE if never received or cached
+  uint8_t cachedMask;       // bit n set while values[n] is the one restored at boot, not answered since
+};
+
+static_assert(sizeof(DataBinaryHeader) == 40, "DataBinaryHeader layout is published");
+static_assert(sizeof(DataBinaryUnit) == 45, "DataBinaryUnit layout is published");
+
+/**
+ * @brief Encodes one frame of the current values.
+ * @return Its length, or 0 if it does not fit in `size` bytes.
+ */
+size_t dataBinaryEncode(uint8_t *out, size_t size);
+
+/**
+ * @brief Answers GET /data.bin, one frame or a stream.
+ */
+void dataBinaryHandleRequest(AsyncWebServerRequest *request);
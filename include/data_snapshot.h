@@ -0,0 +1,64 @@
+// Shared, versioned telemetry snapshot served by /data.
+//
+// The /data document is serialized into a static buffer whenever a value,
+// the set of rectifiers or the command status changes, instead of being
+// rebuilt with String concatenation on every request. Each rebuild gets a
+// new version number, which is also the ETag of /data, so a client that
+// already has the current version gets a 304 without a body.
+//
+// There are two buffers. A rebuild writes the one that is not being
+// served and then publishes it. Responses still streaming a buffer pin
+// it, and a rebuild is deferred until the buffer it would overwrite is
+// no longer pinned, so a slow client never sees a half-rewritten body.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Size of each snapshot buffer; fits MAX_RECTIFIERS units with all their values and ages.
+const size_t DATA_SNAPSHOT_SIZE = 3072;
+// The snapshot is rebuilt at least this often while units are tracked, so the reported ages stay roughly current.
+const unsigned long DATA_SNAPSHOT_REFRESH = 5000;
+
+/**
+ * @brief Builds the first snapshot. Call once from setup().
+ */
+void dataSnapshotBegin();
+
+/**
+ * @brief Marks the snapshot as out of date, e.g. after a value changed or a rectifier joined or left.
+ */
+void dataSnapshotMarkChanged();
+
+/**
+ * @brief Publishes the command status; the snapshot is rebuilt when it changes.
+ * @param commandResult Outcome of the last batch of commands (see commandResultName()).
+ */
+void dataSnapshotSetStatus(bool commandPending, unsigned long remainingSeconds, const char *commandResult);
+
+/**
+ * @brief Rebuilds the snapshot when it is out of date. Call from loop().
+ */
+void dataSnapshotService();
+
+/**
+ * @brief True when no change is waiting to be serialized.
+ */
+bool dataSnapshotIsCurrent();
+
+/**
+ * @brief The published snapshot as a NUL-terminated JSON document.
+ */
+const char *dataSnapshotJson();
+
+uint32_t dataSnapshotVersion();
+
+/**
+ * @brief Answers a /data request from the published snapshot.
+ *
+ * Sends 304 when If-None-Match carries the current ETag. Both 200 and 304
+ * responses report the free heap and the largest free block in the
+ * X-Heap-Free and X-Heap-Max-Block headers.
+ */
+void dataSnapshotHandleRequest(AsyncWebServerRequest *request);
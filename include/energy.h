@@ -0,0 +1,133 @@
+// Energy (Wh) and charge (Ah) metering per rectifier, persisted to flash.
+//
+// Every fresh output voltage or current answer of a rectifier adds the
+// trapezoid between it and the previous sample of that unit, using the
+// frames' receive timestamps: (P0 + P1) / 2 * (t1 - t0) with P = V * I from
+// the unit's latest voltage and current. Gaps longer than ENERGY_GAP_PERIODS
+// sample periods, and at least ENERGY_MAX_GAP, (a unit that went silent) are
+// not bridged. The sample period follows the voltage and current poll
+// periods set through /config (energySetSamplePeriod()).
+//
+// Each unit has lifetime totals and today's totals; finished days go to a
+// ring of ENERGY_DAYS days. Days are UTC days of the wall clock passed to
+// energyBegin(). While the clock is not set yet, the energy is added to the
+// day it turns out to be once it is.
+//
+// Persistence, in LittleFS:
+//
+//   /energy0.jnl, /energy1.jnl  journal of EnergyCheckpoint records,
+//                               appended every ENERGY_CHECKPOINT_INTERVAL
+//                               while something changed
+//   /energy_days.bin            the finished days, rewritten once a day
+//
+// Records are only ever appended. When a journal file holds
+// ENERGY_JOURNAL_RECORDS, the next record starts the other file over, so
+// the writes move through fresh blocks instead of rewriting one in place.
+// At boot the valid record (CRC) with the highest sequence number wins;
+// a power cut loses at most one interval.
+//
+// HTTP:
+//   GET /energy   lifetime, today's and the finished days' totals as JSON
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "rectifiers.h"
+
+const unsigned long ENERGY_CHECKPOINT_INTERVAL = 60000;  // ms
+const unsigned long ENERGY_MAX_GAP = 5000;               // ms between two samples that are always integrated
+const uint8_t ENERGY_GAP_PERIODS = 5;                    // sample periods a gap may span and still be integrated
+const uint8_t ENERGY_JOURNAL_RECORDS = 16;               // records per journal file, about one flash block
+const uint8_t ENERGY_DAYS = 14;
+
+// Wall clock in seconds since 1970 (UTC), or 0 while it is not set.
+typedef uint32_t (*EnergyClockFunction)();
+
+// A slot is free until `used`: 0x00 is a valid address, the rectifiers' default.
+struct EnergyUnit {
+  bool used;
+  byte address;
+  double wh;         // lifetime
+  double ah;
+  float todayWh;
+  float todayAh;
+};
+
+struct __attribute__((packed)) EnergyDayUnit {
+  byte address;
+  uint8_t used;      // 0 for a free slot
+  float wh;
+  float ah;
+};
+
+struct __attribute__((packed)) EnergyDay {
+  uint32_t day;      // days since 1970-01-01, 0 for an empty slot
+  EnergyDayUnit units[MAX_RECTIFIERS];
+};
+
+// One journal record, little-endian.
+struct __attribute__((packed)) EnergyCheckpoint {
+  char magic[4];     // "R48J"
+  uint32_t sequence;
+  uint32_t day;      // the day todayWh/todayAh belong to, 0 if the clock was not set
+  struct __attribute__((packed)) {
+    byte address;
+    uint8_t used;    // 0 for a free slot
+    double wh;
+    double ah;
+    float todayWh;
+    float todayAh;
+  } units[MAX_RECTIFIERS];
+  uint32_t crc;      // CRC-32 of everything before it
+};
+
+struct EnergyStats {
+  uint32_t samples;      // samples integrated
+  uint32_t gaps;         // samples after a gap, which start over
+  uint32_t checkpoints;  // journal records written
+  uint32_t writeErrors;
+  uint32_t sequence;     // of the newest record
+};
+
+/**
+ * @brief Restores the counters from the journal. Call once from setup() after LittleFS.begin().
+ */
+void energyBegin(EnergyClockFunction clock);
+
+/**
+ * @brief Sets how often a unit is expected to deliver a sample; longer gaps than ENERGY_GAP_PERIODS of it are not
+ * integrated. Call when the voltage or current poll period changes.
+ */
+void energySetSamplePeriod(unsigned long periodMs);
+
+/**
+ * @brief Integrates a unit's latest voltage and current, taken at `timestamp` (millis()).
+ * Call when a fresh output voltage or current was stored.
+ */
+void energyOnSample(byte address, unsigned long timestamp);
+
+/**
+ * @brief Rolls the day over and writes a checkpoint when due. Call from loop().
+ */
+void energyService();
+
+/**
+ * @brief Writes a checkpoint now if anything changed since the last one.
+ */
+void energyCheckpoint();
+
+/**
+ * @brief The unit's counters, or nullptr if it never delivered a sample.
+ */
+const EnergyUnit *energyFind(byte address);
+const EnergyUnit &energyUnitAt(uint8_t index);  // not `used` for a free slot
+
+const EnergyDay &energyDayAt(uint8_t index);  // 0 is the most recent finished day
+uint32_t energyToday();
+EnergyStats energyGetStats();
+
+/**
+ * @brief Answers GET /energy.
+ */
+void energyHandleRequest(AsyncWebServerRequest *request);
@@ -0,0 +1,64 @@
+// Fixed-memory history of the bank measurements.
+//
+// Two rings hold the bank totals (see rectifiersBankTotals()):
+//
+//   fine    one sample every HISTORY_SAMPLE_INTERVAL for the last hour
+//   coarse  min/max/avg of every HISTORY_BUCKET_INTERVAL for the last day,
+//           accumulated from the fine samples as they are taken
+//
+// Values are stored as 16-bit fixed point with a per-measurement scale
+// (HISTORY_MISSING when no rectifier was tracked). Timestamps are not
+// stored: each ring keeps the time of its newest entry and entries are
+// evenly spaced.
+//
+// GET /history streams one ring in chunks, oldest entry first:
+//
+//   res=fine|coarse   which ring (default coarse)
+//   format=csv|bin    CSV with a header row (default), or the binary layout
+//                     below, little-endian
+//
+// Binary layout: a HistoryHeader, followed by `records` records of
+// `channels * valuesPerRecord` int16 values (coarse: min, max, avg of each
+// channel). Multiply by the channel scale to get volts, amps, etc.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "r48_protocol.h"
+
+const unsigned long HISTORY_SAMPLE_INTERVAL = 10000;    // 10 s
+const uint16_t HISTORY_FINE_SAMPLES = 360;              // 1 h
+const unsigned long HISTORY_BUCKET_INTERVAL = 600000;   // 10 min
+const uint16_t HISTORY_BUCKETS = 144;                   // 24 h
+const uint8_t HISTORY_CHANNELS = MEASUREMENT_COUNT;
+// Stored value meaning "no data".
+const int16_t HISTORY_MISSING = INT16_MIN;
+
+// Header of the binary /history format.
+struct __attribute__((packed)) HistoryHeader {
+  char magic[4];            // "R48H"
+  uint8_t version;          // 1
+  uint8_t resolution;       // 0 = fine, 1 = coarse
+  uint8_t channels;         // HISTORY_CHANNELS, in MeasurementType order
+  uint8_t valuesPerRecord;  // 1 (fine) or 3 (coarse: min, max, avg)
+  uint32_t intervalMs;      // time between records
+  uint32_t records;
+  uint32_t newestAgeMs;     // age of the last record when the request started
+  float scales[HISTORY_CHANNELS];
+};
+
+/**
+ * @brief Clears both rings. Call once from setup().
+ */
+void historyBegin();
+
+/**
+ * @brief Takes a sample when HISTORY_SAMPLE_INTERVAL has elapsed. Call from loop().
+ */
+void historyService();
+
+/**
+ * @brief Answers a /history request with a chunked response.
+ */
+void historyHandleRequest(AsyncWebServerRequest *request);
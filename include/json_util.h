@@ -0,0 +1,21 @@
+// JSON pieces shared by the HTTP handlers that build their answers by hand.
+
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Appends text as a JSON string, quoted, with quotes, backslashes and control characters escaped.
+ */
+void jsonAppendString(String &json, const char *text);
+
+/**
+ * @brief Adds a "field":"message" member to the errors of a form that failed validation.
+ * @param errors The members so far, empty while every field is valid.
+ */
+void jsonAppendError(String &errors, const String &field, const String &message);
+
+/**
+ * @brief The body a form endpoint answers 400 with: {"errors":{"field":"message",...}}.
+ */
+String jsonErrorBody(const String &errors);
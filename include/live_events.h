@@ -0,0 +1,57 @@
+// Push-based live data over Server-Sent Events.
+//
+// Browsers subscribe to /events instead of polling /data. A new subscriber
+// receives one "snapshot" event with the published /data document. After that,
+// "delta" events carry only the values that changed, in the same shape
+// (top-level bank values plus a partial "units" array), so the page can
+// merge them into its copy of the snapshot.
+//
+// Changes are coalesced: at most one delta is sent per LIVE_PUSH_INTERVAL.
+// The backlog is judged per subscriber: a client with more than
+// LIVE_PUSH_MAX_BACKLOG unsent events is skipped instead of queueing more,
+// and since it missed a delta it gets a full snapshot once its backlog has
+// drained. The other clients keep getting every delta.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Minimum time between two delta events.
+const unsigned long LIVE_PUSH_INTERVAL = 250;
+// Events are held back from a subscriber with more than this many queued.
+const size_t LIVE_PUSH_MAX_BACKLOG = 4;
+// Subscribers served at once; a further one is closed right after it connects.
+const uint8_t LIVE_MAX_CLIENTS = 8;
+
+/**
+ * @brief Registers the /events endpoint on the web server.
+ */
+void liveEventsBegin(AsyncWebServer &server);
+
+/**
+ * @brief Marks a measurement of a rectifier as changed.
+ * @param address The rectifier address.
+ * @param slot The measurement slot (see measurementSlot()).
+ */
+void liveEventsMarkValue(byte address, uint8_t slot);
+
+/**
+ * @brief Forces a full snapshot to every subscriber, e.g. after a rectifier joined or left.
+ */
+void liveEventsMarkTopology();
+
+/**
+ * @brief Publishes the command status; it is pushed when it changes.
+ */
+void liveEventsSetStatus(bool commandPending, unsigned long remainingSeconds, const char *commandResult);
+
+/**
+ * @brief Sends the pending changes when the push interval has elapsed. Call from loop().
+ */
+void liveEventsService();
+
+/**
+ * @brief Number of connected subscribers.
+ */
+size_t liveEventsClients();
@@ -0,0 +1,124 @@
+// Buffered binary logging.
+//
+// Hot paths (CAN receive/transmit, web handlers) never format text. They push
+// a fixed-size binary record (event id, timestamp, up to three 32-bit
+// arguments or a raw CAN frame) into a RAM ring, which costs about one
+// memcpy. logService() formats the records later from loop(), and only while
+// the UART FIFO has room, so logging never blocks the loop. When the ring is
+// full new records are dropped and counted.
+//
+// Filtering happens before anything is copied: a record is only queued when
+// its level is enabled and its subsystem bit is set in the runtime mask.
+
+#pragma once
+
+#include <Arduino.h>
+
+enum LogLevel : uint8_t {
+  LOG_ERROR = 0,
+  LOG_WARN = 1,
+  LOG_INFO = 2,
+  LOG_DEBUG = 3
+};
+
+// Subsystems, used as bit positions in the enable mask.
+enum LogSubsystem : uint8_t {
+  LOG_SYS = 0,
+  LOG_CAN_RX = 1,
+  LOG_CAN_TX = 2,
+  LOG_WEB = 3
+};
+
+const uint32_t LOG_ALL_SUBSYSTEMS = 0xFFFFFFFF;
+
+// Every message the firmware can log. The text lives in the event table in
+// log.cpp; records only carry the id and the raw arguments.
+enum LogEventId : uint8_t {
+  EV_CAN_RX_FRAME,
+  EV_CAN_RX_VALUE,
+  EV_CAN_RX_UNKNOWN,
+  EV_CAN_TX_FRAME,
+  EV_CAN_TX_COMMAND,
+  EV_CAN_TX_COMMAND_STATE,
+  EV_CAN_TX_READ,
+  EV_CAN_TX_ERROR,
+  EV_SYS_COMMAND_CONFIRMED,
+  EV_SYS_COMMAND_FAILED,
+  EV_SYS_LOG_CONFIG,
+  EV_SYS_RECTIFIER_CHANGE,
+  EV_SYS_CAPTURE_ERROR,
+  EV_SYS_UDP_WATCHDOG,
+  EV_SYS_ENERGY_ERROR,
+  EV_SYS_WIFI_CONNECTED,
+  EV_SYS_WIFI_RETRY,
+  EV_SYS_WIFI_LOST,
+  EV_SYS_WIFI_ACCESS_POINT,
+  EV_SYS_CONFIG_LOADED,
+  EV_SYS_CONFIG_ERROR,
+  EV_SYS_REGISTER_SWEEP,
+  EV_SYS_POLL_FULL,
+  EV_SYS_ROUTES_FULL,
+  LOG_EVENT_COUNT
+};
+
+struct LogStats {
+  uint32_t written;  // records queued
+  uint32_t dropped;  // records lost because the ring was full
+  uint8_t pending;   // records waiting to be formatted
+};
+
+// A log argument: wide enough for a 32-bit value or a pointer.
+typedef uintptr_t LogArg;
+
+extern uint8_t logLevel;
+extern uint32_t logMask;
+
+/**
+ * @brief Returns true when records of this level and subsystem are kept.
+ */
+inline bool logEnabled(LogLevel level, LogSubsystem subsystem) {
+  return level <= logLevel && (logMask & (1UL << subsystem));
+}
+
+/**
+ * @brief Reinterprets a float so it can be passed as a log argument.
+ */
+inline LogArg logFloat(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/**
+ * @brief Passes a string literal as a log argument. Only the pointer is
+ * stored, so the string must outlive the record (use literals only).
+ */
+inline LogArg logString(const char *value) {
+  return (LogArg)value;
+}
+
+/**
+ * @brief Queues an event with up to three arguments.
+ */
+void logEvent(LogLevel level, LogEventId event, LogArg a = 0, LogArg b = 0, LogArg c = 0);
+
+/**
+ * @brief Queues a raw CAN frame (ID plus DLC-sized payload).
+ */
+void logFrame(LogLevel level, LogEventId event, unsigned long id, uint8_t len, const uint8_t *data);
+
+/**
+ * @brief Formats queued records to Serial while the UART FIFO has room.
+ */
+void logService();
+
+void logSetLevel(uint8_t level);
+void logSetMask(uint32_t mask);
+LogStats logGetStats();
+
+/**
+ * @brief Parses "error", "warn", "info" or "debug".
+ * @return false for an unknown name.
+ */
+bool logParseLevel(const String &name, uint8_t &level);
+const char *logLevelName(uint8_t level);
@@ -0,0 +1,70 @@
+// Counters and latency histograms exported at /metrics in the Prometheus
+// text exposition format.
+//
+// Every metric lives in a fixed-size static table and is updated with a
+// plain integer increment (histograms: a short scan over their bucket
+// bounds), so the hooks can stay enabled in production. Nothing is
+// allocated until /metrics itself is requested.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Maximum number of distinct (route, method) pairs counted separately. setup()
+// registers about 42; a route registered past the limit is counted as "other"
+// and logged at boot.
+const uint8_t METRICS_MAX_ROUTES = 64;
+
+enum MetricCounter {
+  METRIC_CAN_RX_FRAMES,   // every frame taken from the receive ring
+  METRIC_CAN_RX_PARSED,   // R48 responses stored as a measurement
+  METRIC_CAN_RX_UNKNOWN,  // R48 responses for a register that is not a measurement
+  METRIC_CAN_TX_FRAMES,   // frames handed to the CAN driver
+  METRIC_COUNTER_COUNT
+};
+
+// Startup milestones, exported as seconds since power-on.
+enum BootMilestone {
+  BOOT_FIRST_MEASUREMENT,  // first measurement stored from a rectifier
+  BOOT_NETWORK,            // station connected, or the configured access point started
+  BOOT_MILESTONE_COUNT
+};
+
+/**
+ * @brief Registers /metrics and counts requests that match no route. Call after the other routes.
+ */
+void metricsBegin(AsyncWebServer &server);
+
+/**
+ * @brief Registers a route like server.on(), counting its requests by route and method.
+ */
+void metricsRoute(AsyncWebServer &server, const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction handler);
+
+void metricsIncrement(MetricCounter counter);
+
+/**
+ * @brief Counts a frame that sendMsgBuf refused, by the command it carried.
+ * @param data The 8 data bytes of the frame (opcode in byte 0, register in byte 3).
+ */
+void metricsCountSendFailure(const byte *data);
+
+/**
+ * @brief Records the time between a read request and its answer.
+ */
+void metricsObservePollLatency(byte measurementNo, unsigned long milliseconds);
+
+/**
+ * @brief Records the duration of one loop() iteration.
+ */
+void metricsObserveLoop(unsigned long microseconds);
+
+/**
+ * @brief Records millis() for a milestone the first time it is reached.
+ */
+void metricsMarkBoot(BootMilestone milestone);
+
+/**
+ * @brief Milliseconds after power-on a milestone was reached, or -1 while it was not.
+ */
+long metricsBootTime(BootMilestone milestone);
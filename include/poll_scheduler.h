@@ -0,0 +1,110 @@
+// Pipelined measurement scheduler.
+//
+// Every polled (unit, register) pair has its own refresh period and priority.
+// On each service call the scheduler picks the most urgent due register and
+// sends a read request, keeping at most POLL_MAX_IN_FLIGHT requests
+// outstanding across all units, so several rectifiers are polled concurrently.
+// Responses are matched back to their request by unit address and register
+// number; a request that is not answered within POLL_RESPONSE_TIMEOUT is
+// retried a bounded number of times, ahead of new requests but under the
+// same gap and in-flight limits. The time of the last answer is kept so
+// callers can tell how old each value is. A consumer that needs fresher
+// values than the normal schedule (the charge controller) can cap the period
+// of a register on every unit while it runs.
+
+#pragma once
+
+#include <Arduino.h>
+#include "rectifiers.h"
+
+// Registers a unit can have polled on top of its measurements (see register_cache.h).
+const uint8_t POLL_MAX_EXTRA_REGISTERS = 8;
+// Maximum number of (unit, register) pairs the scheduler can track: every register of a full bank.
+const uint8_t POLL_MAX_ENTRIES = MAX_RECTIFIERS * (MEASUREMENT_COUNT + POLL_MAX_EXTRA_REGISTERS);
+// Maximum number of read requests waiting for an answer at the same time.
+const uint8_t POLL_MAX_IN_FLIGHT = 4;
+// Time after which an unanswered request is considered lost.
+const unsigned long POLL_RESPONSE_TIMEOUT = 250;
+// Number of times a lost request is re-sent before waiting for the next period.
+const uint8_t POLL_MAX_RETRIES = 2;
+// Minimum gap between two read requests, so bursts do not flood the bus.
+const unsigned long POLL_MIN_REQUEST_GAP = 5;
+
+// Number of registers whose period can be capped at the same time.
+const uint8_t POLL_MAX_PERIOD_CAPS = 4;
+
+// Age reported for a register that was never answered.
+const unsigned long POLL_AGE_NEVER = 0xFFFFFFFF;
+
+// Sends a read request for a register of one unit, returns false if the frame could not be queued.
+typedef bool (*PollSendFunction)(byte unit, byte registerNo);
+
+struct PollStats {
+  uint32_t requests;   // read requests sent, including retries
+  uint32_t responses;  // answers matched to an outstanding request
+  uint32_t unsolicited;// answers for a register nobody was waiting on
+  uint32_t retries;    // requests re-sent after a timeout
+  uint32_t timeouts;   // requests given up after the last retry
+  uint32_t rejected;   // registers not added because the schedule was full
+  uint8_t inFlight;    // requests currently outstanding
+};
+
+/**
+ * @brief Sets the function used to put read requests on the bus.
+ */
+void pollSchedulerBegin(PollSendFunction send);
+
+/**
+ * @brief Adds a register of one unit to the schedule.
+ * @param unit The rectifier address.
+ * @param registerNo The register (measurement number) to read.
+ * @param periodMs How often the value should be refreshed.
+ * @param priority 0 is the most urgent; breaks ties between due registers.
+ * @return false when the schedule is full (logged) or already holds the register.
+ */
+bool pollSchedulerAdd(byte unit, byte registerNo, unsigned long periodMs, uint8_t priority);
+
+/**
+ * @brief Removes every register of a unit, including outstanding requests.
+ */
+void pollSchedulerRemoveUnit(byte unit);
+
+/**
+ * @brief Removes one register of a unit, including an outstanding request.
+ */
+void pollSchedulerRemove(byte unit, byte registerNo);
+
+/**
+ * @brief Expires lost requests and sends the next due ones. Call from loop().
+ */
+void pollSchedulerService();
+
+/**
+ * @brief Records an answer from a unit for a register.
+ * @return true if the answer matched an outstanding request.
+ */
+bool pollSchedulerOnResponse(byte unit, byte registerNo);
+
+/**
+ * @brief Caps the refresh period of a register on every unit, present and future.
+ * @param maxPeriodMs The longest period allowed, or 0 to remove the cap.
+ * @return false when POLL_MAX_PERIOD_CAPS other registers are already capped.
+ */
+bool pollSchedulerCapPeriod(byte registerNo, unsigned long maxPeriodMs);
+
+/**
+ * @brief Stops sending new requests (answers are still matched) while paused.
+ */
+void pollSchedulerSetPaused(bool paused);
+
+/**
+ * @brief Milliseconds since the register was last answered, or POLL_AGE_NEVER.
+ */
+unsigned long pollSchedulerAge(byte unit, byte registerNo);
+
+PollStats pollSchedulerGetStats();
+
+/**
+ * @brief Writes the schedule (unit, period, priority, age, state) as a JSON object.
+ */
+String pollSchedulerToJson();
@@ -0,0 +1,108 @@
+// Cycle-counter profiler of the loop, the CAN driver calls and the HTTP
+// route handlers.
+//
+// Only compiled in when R48_PROFILE is defined ([env:d1_mini_profile] and
+// the host builds); without it PROFILE_SCOPE() expands to nothing and
+// /profile does not exist.
+//
+// PROFILE_SCOPE(probe) measures the rest of the enclosing block with
+// ESP.getCycleCount() (a register read, about a dozen cycles per probe).
+// Each probe keeps its count, min, max and total cycles and a histogram of
+// 64 buckets, two per power of two; a percentile is reported as the upper
+// bound of its bucket, at most 50% above the true value. The bucket counts
+// are 16-bit and are all halved when one would overflow, which keeps their
+// proportions.
+//
+// A probe also counts how often it ran outside loop(): on the ESP8266 that
+// is from a web server or WiFi callback, the case that competes with loop()
+// for the SPI bus.
+//
+// HTTP:
+//   GET /profile   per-probe count, outside-loop count, min, mean, p99 and max
+//                  in microseconds as JSON since the previous request, then
+//                  resets every probe
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+typedef uint8_t ProfileProbe;
+
+// Fixed probes; the route handlers get theirs from profileAddProbe().
+enum : ProfileProbe {
+  PROFILE_LOOP,
+  PROFILE_CAN_RX,       // processIncomingCanMessages()
+  PROFILE_CAN_SEND,     // one frame handed to the CAN controller (sendMsgBuf)
+  PROFILE_CAN_READ,     // one frame read from the CAN controller (readMsgBuf)
+  PROFILE_FIXED_PROBES
+};
+
+// Fixed probes, one per route counted by metricsRoute() (METRICS_MAX_ROUTES), and the overflow probe.
+const uint8_t PROFILE_MAX_PROBES = PROFILE_FIXED_PROBES + 64 + 1;
+const uint8_t PROFILE_BUCKETS = 64;
+
+#ifdef R48_PROFILE
+
+struct ProfileStats {
+  uint32_t count;
+  uint32_t outsideLoop;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint16_t buckets[PROFILE_BUCKETS];
+};
+
+/**
+ * @brief Adds a probe for a route handler.
+ * @return Its id, or a shared overflow probe once PROFILE_MAX_PROBES are in use.
+ */
+ProfileProbe profileAddProbe(const char *uri, const char *method);
+
+/**
+ * @brief Records one measurement of a probe.
+ */
+void profileRecord(ProfileProbe probe, uint32_t cycles);
+
+/**
+ * @brief Upper bound in cycles of the bucket holding `fraction` (0..1) of a probe's measurements.
+ */
+uint32_t profilePercentile(const ProfileStats &stats, float fraction);
+
+const ProfileStats &profileGetStats(ProfileProbe probe);
+void profileReset();
+
+/**
+ * @brief Answers GET /profile and resets the probes.
+ */
+void profileHandleRequest(AsyncWebServerRequest *request);
+
+// True while loop() runs, set by the PROFILE_LOOP probe.
+extern bool profileInLoop;
+
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfileProbe probe) : probe(probe), start(ESP.getCycleCount()) {
+    if (probe == PROFILE_LOOP) {
+      profileInLoop = true;
+    }
+  }
+  ~ProfileScope() {
+    profileRecord(probe, ESP.getCycleCount() - start);
+    if (probe == PROFILE_LOOP) {
+      profileInLoop = false;
+    }
+  }
+
+private:
+  ProfileProbe probe;
+  uint32_t start;
+};
+
+#define PROFILE_SCOPE(probe) ProfileScope profileScope(probe)
+
+#else
+
+#define PROFILE_SCOPE(probe) (void)(probe)
+
+#endif
@@ -0,0 +1,127 @@
+// Vertiv/Emerson R48 CAN protocol definitions shared by the controller modules.
+//
+// The R48 uses 29-bit extended IDs laid out as:
+//
+//   bits 28..20  protocol number (0x060)
+//   bit  19      point-to-point flag (0 = broadcast)
+//   bits 18..11  destination address
+//   bits 10..3   source address
+//   bits  2..0   frame counter / reserved (0b011)
+//
+// The controller talks as address 0xF0; each rectifier answers with its own
+// address in the source field.
+
+#pragma once
+
+#include <Arduino.h>
+
+// --- CAN Bus Definitions ---
+// These are the CAN IDs based on the working example you provided.
+const long VERTIV_COMMAND_ID = 0x06080783;      // point-to-point, to rectifier address 0x00
+const long VERTIV_READ_REQUEST_ID = 0x06000783; // broadcast read request
+const long VERTIV_RESPONSE_ID = 0x860F8003; // Updated CAN ID based on your logs (bit 31 is the mcp_can extended flag)
+const unsigned long CAN_BUS_SPEED = 125000; // 125 Kbps
+
+const uint16_t R48_PROTOCOL_NO = 0x060;
+const byte R48_CONTROLLER_ADDRESS = 0xF0;
+// Pseudo address used by the controller to mean "every rectifier" (sent as VERTIV_READ_REQUEST_ID).
+const byte R48_BROADCAST_ADDRESS = 0xFF;
+const byte R48_ID_TAIL = 0x03;
+
+// Bits of a response ID that differ between rectifiers (the source address).
+const unsigned long R48_SOURCE_ADDRESS_BITS = 0xFFUL << 3;
+
+// Enum for measurement numbers
+enum MeasurementType {
+  OUTPUT_VOLTAGE = 0x01,
+  OUTPUT_CURRENT = 0x02,
+  OUTPUT_CURRENT_LIMIT = 0x03,
+  TEMPERATURE = 0x04,
+  SUPPLY_VOLTAGE = 0x05,
+  // Define command types for confirmation
+  SET_PERMANENT_VOLTAGE_CMD = 0x24,
+  SET_PERMANENT_CURRENT_LIMIT_CMD = 0x19,
+  SET_PERMANENT_MAX_INPUT_CURRENT_CMD = 0x1A
+};
+
+// Number of measurements kept per rectifier (OUTPUT_VOLTAGE .. SUPPLY_VOLTAGE).
+const uint8_t MEASUREMENT_COUNT = 5;
+
+// A decoded R48 CAN ID.
+struct R48Id {
+  bool pointToPoint;
+  byte destination;
+  byte source;
+};
+
+/**
+ * @brief Builds a 29-bit R48 CAN ID (without the mcp_can extended flag).
+ */
+inline unsigned long r48MakeId(bool pointToPoint, byte destination, byte source) {
+  return ((unsigned long)R48_PROTOCOL_NO << 20) | ((unsigned long)(pointToPoint ? 1 : 0) << 19) |
+         ((unsigned long)destination << 11) | ((unsigned long)source << 3) | R48_ID_TAIL;
+}
+
+/**
+ * @brief Splits an R48 CAN ID into its fields.
+ * @param id The ID, with or without the mcp_can extended flag in bit 31.
+ * @return false if the ID does not carry the R48 protocol number.
+ */
+inline bool r48DecodeId(unsigned long id, R48Id &out) {
+  id &= 0x1FFFFFFF;
+  if ((id >> 20) != R48_PROTOCOL_NO) {
+    return false;
+  }
+  out.pointToPoint = (id >> 19) & 0x01;
+  out.destination = (id >> 11) & 0xFF;
+  out.source = (id >> 3) & 0xFF;
+  return true;
+}
+
+/**
+ * @brief ID of the frames a rectifier sends back to this controller.
+ */
+inline unsigned long r48ResponseId(byte rectifierAddress) {
+  return r48MakeId(true, R48_CONTROLLER_ADDRESS, rectifierAddress);
+}
+
+/**
+ * @brief ID used to send a command or read request to a single rectifier.
+ */
+inline unsigned long r48RequestId(byte rectifierAddress) {
+  return r48MakeId(true, rectifierAddress, R48_CONTROLLER_ADDRESS);
+}
+
+/**
+ * @brief Index of a measurement in the per-rectifier value arrays, or -1.
+ */
+inline int8_t measurementSlot(byte measurementNo) {
+  if (measurementNo >= OUTPUT_VOLTAGE && measurementNo <= SUPPLY_VOLTAGE) {
+    return measurementNo - OUTPUT_VOLTAGE;
+  }
+  return -1;
+}
+
+/**
+ * @brief Writes a float as the 4 big-endian value bytes of a frame.
+ */
+inline void r48PutFloat(byte *out, float value) {
+  union { float f; byte b[4]; } converter;
+  converter.f = value;
+  out[0] = converter.b[3];
+  out[1] = converter.b[2];
+  out[2] = converter.b[1];
+  out[3] = converter.b[0];
+}
+
+/**
+ * @brief Reads a float from the 4 big-endian value bytes of a frame.
+ */
+inline float r48GetFloat(const byte *in) {
+  union { float f; byte b[4]; } converter;
+  converter.b[3] = in[0];
+  converter.b[2] = in[1];
+  converter.b[1] = in[2];
+  converter.b[0] = in[3];
+  return converter.f;
+}
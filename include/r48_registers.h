@@ -0,0 +1,90 @@
+// Descriptor table of the R48 settings the controller can write.
+//
+// Every writable register is described once: its number, how its value is
+// encoded, the accepted range, and whether the rectifier stores it in
+// EEPROM (permanent) or only applies it until the next power cycle or
+// timeout (online). The HTTP routes, the command queue, the read-back
+// confirmation and the metrics labels are all driven by this table.
+//
+// Write frame: [0x03, 0xF0, 0x00, register, value (4 bytes)]
+//   float settings: IEEE 754 single precision, big-endian
+//   state settings: 0x00 or 0x01 in the first value byte, zeros after
+
+#pragma once
+
+#include <Arduino.h>
+#include "r48_protocol.h"
+
+enum R48ValueType : uint8_t {
+  R48_VALUE_FLOAT,
+  R48_VALUE_STATE
+};
+
+enum R48WriteClass : uint8_t {
+  R48_WRITE_ONLINE,     // applied immediately, not stored
+  R48_WRITE_PERMANENT   // stored in EEPROM; confirmed by reading it back
+};
+
+// Output current of one R48-2000e3 at a current limit of 1.0; the current limit settings are fractions of it.
+const float R48_RATED_CURRENT = 41.7f;
+
+// Index of a setting in the descriptor table.
+enum R48SettingId : uint8_t {
+  SETTING_PERMANENT_VOLTAGE,
+  SETTING_ONLINE_VOLTAGE,
+  SETTING_PERMANENT_CURRENT_LIMIT,
+  SETTING_ONLINE_CURRENT_LIMIT,
+  SETTING_MAX_INPUT_CURRENT,
+  SETTING_FAN_SPEED,
+  SETTING_WALK_IN,
+  SETTING_WALK_IN_TIME,
+  SETTING_COUNT
+};
+
+struct R48Setting {
+  const char *name;         // API and metrics name
+  const char *label;        // human-readable, for the log
+  const char *route;        // POST endpoint
+  byte registerNo;
+  R48ValueType type;
+  R48WriteClass writeClass;
+  float minValue;           // float settings: the range the rectifier accepts
+  float maxValue;
+  const char *param;        // form field of the endpoint
+  const char *offWord;      // state settings: the words accepted for 0 and 1
+  const char *onWord;
+};
+
+extern const R48Setting R48_SETTINGS[SETTING_COUNT];
+
+/**
+ * @brief The setting written through a register, or nullptr.
+ */
+const R48Setting *r48FindSetting(byte registerNo);
+
+/**
+ * @brief The setting with an API name, or nullptr.
+ */
+const R48Setting *r48FindSettingByName(const char *name);
+
+/**
+ * @brief Narrows the range a float setting accepts (the safe range), within minValue..maxValue.
+ * @return false, leaving the range unchanged, if the range is empty or outside the table's.
+ */
+bool r48SetSettingRange(R48SettingId id, float minValue, float maxValue);
+
+/**
+ * @brief The range a float setting accepts now: the table's, unless narrowed by r48SetSettingRange().
+ */
+float r48SettingMin(const R48Setting &setting);
+float r48SettingMax(const R48Setting &setting);
+
+/**
+ * @brief Checks a value against the setting's type and accepted range.
+ */
+bool r48SettingValid(const R48Setting &setting, float value);
+
+/**
+ * @brief Builds the 8-byte write frame payload for a setting.
+ */
+void r48EncodeWrite(const R48Setting &setting, float value, byte data[8]);
@@ -0,0 +1,76 @@
+// Table of the rectifiers seen on the bus.
+//
+// A rectifier is tracked from the first frame it sends us (its address is
+// the source field of the response ID) until it has been silent for
+// RECTIFIER_TIMEOUT. Each entry holds the latest value of every measurement
+// and when it arrived. Bank totals are derived from the table on demand.
+
+#pragma once
+
+#include <Arduino.h>
+#include "r48_protocol.h"
+
+// Maximum number of rectifiers handled on one bus.
+const uint8_t MAX_RECTIFIERS = 8;
+// A rectifier that has not answered for this long is dropped from the table.
+const unsigned long RECTIFIER_TIMEOUT = 30000;
+
+struct Rectifier {
+  byte address;
+  uint8_t validMask;    // bit n set once values[n] has been received
+  uint8_t cachedMask;   // bit n set while values[n] is the one restored at boot (see rectifierRestore())
+  unsigned long lastSeen;
+  float values[MEASUREMENT_COUNT];
+  unsigned long updatedAt[MEASUREMENT_COUNT];
+};
+
+// Values summed or averaged over all tracked rectifiers.
+struct BankTotals {
+  uint8_t units;
+  float outputVoltage;      // average
+  float outputCurrent;      // sum
+  float outputCurrentLimit; // average
+  float temperature;        // hottest unit
+  float supplyVoltage;      // average
+};
+
+// Called when a rectifier is added to (added = true) or dropped from the table.
+typedef void (*RectifierChangeFunction)(byte address, bool added);
+
+/**
+ * @brief Sets the function notified when the set of tracked rectifiers changes.
+ */
+void rectifiersBegin(RectifierChangeFunction onChange);
+
+/**
+ * @brief Stores a measurement answered by a rectifier, tracking it if it is new.
+ * @param changed If given, set to true when the value differs from the previous one.
+ * @return false if the table is full or the measurement is not tracked.
+ */
+bool rectifierStore(byte address, byte measurementNo, float value, bool *changed = nullptr);
+
+/**
+ * @brief Adds a rectifier with the values it had before a reboot, until it answers again.
+ *
+ * The values are flagged in cachedMask and have no age (rectifierValueAge()) until the unit answers
+ * them again, so nothing takes them for fresh; the unit is dropped like any other if it stays silent
+ * for RECTIFIER_TIMEOUT.
+ * @return false if the rectifier is already tracked or the table is full.
+ */
+bool rectifierRestore(byte address, uint8_t validMask, const float values[MEASUREMENT_COUNT]);
+
+/**
+ * @brief Drops rectifiers that have been silent for longer than RECTIFIER_TIMEOUT.
+ */
+void rectifiersExpire();
+
+Rectifier *rectifierFind(byte address);
+uint8_t rectifierCount();
+const Rectifier &rectifierAt(uint8_t index);
+
+/**
+ * @brief Milliseconds since a value was received, or 0xFFFFFFFF if never (a value restored at boot counts as never).
+ */
+unsigned long rectifierValueAge(const Rectifier &rectifier, uint8_t slot);
+
+BankTotals rectifiersBankTotals();
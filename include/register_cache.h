@@ -0,0 +1,134 @@
+// Register discovery and a cache of every register the rectifiers answer.
+//
+// Only the five measurements have a slot in the rectifier table, but an R48
+// answers reads for many more registers: its settings, the status and alarm
+// words, the input side. Every answer the controller receives, whatever
+// asked for it (the poll scheduler, a command read-back, a sweep), is
+// recorded here.
+//
+// The cache is dense and indexed by register number: for each of the 256
+// registers it keeps how often it answered, when it last did, and what its
+// value looks like. A value decoding as a plausible float is taken for a
+// float, anything else for a word (status and alarm bits, counters); a
+// register that only ever answered zero stays unknown, and a register that
+// once answered a word stays a word. The raw value bytes are kept per unit
+// and register in a pool of REGISTER_CACHE_MAX_VALUES entries, which drops
+// the least recently answered entry when full.
+//
+// A discovery sweep sends a broadcast read for every register number,
+// 0x00 to 0xFF, one request per gap (REGISTER_DISCOVERY_DEFAULT_GAP unless
+// configured), so it never floods the bus, and finishes after the last
+// answer had time to arrive. The sweep only hears the units whose response
+// IDs pass the acceptance filters, i.e. the tracked ones.
+//
+// Any register that answered can be polled: it is added to the poll
+// scheduler for every tracked unit, and for units found later, with its
+// own period and a priority below the measurements.
+//
+// HTTP:
+//   GET  /reg        sweep state and every register that answered: type,
+//                    answers, ms since the last one, poll period
+//   GET  /reg/<id>   one register (decimal or 0x hex): type and the value of
+//                    every unit that answered it; 404 if it never did
+//   POST /reg        discover=start|stop, gap (ms between two sweep
+//                    requests), poll=<id> with period (ms, 0 stops polling)
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "poll_scheduler.h"
+
+// Unit and register values kept at once.
+const uint8_t REGISTER_CACHE_MAX_VALUES = 64;
+// Registers polled on top of the measurements; the poll schedule has room for them on every unit.
+const uint8_t REGISTER_CACHE_MAX_POLLED = POLL_MAX_EXTRA_REGISTERS;
+// Scheduler priority of a polled register; the measurements use 0 to 4.
+const uint8_t REGISTER_POLL_PRIORITY = 5;
+const unsigned long REGISTER_POLL_MIN_PERIOD = 100;  // ms
+const unsigned long REGISTER_POLL_MAX_PERIOD = 3600000;
+const unsigned long REGISTER_DISCOVERY_DEFAULT_GAP = 50;  // ms between two sweep requests
+const unsigned long REGISTER_DISCOVERY_MIN_GAP = 10;
+const unsigned long REGISTER_DISCOVERY_MAX_GAP = 10000;
+
+enum RegisterType : uint8_t {
+  REGISTER_TYPE_UNKNOWN,  // only answered zero so far
+  REGISTER_TYPE_FLOAT,
+  REGISTER_TYPE_WORD
+};
+
+// What is known about one register, over every unit.
+struct RegisterInfo {
+  uint32_t answeredAt;    // millis() of the last answer
+  uint16_t answers;       // saturates at 0xFFFF
+  RegisterType type;
+};
+
+// The last answer of one unit for one register.
+struct RegisterValue {
+  byte unit;
+  byte registerNo;
+  byte raw[4];            // value bytes as sent, big-endian
+  unsigned long answeredAt;
+};
+
+struct RegisterCacheStats {
+  bool sweeping;
+  uint32_t requests;      // sweep requests sent
+  uint32_t sweeps;        // sweeps run to the end
+  uint16_t registers;     // registers that answered
+  uint8_t polled;         // registers polled on top of the measurements
+};
+
+/**
+ * @brief Sets the function used to put the sweep's broadcast reads on the bus.
+ */
+void registerCacheBegin(PollSendFunction send);
+
+/**
+ * @brief Records an answer. Call for every read answer received.
+ * @param raw The 4 value bytes of the frame.
+ */
+void registerCacheStore(byte unit, byte registerNo, const byte raw[4]);
+
+const RegisterInfo &registerCacheInfo(byte registerNo);
+
+/**
+ * @brief Adds the polled registers of a unit to the poll scheduler. Call when the unit is scheduled.
+ */
+void registerCacheSchedulePolling(byte unit);
+
+/**
+ * @brief Sends the next sweep request when due. Call from loop().
+ */
+void registerCacheService();
+
+uint8_t registerCacheValueCount();
+const RegisterValue &registerCacheValueAt(uint8_t index);
+
+/**
+ * @brief Poll period of a register, or 0 when it is not polled.
+ */
+unsigned long registerCachePollPeriod(byte registerNo);
+
+/**
+ * @brief The value as a float for a float register, else as the unsigned word.
+ */
+double registerCacheDecode(byte registerNo, const byte raw[4]);
+
+RegisterCacheStats registerCacheGetStats();
+
+/**
+ * @brief Answers GET /reg.
+ */
+void registerCacheHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers GET /reg/<id>.
+ */
+void registerCacheHandleRegister(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /reg.
+ */
+void registerCacheHandleControl(AsyncWebServerRequest *request);
@@ -0,0 +1,79 @@
+// Keeps the online setpoints alive.
+//
+// The online voltage and current limit (registers 0x21 and 0x22) only hold
+// while the rectifier keeps hearing them; otherwise it falls back to its
+// permanent settings. The command queue reports every online write it puts
+// on the bus, whatever sent it (the HTTP routes, the charger, the UDP stream,
+// a settings batch), and this module writes the last value again before it
+// is a period old (SETPOINT_KEEPALIVE_DEFAULT_PERIOD unless configured). The
+// charger and the UDP watchdog only write when their setpoint moves, and
+// rely on this.
+//
+// A refresh is due from 3/4 of the period. In that window it is only queued
+// while no read request of the poll scheduler is outstanding, so it lands in
+// a gap between the measurement bursts; at the full period it is queued
+// regardless. When every tracked unit holds the same value for a setting,
+// the refresh is one broadcast frame, like the discovery read, instead of a
+// frame per unit, and the units stay in step from then on. A refresh never
+// overtakes a newer write still waiting in the queue.
+//
+// A setpoint is kept until its unit is dropped from the table, or until
+// POST /keepalive clear=1 lets all of them lapse to the permanent settings.
+//
+// HTTP:
+//   GET  /keepalive   period, counters, and every kept setpoint with the
+//                     ms since it was last written
+//   POST /keepalive   period (ms, 0 disables the refreshes), group=on|off
+//                     (broadcast refreshes), clear=1
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "r48_registers.h"
+#include "rectifiers.h"
+
+const unsigned long SETPOINT_KEEPALIVE_DEFAULT_PERIOD = 10000;  // ms
+const unsigned long SETPOINT_KEEPALIVE_MIN_PERIOD = 1000;
+// Setpoints kept at once: both online settings of every unit.
+const uint8_t SETPOINT_KEEPALIVE_MAX = 2 * MAX_RECTIFIERS;
+
+// An online setpoint and when it was last written.
+struct KeptSetpoint {
+  byte unit;
+  R48SettingId setting;
+  float value;
+  unsigned long writtenAt;
+};
+
+struct SetpointKeepaliveStats {
+  uint32_t refreshes;   // refresh frames queued, broadcasts included
+  uint32_t broadcasts;  // refreshes sent to every unit in one frame
+  uint32_t forced;      // refreshes queued at the full period, during a measurement burst
+};
+
+/**
+ * @brief Records an online write that went out. Called by the command queue.
+ * @param unit The rectifier address, or R48_BROADCAST_ADDRESS for every tracked unit.
+ */
+void setpointKeepaliveOnWrite(byte unit, R48SettingId setting, float value);
+
+/**
+ * @brief Queues the refreshes that are due. Call from loop() before commandQueueService().
+ */
+void setpointKeepaliveService();
+
+uint8_t setpointKeepaliveCount();
+const KeptSetpoint &setpointKeepaliveAt(uint8_t index);
+
+SetpointKeepaliveStats setpointKeepaliveGetStats();
+
+/**
+ * @brief Answers GET /keepalive.
+ */
+void setpointKeepaliveHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /keepalive.
+ */
+void setpointKeepaliveHandleControl(AsyncWebServerRequest *request);
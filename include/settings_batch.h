@@ -0,0 +1,65 @@
+// Writes a whole settings profile in one request, e.g. when commissioning
+// a bank.
+//
+// Every field is checked against the setting's range before anything is
+// sent; a single invalid field rejects the whole request and nothing is
+// written. An accepted batch becomes one write per (setting, unit), fed to
+// the command queue from loop() as fast as it and the read-back tracker
+// can take them: at most SETTINGS_BATCH_MAX_QUEUED writes in the queue at a
+// time, and no more permanent writes in flight than the tracker has entries
+// for. The queue paces the frames at COMMAND_QUEUE_TICK, so a full profile
+// for eight units is sent and confirmed in seconds.
+//
+// Each write ends up as:
+//
+//   confirmed  a permanent setting was read back with the written value
+//   sent       an online setting went out (they are not read back)
+//   failed     not confirmed after COMMAND_VERIFY_ATTEMPTS read-backs, or
+//              the CAN driver kept refusing the frame
+//
+// Writes already stored by the rectifiers are not rolled back when a later
+// one fails; the batch reports which ones did not take.
+//
+// HTTP:
+//   POST /settings   fields named after the settings (permanent_voltage,
+//                    fan_speed=auto|full, walk_in=on|off, ...; see
+//                    r48_registers.cpp), plus an optional unit. 202 with the
+//                    batch as JSON, 400 with an error per invalid field, 409
+//                    while a batch runs
+//   GET  /settings   the last batch: every write and its state
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "r48_registers.h"
+#include "rectifiers.h"
+
+// Writes of one batch: every setting for every unit.
+const uint8_t SETTINGS_BATCH_MAX = SETTING_COUNT * MAX_RECTIFIERS;
+// Writes of a batch in the command queue at once; the rest of the queue stays free for the other routes.
+const uint8_t SETTINGS_BATCH_MAX_QUEUED = 8;
+
+enum SettingsBatchState : uint8_t {
+  SETTINGS_BATCH_IDLE,     // no batch since boot
+  SETTINGS_BATCH_RUNNING,
+  SETTINGS_BATCH_CONFIRMED,
+  SETTINGS_BATCH_FAILED    // at least one write failed
+};
+
+/**
+ * @brief Feeds the queue and collects the outcome of the writes. Call from loop() before commandQueueService().
+ */
+void settingsBatchService();
+
+SettingsBatchState settingsBatchState();
+
+/**
+ * @brief Answers POST /settings for the given target units (see commandTargets() in the sketch).
+ */
+void settingsBatchHandleRequest(AsyncWebServerRequest *request, const byte targets[], uint8_t targetCount);
+
+/**
+ * @brief Answers GET /settings.
+ */
+void settingsBatchHandleStatus(AsyncWebServerRequest *request);
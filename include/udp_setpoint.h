@@ -0,0 +1,106 @@
+// Binary UDP setpoint stream for an external energy manager (zero export,
+// PV surplus charging), bypassing the HTTP handlers.
+//
+// Each datagram is one UdpSetpointPacket. It is checked and queued for the
+// CAN bus in the same loop() pass it arrives in; the command queue sends it
+// on its next tick. A packet for UDP_SETPOINT_ALL_UNITS is one broadcast
+// frame per setting, whatever the size of the bank. A packet is dropped when:
+//
+//   stale         its deadline (in the controller's millis(), 0 = none) has
+//                 passed
+//   out of order  its sequence number is not newer than the last accepted
+//                 one. The sequence restarts when the sender's address or port
+//                 changes, or after the watchdog fired.
+//   invalid       the values are out of range or the unit is unknown
+//   refused       the charger (charger.h) owns the online setpoints
+//   queue full    the command queue has no room for all its writes; none
+//                 is queued, so the sender may repeat the sequence number
+//
+// Every well-formed packet is answered with a UdpSetpointAck carrying the
+// result and the controller's millis(). The sender learns the clock from it
+// to set its deadlines; the first packet can use deadline 0.
+//
+// Watchdog: once a packet was accepted, if none follows within the timeout
+// the online current limit of every unit is set to the safe limit, again in
+// one broadcast frame. The stream then starts over with the next packet.
+//
+// HTTP:
+//   GET  /udp   counters, last sequence and age, watchdog state as JSON
+//   POST /udp   timeout (ms, 0 disables the watchdog), safe_limit
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+const unsigned long UDP_SETPOINT_DEFAULT_TIMEOUT = 2000;  // ms
+const float UDP_SETPOINT_DEFAULT_SAFE_LIMIT = 0.1f;       // fraction of the rated current
+// Datagrams handled per udpSetpointService() call; the rest wait for the next pass.
+const uint8_t UDP_SETPOINT_MAX_PER_SERVICE = 4;
+
+const uint8_t UDP_SETPOINT_VERSION = 1;
+const uint8_t UDP_SETPOINT_HAS_LIMIT = 0x01;
+const uint8_t UDP_SETPOINT_HAS_VOLTAGE = 0x02;
+const byte UDP_SETPOINT_ALL_UNITS = 0xFF;
+
+// Little-endian, floats in IEEE 754 single precision.
+struct __attribute__((packed)) UdpSetpointPacket {
+  char magic[2];         // "RS"
+  uint8_t version;       // 1
+  uint8_t flags;         // UDP_SETPOINT_HAS_LIMIT, UDP_SETPOINT_HAS_VOLTAGE
+  uint8_t unit;          // rectifier address, or UDP_SETPOINT_ALL_UNITS
+  uint8_t reserved[3];
+  uint32_t sequence;
+  uint32_t deadline;     // controller millis() after which the packet is stale; 0 = none
+  float currentLimit;    // online current limit, fraction of the rated current
+  float voltage;         // online voltage, V
+};
+
+enum UdpSetpointResult : uint8_t {
+  UDP_SETPOINT_ACCEPTED,
+  UDP_SETPOINT_STALE,
+  UDP_SETPOINT_OUT_OF_ORDER,
+  UDP_SETPOINT_INVALID,
+  UDP_SETPOINT_REFUSED,
+  UDP_SETPOINT_QUEUE_FULL
+};
+
+struct __attribute__((packed)) UdpSetpointAck {
+  char magic[2];         // "RA"
+  uint8_t version;       // 1
+  uint8_t result;        // UdpSetpointResult
+  uint32_t sequence;     // of the packet answered
+  uint32_t now;          // controller millis()
+};
+
+struct UdpSetpointStats {
+  uint32_t received;     // datagrams, well-formed or not
+  uint32_t accepted;
+  uint32_t stale;
+  uint32_t outOfOrder;
+  uint32_t invalid;      // malformed datagrams included
+  uint32_t refused;      // charger running or queue full
+  uint32_t watchdogTrips;
+};
+
+/**
+ * @brief Binds the UDP port. Call once from setup() after the network is up.
+ */
+void udpSetpointBegin(uint16_t port);
+
+/**
+ * @brief Handles the waiting datagrams and runs the watchdog. Call from loop() before commandQueueService().
+ */
+void udpSetpointService();
+
+UdpSetpointStats udpSetpointGetStats();
+
+/**
+ * @brief Answers GET /udp.
+ */
+void udpSetpointHandleStatus(AsyncWebServerRequest *request);
+
+/**
+ * @brief Answers POST /udp.
+ */
+void udpSetpointHandleControl(AsyncWebServerRequest *request);
@@ -0,0 +1,30 @@
+// Web UI served from flash.
+//
+// The page, its stylesheet and its script live in web/ and are gzipped
+// into include/web_assets.h by tools/embed_web_assets.py at build time.
+// Each asset is sent as-is with Content-Encoding: gzip and a strong ETag
+// derived from its content. The stylesheet and script are served under
+// hashed names and cached for a year; the page keeps its URL and is
+// revalidated, which costs a 304 once it is cached.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Cache lifetime of the hashed assets, in seconds.
+const unsigned long WEB_ASSET_MAX_AGE = 31536000;
+
+struct WebAsset {
+  const char *path;
+  const char *contentType;
+  const uint8_t *data; // gzipped, in PROGMEM
+  size_t length;
+  const char *etag;
+  bool immutable;      // served under a content-hashed name
+};
+
+/**
+ * @brief Registers a route for every embedded asset.
+ */
+void webUiBegin(AsyncWebServer &server);
@@ -0,0 +1,77 @@
+// WiFi bring-up and reconnects as a state machine driven from loop(), so
+// setup() never waits for the network and CAN polling starts right away.
+//
+// Station mode:
+//
+//   connecting  WiFi.begin() was called; the attempt fails after
+//               WIFI_LINK_CONNECT_TIMEOUT or when the driver reports a
+//               wrong password or a missing SSID
+//   backoff     waiting before the next attempt: WIFI_LINK_BACKOFF_MIN,
+//               doubled after every failed attempt up to WIFI_LINK_BACKOFF_MAX
+//   connected   a lost connection is retried at once, then backs off again
+//
+// After WIFI_LINK_AP_FALLBACK_FAILURES failed attempts in a row the
+// controller also opens its own access point (ap_ssid in the sketch), so it
+// stays reachable while the station keeps retrying. The access point is
+// closed again once the station connects. Retries scan the channels, which
+// briefly disturbs clients of the fallback access point.
+//
+// Access point mode (WIFI_AP_MODE in the sketch) only starts the access
+// point and never leaves it.
+//
+// The SDK's own reconnects and its credential writes to flash on every
+// WiFi.begin() are switched off; this module owns both.
+//
+// HTTP:
+//   GET /wifi   state, IP, RSSI, attempt and disconnect counters, the next
+//               retry and the boot milestones as JSON
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+const unsigned long WIFI_LINK_CONNECT_TIMEOUT = 15000;  // ms per attempt
+const unsigned long WIFI_LINK_BACKOFF_MIN = 1000;       // ms after the first failed attempt
+const unsigned long WIFI_LINK_BACKOFF_MAX = 60000;      // ms
+const uint8_t WIFI_LINK_AP_FALLBACK_FAILURES = 3;
+
+enum WifiLinkState : uint8_t {
+  WIFI_LINK_ACCESS_POINT,  // access point mode only
+  WIFI_LINK_CONNECTING,
+  WIFI_LINK_BACKOFF,
+  WIFI_LINK_CONNECTED
+};
+
+struct WifiLinkStatus {
+  WifiLinkState state;
+  bool fallbackAp;           // the fallback access point is open
+  uint8_t failures;          // failed attempts in a row
+  uint32_t attempts;         // WiFi.begin() calls
+  uint32_t disconnects;      // connections lost after they were up
+  unsigned long retryIn;     // ms until the next attempt while backing off
+};
+
+// Called when the station connects (true) or loses its connection (false).
+typedef void (*WifiLinkChangeFunction)(bool connected);
+
+/**
+ * @brief Starts the access point, or the first station attempt. Returns at once.
+ * @param accessPoint Access point mode only (WIFI_AP_MODE).
+ */
+void wifiLinkBegin(bool accessPoint, const char *ssid, const char *password,
+                   const char *apSsid, const char *apPassword, WifiLinkChangeFunction onChange);
+
+/**
+ * @brief Advances the state machine. Call from loop().
+ */
+void wifiLinkService();
+
+bool wifiLinkConnected();
+WifiLinkStatus wifiLinkGetStatus();
+const char *wifiLinkStateName(WifiLinkState state);
+
+/**
+ * @brief Answers GET /wifi.
+ */
+void wifiLinkHandleStatus(AsyncWebServerRequest *request);
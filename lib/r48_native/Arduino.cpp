@@ -0,0 +1,217 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <random>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static unsigned long long clockMicros = 0;
+
+struct NativePin {
+  std::function<int()> reader;
+  int written;
+  void (*isr)();
+  int mode;
+  int lastLevel;
+};
+
+static NativePin pins[NATIVE_PIN_COUNT];
+static bool interruptsEnabled = true;
+
+static int pinLevel(uint8_t pin) {
+  if (pins[pin].reader) {
+    return pins[pin].reader();
+  }
+  return pins[pin].written;
+}
+
+unsigned long millis() {
+  return (unsigned long)(clockMicros / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)clockMicros;
+}
+
+void delay(unsigned long ms) {
+  nativeClockAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  nativeClockAdvance(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < NATIVE_PIN_COUNT && mode == INPUT_PULLUP && !pins[pin].reader) {
+    pins[pin].written = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NATIVE_PIN_COUNT) {
+    pins[pin].written = value;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NATIVE_PIN_COUNT ? pinLevel(pin) : LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (pin < NATIVE_PIN_COUNT) {
+    pins[pin].isr = isr;
+    pins[pin].mode = mode;
+    pins[pin].lastLevel = pinLevel(pin);
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < NATIVE_PIN_COUNT) {
+    pins[pin].isr = nullptr;
+  }
+}
+
+void noInterrupts() {
+  interruptsEnabled = false;
+}
+
+void interrupts() {
+  interruptsEnabled = true;
+  nativeCheckInterrupts();
+}
+
+void nativeClockAdvance(unsigned long microseconds) {
+  clockMicros += microseconds;
+  nativeCheckInterrupts();
+}
+
+void nativeSetPinReader(uint8_t pin, std::function<int()> reader) {
+  if (pin < NATIVE_PIN_COUNT) {
+    pins[pin].reader = reader;
+  }
+}
+
+void nativeCheckInterrupts() {
+  if (!interruptsEnabled) {
+    return;
+  }
+  for (uint8_t pin = 0; pin < NATIVE_PIN_COUNT; pin++) {
+    NativePin &p = pins[pin];
+    if (p.isr == nullptr) {
+      continue;
+    }
+    int level = pinLevel(pin);
+    bool fire = (p.mode == FALLING && p.lastLevel == HIGH && level == LOW) ||
+                (p.mode == RISING && p.lastLevel == LOW && level == HIGH) ||
+                (p.mode == CHANGE && p.lastLevel != level);
+    p.lastLevel = level;
+    if (fire) {
+      p.isr();
+    }
+  }
+}
+
+// --- String ---
+
+void String::setFloat(double v, unsigned char decimals) {
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, v);
+  s = buffer;
+}
+
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  size_t last = s.find_last_not_of(" \t\r\n");
+  s = first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+  return String(text);
+}
+
+// --- Print ---
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char text[24];
+  snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+  return write(text);
+}
+
+size_t Print::print(long value, int base) {
+  char text[24];
+  snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", value);
+  return write(text);
+}
+
+size_t Print::print(double value, int decimals) {
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", decimals, value);
+  return write(text);
+}
+
+size_t Print::print(const IPAddress &address) {
+  return print(address.toString());
+}
+
+size_t Print::printf(const char *format, ...) {
+  char small[128];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  if ((size_t)length < sizeof(small)) {
+    return write((const uint8_t *)small, length);
+  }
+  std::string large(length + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&large[0], large.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)large.data(), length);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  bytesWritten += size;
+  if (echo) {
+    fwrite(buffer, 1, size, stdout);
+  }
+  return size;
+}
+
+// --- ESP ---
+
+uint32_t EspClass::getCycleCount() {
+  using namespace std::chrono;
+  return (uint32_t)(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() * 80 / 1000);
+}
+
+uint32_t EspClass::random() {
+  // Fixed seed: the same run gives the same boot ID and jitter every time.
+  static std::mt19937 generator(0x5eed);
+  return generator();
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart() called\n");
+  exit(1);
+}
@@ -0,0 +1,223 @@
+// Host stand-in for the parts of the ESP8266 Arduino core the controller uses.
+//
+// Time is virtual: millis() and micros() only move when a test or
+// benchmark calls nativeClockAdvance() (or the sketch calls delay()), so
+// a run is deterministic and independent of the host's speed. Pins read
+// back whatever their reader function returns, and interrupts attached
+// with attachInterrupt() fire when the clock advance changes the level of
+// their pin, which is how the simulated MCP2515 raises its INT line.
+//
+// Serial output is counted and dropped unless Serial.echo is set.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+using std::isnan;
+using std::isinf;
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define HEX 16
+#define DEC 10
+
+// Wemos D1 mini pin names (GPIO numbers)
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define LED_BUILTIN 2
+#define NATIVE_PIN_COUNT 17
+
+#define digitalPinToInterrupt(p) (p)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// SNTP is not run on the host; time() is the host's clock.
+inline void configTime(int timezone, int daylightOffset, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr) {}
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+// --- Native test hooks ---
+
+/**
+ * @brief Moves the virtual clock forward and fires the interrupts whose pin level changed.
+ */
+void nativeClockAdvance(unsigned long microseconds);
+
+/**
+ * @brief Makes digitalRead() of a pin return what `reader` returns (e.g. a simulated INT line).
+ */
+void nativeSetPinReader(uint8_t pin, std::function<int()> reader);
+
+/**
+ * @brief Fires the attached interrupts whose pin changed level since the last check.
+ */
+void nativeCheckInterrupts();
+
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &c) : s(c) {}
+  explicit String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(float v, unsigned char decimals = 2) { setFloat(v, decimals); }
+  String(double v, unsigned char decimals = 2) { setFloat(v, decimals); }
+
+  const char *c_str() const { return s.c_str(); }
+  size_t length() const { return s.size(); }
+  bool reserve(size_t n) { s.reserve(n); return true; }
+  float toFloat() const { return strtof(s.c_str(), nullptr); }
+  long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+  bool startsWith(const String &prefix) const { return s.rfind(prefix.s, 0) == 0; }
+  bool endsWith(const String &suffix) const {
+    return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+  }
+  String substring(size_t from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(size_t from, size_t to) const { return from < s.size() && to > from ? String(s.substr(from, to - from)) : String(); }
+  int indexOf(char c, size_t from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const String &text, size_t from = 0) const { size_t p = s.find(text.s, from); return p == std::string::npos ? -1 : (int)p; }
+  bool equals(const String &other) const { return s == other.s; }
+  bool equalsIgnoreCase(const String &other) const { return strcasecmp(s.c_str(), other.s.c_str()) == 0; }
+  void toLowerCase() { for (char &c : s) c = tolower((unsigned char)c); }
+  void trim();
+
+  bool operator==(const char *other) const { return s == (other ? other : ""); }
+  bool operator==(const String &other) const { return s == other.s; }
+  bool operator!=(const char *other) const { return !(*this == other); }
+  bool operator!=(const String &other) const { return s != other.s; }
+  char operator[](size_t i) const { return i < s.size() ? s[i] : 0; }
+  String &operator+=(const String &other) { s += other.s; return *this; }
+  String &operator+=(const char *other) { s += other ? other : ""; return *this; }
+  String &operator+=(char c) { s += c; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+  friend String operator+(const char *a, const String &b) { return String(std::string(a) + b.s); }
+  friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+
+private:
+  void setFloat(double v, unsigned char decimals);
+  std::string s;
+};
+
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  String toString() const;
+  operator uint32_t() const { return octets[0] | octets[1] << 8 | octets[2] << 16 | (uint32_t)octets[3] << 24; }
+
+  uint8_t octets[4] = {0, 0, 0, 0};
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+  size_t print(const char *text) { return write(text); }
+  size_t print(const String &text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(double value, int decimals = 2);
+  size_t print(const IPAddress &address);
+
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  int availableForWrite() { return 128; }
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+  bool echo = false;        // copy the output to stdout
+  uint32_t bytesWritten = 0;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getMaxFreeBlockSize() { return 30000; }
+  uint8_t getHeapFragmentation() { return 0; }
+  uint32_t getCpuFreqMHz() { return 80; }
+  uint32_t getChipId() { return 0x00ABCDEF; }
+  // Counts at 80 MHz of the host's real clock, so cycle-based timing measures host time.
+  uint32_t getCycleCount();
+  uint32_t random();
+  void restart();
+};
+
+extern EspClass ESP;
@@ -0,0 +1,57 @@
+#include "ESP8266WiFi.h"
+
+ESP8266WiFiClass WiFi;
+
+wl_status_t ESP8266WiFiClass::begin(const char *, const char *) {
+  nativeMode = nativeMode == WIFI_AP ? WIFI_AP_STA : WIFI_STA;
+  nativeStatus = nativeNetworkUp ? WL_CONNECTED : WL_DISCONNECTED;
+  return nativeStatus;
+}
+
+bool ESP8266WiFiClass::softAP(const char *, const char *) {
+  nativeMode = nativeMode == WIFI_STA ? WIFI_AP_STA : WIFI_AP;
+  return true;
+}
+
+bool ESP8266WiFiClass::softAPdisconnect(bool) {
+  nativeMode = nativeMode == WIFI_AP_STA ? WIFI_STA : (nativeMode == WIFI_AP ? WIFI_OFF : nativeMode);
+  return true;
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode) {
+  nativeMode = mode;
+  return true;
+}
+
+WiFiMode_t ESP8266WiFiClass::getMode() {
+  return nativeMode;
+}
+
+bool ESP8266WiFiClass::disconnect(bool) {
+  nativeStatus = WL_DISCONNECTED;
+  return true;
+}
+
+bool ESP8266WiFiClass::setAutoReconnect(bool) {
+  return true;
+}
+
+bool ESP8266WiFiClass::persistent(bool) {
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+  return nativeStatus;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+  return nativeStatus == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+IPAddress ESP8266WiFiClass::softAPIP() {
+  return IPAddress(192, 168, 4, 1);
+}
+
+int32_t ESP8266WiFiClass::RSSI() {
+  return nativeStatus == WL_CONNECTED ? -55 : 31;
+}
@@ -0,0 +1,44 @@
+// Host stand-in for the ESP8266 WiFi driver.
+//
+// Station mode connects at once and access point mode always succeeds, so
+// setup() runs through without waiting. Tests can set `WiFi.nativeStatus`
+// to simulate a lost connection, and clear `WiFi.nativeNetworkUp` to make
+// the following attempts hang until they time out.
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+class ESP8266WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *password = nullptr);
+  bool softAP(const char *ssid, const char *password = nullptr);
+  bool softAPdisconnect(bool wifiOff = false);
+  bool mode(WiFiMode_t mode);
+  WiFiMode_t getMode();
+  bool disconnect(bool wifiOff = false);
+  bool setAutoReconnect(bool autoReconnect);
+  bool persistent(bool persistent);
+  wl_status_t status();
+  IPAddress localIP();
+  IPAddress softAPIP();
+  int32_t RSSI();
+
+  wl_status_t nativeStatus = WL_DISCONNECTED;
+  WiFiMode_t nativeMode = WIFI_OFF;
+  bool nativeNetworkUp = true;
+};
+
+extern ESP8266WiFiClass WiFi;
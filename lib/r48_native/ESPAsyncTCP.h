@@ -0,0 +1,5 @@
+// Host stand-in for ESPAsyncTCP; the simulated web server needs no sockets.
+
+#pragma once
+
+#include <Arduino.h>
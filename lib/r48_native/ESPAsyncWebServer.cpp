@@ -0,0 +1,511 @@
+#include "ESPAsyncWebServer.h"
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// How often a filler may ask to be called again before the response is treated as stalled.
+static const uint32_t NATIVE_MAX_TRY_AGAIN = 10000;
+// Buffer offered to a filler per call, about one TCP segment like on the device.
+static const size_t NATIVE_CHUNK_SIZE = 1460;
+
+const char *NativeResponse::header(const char *name) const {
+  for (const auto &h : headers) {
+    if (strcasecmp(h.first.c_str(), name) == 0) {
+      return h.second.c_str();
+    }
+  }
+  return nullptr;
+}
+
+// --- Responses ---
+
+bool AsyncWebServerResponse::addHeader(const char *name, const char *value, bool replaceExisting) {
+  for (auto &h : _headers) {
+    if (strcasecmp(h.first.c_str(), name) == 0) {
+      if (!replaceExisting) {
+        return false;
+      }
+      h.second = value;
+      return true;
+    }
+  }
+  _headers.emplace_back(name, value);
+  return true;
+}
+
+NativeResponse AsyncWebServerResponse::nativeRender() {
+  NativeResponse out;
+  out.code = _code;
+  out.contentType = _contentType;
+  out.headers = _headers;
+  renderBody(out);
+  return out;
+}
+
+NativeBufferResponse::NativeBufferResponse(int code, const char *contentType, const char *text)
+  : AsyncWebServerResponse(code, contentType), text(text ? text : ""), content(nullptr), length(0) {}
+
+NativeBufferResponse::NativeBufferResponse(int code, const char *contentType, const uint8_t *content, size_t length)
+  : AsyncWebServerResponse(code, contentType), content(content), length(length) {}
+
+void NativeBufferResponse::renderBody(NativeResponse &out) {
+  if (content != nullptr) {
+    out.body.assign((const char *)content, length);
+  } else {
+    out.body = text;
+  }
+}
+
+NativeFillerResponse::NativeFillerResponse(const char *contentType, size_t length, AwsResponseFiller filler)
+  : AsyncWebServerResponse(200, contentType), length(length), filler(filler) {}
+
+void NativeFillerResponse::renderBody(NativeResponse &out) {
+  uint8_t buffer[NATIVE_CHUNK_SIZE];
+  uint32_t retries = 0;
+  while (length == 0 || out.body.size() < length) {
+    size_t room = length == 0 ? sizeof(buffer) : min(sizeof(buffer), length - out.body.size());
+    size_t written = filler(buffer, room, out.body.size());
+    if (written == RESPONSE_TRY_AGAIN) {
+      // The client waits: let 1 ms of virtual time pass before the filler is asked again
+      nativeClockAdvance(1000);
+      if (++retries > NATIVE_MAX_TRY_AGAIN) {
+        fprintf(stderr, "response filler stalled after %u bytes\n", (unsigned)out.body.size());
+        return;
+      }
+      continue;
+    }
+    if (written == 0) {
+      return;
+    }
+    retries = 0;
+    out.chunks++;
+    out.body.append((const char *)buffer, min(written, room));
+  }
+}
+
+size_t AsyncResponseStream::write(uint8_t c) {
+  content += (char)c;
+  return 1;
+}
+
+size_t AsyncResponseStream::write(const uint8_t *buffer, size_t size) {
+  content.append((const char *)buffer, size);
+  return size;
+}
+
+void AsyncResponseStream::renderBody(NativeResponse &out) {
+  out.body = content;
+}
+
+// --- Requests ---
+
+AsyncWebServerRequest::AsyncWebServerRequest(WebRequestMethodComposite method, const String &url)
+  : _method(method), _url(url) {}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+  delete response;
+}
+
+bool AsyncWebServerRequest::hasParam(const char *name, bool post, bool file) const {
+  return getParam(name, post, file) != nullptr;
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(const char *name, bool post, bool) const {
+  for (const AsyncWebParameter &param : _params) {
+    if (param.name() == name && param.isPost() == post) {
+      return &param;
+    }
+  }
+  return nullptr;
+}
+
+const AsyncWebHeader *AsyncWebServerRequest::getHeader(const char *name) const {
+  for (const AsyncWebHeader &header : _headers) {
+    if (header.name().equalsIgnoreCase(name)) {
+      return &header;
+    }
+  }
+  return nullptr;
+}
+
+const String &AsyncWebServerRequest::header(const char *name) const {
+  static const String empty;
+  const AsyncWebHeader *found = getHeader(name);
+  return found ? found->value() : empty;
+}
+
+void AsyncWebServerRequest::send(int code, const char *contentType, const char *content, AwsTemplateProcessor) {
+  send(new NativeBufferResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content) {
+  send(new NativeBufferResponse(code, contentType.c_str(), content.c_str()));
+}
+
+void AsyncWebServerRequest::send(int code, const char *contentType, const uint8_t *content, size_t length, AwsTemplateProcessor) {
+  send(new NativeBufferResponse(code, contentType, content, length));
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *newResponse) {
+  // Like the library, only the first response of a request is sent.
+  if (response != nullptr) {
+    delete newResponse;
+    return;
+  }
+  response = newResponse;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const char *contentType, const char *content, AwsTemplateProcessor) {
+  return new NativeBufferResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const char *contentType, const uint8_t *content, size_t length, AwsTemplateProcessor) {
+  return new NativeBufferResponse(code, contentType, content, length);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(const char *contentType, size_t length, AwsResponseFiller filler, AwsTemplateProcessor) {
+  return new NativeFillerResponse(contentType, length, filler);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const char *contentType, AwsResponseFiller filler, AwsTemplateProcessor) {
+  return new NativeFillerResponse(contentType, 0, filler);
+}
+
+AsyncResponseStream *AsyncWebServerRequest::beginResponseStream(const char *contentType, size_t) {
+  return new AsyncResponseStream(contentType);
+}
+
+void AsyncWebServerRequest::nativeAddParam(const String &name, const String &value, bool post) {
+  _params.emplace_back(name, value, post);
+}
+
+void AsyncWebServerRequest::nativeAddHeader(const String &name, const String &value) {
+  _headers.emplace_back(name, value);
+}
+
+NativeResponse AsyncWebServerRequest::nativeFinish() {
+  NativeResponse out;
+  if (response != nullptr) {
+    out = response->nativeRender();
+  }
+  for (auto &handler : disconnectHandlers) {
+    handler();
+  }
+  disconnectHandlers.clear();
+  return out;
+}
+
+// --- Server-Sent Events ---
+
+bool AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t) {
+  nativeEvents.push_back({event ? event : "", message ? message : "", id});
+  if (id) {
+    _lastId = id;
+  }
+  return true;
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect) {
+  for (auto &client : clients) {
+    client->send(message, event, id, reconnect);
+  }
+}
+
+AsyncEventSourceClient *AsyncEventSource::nativeConnect() {
+  clients.emplace_back(new AsyncEventSourceClient());
+  AsyncEventSourceClient *client = clients.back().get();
+  if (connectHandler) {
+    connectHandler(client);
+  }
+  return client;
+}
+
+void AsyncEventSource::nativeDisconnect(AsyncEventSourceClient *client) {
+  for (auto it = clients.begin(); it != clients.end(); ++it) {
+    if (it->get() == client) {
+      if (disconnectHandler) {
+        disconnectHandler(client);
+      }
+      clients.erase(it);
+      return;
+    }
+  }
+}
+
+// --- Server ---
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+  return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction, ArBodyHandlerFunction onBody) {
+  routes.emplace_back(new AsyncCallbackWebHandler());
+  AsyncCallbackWebHandler &handler = *routes.back();
+  handler.uri = uri;
+  handler.method = method;
+  handler.onRequest = onRequest;
+  handler.onBody = onBody;
+  return handler;
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler) {
+  handlers.push_back(handler);
+  return *handler;
+}
+
+static std::string urlDecode(const std::string &text) {
+  std::string out;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '+') {
+      out += ' ';
+    } else if (text[i] == '%' && i + 2 < text.size()) {
+      out += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += text[i];
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Matches a path like the library's callback handlers: the exact URI, a path below it, or a prefix
+ * ending in '*'.
+ */
+static bool routeMatches(const std::string &uri, const std::string &path) {
+  if (!uri.empty() && uri.back() == '*') {
+    return path.compare(0, uri.size() - 1, uri, 0, uri.size() - 1) == 0;
+  }
+  return path == uri || path.compare(0, uri.size() + 1, uri + "/") == 0;
+}
+
+NativeResponse AsyncWebServer::nativeRequest(WebRequestMethodComposite method, const char *url, const NativeParams &params,
+                                             const NativeParams &headers) {
+  std::string path = url;
+  std::string query;
+  size_t mark = path.find('?');
+  if (mark != std::string::npos) {
+    query = path.substr(mark + 1);
+    path.resize(mark);
+  }
+
+  AsyncWebServerRequest request(method, path.c_str());
+  size_t start = 0;
+  while (start < query.size()) {
+    size_t end = query.find('&', start);
+    if (end == std::string::npos) end = query.size();
+    std::string pair = query.substr(start, end - start);
+    size_t equals = pair.find('=');
+    std::string name = urlDecode(pair.substr(0, equals));
+    std::string value = equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1));
+    request.nativeAddParam(name.c_str(), value.c_str(), false);
+    start = end + 1;
+  }
+  for (const auto &param : params) {
+    request.nativeAddParam(param.first.c_str(), param.second.c_str(), method == HTTP_POST);
+  }
+  for (const auto &header : headers) {
+    request.nativeAddHeader(header.first.c_str(), header.second.c_str());
+  }
+
+  bool handled = false;
+  for (auto &route : routes) {
+    if (routeMatches(route->uri, path) && (route->method & method)) {
+      route->onRequest(&request);
+      handled = true;
+      break;
+    }
+  }
+  if (!handled) {
+    if (notFound) {
+      notFound(&request);
+    } else {
+      request.send(404);
+    }
+  }
+  return request.nativeFinish();
+}
+
+AsyncEventSourceClient *AsyncWebServer::nativeConnectEvents(const char *url) {
+  for (AsyncWebHandler *handler : handlers) {
+    AsyncEventSource *source = dynamic_cast<AsyncEventSource *>(handler);
+    if (source != nullptr && strcmp(source->url(), url) == 0) {
+      return source->nativeConnect();
+    }
+  }
+  return nullptr;
+}
+
+// --- Socket listener (daemon builds) ---
+
+#ifdef __linux__
+
+// Largest request accepted; the API only takes small forms.
+static const size_t NATIVE_MAX_REQUEST = 16384;
+
+bool AsyncWebServer::nativeListen(uint16_t port) {
+  listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listener < 0) {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 8) < 0) {
+    close(listener);
+    listener = -1;
+    return false;
+  }
+  return true;
+}
+
+void AsyncWebServer::nativeServe() {
+  if (listener < 0) {
+    return;
+  }
+  int connection;
+  while ((connection = accept4(listener, nullptr, nullptr, 0)) >= 0) {
+    // A slow client may hold up loop() for at most this long.
+    struct timeval timeout = {1, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    nativeServeConnection(connection);
+    close(connection);
+  }
+}
+
+static void parseForm(const std::string &form, NativeParams &params) {
+  size_t start = 0;
+  while (start < form.size()) {
+    size_t end = form.find('&', start);
+    if (end == std::string::npos) end = form.size();
+    std::string pair = form.substr(start, end - start);
+    size_t equals = pair.find('=');
+    params.emplace_back(urlDecode(pair.substr(0, equals)), equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1)));
+    start = end + 1;
+  }
+}
+
+static const char *statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 503: return "Service Unavailable";
+    default: return code < 400 ? "OK" : "Error";
+  }
+}
+
+static void writeAll(int connection, const std::string &text) {
+  size_t offset = 0;
+  while (offset < text.size()) {
+    ssize_t written = write(connection, text.data() + offset, text.size() - offset);
+    if (written <= 0) {
+      return;
+    }
+    offset += written;
+  }
+}
+
+void AsyncWebServer::nativeServeConnection(int connection) {
+  std::string request;
+  size_t headerEnd = std::string::npos;
+  size_t contentLength = 0;
+  char buffer[2048];
+  while (true) {
+    if (headerEnd == std::string::npos) {
+      headerEnd = request.find("\r\n\r\n");
+      if (headerEnd != std::string::npos) {
+        std::string lower = request.substr(0, headerEnd);
+        for (char &c : lower) c = tolower(c);
+        size_t field = lower.find("\r\ncontent-length:");
+        if (field != std::string::npos) {
+          contentLength = strtoul(lower.c_str() + field + 17, nullptr, 10);
+        }
+      }
+    }
+    if (headerEnd != std::string::npos && request.size() >= headerEnd + 4 + contentLength) {
+      break;
+    }
+    if (request.size() > NATIVE_MAX_REQUEST) {
+      return;
+    }
+    ssize_t received = read(connection, buffer, sizeof(buffer));
+    if (received <= 0) {
+      return;
+    }
+    request.append(buffer, received);
+  }
+
+  // Request line: METHOD URL VERSION
+  size_t lineEnd = request.find("\r\n");
+  std::string line = request.substr(0, lineEnd);
+  size_t space1 = line.find(' ');
+  size_t space2 = line.find(' ', space1 + 1);
+  if (space1 == std::string::npos || space2 == std::string::npos) {
+    return;
+  }
+  std::string methodName = line.substr(0, space1);
+  std::string url = line.substr(space1 + 1, space2 - space1 - 1);
+  WebRequestMethodComposite method = methodName == "POST"     ? HTTP_POST
+                                     : methodName == "DELETE" ? HTTP_DELETE
+                                     : methodName == "PUT"    ? HTTP_PUT
+                                     : methodName == "PATCH"  ? HTTP_PATCH
+                                     : methodName == "HEAD"   ? HTTP_HEAD
+                                                              : HTTP_GET;
+
+  NativeParams headers;
+  size_t start = lineEnd + 2;
+  while (start < headerEnd) {
+    size_t end = request.find("\r\n", start);
+    if (end == std::string::npos || end > headerEnd) end = headerEnd;
+    std::string field = request.substr(start, end - start);
+    size_t colon = field.find(':');
+    if (colon != std::string::npos) {
+      size_t valueStart = field.find_first_not_of(' ', colon + 1);
+      headers.emplace_back(field.substr(0, colon), valueStart == std::string::npos ? "" : field.substr(valueStart));
+    }
+    start = end + 2;
+  }
+
+  NativeParams params;
+  std::string body = request.substr(headerEnd + 4, contentLength);
+  for (const auto &header : headers) {
+    if (strcasecmp(header.first.c_str(), "Content-Type") == 0 &&
+        header.second.find("application/x-www-form-urlencoded") != std::string::npos) {
+      parseForm(body, params);
+    }
+  }
+
+  NativeResponse response = nativeRequest(method, url.c_str(), params, headers);
+  if (response.code == 0) {
+    response.code = 500;
+  }
+  std::string head = "HTTP/1.0 " + std::to_string(response.code) + " " + statusText(response.code) + "\r\n";
+  if (!response.contentType.empty()) {
+    head += "Content-Type: " + response.contentType + "\r\n";
+  }
+  for (const auto &header : response.headers) {
+    head += header.first + ": " + header.second + "\r\n";
+  }
+  head += "Content-Length: " + std::to_string(response.body.size()) + "\r\nConnection: close\r\n\r\n";
+  writeAll(connection, head);
+  if (method != HTTP_HEAD) {
+    writeAll(connection, response.body);
+  }
+}
+
+#endif
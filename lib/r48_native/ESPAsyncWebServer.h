@@ -0,0 +1,309 @@
+// Host stand-in for ESPAsyncWebServer 3.8.1.
+//
+// Routes are registered exactly like on the device, but requests come
+// from AsyncWebServer::nativeRequest() instead of a socket: the handler
+// runs synchronously, the response it sends is rendered the way the
+// library would put it on the wire (chunked fillers are called until
+// they finish, streams are flushed) and returned as a NativeResponse.
+// A filler that asks to be retried gets 1 ms of virtual time per retry,
+// up to 10 s.
+// The request's onDisconnect() callbacks run once the body is complete.
+//
+// Server-Sent Events clients are connected with nativeConnectEvents()
+// and record every event sent to them.
+//
+// On Linux, nativeListen()/nativeServe() also put the routes on a real
+// socket for the SocketCAN daemon build ([env:linux]).
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+typedef std::function<String(const String &)> AwsTemplateProcessor;
+typedef std::vector<std::pair<std::string, std::string>> NativeParams;
+
+// What a simulated request got back.
+struct NativeResponse {
+  int code = 0;  // 0 if the handler sent nothing
+  std::string contentType;
+  NativeParams headers;
+  std::string body;
+  uint32_t chunks = 0;  // filler calls that produced data
+
+  /**
+   * @brief Value of a response header, or nullptr.
+   */
+  const char *header(const char *name) const;
+};
+
+class AsyncWebParameter {
+public:
+  AsyncWebParameter(const String &name, const String &value, bool post) : _name(name), _value(value), _post(post) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  bool isPost() const { return _post; }
+
+private:
+  String _name;
+  String _value;
+  bool _post;
+};
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name;
+  String _value;
+};
+
+class AsyncWebServerResponse {
+public:
+  AsyncWebServerResponse(int code, const char *contentType) : _code(code), _contentType(contentType ? contentType : "") {}
+  virtual ~AsyncWebServerResponse() {}
+  bool addHeader(const char *name, const char *value, bool replaceExisting = true);
+  bool addHeader(const char *name, const String &value, bool replaceExisting = true) { return addHeader(name, value.c_str(), replaceExisting); }
+  void setCode(int code) { _code = code; }
+
+  /**
+   * @brief Produces the status, headers and whole body, as the library would send them.
+   */
+  NativeResponse nativeRender();
+
+protected:
+  virtual void renderBody(NativeResponse &out) {}
+
+private:
+  int _code;
+  std::string _contentType;
+  NativeParams _headers;
+};
+
+// A body known up front. Text bodies are copied like the library's String
+// content; byte buffers are not, so they must outlive the response.
+class NativeBufferResponse : public AsyncWebServerResponse {
+public:
+  NativeBufferResponse(int code, const char *contentType, const char *text);
+  NativeBufferResponse(int code, const char *contentType, const uint8_t *content, size_t length);
+
+protected:
+  void renderBody(NativeResponse &out) override;
+
+private:
+  std::string text;
+  const uint8_t *content;
+  size_t length;
+};
+
+// A body produced by a filler, with a known length or chunked.
+class NativeFillerResponse : public AsyncWebServerResponse {
+public:
+  NativeFillerResponse(const char *contentType, size_t length, AwsResponseFiller filler);
+
+protected:
+  void renderBody(NativeResponse &out) override;
+
+private:
+  size_t length;  // 0 for chunked
+  AwsResponseFiller filler;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+  AsyncResponseStream(const char *contentType) : AsyncWebServerResponse(200, contentType) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+protected:
+  void renderBody(NativeResponse &out) override;
+
+private:
+  std::string content;
+};
+
+class AsyncWebServerRequest {
+public:
+  AsyncWebServerRequest(WebRequestMethodComposite method, const String &url);
+  ~AsyncWebServerRequest();
+
+  WebRequestMethodComposite method() const { return _method; }
+  const String &url() const { return _url; }
+
+  size_t params() const { return _params.size(); }
+  bool hasParam(const char *name, bool post = false, bool file = false) const;
+  bool hasParam(const String &name, bool post = false, bool file = false) const { return hasParam(name.c_str(), post, file); }
+  const AsyncWebParameter *getParam(const char *name, bool post = false, bool file = false) const;
+  const AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const { return getParam(name.c_str(), post, file); }
+  const AsyncWebParameter *getParam(size_t num) const { return num < _params.size() ? &_params[num] : nullptr; }
+  const AsyncWebParameter *getParam(int num) const { return getParam((size_t)num); }
+
+  bool hasHeader(const char *name) const { return getHeader(name) != nullptr; }
+  const AsyncWebHeader *getHeader(const char *name) const;
+  const String &header(const char *name) const;
+
+  void send(int code, const char *contentType = "", const char *content = "", AwsTemplateProcessor callback = nullptr);
+  void send(int code, const String &contentType, const String &content = String());
+  void send(int code, const char *contentType, const uint8_t *content, size_t length, AwsTemplateProcessor callback = nullptr);
+  void send(AsyncWebServerResponse *response);
+  void send_P(int code, const char *contentType, const char *content) { send(code, contentType, content); }
+
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType = "", const char *content = "", AwsTemplateProcessor callback = nullptr);
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType, const uint8_t *content, size_t length, AwsTemplateProcessor callback = nullptr);
+  AsyncWebServerResponse *beginResponse(const char *contentType, size_t length, AwsResponseFiller filler, AwsTemplateProcessor callback = nullptr);
+  AsyncWebServerResponse *beginChunkedResponse(const char *contentType, AwsResponseFiller filler, AwsTemplateProcessor callback = nullptr);
+  AsyncResponseStream *beginResponseStream(const char *contentType, size_t bufferSize = 1460);
+
+  void onDisconnect(std::function<void()> fn) { disconnectHandlers.push_back(fn); }
+
+  // --- Native test hooks ---
+  void nativeAddParam(const String &name, const String &value, bool post);
+  void nativeAddHeader(const String &name, const String &value);
+  /**
+   * @brief Renders the sent response and runs the disconnect callbacks.
+   */
+  NativeResponse nativeFinish();
+
+private:
+  WebRequestMethodComposite _method;
+  String _url;
+  std::vector<AsyncWebParameter> _params;
+  std::vector<AsyncWebHeader> _headers;
+  AsyncWebServerResponse *response = nullptr;
+  std::vector<std::function<void()>> disconnectHandlers;
+};
+
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool)> ArUploadHandlerFunction;
+
+class AsyncWebHandler {
+public:
+  virtual ~AsyncWebHandler() {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+  std::string uri;
+  WebRequestMethodComposite method;
+  ArRequestHandlerFunction onRequest;
+  ArBodyHandlerFunction onBody;
+};
+
+class AsyncEventSourceClient {
+public:
+  struct Event {
+    std::string event;
+    std::string data;
+    uint32_t id;
+  };
+
+  bool send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t packetsWaiting() const { return nativePacketsWaiting; }
+  bool connected() const { return !nativeClosed; }
+  void close() { nativeClosed = true; }
+  uint32_t lastId() const { return _lastId; }
+
+  std::vector<Event> nativeEvents;  // everything sent to this client
+  size_t nativePacketsWaiting = 0;  // reported by packetsWaiting(), to play a slow client
+  bool nativeClosed = false;        // close() was called
+
+private:
+  uint32_t _lastId = 0;
+};
+
+typedef std::function<void(AsyncEventSourceClient *)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+public:
+  AsyncEventSource(const char *url) : _url(url) {}
+  const char *url() const { return _url.c_str(); }
+  void onConnect(ArEventHandlerFunction callback) { connectHandler = callback; }
+  void onDisconnect(ArEventHandlerFunction callback) { disconnectHandler = callback; }
+  void send(const char *message, const char *event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t count() const { return clients.size(); }
+  size_t avgPacketsWaiting() const { return 0; }
+
+  AsyncEventSourceClient *nativeConnect();
+  void nativeDisconnect(AsyncEventSourceClient *client);
+
+private:
+  std::string _url;
+  ArEventHandlerFunction connectHandler;
+  ArEventHandlerFunction disconnectHandler;
+  std::vector<std::unique_ptr<AsyncEventSourceClient>> clients;
+};
+
+class AsyncWebServer {
+public:
+  AsyncWebServer(uint16_t port) {}
+  void begin() { started = true; }
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                              ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody = nullptr);
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+  void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+
+  // --- Native test hooks ---
+
+  /**
+   * @brief Runs one request through the registered routes.
+   * @param url Path, optionally with a query string (its values are GET parameters).
+   * @param params Form fields of a POST (POST parameters) or extra GET parameters.
+   * @param headers Request headers, e.g. {"If-None-Match", "\"3-1a\""}.
+   */
+  NativeResponse nativeRequest(WebRequestMethodComposite method, const char *url, const NativeParams &params = {},
+                               const NativeParams &headers = {});
+
+  /**
+   * @brief Connects a Server-Sent Events client to the event source registered at `url`, or returns nullptr.
+   */
+  AsyncEventSourceClient *nativeConnectEvents(const char *url);
+
+#ifdef __linux__
+  /**
+   * @brief Opens a non-blocking HTTP/1.0 listener on `port`, all interfaces (daemon builds).
+   * @return false if the port could not be bound.
+   */
+  bool nativeListen(uint16_t port);
+
+  /**
+   * @brief Answers the connections waiting on the listener through nativeRequest().
+   * One request per connection (Connection: close); /events is not streamed,
+   * so the page falls back to polling /data.
+   */
+  void nativeServe();
+#endif
+
+  bool started = false;
+
+private:
+#ifdef __linux__
+  void nativeServeConnection(int connection);
+  int listener = -1;
+#endif
+  std::vector<std::unique_ptr<AsyncCallbackWebHandler>> routes;
+  std::vector<AsyncWebHandler *> handlers;
+  ArRequestHandlerFunction notFound;
+};
@@ -0,0 +1,150 @@
+#include "LittleFS.h"
+
+fs::FS LittleFS;
+
+// LittleFS allocates whole blocks to a file.
+static const size_t NATIVE_BLOCK_SIZE = 4096;
+
+namespace fs {
+
+struct NativeFileHandle {
+  FS *fs;
+  std::string name;
+  std::shared_ptr<std::vector<uint8_t>> data;
+  size_t pos = 0;
+  bool readable = false;
+  bool writable = false;
+  bool append = false;
+  bool open = true;
+};
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!*this || !handle->writable || handle->fs->nativeWriteFails) {
+    return 0;
+  }
+  std::vector<uint8_t> &data = *handle->data;
+  if (handle->append) {
+    handle->pos = data.size();
+  }
+  if (handle->pos + size > data.size()) {
+    data.resize(handle->pos + size);
+  }
+  memcpy(data.data() + handle->pos, buffer, size);
+  handle->pos += size;
+  handle->fs->nativeBytesWritten += size;
+  return size;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!*this || !handle->readable) {
+    return 0;
+  }
+  const std::vector<uint8_t> &data = *handle->data;
+  size_t count = handle->pos < data.size() ? min(size, data.size() - handle->pos) : 0;
+  memcpy(buffer, data.data() + handle->pos, count);
+  handle->pos += count;
+  return count;
+}
+
+int File::available() {
+  return *this && handle->pos < handle->data->size() ? handle->data->size() - handle->pos : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this) {
+    return false;
+  }
+  size_t base = mode == SeekSet ? 0 : mode == SeekCur ? handle->pos : handle->data->size();
+  if (base + pos > handle->data->size()) {
+    return false;
+  }
+  handle->pos = base + pos;
+  return true;
+}
+
+size_t File::position() const {
+  return *this ? handle->pos : 0;
+}
+
+size_t File::size() const {
+  return *this ? handle->data->size() : 0;
+}
+
+void File::close() {
+  if (handle) {
+    handle->open = false;
+  }
+}
+
+const char *File::name() const {
+  return handle ? handle->name.c_str() : "";
+}
+
+File::operator bool() const {
+  return handle && handle->open;
+}
+
+bool FS::info(FSInfo &info) {
+  info.totalBytes = nativeTotalBytes;
+  info.usedBytes = 2 * NATIVE_BLOCK_SIZE;
+  for (const auto &file : files) {
+    info.usedBytes += (file.second->size() + NATIVE_BLOCK_SIZE - 1) / NATIVE_BLOCK_SIZE * NATIVE_BLOCK_SIZE;
+  }
+  info.blockSize = NATIVE_BLOCK_SIZE;
+  info.pageSize = 256;
+  info.maxOpenFiles = 5;
+  info.maxPathLength = 32;
+  return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+  bool plus = strchr(mode, '+') != nullptr;
+  auto found = files.find(path);
+  if (mode[0] == 'r' && found == files.end()) {
+    return File();
+  }
+  if (found == files.end()) {
+    found = files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+  }
+  std::shared_ptr<NativeFileHandle> handle = std::make_shared<NativeFileHandle>();
+  handle->fs = this;
+  handle->name = path[0] == '/' ? path + 1 : path;
+  handle->data = found->second;
+  handle->readable = mode[0] == 'r' || plus;
+  handle->writable = mode[0] != 'r' || plus;
+  handle->append = mode[0] == 'a';
+  if (mode[0] == 'w') {
+    handle->data->clear();
+  }
+  return File(handle);
+}
+
+bool FS::exists(const char *path) {
+  return files.count(path) != 0;
+}
+
+bool FS::remove(const char *path) {
+  return files.erase(path) != 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  auto found = files.find(from);
+  if (found == files.end()) {
+    return false;
+  }
+  std::shared_ptr<std::vector<uint8_t>> data = found->second;
+  files.erase(found);
+  files[to] = data;
+  return true;
+}
+
+void FS::nativeFormat() {
+  files.clear();
+}
+
+}  // namespace fs
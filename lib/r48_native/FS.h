@@ -0,0 +1,91 @@
+// Host stand-in for the ESP8266 core's file system API (FS.h).
+//
+// Files live in memory for the life of the process, keyed by path, so a
+// test starts from whatever the previous test left behind unless it calls
+// nativeFormat(). Open handles share the file's contents: a file removed
+// or renamed while open stays readable through the handle, as on LittleFS.
+// Directories are implied by the paths and not modelled.
+
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+struct NativeFileHandle;
+
+class File : public Print {
+public:
+  File() {}
+  explicit File(std::shared_ptr<NativeFileHandle> handle) : handle(handle) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  int available();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void flush() {}
+  void close();
+  const char *name() const;
+  operator bool() const;
+
+private:
+  std::shared_ptr<NativeFileHandle> handle;
+};
+
+class FS {
+public:
+  bool begin() { return true; }
+  void end() {}
+  bool format() { nativeFormat(); return true; }
+  bool info(FSInfo &info);
+
+  /**
+   * @param mode "r", "w" or "a", optionally with "+".
+   */
+  File open(const char *path, const char *mode);
+  File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+
+  // --- Native test hooks ---
+  void nativeFormat();
+  uint32_t nativeBytesWritten = 0;  // every byte written since the start, like flash wear
+  size_t nativeTotalBytes = 1024 * 1024;
+  bool nativeWriteFails = false;    // writes store nothing and return 0, like a full or failing partition
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
+using fs::SeekMode;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
@@ -0,0 +1,7 @@
+// Host stand-in for the ESP8266 core's LittleFS; see FS.h.
+
+#pragma once
+
+#include <FS.h>
+
+extern fs::FS LittleFS;
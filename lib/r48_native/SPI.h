@@ -0,0 +1,46 @@
+// Host stand-in for the ESP8266 SPI driver. The simulated MCP2515 is mostly
+// driven through mcp_can; the few raw transfers the controller makes itself
+// reach the device set in SPI.nativeDevice.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+
+struct SPISettings {
+  SPISettings() {}
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+// Something on the SPI bus that sees the controller's raw transfers.
+class NativeSpiDevice {
+public:
+  virtual ~NativeSpiDevice() {}
+  /**
+   * @brief Called for every byte transferred.
+   * @param index Position of the byte since beginTransaction().
+   * @return The byte clocked back out.
+   */
+  virtual uint8_t nativeSpiTransfer(uint8_t index, uint8_t value) = 0;
+};
+
+class SPIClass {
+public:
+  void begin() {}
+  void beginTransaction(SPISettings) {
+    index = 0;
+  }
+  uint8_t transfer(uint8_t value) {
+    return nativeDevice != nullptr ? nativeDevice->nativeSpiTransfer(index++, value) : 0xFF;
+  }
+  void endTransaction() {}
+
+  NativeSpiDevice *nativeDevice = nullptr;
+
+private:
+  uint8_t index = 0;
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,133 @@
+#include "WiFiUdp.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+std::deque<NativeDatagram> WiFiUDP::nativeOutbox;
+#ifdef __linux__
+bool WiFiUDP::nativeSockets = false;
+#endif
+
+// Bound instances, for nativeSend().
+static std::vector<WiFiUDP *> bound;
+
+WiFiUDP::~WiFiUDP() {
+  stop();
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  stop();
+#ifdef __linux__
+  if (nativeSockets) {
+    socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socketFd < 0) {
+      return 0;
+    }
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(socketFd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+      close(socketFd);
+      socketFd = -1;
+      return 0;
+    }
+  }
+#endif
+  localPort = port;
+  bound.push_back(this);
+  return 1;
+}
+
+void WiFiUDP::stop() {
+#ifdef __linux__
+  if (socketFd >= 0) {
+    close(socketFd);
+    socketFd = -1;
+  }
+#endif
+  bound.erase(std::remove(bound.begin(), bound.end(), this), bound.end());
+  inbox.clear();
+  localPort = 0;
+}
+
+int WiFiUDP::parsePacket() {
+  readPosition = 0;
+#ifdef __linux__
+  if (socketFd >= 0) {
+    char buffer[1500];
+    struct sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t len = recvfrom(socketFd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &fromLen);
+    if (len < 0) {
+      current.data.clear();
+      return 0;
+    }
+    const uint8_t *octets = (const uint8_t *)&from.sin_addr.s_addr;
+    current.address = IPAddress(octets[0], octets[1], octets[2], octets[3]);
+    current.port = ntohs(from.sin_port);
+    current.data.assign(buffer, len);
+    return len;
+  }
+#endif
+  if (inbox.empty()) {
+    current.data.clear();
+    return 0;
+  }
+  current = inbox.front();
+  inbox.pop_front();
+  return current.data.size();
+}
+
+int WiFiUDP::available() {
+  return current.data.size() - readPosition;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t len) {
+  size_t count = std::min(len, current.data.size() - readPosition);
+  memcpy(buffer, current.data.data() + readPosition, count);
+  readPosition += count;
+  return count;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  outgoing.address = ip;
+  outgoing.port = port;
+  outgoing.data.clear();
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size) {
+  outgoing.data.append((const char *)buffer, size);
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+#ifdef __linux__
+  if (socketFd >= 0) {
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = (uint32_t)outgoing.address;
+    to.sin_port = htons(outgoing.port);
+    return sendto(socketFd, outgoing.data.data(), outgoing.data.size(), 0, (struct sockaddr *)&to, sizeof(to)) >= 0;
+  }
+#endif
+  nativeOutbox.push_back(outgoing);
+  return 1;
+}
+
+bool WiFiUDP::nativeSend(uint16_t port, const void *data, size_t len, IPAddress from, uint16_t fromPort) {
+  for (WiFiUDP *udp : bound) {
+    if (udp->localPort == port) {
+      udp->inbox.push_back({from, fromPort, std::string((const char *)data, len)});
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,63 @@
+// Host stand-in for the ESP8266 core's WiFiUDP.
+//
+// Datagrams come from WiFiUDP::nativeSend() instead of the network: it
+// queues one for whichever instance is bound to the port, and
+// parsePacket() takes them out in order. Datagrams the sketch sends go to
+// nativeOutbox.
+//
+// On Linux, setting nativeSockets before begin() binds a real UDP socket
+// instead (daemon builds).
+
+#pragma once
+
+#include <Arduino.h>
+#include <deque>
+#include <string>
+
+struct NativeDatagram {
+  IPAddress address;    // sender, or destination for the outbox
+  uint16_t port;
+  std::string data;
+};
+
+class WiFiUDP {
+public:
+  ~WiFiUDP();
+
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  /**
+   * @brief Takes the next datagram; returns its size, 0 if none is waiting.
+   */
+  int parsePacket();
+  int available();
+  int read(uint8_t *buffer, size_t len);
+  int read(char *buffer, size_t len) { return read((uint8_t *)buffer, len); }
+  IPAddress remoteIP() { return current.address; }
+  uint16_t remotePort() { return current.port; }
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  size_t write(const uint8_t *buffer, size_t size);
+  int endPacket();
+
+  /**
+   * @brief Delivers a datagram to the instance bound to `port`.
+   * @return false if nothing is bound to it.
+   */
+  static bool nativeSend(uint16_t port, const void *data, size_t len, IPAddress from = IPAddress(192, 168, 1, 10),
+                         uint16_t fromPort = 40000);
+
+  static std::deque<NativeDatagram> nativeOutbox;
+#ifdef __linux__
+  static bool nativeSockets;
+#endif
+
+private:
+  uint16_t localPort = 0;
+  std::deque<NativeDatagram> inbox;
+  NativeDatagram current;
+  size_t readPosition = 0;
+  NativeDatagram outgoing;
+  int socketFd = -1;
+};
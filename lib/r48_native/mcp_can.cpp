@@ -0,0 +1,201 @@
+#include "mcp_can.h"
+
+MCP_CAN::MCP_CAN(INT8U) {}
+
+INT8U MCP_CAN::begin(INT8U idmodeset, INT8U, INT8U) {
+  idMode = idmodeset;
+  mode = MCP_LOOPBACK;
+  initialised = true;
+  errorFlags = 0;
+  SPI.nativeDevice = this;
+  for (uint8_t i = 0; i < 2; i++) masks[i] = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    filters[i] = 0;
+    filterExt[i] = false;
+  }
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::init_Mask(INT8U num, INT8U, INT32U ulData) {
+  if (num > 1) {
+    return CAN_FAIL;
+  }
+  masks[num] = ulData & 0x1FFFFFFF;
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::init_Mask(INT8U num, INT32U ulData) {
+  return init_Mask(num, (ulData & 0x80000000) ? 1 : 0, ulData);
+}
+
+INT8U MCP_CAN::init_Filt(INT8U num, INT8U ext, INT32U ulData) {
+  if (num > 5) {
+    return CAN_FAIL;
+  }
+  filters[num] = ulData & 0x1FFFFFFF;
+  filterExt[num] = ext != 0;
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::init_Filt(INT8U num, INT32U ulData) {
+  return init_Filt(num, (ulData & 0x80000000) ? 1 : 0, ulData);
+}
+
+INT8U MCP_CAN::setMode(INT8U opMode) {
+  mode = opMode;
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf) {
+  if (!initialised || mode == MCP_SLEEP || mode == MCP_LISTENONLY) {
+    return CAN_FAILTX;
+  }
+  if (nativeFailSends > 0) {
+    nativeFailSends--;
+    return CAN_FAILTX;
+  }
+  if (len > 8) {
+    len = 8;
+  }
+  nativeSent++;
+  id &= ext ? 0x1FFFFFFF : 0x7FF;
+  if (mode == MCP_LOOPBACK) {
+    nativeInject(id, len, buf);
+    return CAN_OK;
+  }
+  for (NativeCanNode *node : nodes) {
+    node->onFrame(id, len, buf);
+  }
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U len, INT8U *buf) {
+  return sendMsgBuf(id, (id & 0x80000000) ? 1 : 0, len, buf);
+}
+
+INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U *buf) {
+  deliver();
+  // Like the chip, RXB0 is read before RXB1.
+  uint8_t n = bufferFull[0] ? 0 : 1;
+  if (!bufferFull[n]) {
+    return CAN_NOMSG;
+  }
+  const Frame &frame = buffers[n];
+  *id = frame.id;
+  *ext = frame.ext ? 1 : 0;
+  *len = frame.len;
+  memcpy(buf, frame.data, frame.len);
+  bufferFull[n] = false;
+  return CAN_OK;
+}
+
+INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *len, INT8U *buf) {
+  INT8U ext;
+  INT8U result = readMsgBuf(id, &ext, len, buf);
+  if (result == CAN_OK && ext) {
+    *id |= 0x80000000;
+  }
+  return result;
+}
+
+INT8U MCP_CAN::checkReceive(void) {
+  deliver();
+  return bufferFull[0] || bufferFull[1] ? CAN_MSGAVAIL : CAN_NOMSG;
+}
+
+INT8U MCP_CAN::checkError(void) {
+  return errorFlags ? CAN_CTRLERROR : CAN_OK;
+}
+
+INT8U MCP_CAN::getError(void) {
+  deliver();
+  return errorFlags;
+}
+
+INT8U MCP_CAN::errorCountRX(void) {
+  return 0;
+}
+
+INT8U MCP_CAN::errorCountTX(void) {
+  return 0;
+}
+
+// --- Native test hooks ---
+
+void MCP_CAN::nativeAttach(NativeCanNode *node) {
+  nodes.push_back(node);
+}
+
+void MCP_CAN::nativeInject(unsigned long id, byte len, const byte *data, unsigned long delayUs) {
+  Frame frame;
+  frame.id = id & 0x1FFFFFFF;
+  frame.ext = true;
+  frame.len = len > 8 ? 8 : len;
+  memcpy(frame.data, data, frame.len);
+  frame.arrival = micros() + delayUs;
+
+  // Keep the bus ordered by arrival; equal arrivals keep their injection order.
+  auto position = bus.end();
+  while (position != bus.begin() && (long)((position - 1)->arrival - frame.arrival) > 0) {
+    --position;
+  }
+  bus.insert(position, frame);
+}
+
+int MCP_CAN::nativeIntLevel() {
+  deliver();
+  return bufferFull[0] || bufferFull[1] ? LOW : HIGH;
+}
+
+uint8_t MCP_CAN::nativeSpiTransfer(uint8_t index, uint8_t value) {
+  if (index < 3) {
+    spiBytes[index] = value;
+  } else if (index == 3 && spiBytes[0] == MCP_BITMOD && spiBytes[1] == MCP_EFLG) {
+    // Only the receive overflow bits of EFLG are writable.
+    uint8_t mask = spiBytes[2] & (MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR);
+    errorFlags = (errorFlags & ~mask) | (value & mask);
+  }
+  return 0xFF;
+}
+
+bool MCP_CAN::matches(const Frame &frame, uint8_t mask, uint8_t firstFilter, uint8_t filterCount) const {
+  for (uint8_t i = firstFilter; i < firstFilter + filterCount; i++) {
+    if (filterExt[i] == frame.ext && (frame.id & masks[mask]) == (filters[i] & masks[mask])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Moves the frames that have arrived by now from the bus into the receive buffers.
+ */
+void MCP_CAN::deliver() {
+  unsigned long now = micros();
+  size_t arrived = 0;
+  while (arrived < bus.size() && (long)(now - bus[arrived].arrival) >= 0) {
+    const Frame &frame = bus[arrived++];
+    if (mode != MCP_NORMAL && mode != MCP_LOOPBACK && mode != MCP_LISTENONLY) {
+      continue;
+    }
+
+    bool toRxb0 = idMode == MCP_ANY || matches(frame, 0, 0, 2);
+    bool toRxb1 = idMode == MCP_ANY || matches(frame, 1, 2, 4);
+    if (!toRxb0 && !toRxb1) {
+      nativeFiltered++;
+      continue;
+    }
+    // RXB0 rolls over into RXB1 when it is full (mcp_can sets BUKT).
+    if (toRxb0 && !bufferFull[0]) {
+      buffers[0] = frame;
+      bufferFull[0] = true;
+    } else if (!bufferFull[1]) {
+      buffers[1] = frame;
+      bufferFull[1] = true;
+    } else {
+      errorFlags |= toRxb0 && !toRxb1 ? MCP_EFLG_RX0OVR : MCP_EFLG_RX1OVR;
+      nativeOverflows++;
+    }
+  }
+  bus.erase(bus.begin(), bus.begin() + arrived);
+}
@@ -0,0 +1,130 @@
+// Host stand-in for the mcp_can 1.5.1 MCP2515 driver.
+//
+// Behaves like the chip as far as the controller can tell: two receive
+// buffers (RXB0 rolls over into RXB1), the acceptance masks and filters
+// programmed with init_Mask()/init_Filt(), RX0OVR/RX1OVR when a frame
+// arrives while both buffers are full, and an INT line that is low while
+// a buffer holds a frame. Frames travel on a virtual bus: a node attached
+// with nativeAttach() sees every transmitted frame and answers through
+// nativeInject() with an arrival delay measured on the virtual clock.
+// Raw BIT MODIFY transfers on SPI clear bits of EFLG, as on the chip.
+
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <vector>
+
+#define CAN_OK 0
+#define CAN_FAILINIT 1
+#define CAN_FAILTX 2
+#define CAN_MSGAVAIL 3
+#define CAN_NOMSG 4
+#define CAN_CTRLERROR 5
+#define CAN_GETTXBFTIMEOUT 6
+#define CAN_SENDMSGTIMEOUT 7
+#define CAN_FAIL 0xff
+
+#define MCP_ANY 0
+#define MCP_STD 1
+#define MCP_EXT 2
+#define MCP_STDEXT 3
+
+#define MCP_NORMAL 0x00
+#define MCP_SLEEP 0x20
+#define MCP_LOOPBACK 0x40
+#define MCP_LISTENONLY 0x60
+
+#define MCP_8MHZ 1
+#define MCP_16MHZ 0
+#define CAN_125KBPS 10
+#define CAN_250KBPS 12
+#define CAN_500KBPS 15
+
+#define MCP_BITMOD 0x05
+#define MCP_EFLG 0x2D
+#define MCP_EFLG_RX1OVR (1 << 7)
+#define MCP_EFLG_RX0OVR (1 << 6)
+
+typedef uint8_t INT8U;
+typedef unsigned long INT32U;
+
+// Something on the virtual bus that receives the controller's frames.
+class NativeCanNode {
+public:
+  virtual ~NativeCanNode() {}
+  /**
+   * @brief Called for every frame the controller transmits.
+   * @param id The 29-bit ID (without the extended flag).
+   */
+  virtual void onFrame(unsigned long id, byte len, const byte *data) = 0;
+};
+
+class MCP_CAN : public NativeSpiDevice {
+public:
+  MCP_CAN(INT8U cs);
+  INT8U begin(INT8U idmodeset, INT8U speedset, INT8U clockset);
+  INT8U init_Mask(INT8U num, INT8U ext, INT32U ulData);
+  INT8U init_Mask(INT8U num, INT32U ulData);
+  INT8U init_Filt(INT8U num, INT8U ext, INT32U ulData);
+  INT8U init_Filt(INT8U num, INT32U ulData);
+  INT8U setMode(INT8U opMode);
+  INT8U sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf);
+  INT8U sendMsgBuf(INT32U id, INT8U len, INT8U *buf);
+  INT8U readMsgBuf(INT32U *id, INT8U *ext, INT8U *len, INT8U *buf);
+  INT8U readMsgBuf(INT32U *id, INT8U *len, INT8U *buf);
+  INT8U checkReceive(void);
+  INT8U checkError(void);
+  INT8U getError(void);
+  INT8U errorCountRX(void);
+  INT8U errorCountTX(void);
+
+  // --- Native test hooks ---
+
+  /**
+   * @brief Connects a node (e.g. the R48 simulator) that sees every transmitted frame.
+   */
+  void nativeAttach(NativeCanNode *node);
+
+  /**
+   * @brief Puts an extended frame on the bus; it reaches the receive buffers after `delayUs`.
+   */
+  void nativeInject(unsigned long id, byte len, const byte *data, unsigned long delayUs = 0);
+
+  /**
+   * @brief Level of the INT output: LOW while a receive buffer holds a frame.
+   */
+  int nativeIntLevel();
+
+  uint8_t nativeSpiTransfer(uint8_t index, uint8_t value) override;
+
+  uint32_t nativeSent = 0;       // frames transmitted
+  uint32_t nativeFiltered = 0;   // frames rejected by the acceptance filters
+  uint32_t nativeOverflows = 0;  // frames lost because both receive buffers were full
+  uint32_t nativeFailSends = 0;  // the next this many sendMsgBuf() calls fail with CAN_FAILTX
+
+private:
+  struct Frame {
+    unsigned long id;
+    bool ext;
+    byte len;
+    byte data[8];
+    unsigned long arrival; // micros()
+  };
+
+  void deliver();
+  bool matches(const Frame &frame, uint8_t mask, uint8_t firstFilter, uint8_t filterCount) const;
+
+  std::vector<NativeCanNode *> nodes;
+  std::vector<Frame> bus;   // in flight, ordered by arrival
+  Frame buffers[2];         // RXB0, RXB1
+  bool bufferFull[2] = {};
+  uint8_t errorFlags = 0;
+  uint8_t spiBytes[3] = {};  // instruction, address and mask of the raw transfer in progress
+  bool initialised = false;
+  INT8U idMode = MCP_ANY;
+  INT8U mode = MCP_LOOPBACK; // mcp_can leaves the chip in loopback after begin()
+  unsigned long masks[2] = {};
+  unsigned long filters[6] = {};
+  bool filterExt[6] = {};
+};
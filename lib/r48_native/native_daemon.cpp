@@ -0,0 +1,54 @@
+// Entry point of the Linux daemon build ([env:linux], R48_DAEMON).
+//
+// Runs the unchanged sketch against a real SocketCAN interface: setup()
+// once, then loop() forever with the virtual clock following the host's,
+// and the web routes served on R48_HTTP_PORT (default 8080). UDP sockets
+// are real too. Serial output goes to stdout.
+
+#ifdef R48_DAEMON
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <WiFiUdp.h>
+#include <chrono>
+#include <unistd.h>
+
+void setup();
+void loop();
+extern AsyncWebServer server;
+
+// Idle time per iteration; keeps an idle daemon off the CPU while staying
+// far below the 1 ms resolution the sketch schedules with.
+static const useconds_t DAEMON_IDLE_US = 250;
+
+int main() {
+  Serial.echo = true;
+  WiFiUDP::nativeSockets = true;
+
+  typedef std::chrono::steady_clock HostClock;
+  HostClock::time_point last = HostClock::now();
+  auto followHostClock = [&last]() {
+    HostClock::time_point now = HostClock::now();
+    nativeClockAdvance(std::chrono::duration_cast<std::chrono::microseconds>(now - last).count());
+    last = now;
+  };
+
+  setup();
+
+  const char *portText = getenv("R48_HTTP_PORT");
+  uint16_t port = portText != nullptr ? atoi(portText) : 8080;
+  if (!server.nativeListen(port)) {
+    fprintf(stderr, "Cannot listen on port %u\n", port);
+    return 1;
+  }
+  printf("Web UI on http://localhost:%u/\n", port);
+
+  while (true) {
+    followHostClock();
+    loop();
+    server.nativeServe();
+    usleep(DAEMON_IDLE_US);
+  }
+}
+
+#endif
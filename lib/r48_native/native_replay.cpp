@@ -0,0 +1,135 @@
+// Entry point of the replay program ([env:replay], R48_REPLAY).
+//
+// Feeds capture files (see can_capture.h) back through the unchanged
+// sketch: every received frame goes to handleCanFrame() after the virtual
+// clock has been advanced by its recorded delta, with loop() running in
+// between, so a field incident plays out as it did on the device, only as
+// fast as the host can go. Frames the controller sent are not re-sent;
+// its own requests go to the stand-in bus and are ignored.
+//
+//   program [--dump] [--quiet] can3.bin can2.bin can1.bin can0.bin
+//
+// Files are played in the order given, so list them oldest first.
+// --dump prints every record in candump's log format instead of replaying;
+// --quiet suppresses the sketch's Serial output. At the end the replay
+// prints the frame counts, the speed-up over the recorded time and /data.
+
+#ifdef R48_REPLAY
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <chrono>
+#include <vector>
+
+#include "can_capture.h"
+#include "can_driver.h"
+
+void setup();
+void loop();
+void handleCanFrame(const CanFrame &frame);
+extern AsyncWebServer server;
+
+static bool readFile(const char *path, std::vector<uint8_t> &content) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint8_t chunk[4096];
+  size_t count;
+  while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    content.insert(content.end(), chunk, chunk + count);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  bool dump = false;
+  bool quiet = false;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--dump") == 0) {
+      dump = true;
+    } else if (strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "usage: %s [--dump] [--quiet] capture.bin...\n", argv[0]);
+    return 2;
+  }
+
+  Serial.echo = !quiet && !dump;
+  if (!dump) {
+    setup();
+  }
+
+  uint32_t received = 0;
+  uint32_t sent = 0;
+  uint64_t recordedMicros = 0;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (const char *path : paths) {
+    std::vector<uint8_t> content;
+    if (!readFile(path, content)) {
+      fprintf(stderr, "%s: cannot read\n", path);
+      return 1;
+    }
+    CaptureFileHeader header;
+    if (content.size() < sizeof(header) || memcmp(content.data(), "R48C", 4) != 0) {
+      fprintf(stderr, "%s: not a capture file\n", path);
+      return 1;
+    }
+    memcpy(&header, content.data(), sizeof(header));
+
+    size_t offset = header.headerSize;
+    uint64_t fileMicros = 0;
+    CaptureRecord record;
+    while (canCaptureDecode(content.data(), content.size(), offset, record)) {
+      fileMicros += record.deltaMicros;
+      recordedMicros += record.deltaMicros;
+      if (dump) {
+        // candump -l format, timestamps in seconds of the device's uptime
+        uint64_t at = (uint64_t)header.baseMillis * 1000 + fileMicros;
+        printf("(%010llu.%06llu) %s %0*lX#", (unsigned long long)(at / 1000000), (unsigned long long)(at % 1000000),
+               record.sent ? "tx" : "rx", record.id & CAN_EXTENDED_FLAG ? 8 : 3, record.id & 0x1FFFFFFFUL);
+        for (byte i = 0; i < record.len; i++) {
+          printf("%02X", record.data[i]);
+        }
+        printf("\n");
+        continue;
+      }
+
+      nativeClockAdvance(record.deltaMicros);
+      if (record.sent) {
+        sent++;
+      } else {
+        CanFrame frame;
+        frame.id = record.id;
+        frame.timestamp = millis();
+        frame.len = record.len;
+        memcpy(frame.data, record.data, record.len);
+        handleCanFrame(frame);
+        received++;
+      }
+      loop();
+    }
+    if (offset != content.size()) {
+      fprintf(stderr, "%s: stopped at a damaged record, offset %zu of %zu\n", path, offset, content.size());
+    }
+  }
+  if (dump) {
+    return 0;
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  printf("\nReplayed %u received frames (%u sent frames skipped), %.1f s of traffic in %.3f s (%.0fx real time)\n",
+         (unsigned)received, (unsigned)sent, recordedMicros / 1e6, wallSeconds,
+         wallSeconds > 0 ? recordedMicros / 1e6 / wallSeconds : 0.0);
+  printf("%s\n", server.nativeRequest(HTTP_GET, "/data").body.c_str());
+  return 0;
+}
+
+#endif
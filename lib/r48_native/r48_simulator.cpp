@@ -0,0 +1,214 @@
+#include "r48_simulator.h"
+
+// Registers of the settings the simulator interprets; any other write is stored as is.
+static const byte REG_ONLINE_VOLTAGE = 0x21;
+static const byte REG_ONLINE_CURRENT_LIMIT = 0x22;
+
+R48Simulator::R48Simulator(MCP_CAN &can, uint8_t intPin) : can(can) {
+  can.nativeAttach(this);
+  nativeSetPinReader(intPin, [&can]() { return can.nativeIntLevel(); });
+}
+
+static void putFloat(R48SimUnit &unit, byte registerNo, float value) {
+  r48PutFloat(unit.stored[registerNo], value);
+  unit.known[registerNo] = true;
+}
+
+R48SimUnit &R48Simulator::addUnit(byte address) {
+  units.emplace_back();
+  R48SimUnit &unit = units.back();
+  unit.address = address;
+  unit.answering = true;
+  unit.loadCurrent = 0;
+  unit.batteryVoltage = 0;
+  unit.batteryResistance = 0;
+  unit.supplyVoltage = 230.0f;
+  unit.ambient = 25.0f;
+  memset(unit.stored, 0, sizeof(unit.stored));
+  memset(unit.known, 0, sizeof(unit.known));
+  unit.onlineVoltage = NAN;
+  unit.onlineCurrentLimit = NAN;
+  unit.onlineVoltageAt = 0;
+  unit.onlineCurrentLimitAt = 0;
+
+  putFloat(unit, SET_PERMANENT_VOLTAGE_CMD, 53.5f);
+  putFloat(unit, SET_PERMANENT_CURRENT_LIMIT_CMD, 1.0f);
+  putFloat(unit, SET_PERMANENT_MAX_INPUT_CURRENT_CMD, 13.0f);
+  putFloat(unit, 0x29, 8.0f);  // walk-in time
+  unit.known[0x32] = true;     // walk-in off
+  unit.known[0x33] = true;     // fan auto
+  for (byte m = OUTPUT_VOLTAGE; m <= SUPPLY_VOLTAGE; m++) {
+    unit.known[m] = true;
+  }
+  return unit;
+}
+
+R48SimUnit *R48Simulator::unit(byte address) {
+  for (R48SimUnit &unit : units) {
+    if (unit.address == address) {
+      return &unit;
+    }
+  }
+  return nullptr;
+}
+
+void R48Simulator::setAnswering(byte address, bool answering) {
+  R48SimUnit *u = unit(address);
+  if (u) u->answering = answering;
+}
+
+void R48Simulator::setLoad(byte address, float amps) {
+  R48SimUnit *u = unit(address);
+  if (u) {
+    u->loadCurrent = amps;
+    u->batteryResistance = 0;
+  }
+}
+
+void R48Simulator::setBattery(byte address, float openCircuitVoltage, float resistance) {
+  R48SimUnit *u = unit(address);
+  if (u) {
+    u->batteryVoltage = openCircuitVoltage;
+    u->batteryResistance = resistance;
+  }
+}
+
+float R48Simulator::storedFloat(const R48SimUnit &unit, byte registerNo) const {
+  return r48GetFloat(unit.stored[registerNo]);
+}
+
+/**
+ * @brief Applies the permanent writes that have been stored by now and expires stale online settings.
+ */
+void R48Simulator::settle(R48SimUnit &unit) {
+  unsigned long now = millis();
+  for (size_t i = 0; i < unit.pending.size();) {
+    R48SimUnit::PendingWrite &write = unit.pending[i];
+    if ((long)(now - write.at) < 0) {
+      i++;
+      continue;
+    }
+    if (write.registerNo == REG_ONLINE_VOLTAGE) {
+      unit.onlineVoltage = r48GetFloat(write.value);
+      unit.onlineVoltageAt = write.at;
+    } else if (write.registerNo == REG_ONLINE_CURRENT_LIMIT) {
+      unit.onlineCurrentLimit = r48GetFloat(write.value);
+      unit.onlineCurrentLimitAt = write.at;
+    } else {
+      memcpy(unit.stored[write.registerNo], write.value, 4);
+      unit.known[write.registerNo] = true;
+    }
+    unit.pending.erase(unit.pending.begin() + i);
+  }
+
+  if (onlineHoldMs > 0) {
+    if (!isnan(unit.onlineVoltage) && now - unit.onlineVoltageAt > onlineHoldMs) {
+      unit.onlineVoltage = NAN;
+    }
+    if (!isnan(unit.onlineCurrentLimit) && now - unit.onlineCurrentLimitAt > onlineHoldMs) {
+      unit.onlineCurrentLimit = NAN;
+    }
+  }
+}
+
+float R48Simulator::setpointVoltage(R48SimUnit &unit) {
+  settle(unit);
+  return isnan(unit.onlineVoltage) ? storedFloat(unit, SET_PERMANENT_VOLTAGE_CMD) : unit.onlineVoltage;
+}
+
+float R48Simulator::currentLimit(R48SimUnit &unit) {
+  settle(unit);
+  return isnan(unit.onlineCurrentLimit) ? storedFloat(unit, SET_PERMANENT_CURRENT_LIMIT_CMD) : unit.onlineCurrentLimit;
+}
+
+float R48Simulator::outputCurrent(R48SimUnit &unit) {
+  float limit = currentLimit(unit) * R48_SIM_RATED_CURRENT;
+  if (unit.batteryResistance > 0) {
+    float current = (setpointVoltage(unit) - unit.batteryVoltage) / unit.batteryResistance;
+    return current < 0 ? 0 : min(current, limit);
+  }
+  return min(unit.loadCurrent, limit);
+}
+
+float R48Simulator::outputVoltage(R48SimUnit &unit) {
+  float current = outputCurrent(unit);
+  if (unit.batteryResistance > 0) {
+    // Constant current pulls the output down to what the battery accepts at that current.
+    return min(setpointVoltage(unit), unit.batteryVoltage + current * unit.batteryResistance);
+  }
+  if (current < unit.loadCurrent && unit.loadCurrent > 0) {
+    return setpointVoltage(unit) * current / unit.loadCurrent;
+  }
+  return setpointVoltage(unit);
+}
+
+bool R48Simulator::readRegister(byte address, byte registerNo, float &value) {
+  R48SimUnit *u = unit(address);
+  if (u == nullptr || !u->known[registerNo]) {
+    return false;
+  }
+  settle(*u);
+  switch (registerNo) {
+    case OUTPUT_VOLTAGE: value = outputVoltage(*u); break;
+    case OUTPUT_CURRENT: value = outputCurrent(*u); break;
+    case OUTPUT_CURRENT_LIMIT: value = currentLimit(*u); break;
+    case TEMPERATURE: value = u->ambient + outputCurrent(*u) * 0.3f; break;
+    case SUPPLY_VOLTAGE: value = u->supplyVoltage; break;
+    default: value = storedFloat(*u, registerNo); break;
+  }
+  return true;
+}
+
+void R48Simulator::answer(R48SimUnit &unit, byte registerNo) {
+  float value;
+  if (!unit.answering || !readRegister(unit.address, registerNo, value)) {
+    return;
+  }
+  byte data[8] = {0x41, R48_CONTROLLER_ADDRESS, 0x00, registerNo};
+  if (registerNo >= OUTPUT_VOLTAGE && registerNo <= SUPPLY_VOLTAGE) {
+    r48PutFloat(&data[4], value);
+  } else {
+    settle(unit);
+    memcpy(&data[4], unit.stored[registerNo], 4);
+  }
+
+  // Answers leave one after another, never faster than the bus carries them.
+  seed = seed * 1103515245 + 12345;
+  unsigned long ready = micros() + answerDelayUs + (answerJitterUs ? (seed >> 8) % answerJitterUs : 0);
+  unsigned long arrival = (long)(busFreeAt + frameTimeUs - ready) > 0 ? busFreeAt + frameTimeUs : ready;
+  busFreeAt = arrival;
+  can.nativeInject(r48ResponseId(unit.address), 8, data, arrival - micros());
+  answers++;
+}
+
+void R48Simulator::write(R48SimUnit &unit, const byte *data) {
+  if (!unit.answering) {
+    return;
+  }
+  R48SimUnit::PendingWrite write;
+  write.registerNo = data[3];
+  memcpy(write.value, &data[4], 4);
+  bool online = write.registerNo == REG_ONLINE_VOLTAGE || write.registerNo == REG_ONLINE_CURRENT_LIMIT;
+  write.at = millis() + (online ? onlineApplyMs : storeMs);
+  unit.pending.push_back(write);
+}
+
+void R48Simulator::onFrame(unsigned long id, byte len, const byte *data) {
+  R48Id decoded;
+  if (!r48DecodeId(id, decoded) || decoded.source != R48_CONTROLLER_ADDRESS || len != 8) {
+    return;
+  }
+  // The controller's broadcast read (VERTIV_READ_REQUEST_ID) reaches every unit.
+  for (R48SimUnit &unit : units) {
+    if (decoded.pointToPoint && decoded.destination != unit.address) {
+      continue;
+    }
+    if (data[0] == 0x01) {
+      requests++;
+      answer(unit, data[3]);
+    } else if (data[0] == 0x03) {
+      writes++;
+      write(unit, data);
+    }
+  }
+}
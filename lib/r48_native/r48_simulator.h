@@ -0,0 +1,109 @@
+// Behavioural model of a bank of Vertiv R48 rectifiers on the virtual CAN bus.
+//
+// Each simulated unit answers read requests addressed to it (and broadcast
+// reads) after a short, slightly jittered processing delay, and the answers
+// are serialized on a 125 kbit/s bus, so a burst of requests comes back
+// spread out the way it does on real hardware. Writes behave like the
+// rectifier's:
+//
+//   - online settings (0x21 voltage, 0x22 current limit) take effect after
+//     onlineApplyMs and, if onlineHoldMs is set, fall back to the permanent
+//     value when they are not rewritten in time;
+//   - permanent settings are stored after storeMs (the EEPROM write), and a
+//     read-back before that still returns the old value.
+//
+// The output follows a simple electrical model: either a constant-current
+// load or a battery (open-circuit voltage behind an internal resistance),
+// limited by the current limit times the rated current.
+
+#pragma once
+
+#include <Arduino.h>
+#include <mcp_can.h>
+#include <deque>
+#include <vector>
+
+#include "r48_protocol.h"
+
+// Rated output current of an R48-2000e3, the reference of the current limit fraction.
+const float R48_SIM_RATED_CURRENT = 41.7f;
+
+struct R48SimUnit {
+  byte address;
+  bool answering;         // false models a unit that left the bus
+  float loadCurrent;      // constant-current load, A (used when batteryResistance is 0)
+  float batteryVoltage;   // battery open-circuit voltage, V
+  float batteryResistance;// battery internal resistance, ohm (0 = constant-current load)
+  float supplyVoltage;    // AC input, V
+  float ambient;          // °C
+
+  byte stored[256][4];    // permanent registers as their value bytes
+  bool known[256];        // registers that answer a read
+
+  struct PendingWrite {
+    byte registerNo;
+    byte value[4];
+    unsigned long at;     // millis() when it takes effect
+  };
+  std::vector<PendingWrite> pending;
+
+  float onlineVoltage;        // NAN while no online setting is active
+  float onlineCurrentLimit;
+  unsigned long onlineVoltageAt;  // millis() of the last online write
+  unsigned long onlineCurrentLimitAt;
+};
+
+class R48Simulator : public NativeCanNode {
+public:
+  /**
+   * @brief Connects the simulator to the controller's MCP2515 and its INT pin.
+   */
+  R48Simulator(MCP_CAN &can, uint8_t intPin);
+
+  /**
+   * @brief Adds a rectifier with factory settings (53.5 V, full current limit, no load).
+   */
+  R48SimUnit &addUnit(byte address);
+  R48SimUnit *unit(byte address);
+
+  void setAnswering(byte address, bool answering);
+  void setLoad(byte address, float amps);
+  void setBattery(byte address, float openCircuitVoltage, float resistance);
+
+  /**
+   * @brief The value a read of `registerNo` would return right now.
+   * @return false if the unit does not answer that register.
+   */
+  bool readRegister(byte address, byte registerNo, float &value);
+
+  // Electrical state of a unit right now.
+  float setpointVoltage(R48SimUnit &unit);
+  float currentLimit(R48SimUnit &unit);
+  float outputCurrent(R48SimUnit &unit);
+  float outputVoltage(R48SimUnit &unit);
+
+  void onFrame(unsigned long id, byte len, const byte *data) override;
+
+  // Timing, all adjustable by a test.
+  unsigned long answerDelayUs = 2000;  // request received to answer queued
+  unsigned long answerJitterUs = 1000; // added at random, 0..answerJitterUs
+  unsigned long frameTimeUs = 1040;    // one 8-byte extended frame at 125 kbit/s, with stuffing
+  unsigned long onlineApplyMs = 20;
+  unsigned long onlineHoldMs = 0;      // 0 = online settings never expire
+  unsigned long storeMs = 400;
+
+  uint32_t requests = 0;  // read requests received
+  uint32_t answers = 0;   // answers put on the bus
+  uint32_t writes = 0;    // write commands received
+
+private:
+  void answer(R48SimUnit &unit, byte registerNo);
+  void write(R48SimUnit &unit, const byte *data);
+  void settle(R48SimUnit &unit);
+  float storedFloat(const R48SimUnit &unit, byte registerNo) const;
+
+  MCP_CAN &can;
+  std::deque<R48SimUnit> units;  // a deque keeps the references handed out by addUnit() valid
+  unsigned long busFreeAt = 0;  // micros() when the last queued answer has left the bus
+  uint32_t seed = 0x1234567;
+};
@@ -0,0 +1,356 @@
+#include "can_capture.h"
+#include "log.h"
+
+#include <LittleFS.h>
+
+static const char CAPTURE_MAGIC[4] = {'R', '4', '8', 'C'};
+static const uint8_t CAPTURE_VERSION = 1;
+static const char *const CAPTURE_NEWEST = "/can0.bin";
+
+static bool enabled = false;
+static uint8_t buffer[CAPTURE_BUFFER_SIZE];
+static uint16_t buffered = 0;
+static uint16_t bufferedRecords = 0;
+static uint32_t lastMicros = 0;      // time of the newest record encoded
+static uint32_t flushedMicros = 0;   // time of the newest record in flash; the buffer's first delta counts from it
+static uint32_t fileSize = 0;        // bytes in /can0.bin
+static bool startNewFile = true;
+static unsigned long lastFlush = 0;
+static uint8_t downloads = 0;        // rotation waits while a file is being downloaded
+static CaptureStats stats;
+
+// Requests from the web handlers, carried out by canCaptureService() so the flash is only written from loop().
+static bool startRequested = false;
+static bool stopRequested = false;
+static bool clearRequested = false;
+static bool flushRequested = false;
+
+/**
+ * @brief Path of capture file `index` (0 is the newest).
+ */
+static void capturePath(uint8_t index, char *path, size_t size) {
+  snprintf(path, size, "/can%u.bin", (unsigned)index);
+}
+
+void canCaptureBegin() {
+  enabled = false;
+  buffered = 0;
+  bufferedRecords = 0;
+  startNewFile = true;
+  downloads = 0;
+  startRequested = false;
+  stopRequested = false;
+  clearRequested = false;
+  flushRequested = false;
+  memset(&stats, 0, sizeof(stats));
+  File file = LittleFS.open(CAPTURE_NEWEST, "r");
+  fileSize = file ? file.size() : 0;
+}
+
+void canCaptureFrame(bool sent, unsigned long id, byte len, const byte *data) {
+  if (!enabled) {
+    return;
+  }
+  if (buffered + CAPTURE_MAX_RECORD > CAPTURE_BUFFER_SIZE) {
+    stats.dropped++;
+    return;
+  }
+
+  uint32_t now = micros();
+  uint32_t delta = now - lastMicros;
+  lastMicros = now;
+  bool extended = id & CAN_EXTENDED_FLAG;
+  if (len > 8) {
+    len = 8;
+  }
+
+  uint8_t *out = buffer + buffered;
+  *out++ = (sent ? CAPTURE_FLAG_TX : 0) | (extended ? CAPTURE_FLAG_EXTENDED : 0) |
+           (id & 0x40000000UL ? CAPTURE_FLAG_REMOTE : 0) | len;
+  do {
+    *out++ = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+    delta >>= 7;
+  } while (delta);
+  *out++ = id;
+  *out++ = id >> 8;
+  if (extended) {
+    *out++ = id >> 16;
+    *out++ = (id >> 24) & 0x1F;
+  }
+  memcpy(out, data, len);
+  out += len;
+
+  buffered = out - buffer;
+  bufferedRecords++;
+  stats.records++;
+}
+
+/**
+ * @brief Shifts /can0.bin .. /can(N-2).bin up by one, deleting the oldest file.
+ */
+static void rotate() {
+  char from[16];
+  char to[16];
+  capturePath(CAPTURE_FILES - 1, to, sizeof(to));
+  LittleFS.remove(to);
+  for (uint8_t i = CAPTURE_FILES - 1; i > 0; i--) {
+    capturePath(i - 1, from, sizeof(from));
+    capturePath(i, to, sizeof(to));
+    if (LittleFS.exists(from)) {
+      LittleFS.rename(from, to);
+    }
+  }
+  fileSize = 0;
+  stats.rotations++;
+}
+
+/**
+ * @brief Appends the buffer to /can0.bin, starting a new file first when needed.
+ */
+static void flush() {
+  lastFlush = millis();
+  if (buffered == 0) {
+    return;
+  }
+
+  if (startNewFile || fileSize == 0 || fileSize + buffered > CAPTURE_FILE_SIZE) {
+    if (downloads > 0) {
+      return;  // keep buffering; the buffer drops frames once full
+    }
+    if (fileSize > 0) {
+      rotate();
+    }
+    CaptureFileHeader header;
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.headerSize = sizeof(header);
+    header.reserved = 0;
+    header.baseMicros = flushedMicros;
+    header.baseMillis = millis() - (micros() - flushedMicros) / 1000;
+    File file = LittleFS.open(CAPTURE_NEWEST, "w");
+    if (!file || file.write((const uint8_t *)&header, sizeof(header)) != sizeof(header)) {
+      logEvent(LOG_ERROR, EV_SYS_CAPTURE_ERROR, logString(CAPTURE_NEWEST));
+      stats.dropped += bufferedRecords;
+      buffered = 0;
+      bufferedRecords = 0;
+      return;
+    }
+    fileSize = sizeof(header);
+    startNewFile = false;
+  }
+
+  File file = LittleFS.open(CAPTURE_NEWEST, "a");
+  size_t written = file ? file.write(buffer, buffered) : 0;
+  if (written != buffered) {
+    // A partial record would corrupt the rest of the file: start over in a new one.
+    logEvent(LOG_ERROR, EV_SYS_CAPTURE_ERROR, logString(CAPTURE_NEWEST));
+    stats.dropped += bufferedRecords;
+    startNewFile = true;
+  }
+  fileSize += written;
+  flushedMicros = lastMicros;
+  buffered = 0;
+  bufferedRecords = 0;
+}
+
+void canCaptureEnable(bool enable) {
+  startRequested = enable;
+  stopRequested = !enable;
+}
+
+void canCaptureClear() {
+  clearRequested = true;
+}
+
+void canCaptureFlush() {
+  flushRequested = true;
+}
+
+/**
+ * @brief Deletes every capture file and whatever is still buffered.
+ */
+static void removeFiles() {
+  char path[16];
+  for (uint8_t i = 0; i < CAPTURE_FILES; i++) {
+    capturePath(i, path, sizeof(path));
+    LittleFS.remove(path);
+  }
+  buffered = 0;
+  bufferedRecords = 0;
+  flushedMicros = lastMicros;
+  fileSize = 0;
+  startNewFile = true;
+}
+
+void canCaptureService() {
+  // Stop before clearing, so the frames still buffered are deleted as well
+  if (stopRequested) {
+    stopRequested = false;
+    if (enabled) {
+      flush();
+      enabled = false;
+    }
+  }
+  if (clearRequested && downloads == 0) {
+    clearRequested = false;
+    removeFiles();
+  }
+  if (startRequested) {
+    startRequested = false;
+    if (!enabled) {
+      lastMicros = micros();
+      flushedMicros = lastMicros;
+      startNewFile = true;
+      lastFlush = millis();
+      enabled = true;
+    }
+  }
+
+  if (!enabled) {
+    flushRequested = false;
+    return;
+  }
+  if (flushRequested || buffered >= CAPTURE_BUFFER_SIZE / 2 || millis() - lastFlush >= CAPTURE_FLUSH_INTERVAL) {
+    flushRequested = false;
+    flush();
+  }
+}
+
+CaptureStats canCaptureGetStats() {
+  CaptureStats current = stats;
+  current.enabled = enabled;
+  current.buffered = buffered;
+  return current;
+}
+
+bool canCaptureDecode(const uint8_t *data, size_t length, size_t &offset, CaptureRecord &record) {
+  size_t at = offset;
+  if (at >= length) {
+    return false;
+  }
+  uint8_t flags = data[at++];
+  record.sent = flags & CAPTURE_FLAG_TX;
+  record.len = flags & CAPTURE_DLC_MASK;
+  if (record.len > 8) {
+    return false;
+  }
+
+  record.deltaMicros = 0;
+  for (uint8_t shift = 0;; shift += 7) {
+    if (at >= length || shift > 28) {
+      return false;
+    }
+    uint8_t part = data[at++];
+    record.deltaMicros |= (uint32_t)(part & 0x7F) << shift;
+    if (!(part & 0x80)) {
+      break;
+    }
+  }
+
+  bool extended = flags & CAPTURE_FLAG_EXTENDED;
+  uint8_t idBytes = extended ? 4 : 2;
+  if (at + idBytes + record.len > length) {
+    return false;
+  }
+  record.id = data[at] | ((unsigned long)data[at + 1] << 8);
+  if (extended) {
+    record.id |= ((unsigned long)data[at + 2] << 16) | ((unsigned long)data[at + 3] << 24) | CAN_EXTENDED_FLAG;
+  }
+  if (flags & CAPTURE_FLAG_REMOTE) {
+    record.id |= 0x40000000UL;
+  }
+  at += idBytes;
+  memcpy(record.data, data + at, record.len);
+  offset = at + record.len;
+  return true;
+}
+
+// --- HTTP ---
+
+void canCaptureHandleStatus(AsyncWebServerRequest *request) {
+  CaptureStats current = canCaptureGetStats();
+  String json = "{\"enabled\":";
+  json += current.enabled ? "true" : "false";
+  json += ",\"records\":";
+  json += String(current.records);
+  json += ",\"dropped\":";
+  json += String(current.dropped);
+  json += ",\"rotations\":";
+  json += String(current.rotations);
+  json += ",\"buffered\":";
+  json += String(current.buffered);
+  json += ",\"fileLimit\":";
+  json += String(CAPTURE_FILE_SIZE);
+  json += ",\"files\":[";
+  char path[16];
+  for (uint8_t i = 0; i < CAPTURE_FILES; i++) {
+    capturePath(i, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (i > 0) json += ",";
+    json += String((unsigned long)(file ? file.size() : 0));
+  }
+  json += "]}";
+  request->send(200, "application/json", json);
+}
+
+void canCaptureHandleControl(AsyncWebServerRequest *request) {
+  bool clear = request->hasParam("clear", true);
+  bool flushNow = request->hasParam("flush", true);
+  if (!clear && !flushNow && !request->hasParam("enabled", true)) {
+    request->send(400, "text/plain", "Missing enabled, clear or flush parameter.");
+    return;
+  }
+  if (clear && downloads > 0) {
+    request->send(409, "text/plain", "A capture file is being downloaded.");
+    return;
+  }
+  bool running = enabled ? !stopRequested : startRequested;
+  if (request->hasParam("enabled", true)) {
+    String mode = request->getParam("enabled", true)->value();
+    if (mode != "on" && mode != "off") {
+      request->send(400, "text/plain", "Invalid enabled mode.");
+      return;
+    }
+    running = mode == "on";
+    canCaptureEnable(running);
+  }
+  if (clear) {
+    canCaptureClear();
+  }
+  if (flushNow) {
+    canCaptureFlush();
+  }
+  request->send(200, "text/plain", running ? "CAN capture running." : "CAN capture stopped.");
+}
+
+void canCaptureHandleDownload(AsyncWebServerRequest *request) {
+  long index = request->hasParam("file") ? request->getParam("file")->value().toInt() : 0;
+  if (index < 0 || index >= CAPTURE_FILES) {
+    request->send(400, "text/plain", "Invalid capture file.");
+    return;
+  }
+  char path[16];
+  capturePath(index, path, sizeof(path));
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    request->send(404, "text/plain", "No such capture file.");
+    return;
+  }
+
+  // Only what is in the file now is sent, even if the capture appends to it meanwhile.
+  size_t size = file.size();
+  downloads++;
+  request->onDisconnect([]() { downloads--; });
+  AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", size,
+    [file, size](uint8_t *out, size_t maxLen, size_t offset) mutable -> size_t {
+      if (offset >= size || !file.seek(offset)) {
+        return 0;
+      }
+      return file.read(out, min(maxLen, size - offset));
+    });
+  char disposition[48];
+  snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s\"", path + 1);
+  response->addHeader("Content-Disposition", disposition);
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
@@ -0,0 +1,230 @@
+#include "can_filter.h"
+
+// The MCP2515 checks receive buffer 0 against mask 0 and filters 0-1, and
+// receive buffer 1 against mask 1 and filters 2-5.
+const uint8_t RXB0_FILTERS = 2;
+const uint8_t RXB1_FILTERS = 4;
+
+struct FilterEntry {
+  unsigned long id;
+  unsigned long mask;
+};
+
+static CanDriver *filterDriver = nullptr;
+static FilterEntry entries[CAN_FILTER_MAX_ENTRIES];
+static uint8_t entryCount = 0;
+static bool promiscuous = false;
+static bool dirty = true;
+
+// What was last written to the chip, for the status endpoint.
+static unsigned long programmedMask[2];
+static unsigned long programmedFilter[6];
+static uint32_t reprogramCount = 0;
+
+static uint8_t countBits(unsigned long value) {
+  uint8_t bits = 0;
+  while (value) {
+    value &= value - 1;
+    bits++;
+  }
+  return bits;
+}
+
+/**
+ * @brief Compiles a group of entries into one mask and up to `slots` filter values.
+ *
+ * The mask starts as the intersection of the entry masks. While more distinct
+ * filter values remain than there are slots, the two values that differ in the
+ * fewest bits are merged by dropping those bits from the mask.
+ * @return The number of distinct filter values written to `filters`.
+ */
+static uint8_t compileGroup(const FilterEntry *group, uint8_t count, uint8_t slots,
+                            unsigned long &mask, unsigned long *filters) {
+  mask = CAN_FILTER_EXACT;
+  for (uint8_t i = 0; i < count; i++) {
+    mask &= group[i].mask;
+  }
+
+  while (true) {
+    uint8_t distinct = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      unsigned long value = group[i].id & mask;
+      bool seen = false;
+      for (uint8_t j = 0; j < distinct; j++) {
+        if (filters[j] == value) {
+          seen = true;
+          break;
+        }
+      }
+      if (!seen && distinct < CAN_FILTER_MAX_ENTRIES) {
+        filters[distinct++] = value;
+      }
+    }
+
+    if (distinct <= slots) {
+      return distinct;
+    }
+
+    uint8_t best = 30;
+    unsigned long bestDiff = 0;
+    for (uint8_t i = 0; i < distinct; i++) {
+      for (uint8_t j = i + 1; j < distinct; j++) {
+        unsigned long diff = filters[i] ^ filters[j];
+        uint8_t bits = countBits(diff);
+        if (bits < best) {
+          best = bits;
+          bestDiff = diff;
+        }
+      }
+    }
+    mask &= ~bestDiff;
+  }
+}
+
+static void programChip() {
+  unsigned long masks[2];
+  unsigned long filters[6];
+  bool extended[6];
+
+  if (promiscuous) {
+    // Zero masks let everything through; one standard and one extended filter
+    // per buffer so both frame formats are accepted.
+    masks[0] = masks[1] = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+      filters[i] = 0;
+      extended[i] = (i != 0 && i != 2);
+    }
+  } else {
+    // Entries with the widest "don't care" masks go to buffer 0 so they do not
+    // loosen the mask shared by the exact IDs in buffer 1.
+    FilterEntry sorted[CAN_FILTER_MAX_ENTRIES];
+    memcpy(sorted, entries, sizeof(FilterEntry) * entryCount);
+    for (uint8_t i = 1; i < entryCount; i++) {
+      FilterEntry e = sorted[i];
+      uint8_t j = i;
+      while (j > 0 && countBits(sorted[j - 1].mask) > countBits(e.mask)) {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = e;
+    }
+
+    uint8_t rxb0Count = 0;
+    if (entryCount > RXB1_FILTERS) {
+      rxb0Count = entryCount - RXB1_FILTERS;
+    } else if (entryCount > 1 && sorted[0].mask != CAN_FILTER_EXACT) {
+      rxb0Count = 1;
+    }
+    uint8_t rxb1Count = entryCount - rxb0Count;
+
+    unsigned long group[CAN_FILTER_MAX_ENTRIES];
+    uint8_t n;
+
+    // An empty group keeps an exact mask and a zero filter, which accepts
+    // only the (unused) extended ID 0.
+    n = compileGroup(sorted, rxb0Count, RXB0_FILTERS, masks[0], group);
+    for (uint8_t i = 0; i < RXB0_FILTERS; i++) {
+      filters[i] = n ? group[i < n ? i : 0] : 0;
+    }
+    n = compileGroup(sorted + rxb0Count, rxb1Count, RXB1_FILTERS, masks[1], group);
+    for (uint8_t i = 0; i < RXB1_FILTERS; i++) {
+      filters[RXB0_FILTERS + i] = n ? group[i < n ? i : 0] : 0;
+    }
+    if (rxb0Count == 0) {
+      // Let buffer 0 mirror buffer 1 so back-to-back frames can use both buffers.
+      masks[0] = masks[1];
+      filters[0] = filters[2];
+      filters[1] = filters[3];
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+      extended[i] = true;
+    }
+  }
+
+  filterDriver->setFilters(masks, filters, extended);
+
+  memcpy(programmedMask, masks, sizeof(masks));
+  memcpy(programmedFilter, filters, sizeof(filters));
+  reprogramCount++;
+}
+
+void canFilterBegin(CanDriver &driver) {
+  filterDriver = &driver;
+  dirty = true;
+}
+
+bool canFilterAdd(unsigned long id, unsigned long mask) {
+  id &= CAN_FILTER_EXACT;
+  mask &= CAN_FILTER_EXACT;
+  for (uint8_t i = 0; i < entryCount; i++) {
+    if (entries[i].id == id && entries[i].mask == mask) {
+      return true;
+    }
+  }
+  if (entryCount >= CAN_FILTER_MAX_ENTRIES) {
+    return false;
+  }
+  entries[entryCount++] = {id, mask};
+  dirty = true;
+  return true;
+}
+
+bool canFilterRemove(unsigned long id, unsigned long mask) {
+  id &= CAN_FILTER_EXACT;
+  mask &= CAN_FILTER_EXACT;
+  for (uint8_t i = 0; i < entryCount; i++) {
+    if (entries[i].id == id && entries[i].mask == mask) {
+      entries[i] = entries[--entryCount];
+      dirty = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void canFilterSetPromiscuous(bool on) {
+  if (promiscuous != on) {
+    promiscuous = on;
+    dirty = true;
+  }
+}
+
+bool canFilterIsPromiscuous() {
+  return promiscuous;
+}
+
+void canFilterService() {
+  if (!dirty || filterDriver == nullptr) {
+    return;
+  }
+  dirty = false;
+  programChip();
+}
+
+uint32_t canFilterReprograms() {
+  return reprogramCount;
+}
+
+String canFilterToJson() {
+  char hex[12];
+  String json = "{\"promiscuous\":";
+  json += promiscuous ? "true" : "false";
+  json += ",\"entries\":";
+  json += String(entryCount);
+  json += ",\"reprograms\":";
+  json += String(reprogramCount);
+  json += ",\"masks\":[";
+  for (uint8_t i = 0; i < 2; i++) {
+    snprintf(hex, sizeof(hex), "\"%08lX\"", programmedMask[i]);
+    if (i) json += ",";
+    json += hex;
+  }
+  json += "],\"filters\":[";
+  for (uint8_t i = 0; i < 6; i++) {
+    snprintf(hex, sizeof(hex), "\"%08lX\"", programmedFilter[i]);
+    if (i) json += ",";
+    json += hex;
+  }
+  json += "]}";
+  return json;
+}
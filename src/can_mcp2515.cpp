@@ -0,0 +1,89 @@
+#include "can_mcp2515.h"
+#include "profiler.h"
+
+// Only one MCP2515 is supported, so the ISR state is module-wide.
+static volatile bool irqPending = false;
+static volatile uint32_t irqCount = 0;
+
+static void IRAM_ATTR mcp2515Isr() {
+  irqPending = true;
+  irqCount++;
+}
+
+bool Mcp2515Driver::begin() {
+  // 8 MHz crystal, masks and filters enabled for standard and extended frames.
+  if (can.begin(MCP_STDEXT, CAN_125KBPS, MCP_8MHZ) != CAN_OK) {
+    return false;
+  }
+  // mcp_can leaves the chip in loopback mode; normal mode is needed to transmit.
+  can.setMode(MCP_NORMAL);
+
+  pinMode(intPin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(intPin), mcp2515Isr, FALLING);
+  // Frames may already be waiting from before the interrupt was attached.
+  irqPending = true;
+  return true;
+}
+
+bool Mcp2515Driver::send(unsigned long id, byte len, const byte *data) {
+  PROFILE_SCOPE(PROFILE_CAN_SEND);
+  return can.sendMsgBuf(id, 1, len, const_cast<byte *>(data)) == CAN_OK;
+}
+
+bool Mcp2515Driver::rxPending() {
+  // INT stays low while a buffer is full, so a missed edge is still caught here.
+  if (!irqPending && digitalRead(intPin) == HIGH) {
+    return false;
+  }
+  irqPending = false;
+  return true;
+}
+
+/**
+ * @brief Clears EFLG bits with a BIT MODIFY; mcp_can only reads the register.
+ */
+void Mcp2515Driver::clearErrorFlags(uint8_t flags) {
+  SPI.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  SPI.transfer(MCP_BITMOD);
+  SPI.transfer(MCP_EFLG);
+  SPI.transfer(flags);
+  SPI.transfer(0x00);
+  digitalWrite(csPin, HIGH);
+  SPI.endTransaction();
+}
+
+bool Mcp2515Driver::read(CanFrame &frame) {
+  if (can.checkReceive() != CAN_MSGAVAIL) {
+    return false;
+  }
+  PROFILE_SCOPE(PROFILE_CAN_READ);
+  can.readMsgBuf(&frame.id, &frame.len, frame.data);
+  return true;
+}
+
+void Mcp2515Driver::checkOverflow() {
+  // Read whether or not a buffer is still full: under a steady flood the buffers never run empty.
+  // RX0OVR/RX1OVR stay set until cleared, so clear them to count the next overflow too.
+  uint8_t overflow = can.getError() & (MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR);
+  if (overflow) {
+    hwOverflows++;
+    clearErrorFlags(overflow);
+  }
+}
+
+void Mcp2515Driver::setFilters(const unsigned long masks[2], const unsigned long filters[6], const bool extended[6]) {
+  // init_Mask/init_Filt switch the chip into configuration mode and back.
+  can.init_Mask(0, 1, masks[0]);
+  can.init_Mask(1, 1, masks[1]);
+  for (uint8_t i = 0; i < 6; i++) {
+    can.init_Filt(i, extended[i] ? 1 : 0, filters[i]);
+  }
+}
+
+CanDriverStats Mcp2515Driver::stats() {
+  CanDriverStats stats;
+  stats.interrupts = irqCount;
+  stats.hwOverflows = hwOverflows;
+  return stats;
+}
@@ -0,0 +1,75 @@
+#include "can_rx.h"
+
+// One drain never takes more than a ring's worth of frames, so a driver that
+// keeps reporting frames (a stuck INT line, a flooded socket) cannot hold up loop().
+const uint8_t CAN_RX_MAX_DRAIN = CAN_RX_RING_SIZE;
+
+static CanDriver *rxDriver = nullptr;
+
+static CanFrame ring[CAN_RX_RING_SIZE];
+static volatile uint8_t ringHead = 0; // written by the producer only
+static volatile uint8_t ringTail = 0; // written by the consumer only
+
+static CanRxStats stats = {};
+
+void canRxBegin(CanDriver &driver) {
+  rxDriver = &driver;
+  ringHead = 0;
+  ringTail = 0;
+  stats = {};
+}
+
+void canRxService() {
+  if (rxDriver == nullptr || !rxDriver->rxPending()) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < CAN_RX_MAX_DRAIN; i++) {
+    uint8_t head = ringHead;
+    uint8_t next = (head + 1) & (CAN_RX_RING_SIZE - 1);
+    CanFrame &slot = ring[head];
+    // Always read the frame, even when the ring is full, so the driver's buffer is released.
+    if (!rxDriver->read(slot)) {
+      break;
+    }
+
+    if (next == ringTail) {
+      stats.overruns++;
+      continue;
+    }
+
+    slot.timestamp = millis();
+    ringHead = next;
+    stats.received++;
+
+    uint8_t fill = (next - ringTail) & (CAN_RX_RING_SIZE - 1);
+    if (fill > stats.highWater) {
+      stats.highWater = fill;
+    }
+  }
+  rxDriver->checkOverflow();
+}
+
+bool canRxPop(CanFrame &frame) {
+  uint8_t tail = ringTail;
+  if (tail == ringHead) {
+    return false;
+  }
+  frame = ring[tail];
+  ringTail = (tail + 1) & (CAN_RX_RING_SIZE - 1);
+  return true;
+}
+
+uint8_t canRxPending() {
+  return (ringHead - ringTail) & (CAN_RX_RING_SIZE - 1);
+}
+
+CanRxStats canRxGetStats() {
+  CanRxStats copy = stats;
+  if (rxDriver != nullptr) {
+    CanDriverStats driver = rxDriver->stats();
+    copy.interrupts = driver.interrupts;
+    copy.hwOverflows = driver.hwOverflows;
+  }
+  return copy;
+}
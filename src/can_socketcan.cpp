@@ -0,0 +1,152 @@
+#ifdef __linux__
+
+#include "can_socketcan.h"
+#include "profiler.h"
+
+#include <errno.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+SocketCanDriver::~SocketCanDriver() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool SocketCanDriver::begin() {
+  fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (fd < 0) {
+    fprintf(stderr, "SocketCAN: socket: %s\n", strerror(errno));
+    return false;
+  }
+
+  struct ifreq ifr = {};
+  strncpy(ifr.ifr_name, interfaceName, IFNAMSIZ - 1);
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+    fprintf(stderr, "SocketCAN: no interface %s: %s\n", interfaceName, strerror(errno));
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  struct sockaddr_can address = {};
+  address.can_family = AF_CAN;
+  address.can_ifindex = ifr.ifr_ifindex;
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    fprintf(stderr, "SocketCAN: bind %s: %s\n", interfaceName, strerror(errno));
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  // Every received message then carries the socket's cumulative drop counter.
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+  for (uint8_t i = 0; i < SOCKETCAN_BATCH; i++) {
+    vectors[i].iov_base = &frames[i];
+    vectors[i].iov_len = sizeof(frames[i]);
+    messages[i].msg_hdr = {};
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_control = control[i];
+  }
+  return true;
+}
+
+bool SocketCanDriver::send(unsigned long id, byte len, const byte *data) {
+  PROFILE_SCOPE(PROFILE_CAN_SEND);
+  if (fd < 0) {
+    return false;
+  }
+  struct can_frame frame = {};
+  frame.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  frame.can_dlc = len > CAN_MAX_DLEN ? CAN_MAX_DLEN : len;
+  memcpy(frame.data, data, frame.can_dlc);
+  // A full transmit queue (EAGAIN) fails the send instead of blocking loop().
+  return write(fd, &frame, sizeof(frame)) == (ssize_t)sizeof(frame);
+}
+
+/**
+ * @brief Refills the batch with the frames waiting in the socket.
+ * @return false if none were waiting.
+ */
+bool SocketCanDriver::fillBatch() {
+  batchCount = 0;
+  batchNext = 0;
+  if (fd < 0) {
+    return false;
+  }
+  for (uint8_t i = 0; i < SOCKETCAN_BATCH; i++) {
+    messages[i].msg_hdr.msg_controllen = sizeof(control[i]);
+  }
+  int received = recvmmsg(fd, messages, SOCKETCAN_BATCH, MSG_DONTWAIT, nullptr);
+  if (received <= 0) {
+    return false;
+  }
+  batchCount = received;
+  batches++;
+
+  // The drop counter only ever grows; its increase is the number of frames lost.
+  for (int i = 0; i < received; i++) {
+    struct msghdr &header = messages[i].msg_hdr;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&header); c != nullptr; c = CMSG_NXTHDR(&header, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t drops;
+        memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+        hwOverflows += drops - dropCount;
+        dropCount = drops;
+      }
+    }
+  }
+  return true;
+}
+
+bool SocketCanDriver::rxPending() {
+  return batchNext < batchCount || fillBatch();
+}
+
+bool SocketCanDriver::read(CanFrame &frame) {
+  PROFILE_SCOPE(PROFILE_CAN_READ);
+  if (batchNext >= batchCount && !fillBatch()) {
+    return false;
+  }
+  const struct can_frame &received = frames[batchNext++];
+  // SocketCAN flags extended and remote frames in bits 31 and 30, like mcp_can.
+  frame.id = received.can_id & (received.can_id & CAN_EFF_FLAG ? CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK
+                                                               : CAN_RTR_FLAG | CAN_SFF_MASK);
+  frame.len = received.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : received.can_dlc;
+  memcpy(frame.data, received.data, frame.len);
+  return true;
+}
+
+void SocketCanDriver::setFilters(const unsigned long masks[2], const unsigned long filters[6], const bool extended[6]) {
+  if (fd < 0) {
+    return;
+  }
+  // The same six filters as on the MCP2515; CAN_EFF_FLAG in the mask makes the frame format part of the match.
+  struct can_filter rules[6];
+  for (uint8_t i = 0; i < 6; i++) {
+    unsigned long mask = masks[i < 2 ? 0 : 1];
+    if (extended[i]) {
+      rules[i].can_id = (filters[i] & CAN_EFF_MASK) | CAN_EFF_FLAG;
+      rules[i].can_mask = (mask & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    } else {
+      rules[i].can_id = filters[i] & CAN_SFF_MASK;
+      rules[i].can_mask = (mask & CAN_SFF_MASK) | CAN_EFF_FLAG;
+    }
+  }
+  setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, rules, sizeof(rules));
+}
+
+CanDriverStats SocketCanDriver::stats() {
+  CanDriverStats stats;
+  stats.interrupts = batches;
+  stats.hwOverflows = hwOverflows;
+  return stats;
+}
+
+#endif
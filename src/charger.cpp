@@ -0,0 +1,394 @@
+#include "charger.h"
+#include "command_queue.h"
+#include "poll_scheduler.h"
+#include "rectifiers.h"
+
+// Defaults for a 16-cell LiFePO4 bank.
+static const ChargerConfig DEFAULT_CONFIG = {20.0f, 55.2f, 5.0f, 1800, 53.6f};
+
+static ChargerConfig config;
+static ChargerStage stage = CHARGER_OFF;
+static unsigned long stageStart = 0;
+static unsigned long lastStep = 0;
+static unsigned long lastGoodStep = 0;   // last step that ran on fresh inputs
+static float currentIntegral = 0;        // A
+static float voltageIntegral = 0;        // V
+static unsigned long trimHoldStart = 0;  // the voltage target last changed
+static uint8_t tailSteps = 0;
+static ChargerStatus status;
+
+// What was last queued, and to which units.
+static float writtenVoltage = NAN;
+static float writtenLimit = NAN;         // fraction of the rated current
+static byte writtenUnits[MAX_RECTIFIERS];
+static uint8_t writtenUnitCount = 0;
+
+static const char *const stageNames[] = {"off", "cc", "cv", "absorption", "float", "fault"};
+
+const char *chargerStageName(ChargerStage value) {
+  return stageNames[value];
+}
+
+void chargerBegin() {
+  config = DEFAULT_CONFIG;
+  stage = CHARGER_OFF;
+  memset(&status, 0, sizeof(status));
+  status.voltage = NAN;
+  status.current = NAN;
+  status.setpointVoltage = NAN;
+  status.currentLimit = NAN;
+}
+
+bool chargerConfigValid(const ChargerConfig &candidate) {
+  const R48Setting &voltage = R48_SETTINGS[SETTING_ONLINE_VOLTAGE];
+  // NAN fails every comparison
+  return r48SettingValid(voltage, candidate.cvVoltage) && r48SettingValid(voltage, candidate.floatVoltage) &&
+         candidate.floatVoltage <= candidate.cvVoltage && candidate.ccCurrent > 0 &&
+         candidate.ccCurrent <= MAX_RECTIFIERS * R48_RATED_CURRENT * r48SettingMax(R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT]) &&
+         candidate.tailCurrent >= 0 && candidate.tailCurrent < candidate.ccCurrent &&
+         candidate.absorptionTime <= 24UL * 3600;
+}
+
+const ChargerConfig &chargerGetConfig() {
+  return config;
+}
+
+void chargerSetConfig(const ChargerConfig &candidate) {
+  config = candidate;
+}
+
+bool chargerRunning() {
+  return stage != CHARGER_OFF && stage != CHARGER_FAULT;
+}
+
+static void enterStage(ChargerStage next) {
+  stage = next;
+  stageStart = millis();
+  tailSteps = 0;
+}
+
+/**
+ * @brief Restarts the voltage loop on a new target. The trim holds at zero for CHARGER_MAX_INPUT_AGE,
+ * until no input used by a step can predate the new setpoint.
+ */
+static void resetVoltageLoop() {
+  voltageIntegral = 0;
+  trimHoldStart = millis();
+}
+
+/**
+ * @brief Polls voltage and current faster while the charger runs, or restores the normal periods.
+ */
+static void capInputPeriods(bool cap) {
+  pollSchedulerCapPeriod(OUTPUT_VOLTAGE, cap ? CHARGER_INPUT_PERIOD : 0);
+  pollSchedulerCapPeriod(OUTPUT_CURRENT, cap ? CHARGER_INPUT_PERIOD : 0);
+}
+
+bool chargerStart() {
+  if (rectifierCount() == 0) {
+    return false;
+  }
+  enterStage(CHARGER_CC);
+  unsigned long now = millis();
+  lastStep = now - CHARGER_PERIOD;
+  lastGoodStep = now;
+  currentIntegral = 0;
+  resetVoltageLoop();
+  writtenUnitCount = 0;  // forces the first write
+  capInputPeriods(true);
+  return true;
+}
+
+void chargerStop() {
+  enterStage(CHARGER_OFF);
+  capInputPeriods(false);
+}
+
+/**
+ * @brief True when the voltage and current of every tracked unit are younger than CHARGER_MAX_INPUT_AGE.
+ */
+static bool inputsFresh() {
+  uint8_t count = rectifierCount();
+  if (count == 0) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const Rectifier &rectifier = rectifierAt(i);
+    if (rectifierValueAge(rectifier, measurementSlot(OUTPUT_VOLTAGE)) >= CHARGER_MAX_INPUT_AGE ||
+        rectifierValueAge(rectifier, measurementSlot(OUTPUT_CURRENT)) >= CHARGER_MAX_INPUT_AGE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief True when the units tracked now are not the ones the setpoints were last written to.
+ */
+static bool unitsChanged() {
+  uint8_t count = rectifierCount();
+  if (count != writtenUnitCount) {
+    return true;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (rectifierAt(i).address != writtenUnits[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Queues the setpoints for every unit when they moved past the deadband.
+ * @param limit Current limit as a fraction of the rated current of one unit.
+ */
+static void writeSetpoints(float voltage, float limit, bool force) {
+  uint8_t count = rectifierCount();
+  force |= unitsChanged();
+  bool writeVoltage = force || isnan(writtenVoltage) || fabsf(voltage - writtenVoltage) >= CHARGER_VOLTAGE_DEADBAND;
+  bool writeLimit = force || isnan(writtenLimit) ||
+                    fabsf(limit - writtenLimit) * count * R48_RATED_CURRENT >= CHARGER_CURRENT_DEADBAND;
+  bool queued = true;
+  for (uint8_t i = 0; i < count; i++) {
+    byte unit = rectifierAt(i).address;
+    if (writeVoltage && commandQueuePush(unit, SETTING_ONLINE_VOLTAGE, voltage) == COMMAND_QUEUE_FULL) {
+      queued = false;
+    }
+    if (writeLimit && commandQueuePush(unit, SETTING_ONLINE_CURRENT_LIMIT, limit) == COMMAND_QUEUE_FULL) {
+      queued = false;
+    }
+  }
+  // A full queue leaves the old values recorded, so the next step tries again.
+  if (!queued) {
+    writtenUnitCount = 0;
+    return;
+  }
+  if (writeVoltage) {
+    writtenVoltage = voltage;
+    status.writes++;
+  }
+  if (writeLimit) {
+    writtenLimit = limit;
+    status.writes++;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    writtenUnits[i] = rectifierAt(i).address;
+  }
+  writtenUnitCount = count;
+}
+
+/**
+ * @brief Converts a bank current to the per-unit limit fraction, within the online limit's range.
+ */
+static float limitFraction(float bankAmps, uint8_t units) {
+  const R48Setting &setting = R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT];
+  return constrain(bankAmps / (units * R48_RATED_CURRENT), r48SettingMin(setting), r48SettingMax(setting));
+}
+
+/**
+ * @brief Gives up on stale inputs: float voltage at the lowest current limit, then stop.
+ */
+static void fault() {
+  const R48Setting &limit = R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT];
+  if (rectifierCount() > 0) {
+    writeSetpoints(config.floatVoltage, r48SettingMin(limit), true);
+  }
+  status.setpointVoltage = config.floatVoltage;
+  status.currentLimit = r48SettingMin(limit) * R48_RATED_CURRENT;
+  enterStage(CHARGER_FAULT);
+  capInputPeriods(false);
+}
+
+/**
+ * @brief One PI step of the current loop; returns the bank current limit in amps.
+ */
+static float currentStep(float measured, uint8_t units, float dt) {
+  const R48Setting &setting = R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT];
+  float lowest = units * R48_RATED_CURRENT * r48SettingMin(setting);
+  float highest = units * R48_RATED_CURRENT * r48SettingMax(setting);
+  float error = config.ccCurrent - measured;
+  float output = config.ccCurrent + CHARGER_CURRENT_KP * error + currentIntegral;
+  // Anti-windup: stop integrating while the output is pinned and the error pushes it further.
+  if (!((output >= highest && error > 0) || (output <= lowest && error < 0))) {
+    currentIntegral += CHARGER_CURRENT_KI * error * dt;
+  }
+  return constrain(output, lowest, highest);
+}
+
+/**
+ * @brief One PI step of the voltage loop; returns the voltage setpoint.
+ */
+static float voltageStep(float target, float measured, float dt) {
+  const R48Setting &setting = R48_SETTINGS[SETTING_ONLINE_VOLTAGE];
+  if (millis() - trimHoldStart < CHARGER_MAX_INPUT_AGE) {
+    return constrain(target, r48SettingMin(setting), r48SettingMax(setting));
+  }
+  float error = target - measured;
+  voltageIntegral = constrain(voltageIntegral + CHARGER_VOLTAGE_KI * error * dt, -CHARGER_MAX_VOLTAGE_TRIM,
+                              CHARGER_MAX_VOLTAGE_TRIM);
+  float trim = constrain(CHARGER_VOLTAGE_KP * error + voltageIntegral, -CHARGER_MAX_VOLTAGE_TRIM,
+                         CHARGER_MAX_VOLTAGE_TRIM);
+  return constrain(target + trim, r48SettingMin(setting), r48SettingMax(setting));
+}
+
+void chargerService() {
+  if (!chargerRunning()) {
+    return;
+  }
+  unsigned long now = millis();
+  if (now - lastStep < CHARGER_PERIOD) {
+    return;
+  }
+  // Fixed rate; after a stall, restart the grid from now instead of catching up.
+  lastStep = now - lastStep >= 2 * CHARGER_PERIOD ? now : lastStep + CHARGER_PERIOD;
+
+  if (!inputsFresh()) {
+    status.skippedSteps++;
+    if (now - lastGoodStep >= CHARGER_STALE_TIMEOUT) {
+      fault();
+    }
+    return;
+  }
+  lastGoodStep = now;
+  status.steps++;
+
+  uint8_t units = rectifierCount();
+  BankTotals bank = rectifiersBankTotals();
+  status.voltage = bank.outputVoltage;
+  status.current = bank.outputCurrent;
+  const float dt = CHARGER_PERIOD / 1000.0f;
+
+  switch (stage) {
+    case CHARGER_CC:
+      if (bank.outputVoltage >= config.cvVoltage - CHARGER_CV_ENTRY_MARGIN) {
+        enterStage(CHARGER_CV);
+        resetVoltageLoop();
+      }
+      break;
+    case CHARGER_CV:
+      tailSteps = bank.outputCurrent <= config.tailCurrent ? tailSteps + 1 : 0;
+      if (tailSteps >= CHARGER_TAIL_STEPS) {
+        enterStage(config.absorptionTime > 0 ? CHARGER_ABSORPTION : CHARGER_FLOAT);
+        if (stage == CHARGER_FLOAT) {
+          resetVoltageLoop();
+        }
+      }
+      break;
+    case CHARGER_ABSORPTION:
+      if (now - stageStart >= config.absorptionTime * 1000UL) {
+        enterStage(CHARGER_FLOAT);
+        resetVoltageLoop();
+      }
+      break;
+    default:
+      break;
+  }
+
+  float voltage;
+  float limitAmps;
+  if (stage == CHARGER_CC) {
+    voltage = config.cvVoltage;
+    limitAmps = currentStep(bank.outputCurrent, units, dt);
+  } else {
+    voltage = voltageStep(stage == CHARGER_FLOAT ? config.floatVoltage : config.cvVoltage, bank.outputVoltage, dt);
+    limitAmps = config.ccCurrent;
+  }
+  float limit = limitFraction(limitAmps, units);
+  status.setpointVoltage = voltage;
+  status.currentLimit = limit * R48_RATED_CURRENT;
+  writeSetpoints(voltage, limit, false);
+}
+
+ChargerStatus chargerGetStatus() {
+  ChargerStatus current = status;
+  current.stage = stage;
+  current.stageMs = stage == CHARGER_OFF ? 0 : millis() - stageStart;
+  return current;
+}
+
+// --- HTTP ---
+
+static String jsonFloat(float value) {
+  return isnan(value) ? String("null") : String(value, 2);
+}
+
+void chargerHandleStatus(AsyncWebServerRequest *request) {
+  ChargerStatus current = chargerGetStatus();
+  String json = "{\"stage\":\"";
+  json += chargerStageName(current.stage);
+  json += "\",\"running\":";
+  json += chargerRunning() ? "true" : "false";
+  json += ",\"stageSeconds\":";
+  json += String(current.stageMs / 1000);
+  json += ",\"config\":{\"ccCurrent\":";
+  json += jsonFloat(config.ccCurrent);
+  json += ",\"cvVoltage\":";
+  json += jsonFloat(config.cvVoltage);
+  json += ",\"tailCurrent\":";
+  json += jsonFloat(config.tailCurrent);
+  json += ",\"absorptionTime\":";
+  json += String(config.absorptionTime);
+  json += ",\"floatVoltage\":";
+  json += jsonFloat(config.floatVoltage);
+  json += "},\"voltage\":";
+  json += jsonFloat(current.voltage);
+  json += ",\"current\":";
+  json += jsonFloat(current.current);
+  json += ",\"setpointVoltage\":";
+  json += jsonFloat(current.setpointVoltage);
+  json += ",\"currentLimit\":";
+  json += jsonFloat(current.currentLimit);
+  json += ",\"steps\":";
+  json += String(current.steps);
+  json += ",\"skippedSteps\":";
+  json += String(current.skippedSteps);
+  json += ",\"writes\":";
+  json += String(current.writes);
+  json += "}";
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Overwrites `value` with a form field if present.
+ */
+static void floatParam(AsyncWebServerRequest *request, const char *name, float &value) {
+  if (request->hasParam(name, true)) {
+    value = request->getParam(name, true)->value().toFloat();
+  }
+}
+
+void chargerHandleControl(AsyncWebServerRequest *request) {
+  ChargerConfig candidate = config;
+  floatParam(request, "cc_current", candidate.ccCurrent);
+  floatParam(request, "cv_voltage", candidate.cvVoltage);
+  floatParam(request, "tail_current", candidate.tailCurrent);
+  floatParam(request, "float_voltage", candidate.floatVoltage);
+  if (request->hasParam("absorption_time", true)) {
+    long seconds = request->getParam("absorption_time", true)->value().toInt();
+    candidate.absorptionTime = seconds < 0 ? UINT32_MAX : seconds;
+  }
+  String action = request->hasParam("action", true) ? request->getParam("action", true)->value() : String();
+  if (action.length() > 0 && action != "start" && action != "stop") {
+    request->send(400, "text/plain", "Invalid action, use start or stop.");
+    return;
+  }
+  if (!chargerConfigValid(candidate)) {
+    request->send(400, "text/plain", "Invalid charger configuration: voltages between 41 and 58.5 V, float not above cv, "
+                                     "tail current below the cc current, absorption time up to 24 h.");
+    return;
+  }
+  config = candidate;
+
+  if (action == "start") {
+    if (!chargerStart()) {
+      request->send(409, "text/plain", "No rectifier to charge with.");
+      return;
+    }
+    request->send(200, "text/plain", "Charging started.");
+  } else if (action == "stop") {
+    chargerStop();
+    request->send(200, "text/plain", "Charging stopped.");
+  } else {
+    request->send(200, "text/plain", "Charger configuration updated.");
+  }
+}
@@ -0,0 +1,189 @@
+
+#include "command_queue.h"
+#include "command_tracker.h"
+#include "log.h"
+#include "setpoint_keepalive.h"
+
+enum QueueState : uint8_t {
+  QUEUE_FREE,
+  QUEUE_WAITING,   // a value is waiting to be sent
+  QUEUE_COOLING    // sent; blocks the next write of the same setting until the gap has passed
+};
+
+struct QueuedWrite {
+  byte unit;
+  R48SettingId setting;
+  QueueState state;
+  uint8_t failures;
+  float value;
+  uint32_t order;            // enqueue order, so writes go out first come, first served
+  unsigned long sentAt;      // when the last frame of this setting went out (valid if sentBefore)
+  bool sentBefore;
+};
+
+static QueuedWrite queue[COMMAND_QUEUE_SIZE];
+static CommandSendFunction sendFrame = nullptr;
+static CommandQueueStats stats = {};
+static uint32_t nextOrder = 0;
+static unsigned long lastSend = 0;
+
+static unsigned long rewriteGap(const QueuedWrite &write) {
+  return R48_SETTINGS[write.setting].writeClass == R48_WRITE_PERMANENT
+         ? COMMAND_PERMANENT_REWRITE_GAP : COMMAND_ONLINE_REWRITE_GAP;
+}
+
+static bool coolingDown(const QueuedWrite &write, unsigned long now) {
+  return write.sentBefore && now - write.sentAt < rewriteGap(write);
+}
+
+void commandQueueBegin(CommandSendFunction send) {
+  sendFrame = send;
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    queue[i].state = QUEUE_FREE;
+  }
+}
+
+CommandQueueResult commandQueuePush(byte unit, R48SettingId setting, float value) {
+  if (!r48SettingValid(R48_SETTINGS[setting], value)) {
+    return COMMAND_INVALID;
+  }
+
+  unsigned long now = millis();
+  QueuedWrite *match = nullptr;
+  QueuedWrite *unused = nullptr;
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    QueuedWrite &write = queue[i];
+    if (write.state == QUEUE_COOLING && !coolingDown(write, now)) {
+      write.state = QUEUE_FREE;
+    }
+    if (write.state == QUEUE_FREE) {
+      if (unused == nullptr) unused = &write;
+    } else if (write.unit == unit && write.setting == setting) {
+      match = &write;
+    }
+  }
+
+  if (match != nullptr) {
+    match->value = value;
+    match->failures = 0;
+    if (match->state == QUEUE_WAITING) {
+      stats.coalesced++;
+      return COMMAND_COALESCED;
+    }
+    // Still cooling down: the marker keeps sentAt, so the new value waits for the gap.
+    match->state = QUEUE_WAITING;
+    match->order = nextOrder++;
+    stats.queued++;
+    return COMMAND_QUEUED;
+  }
+
+  if (unused == nullptr) {
+    stats.rejected++;
+    return COMMAND_QUEUE_FULL;
+  }
+  *unused = {unit, setting, QUEUE_WAITING, 0, value, nextOrder++, 0, false};
+  stats.queued++;
+  return COMMAND_QUEUED;
+}
+
+bool commandQueueHasRoom(byte unit, const R48SettingId *settings, uint8_t count) {
+  unsigned long now = millis();
+  uint8_t free = 0;
+  uint8_t needed = count;
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    const QueuedWrite &write = queue[i];
+    if (write.state == QUEUE_FREE || (write.state == QUEUE_COOLING && !coolingDown(write, now))) {
+      free++;
+      continue;
+    }
+    // A write to a setting already held reuses its entry
+    for (uint8_t j = 0; j < count; j++) {
+      if (write.unit == unit && write.setting == settings[j]) {
+        needed--;
+        break;
+      }
+    }
+  }
+  return needed <= free;
+}
+
+void commandQueueService() {
+  unsigned long now = millis();
+  if (sendFrame == nullptr || now - lastSend < COMMAND_QUEUE_TICK) {
+    return;
+  }
+
+  // Oldest waiting write whose setting is not cooling down
+  QueuedWrite *next = nullptr;
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    QueuedWrite &write = queue[i];
+    if (write.state == QUEUE_COOLING && !coolingDown(write, now)) {
+      write.state = QUEUE_FREE;
+    }
+    if (write.state != QUEUE_WAITING || coolingDown(write, now)) {
+      continue;
+    }
+    if (next == nullptr || write.order - next->order > 0x7FFFFFFF) {
+      next = &write;
+    }
+  }
+  if (next == nullptr) {
+    return;
+  }
+
+  const R48Setting &setting = R48_SETTINGS[next->setting];
+  byte data[8];
+  r48EncodeWrite(setting, next->value, data);
+  lastSend = now;
+
+  unsigned long id = next->unit == R48_BROADCAST_ADDRESS ? VERTIV_READ_REQUEST_ID : r48RequestId(next->unit);
+  if (!sendFrame(id, data)) {
+    logEvent(LOG_ERROR, EV_CAN_TX_ERROR, logString(setting.label));
+    if (++next->failures > COMMAND_SEND_RETRIES) {
+      stats.dropped++;
+      next->state = next->sentBefore ? QUEUE_COOLING : QUEUE_FREE;
+    }
+    return;
+  }
+
+  stats.sent++;
+  if (setting.type == R48_VALUE_FLOAT) {
+    logEvent(LOG_INFO, EV_CAN_TX_COMMAND, logString(setting.label), next->unit, logFloat(next->value));
+  } else {
+    logEvent(LOG_INFO, EV_CAN_TX_COMMAND_STATE, logString(setting.label), next->unit,
+             logString(next->value != 0 ? setting.onWord : setting.offWord));
+  }
+  if (setting.writeClass == R48_WRITE_PERMANENT) {
+    // Read the register back until the rectifier reports the new value
+    commandTrackerAdd(next->unit, setting.registerNo, &data[4], setting.type == R48_VALUE_FLOAT);
+  } else {
+    // Written again before the rectifier falls back to the permanent value
+    setpointKeepaliveOnWrite(next->unit, next->setting, next->value);
+  }
+  next->state = QUEUE_COOLING;
+  next->sentAt = now;
+  next->sentBefore = true;
+}
+
+bool commandQueueWaiting(byte unit, R48SettingId setting) {
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    if (queue[i].state == QUEUE_WAITING && queue[i].unit == unit && queue[i].setting == setting) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t commandQueuePending() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    if (queue[i].state == QUEUE_WAITING) {
+      count++;
+    }
+  }
+  return count;
+}
+
+CommandQueueStats commandQueueGetStats() {
+  return stats;
+}
@@ -0,0 +1,233 @@
+#include "command_tracker.h"
+#include "log.h"
+#include "r48_protocol.h"
+
+struct TrackedCommand {
+  byte unit;
+  byte registerNo;
+  byte value[4];
+  bool isFloat;
+  CommandState state;
+  uint8_t attempts;          // read-backs sent so far
+  unsigned long sentAt;      // when the command itself was sent
+  unsigned long nextReadAt;  // when the next read-back is due, or the last one times out
+  unsigned long finishedAt;
+};
+
+static TrackedCommand commands[COMMAND_TRACKER_MAX];
+static CommandReadFunction readRegister = nullptr;
+static bool batchFailed = false;
+static bool batchDone = false;
+
+static bool valueMatches(const TrackedCommand &command, const byte value[4]) {
+  if (!command.isFloat) {
+    return memcmp(command.value, value, 4) == 0;
+  }
+  // The rectifier may round the stored value, so allow half a percent (at least 0.01).
+  float expected = r48GetFloat(command.value);
+  float tolerance = max(0.01f, fabsf(expected) * 0.005f);
+  return fabsf(r48GetFloat(value) - expected) <= tolerance;
+}
+
+static void finish(TrackedCommand &command, CommandState state) {
+  unsigned long now = millis();
+  command.state = state;
+  command.finishedAt = now;
+  if (state == COMMAND_CONFIRMED) {
+    logEvent(LOG_INFO, EV_SYS_COMMAND_CONFIRMED, command.registerNo, command.unit, now - command.sentAt);
+  } else {
+    batchFailed = true;
+    logEvent(LOG_ERROR, EV_SYS_COMMAND_FAILED, command.registerNo, command.unit, command.attempts);
+  }
+  if (!commandTrackerPending()) {
+    batchDone = true;
+  }
+}
+
+void commandTrackerBegin(CommandReadFunction read) {
+  readRegister = read;
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    commands[i].state = COMMAND_FREE;
+  }
+}
+
+bool commandTrackerAdd(byte unit, byte registerNo, const byte value[4], bool isFloat) {
+  // A new batch starts when nothing is pending; its outcome replaces the previous one.
+  if (!commandTrackerPending()) {
+    batchFailed = false;
+    batchDone = false;
+  }
+
+  // Reuse the entry of the same register (a newer write supersedes the old one), else a free
+  // entry, else the one that finished first.
+  TrackedCommand *slot = nullptr;
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX && slot == nullptr; i++) {
+    if (commands[i].state != COMMAND_FREE && commands[i].unit == unit && commands[i].registerNo == registerNo) {
+      slot = &commands[i];
+    }
+  }
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX && slot == nullptr; i++) {
+    if (commands[i].state == COMMAND_FREE) {
+      slot = &commands[i];
+    }
+  }
+  if (slot == nullptr) {
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+      if (commands[i].state != COMMAND_PENDING && (slot == nullptr || now - commands[i].finishedAt > now - slot->finishedAt)) {
+        slot = &commands[i];
+      }
+    }
+  }
+  if (slot == nullptr) {
+    return false;
+  }
+
+  unsigned long now = millis();
+  slot->unit = unit;
+  slot->registerNo = registerNo;
+  memcpy(slot->value, value, 4);
+  slot->isFloat = isFloat;
+  slot->state = COMMAND_PENDING;
+  slot->attempts = 0;
+  slot->sentAt = now;
+  slot->nextReadAt = now + COMMAND_VERIFY_FIRST_DELAY;
+  slot->finishedAt = 0;
+  return true;
+}
+
+void commandTrackerService() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    TrackedCommand &command = commands[i];
+    if (command.state != COMMAND_PENDING || (long)(now - command.nextReadAt) < 0) {
+      continue;
+    }
+    if (command.attempts >= COMMAND_VERIFY_ATTEMPTS) {
+      finish(command, COMMAND_FAILED);
+      continue;
+    }
+    // A read-back that could not be queued is retried on the next pass without counting as an attempt.
+    if (readRegister == nullptr || !readRegister(command.unit, command.registerNo)) {
+      continue;
+    }
+    command.attempts++;
+    command.nextReadAt = now + (command.attempts < COMMAND_VERIFY_ATTEMPTS
+                                ? COMMAND_VERIFY_FIRST_DELAY << command.attempts
+                                : COMMAND_VERIFY_ANSWER_TIMEOUT);
+  }
+}
+
+bool commandTrackerOnResponse(byte unit, byte registerNo, const byte value[4]) {
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    TrackedCommand &command = commands[i];
+    if (command.state != COMMAND_PENDING || command.unit != unit || command.registerNo != registerNo) {
+      continue;
+    }
+    // A different value usually means the write has not been stored yet; the next read-back will tell.
+    if (valueMatches(command, value)) {
+      finish(command, COMMAND_CONFIRMED);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool commandTrackerPending() {
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    if (commands[i].state == COMMAND_PENDING) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t commandTrackerPendingCount() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    if (commands[i].state == COMMAND_PENDING) {
+      count++;
+    }
+  }
+  return count;
+}
+
+CommandState commandTrackerState(byte unit, byte registerNo, unsigned long since) {
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    const TrackedCommand &command = commands[i];
+    if (command.state != COMMAND_FREE && command.unit == unit && command.registerNo == registerNo) {
+      return (long)(command.sentAt - since) >= 0 ? command.state : COMMAND_FREE;
+    }
+  }
+  return COMMAND_FREE;
+}
+
+unsigned long commandTrackerRemaining() {
+  unsigned long now = millis();
+  unsigned long remaining = 0;
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    const TrackedCommand &command = commands[i];
+    if (command.state != COMMAND_PENDING) {
+      continue;
+    }
+    // Time to the next read-back, plus every later backoff step and the final answer timeout.
+    unsigned long left = (long)(command.nextReadAt - now) > 0 ? command.nextReadAt - now : 0;
+    for (uint8_t attempt = command.attempts + 1; attempt < COMMAND_VERIFY_ATTEMPTS; attempt++) {
+      left += COMMAND_VERIFY_FIRST_DELAY << attempt;
+    }
+    if (command.attempts < COMMAND_VERIFY_ATTEMPTS) {
+      left += COMMAND_VERIFY_ANSWER_TIMEOUT;
+    }
+    remaining = max(remaining, left);
+  }
+  return remaining;
+}
+
+CommandResult commandTrackerResult() {
+  if (!batchDone) {
+    return COMMAND_RESULT_NONE;
+  }
+  return batchFailed ? COMMAND_RESULT_FAILED : COMMAND_RESULT_CONFIRMED;
+}
+
+const char *commandResultName(CommandResult result) {
+  switch (result) {
+    case COMMAND_RESULT_CONFIRMED: return "confirmed";
+    case COMMAND_RESULT_FAILED: return "failed";
+    default: return "none";
+  }
+}
+
+String commandTrackerToJson() {
+  static const char *const stateNames[] = {"free", "pending", "confirmed", "failed"};
+  char hex[5];
+  unsigned long now = millis();
+  String json = "{\"pending\":";
+  json += commandTrackerPending() ? "true" : "false";
+  json += ",\"result\":\"";
+  json += commandResultName(commandTrackerResult());
+  json += "\",\"commands\":[";
+  bool first = true;
+  for (uint8_t i = 0; i < COMMAND_TRACKER_MAX; i++) {
+    const TrackedCommand &command = commands[i];
+    if (command.state == COMMAND_FREE) {
+      continue;
+    }
+    snprintf(hex, sizeof(hex), "0x%02X", command.registerNo);
+    if (!first) json += ",";
+    first = false;
+    json += "{\"unit\":";
+    json += String(command.unit);
+    json += ",\"register\":\"";
+    json += hex;
+    json += "\",\"state\":\"";
+    json += stateNames[command.state];
+    json += "\",\"readBacks\":";
+    json += String(command.attempts);
+    json += ",\"ageMs\":";
+    json += String(now - command.sentAt);
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
@@ -0,0 +1,368 @@
+#include "config_store.h"
+#include "checksum.h"
+#include "command_queue.h"
+#include "json_util.h"
+#include "log.h"
+
+#include <LittleFS.h>
+
+static const char *const SLOT_PATHS[2] = {"/config0.bin", "/config1.bin"};
+// Form fields of the poll periods, by measurement slot.
+static const char *const POLL_FIELDS[MEASUREMENT_COUNT] = {
+  "poll_output_voltage", "poll_output_current", "poll_output_current_limit", "poll_temperature", "poll_supply_voltage"
+};
+
+static ConfigValues defaults;
+static ConfigValues current;
+static ConfigBlob stored;             // the newest blob in flash: loaded at boot, then the last one written
+static ConfigBlob pending;            // the blob being written, kept apart until it is in flash
+static int8_t newestSlot = -1;        // -1 while no slot holds a valid blob
+static ConfigChangeFunction changeCallback = nullptr;
+static ConfigStoreStats stats;
+static bool dirty = false;            // configuration changed and not written yet
+static bool writeFailed = false;      // the last write failed, retry after CONFIG_STORE_RETRY_DELAY
+static bool changed = false;          // run the change callback from loop()
+static bool restartRequested = false;
+static unsigned long restartAt = 0;
+static unsigned long lastWrite = 0;
+static unsigned long lastCheck = 0;
+
+// --- Load ---
+
+/**
+ * @brief Reads a slot in one go and checks it.
+ */
+static bool readSlot(uint8_t slot, ConfigBlob &blob) {
+  File file = LittleFS.open(SLOT_PATHS[slot], "r");
+  return file && file.read((uint8_t *)&blob, sizeof(blob)) == sizeof(blob) &&
+         memcmp(blob.magic, "R48C", 4) == 0 && blob.version == CONFIG_STORE_VERSION &&
+         blob.size == sizeof(blob) && checksumCrc32(&blob, offsetof(ConfigBlob, crc)) == blob.crc;
+}
+
+/**
+ * @brief Applies the safe ranges, putting back the factory range of any the rectifier would not accept.
+ */
+static void applyRanges(ConfigValues &config) {
+  for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+    const R48Setting &setting = R48_SETTINGS[id];
+    if (setting.type != R48_VALUE_FLOAT) {
+      config.settingMin[id] = config.settingMax[id] = 0;
+    } else if (!r48SetSettingRange((R48SettingId)id, config.settingMin[id], config.settingMax[id])) {
+      config.settingMin[id] = setting.minValue;
+      config.settingMax[id] = setting.maxValue;
+      r48SetSettingRange((R48SettingId)id, setting.minValue, setting.maxValue);
+    }
+  }
+}
+
+static bool pollPeriodValid(unsigned long period) {
+  return period >= CONFIG_STORE_MIN_POLL_PERIOD && period <= CONFIG_STORE_MAX_POLL_PERIOD;
+}
+
+void configStoreBegin(const ConfigValues &values, ConfigChangeFunction onChange) {
+  changeCallback = onChange;
+  defaults = values;
+  for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+    defaults.settingMin[id] = R48_SETTINGS[id].minValue;
+    defaults.settingMax[id] = R48_SETTINGS[id].maxValue;
+  }
+  current = defaults;
+  stats = {};
+  stored = {};
+  newestSlot = -1;
+  dirty = changed = restartRequested = writeFailed = false;
+
+  for (uint8_t slot = 0; slot < 2; slot++) {
+    ConfigBlob candidate;
+    if (readSlot(slot, candidate) && (newestSlot < 0 || (int32_t)(candidate.sequence - stored.sequence) > 0)) {
+      stored = candidate;
+      newestSlot = slot;
+    }
+  }
+  if (newestSlot >= 0) {
+    current = stored.config;
+    current.ssid[sizeof(current.ssid) - 1] = '\0';
+    current.password[sizeof(current.password) - 1] = '\0';
+    current.apSsid[sizeof(current.apSsid) - 1] = '\0';
+    current.apPassword[sizeof(current.apPassword) - 1] = '\0';
+    for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+      if (!pollPeriodValid(current.pollPeriods[i])) current.pollPeriods[i] = defaults.pollPeriods[i];
+    }
+    stats.fromFlash = true;
+    stats.slot = newestSlot;
+    stats.sequence = stored.sequence;
+    logEvent(LOG_INFO, EV_SYS_CONFIG_LOADED, logString(SLOT_PATHS[newestSlot]), stored.sequence);
+  } else {
+    logEvent(LOG_INFO, EV_SYS_CONFIG_LOADED, logString("the defaults"), 0);
+  }
+  applyRanges(current);
+  lastWrite = lastCheck = millis();
+}
+
+const ConfigValues &configStoreGet() {
+  return current;
+}
+
+void configStoreRestoreState() {
+  for (uint8_t i = 0; i < stored.unitCount && i < MAX_RECTIFIERS; i++) {
+    float values[MEASUREMENT_COUNT];
+    for (uint8_t slot = 0; slot < MEASUREMENT_COUNT; slot++) {
+      values[slot] = stored.units[i].values[slot];
+    }
+    rectifierRestore(stored.units[i].address, stored.units[i].validMask, values);
+  }
+  // The queue refuses values outside the current safe range
+  for (uint8_t i = 0; i < stored.setpointCount && i < SETPOINT_KEEPALIVE_MAX; i++) {
+    const ConfigCachedSetpoint &setpoint = stored.setpoints[i];
+    if (setpoint.setting < SETTING_COUNT && R48_SETTINGS[setpoint.setting].writeClass == R48_WRITE_ONLINE) {
+      commandQueuePush(setpoint.unit, (R48SettingId)setpoint.setting, setpoint.value);
+    }
+  }
+}
+
+// --- Write ---
+
+/**
+ * @brief True when the kept online setpoints differ from the ones in the newest blob.
+ */
+static bool setpointsChanged() {
+  if (setpointKeepaliveCount() != stored.setpointCount) {
+    return true;
+  }
+  for (uint8_t i = 0; i < stored.setpointCount; i++) {
+    const KeptSetpoint &setpoint = setpointKeepaliveAt(i);
+    if (setpoint.unit != stored.setpoints[i].unit || setpoint.setting != stored.setpoints[i].setting ||
+        setpoint.value != stored.setpoints[i].value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Writes the configuration and the current state to the slot not holding the newest blob.
+ *
+ * Only a blob that made it to flash becomes `stored`; after a failure the change stays pending.
+ */
+static void writeBlob() {
+  lastWrite = millis();
+
+  pending = {};
+  memcpy(pending.magic, "R48C", 4);
+  pending.version = CONFIG_STORE_VERSION;
+  pending.size = sizeof(ConfigBlob);
+  pending.sequence = stats.sequence + 1;
+  pending.config = current;
+  pending.unitCount = rectifierCount();
+  for (uint8_t i = 0; i < pending.unitCount; i++) {
+    const Rectifier &rectifier = rectifierAt(i);
+    pending.units[i].address = rectifier.address;
+    pending.units[i].validMask = rectifier.validMask;
+    for (uint8_t slot = 0; slot < MEASUREMENT_COUNT; slot++) {
+      pending.units[i].values[slot] = rectifier.values[slot];
+    }
+  }
+  pending.setpointCount = setpointKeepaliveCount();
+  for (uint8_t i = 0; i < pending.setpointCount; i++) {
+    const KeptSetpoint &setpoint = setpointKeepaliveAt(i);
+    pending.setpoints[i].unit = setpoint.unit;
+    pending.setpoints[i].setting = setpoint.setting;
+    pending.setpoints[i].value = setpoint.value;
+  }
+  pending.crc = checksumCrc32(&pending, offsetof(ConfigBlob, crc));
+
+  uint8_t slot = newestSlot < 0 ? 0 : newestSlot ^ 1;
+  File file = LittleFS.open(SLOT_PATHS[slot], "w");
+  if (!file || file.write((const uint8_t *)&pending, sizeof(pending)) != sizeof(pending)) {
+    // The other slot still holds the newest valid blob
+    writeFailed = true;
+    stats.writeErrors++;
+    logEvent(LOG_ERROR, EV_SYS_CONFIG_ERROR, logString(SLOT_PATHS[slot]));
+    return;
+  }
+  file.close();
+  stored = pending;
+  dirty = false;
+  writeFailed = false;
+  newestSlot = slot;
+  stats.fromFlash = true;
+  stats.slot = slot;
+  stats.sequence = stored.sequence;
+  stats.writes++;
+}
+
+void configStoreService() {
+  unsigned long now = millis();
+  if (changed) {
+    changed = false;
+    if (changeCallback != nullptr) changeCallback();
+  }
+
+  // A failed write, whatever caused it, is tried again until one makes it to flash
+  bool due = writeFailed ? now - lastWrite >= CONFIG_STORE_RETRY_DELAY : dirty;
+  if (!due && !writeFailed && now - lastCheck >= 1000) {
+    lastCheck = now;
+    due = (rectifierCount() > 0 && now - lastWrite >= CONFIG_STORE_STATE_INTERVAL) ||
+          (now - lastWrite >= CONFIG_STORE_SETPOINT_GAP && setpointsChanged());
+  }
+  if (due) {
+    writeBlob();
+  }
+
+  if (restartRequested && (long)(now - restartAt) >= 0) {
+    ESP.restart();
+  }
+}
+
+ConfigStoreStats configStoreGetStats() {
+  return stats;
+}
+
+// --- HTTP ---
+
+void configStoreHandleStatus(AsyncWebServerRequest *request) {
+  String json = "{\"version\":";
+  json += String(CONFIG_STORE_VERSION);
+  json += ",\"source\":\"";
+  json += stats.fromFlash ? SLOT_PATHS[stats.slot] : "defaults";
+  json += "\",\"sequence\":";
+  json += String(stats.sequence);
+  json += ",\"writes\":";
+  json += String(stats.writes);
+  json += ",\"writeErrors\":";
+  json += String(stats.writeErrors);
+  json += ",\"wifi\":{\"mode\":\"";
+  json += current.wifiApMode ? "ap" : "station";
+  json += "\",\"ssid\":";
+  jsonAppendString(json, current.ssid);
+  json += ",\"passwordSet\":";
+  json += current.password[0] ? "true" : "false";
+  json += ",\"apSsid\":";
+  jsonAppendString(json, current.apSsid);
+  json += ",\"apPasswordSet\":";
+  json += current.apPassword[0] ? "true" : "false";
+  json += "},\"pollPeriods\":{";
+  for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+    if (i) json += ",";
+    json += "\"";
+    json += POLL_FIELDS[i] + 5;
+    json += "\":";
+    json += String(current.pollPeriods[i]);
+  }
+  json += "},\"ranges\":{";
+  bool first = true;
+  for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+    const R48Setting &setting = R48_SETTINGS[id];
+    if (setting.type != R48_VALUE_FLOAT) continue;
+    json += first ? "\"" : ",\"";
+    first = false;
+    json += setting.name;
+    json += "\":{\"min\":";
+    json += String(current.settingMin[id], 3);
+    json += ",\"max\":";
+    json += String(current.settingMax[id], 3);
+    json += "}";
+  }
+  json += "}}";
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Copies a form field into a string of the blob if it fits.
+ */
+static void readText(AsyncWebServerRequest *request, const char *field, char *out, size_t size, size_t minLength,
+                     String &errors) {
+  if (!request->hasParam(field, true)) {
+    return;
+  }
+  const String &text = request->getParam(field, true)->value();
+  if (text.length() < minLength || text.length() >= size) {
+    jsonAppendError(errors, field, "expected " + String(minLength) + " to " + String(size - 1) + " characters");
+    return;
+  }
+  memcpy(out, text.c_str(), text.length() + 1);
+}
+
+/**
+ * @brief The number in a form field, or `value` if the field is missing or not a number.
+ */
+static float readFloat(AsyncWebServerRequest *request, const String &field, float value, String &errors) {
+  if (!request->hasParam(field, true)) {
+    return value;
+  }
+  const String &text = request->getParam(field, true)->value();
+  char *end;
+  float parsed = strtof(text.c_str(), &end);
+  if (end == text.c_str() || *end != '\0') {
+    jsonAppendError(errors, field, "expected a number");
+    return value;
+  }
+  return parsed;
+}
+
+void configStoreHandleControl(AsyncWebServerRequest *request) {
+  // Everything is checked on a copy first
+  ConfigValues candidate = request->hasParam("reset", true) ? defaults : current;
+  String errors;
+
+  if (request->hasParam("wifi_mode", true)) {
+    const String &mode = request->getParam("wifi_mode", true)->value();
+    if (mode == "station" || mode == "ap") {
+      candidate.wifiApMode = mode == "ap";
+    } else {
+      jsonAppendError(errors, "wifi_mode", "expected station or ap");
+    }
+  }
+  readText(request, "ssid", candidate.ssid, sizeof(candidate.ssid), 1, errors);
+  readText(request, "password", candidate.password, sizeof(candidate.password), 0, errors);
+  readText(request, "ap_ssid", candidate.apSsid, sizeof(candidate.apSsid), 1, errors);
+  // A WPA2 passphrase has at least 8 characters; an empty one opens the access point without
+  if (request->hasParam("ap_password", true) && request->getParam("ap_password", true)->value().length() == 0) {
+    candidate.apPassword[0] = '\0';
+  } else {
+    readText(request, "ap_password", candidate.apPassword, sizeof(candidate.apPassword), 8, errors);
+  }
+
+  for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+    if (!request->hasParam(POLL_FIELDS[i], true)) continue;
+    const String &text = request->getParam(POLL_FIELDS[i], true)->value();
+    char *end;
+    unsigned long period = strtoul(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || !pollPeriodValid(period)) {
+      jsonAppendError(errors, POLL_FIELDS[i], "expected " + String(CONFIG_STORE_MIN_POLL_PERIOD) + " to " +
+                                              String(CONFIG_STORE_MAX_POLL_PERIOD) + " ms");
+    } else {
+      candidate.pollPeriods[i] = period;
+    }
+  }
+
+  for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+    const R48Setting &setting = R48_SETTINGS[id];
+    if (setting.type != R48_VALUE_FLOAT) continue;
+    String name = setting.name;
+    candidate.settingMin[id] = readFloat(request, name + "_min", candidate.settingMin[id], errors);
+    candidate.settingMax[id] = readFloat(request, name + "_max", candidate.settingMax[id], errors);
+    if (!(candidate.settingMin[id] >= setting.minValue && candidate.settingMax[id] <= setting.maxValue &&
+          candidate.settingMin[id] <= candidate.settingMax[id])) {
+      jsonAppendError(errors, name + "_min", "the range must lie within " + String(setting.minValue) + " and " +
+                                             String(setting.maxValue));
+    }
+  }
+
+  if (errors.length() > 0) {
+    request->send(400, "application/json", jsonErrorBody(errors));
+    return;
+  }
+
+  current = candidate;
+  applyRanges(current);
+  dirty = true;
+  changed = true;
+  String message = "Configuration saved.";
+  if (request->hasParam("restart", true)) {
+    restartRequested = true;
+    restartAt = millis() + CONFIG_STORE_RESTART_DELAY;
+    message += " Restarting.";
+  }
+  request->send(200, "text/plain", message);
+}
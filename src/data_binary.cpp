@@ -0,0 +1,142 @@
+#include "data_binary.h"
+#include "charger.h"
+#include "command_tracker.h"
+#include "data_snapshot.h"
+
+// Streams being served.
+static uint8_t streams = 0;
+
+size_t dataBinaryEncode(uint8_t *out, size_t size) {
+  uint8_t units = rectifierCount();
+  size_t length = sizeof(DataBinaryHeader) + units * sizeof(DataBinaryUnit);
+  if (length > size) {
+    return 0;
+  }
+
+  unsigned long now = millis();
+  DataBinaryHeader header;
+  memcpy(header.magic, "R48T", 4);
+  header.version = DATA_BINARY_VERSION;
+  header.headerSize = sizeof(DataBinaryHeader);
+  header.unitSize = sizeof(DataBinaryUnit);
+  header.unitCount = units;
+  header.sequence = dataSnapshotVersion();
+  header.uptimeMs = now;
+  header.flags = 0;
+  if (commandTrackerPending()) header.flags |= DATA_BINARY_COMMAND_PENDING;
+  if (commandTrackerResult() == COMMAND_RESULT_FAILED) header.flags |= DATA_BINARY_COMMAND_FAILED;
+  if (chargerRunning()) header.flags |= DATA_BINARY_CHARGER_RUNNING;
+  header.remainingSeconds = min<unsigned long>((commandTrackerRemaining() + 999) / 1000, UINT16_MAX);
+  BankTotals bank = rectifiersBankTotals();
+  header.bank[0] = bank.outputVoltage;
+  header.bank[1] = bank.outputCurrent;
+  header.bank[2] = bank.outputCurrentLimit;
+  header.bank[3] = bank.temperature;
+  header.bank[4] = bank.supplyVoltage;
+  memcpy(out, &header, sizeof(header));
+
+  uint8_t *pos = out + sizeof(header);
+  for (uint8_t u = 0; u < units; u++) {
+    const Rectifier &rectifier = rectifierAt(u);
+    DataBinaryUnit unit;
+    unit.address = rectifier.address;
+    unit.validMask = rectifier.validMask;
+    unit.cachedMask = rectifier.cachedMask;
+    unit.reserved[0] = unit.reserved[1] = 0;
+    memcpy(unit.values, rectifier.values, sizeof(unit.values));
+    for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+      unit.ageMs[i] = rectifierValueAge(rectifier, i);
+    }
+    memcpy(pos, &unit, sizeof(unit));
+    pos += sizeof(unit);
+  }
+  return length;
+}
+
+// --- HTTP ---
+
+// One /data.bin stream: the next frame is due at nextAt.
+struct DataBinaryStream {
+  unsigned long interval;
+  unsigned long nextAt;
+  uint32_t count;   // 0 = until the client disconnects
+  uint32_t sent;
+};
+
+static size_t fillStream(DataBinaryStream &stream, uint8_t *buffer, size_t maxLen) {
+  if (stream.count != 0 && stream.sent >= stream.count) {
+    return 0;
+  }
+  unsigned long now = millis();
+  if ((long)(now - stream.nextAt) < 0) {
+    return RESPONSE_TRY_AGAIN;
+  }
+  // A frame is never split across chunks
+  size_t length = dataBinaryEncode(buffer, maxLen);
+  if (length == 0) {
+    return RESPONSE_TRY_AGAIN;
+  }
+  stream.sent++;
+  // A client that fell behind gets the next frame an interval from now, not a burst
+  stream.nextAt += stream.interval;
+  if ((long)(now - stream.nextAt) >= 0) {
+    stream.nextAt = now + stream.interval;
+  }
+  return length;
+}
+
+/**
+ * @brief Parses a parameter as a non-negative decimal number, or leaves `value` alone when it is missing.
+ * @return false if it is present but not such a number.
+ */
+static bool readNumber(AsyncWebServerRequest *request, const char *name, unsigned long &value) {
+  if (!request->hasParam(name)) {
+    return true;
+  }
+  const String &text = request->getParam(name)->value();
+  // strtoul() would take a sign and wrap a negative number around
+  if (!isdigit((unsigned char)text.c_str()[0])) {
+    return false;
+  }
+  char *end;
+  value = strtoul(text.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+void dataBinaryHandleRequest(AsyncWebServerRequest *request) {
+  if (!request->hasParam("interval")) {
+    // A buffer response would keep pointing at the frame after this returns, so it is copied into a stream
+    uint8_t frame[sizeof(DataBinaryHeader) + MAX_RECTIFIERS * sizeof(DataBinaryUnit)];
+    size_t length = dataBinaryEncode(frame, sizeof(frame));
+    AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", length);
+    response->write(frame, length);
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+    return;
+  }
+
+  unsigned long interval = 0;
+  unsigned long count = 0;
+  if (!readNumber(request, "interval", interval) || !readNumber(request, "count", count)) {
+    request->send(400, "text/plain", "Invalid value, interval is in ms and count a number of frames (0 = no limit).");
+    return;
+  }
+  if (streams >= DATA_BINARY_MAX_STREAMS) {
+    request->send(503, "text/plain", "Too many /data.bin streams.");
+    return;
+  }
+  DataBinaryStream stream;
+  stream.interval = max(interval, DATA_BINARY_MIN_INTERVAL);
+  stream.count = count;
+  stream.sent = 0;
+  stream.nextAt = millis();
+
+  streams++;
+  request->onDisconnect([]() { streams--; });
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+    [stream](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      return fillStream(stream, buffer, maxLen);
+    });
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
@@ -0,0 +1,169 @@
+#include <stdarg.h>
+
+#include "data_snapshot.h"
+#include "rectifiers.h"
+
+static char buffers[2][DATA_SNAPSHOT_SIZE];
+static size_t lengths[2] = {0, 0};
+// Responses currently streaming each buffer.
+static uint8_t readers[2] = {0, 0};
+static uint8_t published = 0;
+
+static uint32_t version = 0;
+// Changes with every boot so an ETag cached before a reboot cannot match a new version.
+static uint16_t bootId = 0;
+static char etag[16];
+
+static bool dirty = true;
+static unsigned long lastBuild = 0;
+
+static bool commandPending = false;
+static unsigned long remainingSeconds = 0;
+static const char *commandResult = "none";
+
+static const char *const valueNames[MEASUREMENT_COUNT] = {
+  "outputVoltage", "outputCurrent", "outputCurrentLimit", "temperature", "supplyVoltage"
+};
+
+/**
+ * @brief Appends printf-style text to a snapshot buffer, never past its end.
+ */
+static void append(char *buffer, size_t &pos, const char *format, ...) {
+  if (pos >= DATA_SNAPSHOT_SIZE) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer + pos, DATA_SNAPSHOT_SIZE - pos, format, args);
+  va_end(args);
+  if (n > 0) {
+    pos += n;
+  }
+}
+
+/**
+ * @brief Serializes the current values into a buffer.
+ * @return The document length, or DATA_SNAPSHOT_SIZE or more if it did not fit.
+ */
+static size_t serialize(char *buffer, uint32_t newVersion) {
+  size_t pos = 0;
+
+  // Top-level values are bank totals: voltages and current limit averaged, currents summed, hottest temperature
+  BankTotals bank = rectifiersBankTotals();
+  append(buffer, pos, "{\"version\":%u,\"outputVoltage\":%.2f,\"outputCurrent\":%.2f,\"outputCurrentLimit\":%.2f,"
+         "\"temperature\":%.2f,\"supplyVoltage\":%.2f,\"unitCount\":%u,\"isCommandPending\":%s,\"remainingTime\":%lu,\"commandResult\":\"%s\"",
+         (unsigned)newVersion, bank.outputVoltage, bank.outputCurrent, bank.outputCurrentLimit,
+         bank.temperature, bank.supplyVoltage, bank.units, commandPending ? "true" : "false", remainingSeconds, commandResult);
+
+  // Per-unit values, with the milliseconds since each one was refreshed (null until the first answer)
+  append(buffer, pos, ",\"units\":[");
+  for (uint8_t u = 0; u < rectifierCount(); u++) {
+    const Rectifier &rectifier = rectifierAt(u);
+    append(buffer, pos, "%s{\"address\":%u", u ? "," : "", rectifier.address);
+    for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+      append(buffer, pos, ",\"%s\":%.2f", valueNames[i], rectifier.values[i]);
+    }
+    append(buffer, pos, ",\"ageMs\":{");
+    for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+      unsigned long age = rectifierValueAge(rectifier, i);
+      if (age == 0xFFFFFFFF) {
+        append(buffer, pos, "%s\"%s\":null", i ? "," : "", valueNames[i]);
+      } else {
+        append(buffer, pos, "%s\"%s\":%lu", i ? "," : "", valueNames[i], age);
+      }
+    }
+    // Restored from flash at boot and not answered since
+    append(buffer, pos, "},\"cached\":%s}", rectifier.cachedMask ? "true" : "false");
+  }
+  append(buffer, pos, "]}");
+  return pos;
+}
+
+/**
+ * @brief Rebuilds the snapshot into the spare buffer and publishes it.
+ * @return false if the spare buffer is still being served.
+ */
+static bool rebuild() {
+  uint8_t spare = published ^ 1;
+  if (readers[spare] != 0) {
+    return false;
+  }
+
+  size_t length = serialize(buffers[spare], version + 1);
+  if (length >= DATA_SNAPSHOT_SIZE) {
+    // Should not happen with MAX_RECTIFIERS units; keep serving the last complete document.
+    dirty = false;
+    lastBuild = millis();
+    return true;
+  }
+
+  lengths[spare] = length;
+  published = spare;
+  version++;
+  snprintf(etag, sizeof(etag), "\"%04x-%x\"", bootId, (unsigned)version);
+  dirty = false;
+  lastBuild = millis();
+  return true;
+}
+
+void dataSnapshotBegin() {
+  bootId = ESP.random();
+  dirty = true;
+  rebuild();
+}
+
+void dataSnapshotMarkChanged() {
+  dirty = true;
+}
+
+void dataSnapshotSetStatus(bool pending, unsigned long remaining, const char *result) {
+  if (pending != commandPending || remaining != remainingSeconds || strcmp(result, commandResult) != 0) {
+    commandPending = pending;
+    remainingSeconds = remaining;
+    commandResult = result;
+    dirty = true;
+  }
+}
+
+void dataSnapshotService() {
+  if (!dirty && (rectifierCount() == 0 || millis() - lastBuild < DATA_SNAPSHOT_REFRESH)) {
+    return;
+  }
+  rebuild();
+}
+
+bool dataSnapshotIsCurrent() {
+  return !dirty;
+}
+
+const char *dataSnapshotJson() {
+  return buffers[published];
+}
+
+uint32_t dataSnapshotVersion() {
+  return version;
+}
+
+void dataSnapshotHandleRequest(AsyncWebServerRequest *request) {
+  char heapFree[12];
+  char heapMaxBlock[12];
+  snprintf(heapFree, sizeof(heapFree), "%u", (unsigned)ESP.getFreeHeap());
+  snprintf(heapMaxBlock, sizeof(heapMaxBlock), "%u", (unsigned)ESP.getMaxFreeBlockSize());
+
+  AsyncWebServerResponse *response;
+  const AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+  if (ifNoneMatch != nullptr && etag[0] != '\0' && strstr(ifNoneMatch->value().c_str(), etag) != nullptr) {
+    response = request->beginResponse(304);
+  } else {
+    // The response streams straight from the published buffer, which stays pinned until the client is gone.
+    uint8_t slot = published;
+    readers[slot]++;
+    request->onDisconnect([slot]() { readers[slot]--; });
+    response = request->beginResponse(200, "application/json", (const uint8_t *)buffers[slot], lengths[slot]);
+  }
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  response->addHeader("X-Heap-Free", heapFree);
+  response->addHeader("X-Heap-Max-Block", heapMaxBlock);
+  request->send(response);
+}
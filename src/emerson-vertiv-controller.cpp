@@ -3,16 +3,51 @@
 //
 // The web page allows you to send commands to a Vertiv R48-2000e3
 // power supply over CAN bus and display live measurement data.
-// This version uses the mcp_can library, which you confirmed works for you.
+// The CAN controller is an MCP2515 (mcp_can library), or a Linux SocketCAN
+// interface when built with R48_SOCKETCAN (see can_driver.h).
 
-// Include necessary libraries for ESP8266, WiFi, WebServer, and mcp_can.
+// Include necessary libraries for ESP8266, WiFi, WebServer, and the CAN driver.
+#ifdef R48_SOCKETCAN
+#include "can_socketcan.h"
+#else
 #include <SPI.h>
 #include <mcp_can.h>
+#include "can_mcp2515.h"
+#endif
 #include <ESP8266WiFi.h>
 #include <ESPAsyncTCP.h>
 #include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include <time.h>
+
+#include "can_capture.h"
+#include "can_filter.h"
+#include "can_rx.h"
+#include "charger.h"
+#include "command_queue.h"
+#include "config_store.h"
+#include "command_tracker.h"
+#include "data_binary.h"
+#include "data_snapshot.h"
+#include "energy.h"
+#include "history.h"
+#include "live_events.h"
+#include "log.h"
+#include "metrics.h"
+#include "poll_scheduler.h"
+#include "profiler.h"
+#include "r48_protocol.h"
+#include "r48_registers.h"
+#include "register_cache.h"
+#include "rectifiers.h"
+#include "settings_batch.h"
+#include "setpoint_keepalive.h"
+#include "udp_setpoint.h"
+#include "web_ui.h"
+#include "wifi_link.h"
 
 // --- WiFi Configuration ---
+// Defaults until set through /config (see config_store.h).
 // Set this to true to create an Access Point, false to connect to a network.
 const bool WIFI_AP_MODE = false;
 
@@ -37,295 +72,90 @@ const char* password = "password1234";
 // Define the Chip Select pin for the MCP2515 CAN module
 const int SPI_CS_PIN = D8; // 15 is D8 on ESP8266 // 21; // 21 is D3 on XIAO ESP32C6
 
+// Define the interrupt pin wired to the MCP2515 INT output
+const int CAN_INT_PIN = D1; // 5 is D1 on ESP8266 // 2; // 2 is D2 on XIAO ESP32C6
+
+#ifdef R48_SOCKETCAN
+// R48_SOCKETCAN names the interface, e.g. -DR48_SOCKETCAN=\"can0\"
+SocketCanDriver canDriver(R48_SOCKETCAN);
+#else
 // Create an instance of the MCP_CAN library with the Chip Select pin
 MCP_CAN CAN0(SPI_CS_PIN);
+Mcp2515Driver canDriver(CAN0, SPI_CS_PIN, CAN_INT_PIN);
+#endif
 
 // Create an AsyncWebServer instance on port 80
 AsyncWebServer server(80);
 
-// --- CAN Bus Definitions ---
-// These are the CAN IDs based on the working example you provided.
-const long VERTIV_COMMAND_ID = 0x06080783;
-const long VERTIV_READ_REQUEST_ID = 0x06000783;
-const long VERTIV_RESPONSE_ID = 0x860F8003; // Updated CAN ID based on your logs
-const unsigned long CAN_BUS_SPEED = 125000; // 125 Kbps
-
-// Enum for measurement numbers
-enum MeasurementType {
-  OUTPUT_VOLTAGE = 0x01,
-  OUTPUT_CURRENT = 0x02,
-  OUTPUT_CURRENT_LIMIT = 0x03,
-  TEMPERATURE = 0x04,
-  SUPPLY_VOLTAGE = 0x05,
-  // Define command types for confirmation
-  SET_PERMANENT_VOLTAGE_CMD = 0x24,
-  SET_PERMANENT_CURRENT_LIMIT_CMD = 0x19,
-  SET_PERMANENT_MAX_INPUT_CURRENT_CMD = 0x1A
-};
-
-// --- Global variables to store the latest measurement data ---
-// We'll initialize them with default values.
-float outputVoltage = 0.0;
-float outputCurrent = 0.0;
-float outputCurrentLimit = 0.0;
-float temperature = 0.0;
-float supplyVoltage = 0.0;
-
-// --- Variables for command delay logic ---
-bool isCommandPending = false;
-unsigned long commandSentTime = 0;
-// Set the fixed delay for permanent commands to 45 seconds as requested
-const unsigned long PERMANENT_COMMAND_DELAY = 45000; // 45 seconds
-
-// --- HTML and JavaScript for the Web Page ---
-// This entire string will be sent to the client when they access the root URL.
-const char* html_page = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-  <title>Vertiv CAN Control</title>
-  <meta name="viewport" content="width=device-width, initial-scale=1">
-  <style>
-    body { font-family: sans-serif; margin: 20px; background-color: #f0f0f0; }
-    .container { max-width: 600px; margin: auto; padding: 20px; background-color: #fff; border-radius: 8px; box-shadow: 0 4px 8px rgba(0,0,0,0.1); }
-    h1, h2 { color: #333; }
-    .data-card { background-color: #e9e9e9; padding: 15px; border-radius: 6px; margin-bottom: 10px; }
-    .data-card p { margin: 0; font-size: 1.2em; }
-    .data-card span { font-weight: bold; color: #007BFF; }
-    form { margin-top: 20px; padding: 15px; background-color: #f9f9f9; border-radius: 6px; }
-    input[type="number"], button { width: 100%; padding: 10px; margin-bottom: 10px; border-radius: 4px; border: 1px solid #ccc; box-sizing: border-box; }
-    button { background-color: #007BFF; color: white; border: none; cursor: pointer; font-size: 1em; }
-    button:hover:not(:disabled) { background-color: #0056b3; }
-    button:disabled { background-color: #ccc; cursor: not-allowed; }
-    .status-message {
-      background-color: #ffc107;
-      color: #333;
-      padding: 10px;
-      border-radius: 6px;
-      margin-top: 10px;
-      text-align: center;
-      font-weight: bold;
-    }
-  </style>
-</head>
-<body>
-  <div class="container">
-    <h1>Vertiv R48-2000e3 Control</h1>
-   
-    <h2>Live Data</h2>
-    <div class="data-card">
-      <p>Output Voltage: <span id="outputVoltage">--</span> V</p>
-    </div>
-    <div class="data-card">
-      <p>Output Current: <span id="outputCurrent">--</span> A</p>
-    </div>
-    <div class="data-card">
-      <p>Current Limit: <span id="currentLimit">--</span> %</p>
-    </div>
-    <div class="data-card">
-      <p>Temperature: <span id="temperature">--</span> C</p>
-    </div>
-    <div class="data-card">
-      <p>Supply Voltage: <span id="supplyVoltage">--</span> V</p>
-    </div>
-    <div id="statusMessage" class="status-message" style="display: none;"></div>
-
-    <h2>Set Permanent Voltage</h2>
-    <form id="permVoltageForm">
-      <input type="number" step="0.1" name="value" placeholder="e.g., 52.5" required>
-      <button type="submit" class="command-button">Set Permanent Voltage</button>
-    </form>
-
-    <h2>Set Online Voltage</h2>
-    <form id="onlineVoltageForm">
-      <input type="number" step="0.1" name="value" placeholder="e.g., 50.0" required>
-      <button type="submit" class="command-button">Set Online Voltage</button>
-    </form>
-
-    <h2>Set Permanent Current Limit</h2>
-    <form id="permCurrentForm">
-      <input type="number" step="0.01" name="value" placeholder="e.g., 0.5 (for 50%)" required>
-      <button type="submit" class="command-button">Set Permanent Current Limit</button>
-    </form>
-
-    <h2>Set Online Current Limit</h2>
-    <form id="onlineCurrentForm">
-      <input type="number" step="0.01" name="value" placeholder="e.g., 0.5 (for 50%)" required>
-      <button type="submit" class="command-button">Set Online Current Limit</button>
-    </form>
-
-    <h2>Set Diesel Input Current Limit</h2>
-    <form id="dieselCurrentForm">
-      <input type="number" step="0.01" name="value" placeholder="e.g., 5.21 (for 1200W)" required>
-      <button type="submit" class="command-button">Set Diesel Input Current Limit</button>
-    </form>
-
-    <h2>Set Fan Speed</h2>
-    <form id="fanSpeedForm">
-      <button type="submit" name="speed" value="auto" class="command-button">Auto</button>
-      <button type="submit" name="speed" value="full" class="command-button">Full Speed</button>
-    </form>
-
-    <h2>Walk-in Control</h2>
-    <form id="walkInStateForm">
-      <button type="submit" name="state" value="on" class="command-button">Walk-in On</button>
-      <button type="submit" name="state" value="off" class="command-button">Walk-in Off</button>
-    </form>
-    <form id="walkInTimeForm">
-      <input type="number" step="1" name="value" placeholder="e.g., 10 (seconds)" required>
-      <button type="submit" class="command-button">Set Walk-in Time</button>
-    </form>
-
-  </div>
-
-  <script>
-    // Function to update the data display and button states
-    function updateData() {
-      fetch('/data')
-        .then(response => response.json())
-        .then(data => {
-          document.getElementById('outputVoltage').innerText = data.outputVoltage.toFixed(2);
-          document.getElementById('outputCurrent').innerText = data.outputCurrent.toFixed(2);
-          document.getElementById('currentLimit').innerText = (data.outputCurrentLimit * 100).toFixed(2);
-          document.getElementById('temperature').innerText = data.temperature.toFixed(2);
-          document.getElementById('supplyVoltage').innerText = data.supplyVoltage.toFixed(2);
-         
-          const buttons = document.querySelectorAll('.command-button');
-          const messageBox = document.getElementById('statusMessage');
-
-          if (data.isCommandPending) {
-            buttons.forEach(button => button.disabled = true);
-            messageBox.style.display = 'block';
-            messageBox.innerText = 'Waiting for command to be processed... ' + data.remainingTime + ' seconds remaining';
-          } else {
-            buttons.forEach(button => button.disabled = false);
-            messageBox.style.display = 'none';
-          }
-        })
-        .catch(error => console.error('Error fetching data:', error));
-    }
-   
-    // Set up form submission handlers
-    document.getElementById('permVoltageForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_perm_v', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    document.getElementById('onlineVoltageForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_online_v', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    document.getElementById('permCurrentForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_perm_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    document.getElementById('onlineCurrentForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_online_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    document.getElementById('dieselCurrentForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_diesel_input_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-   
-    // New handler for fan speed form submission
-    document.getElementById('fanSpeedForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const speed = event.submitter.value;
-      fetch('/set_fan_speed', { method: 'POST', body: 'speed=' + speed, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    // New handler for walk-in state form submission (on/off)
-    document.getElementById('walkInStateForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const state = event.submitter.value;
-      fetch('/set_walk_in', { method: 'POST', body: 'state=' + state, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    // New form handler for walk-in time using a POST request
-    document.getElementById('walkInTimeForm').addEventListener('submit', function(event) {
-      event.preventDefault();
-      const value = this.elements.value.value;
-      fetch('/set_walk_in_time', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
-        .then(response => response.text())
-        .then(text => alert(text))
-        .catch(error => console.error('Error:', error));
-    });
-
-    // Request data every 1 second to keep the countdown live
-    setInterval(updateData, 1000);
-    // Initial data fetch on page load
-    updateData();
-  </script>
-</body>
-</html>
-)rawliteral";
+// --- UDP setpoint stream ---
+// Port of the binary setpoint stream from an energy manager (see udp_setpoint.h).
+const uint16_t UDP_SETPOINT_PORT = 4848;
+
+// --- Wall Clock ---
+// UTC from SNTP once the network is up; the energy meter's days are UTC days.
+const char* NTP_SERVER = "pool.ntp.org";
+// time() counts from 0 at boot until SNTP answered; anything before 2020 means not set yet.
+const time_t WALL_CLOCK_VALID = 1577836800;
+
+// --- Logging Configuration ---
+// Log records below this level are discarded before they are queued (LOG_DEBUG dumps every CAN frame).
+const uint8_t LOG_DEFAULT_LEVEL = LOG_INFO;
+
+// --- CAN Bus Configuration ---
+// The CAN IDs and measurement numbers live in r48_protocol.h.
+// Set this to true to receive every frame on the bus instead of only the ones we parse.
+const bool CAN_PROMISCUOUS_MODE = false;
+
+// --- Rectifier discovery ---
+// A broadcast read request is sent this often to find rectifiers that joined the bus.
+const unsigned long DISCOVERY_INTERVAL = 10000;
+// Filter entry matching the answers of every rectifier (any source address). It stays registered: opening it only
+// for each discovery would reprogram the filters twice per DISCOVERY_INTERVAL, and the MCP2515 drops the frames that
+// arrive while it is in configuration mode.
+const unsigned long DISCOVERY_FILTER_MASK = CAN_FILTER_EXACT & ~R48_SOURCE_ADDRESS_BITS;
+
+// --- Measurement polling schedule ---
+// How often each measurement is refreshed by default (/config changes it), and which one wins when several
+// are due (0 = most urgent).
+const unsigned long OUTPUT_CURRENT_PERIOD = 200;
+const unsigned long OUTPUT_VOLTAGE_PERIOD = 1000;
+const unsigned long OUTPUT_CURRENT_LIMIT_PERIOD = 2000;
+const unsigned long SUPPLY_VOLTAGE_PERIOD = 5000;
+const unsigned long TEMPERATURE_PERIOD = 10000;
+
+// The latest measurement data of every rectifier is kept in the table in rectifiers.cpp.
+unsigned long lastDiscoveryTime = 0;
 
 // --- Function Prototypes ---
-void setVertivVoltagePermanent(float voltage);
-void setVertivVoltageOnline(float voltage);
-void setVertivCurrentPermanent(float currentPercentage);
-void setVertivCurrentOnline(float currentPercentage);
-void setVertivMaxInputCurrent(float current);
-void readVertivSetting(byte measurementNo);
+bool readVertivSetting(byte address, byte measurementNo);
+void discoverRectifiers();
+void onRectifierChange(byte address, bool added);
+void schedulePolling(byte address);
+void onConfigChange();
+void energyFollowPollPeriods();
+void onWifiChange(bool connected);
 void processIncomingCanMessages();
-void setVertivFanSpeed(bool fullSpeed);
-void setVertivWalkIn(bool on);
-void setVertivWalkInTime(float seconds);
-
-// Helper function to convert 4 bytes (big-endian) to a float
-float bytesToFloat(byte b[4]) {
-  union { float f; byte b[4]; } converter;
-  // Copy bytes with explicit order, assuming CAN data is big-endian
-  converter.b[3] = b[0];
-  converter.b[2] = b[1];
-  converter.b[1] = b[2];
-  converter.b[0] = b[3];
-  return converter.f;
-}
+void handleCanFrame(const CanFrame &frame);
+uint32_t wallClockSeconds();
+bool sendVertivFrame(unsigned long id, byte data[8]);
+bool commandTargets(AsyncWebServerRequest *request, byte targets[MAX_RECTIFIERS], uint8_t &count);
+float settingValue(AsyncWebServerRequest *request, const R48Setting &setting);
+void handleSettingRequest(AsyncWebServerRequest *request, R48SettingId id);
+unsigned long commandRemainingSeconds();
 
 void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
-  pinMode(D1, INPUT); // MCP2515 INT pin as input (unused in this sketch)
   digitalWrite(LED_BUILTIN, HIGH); // Turn the LED off initially to indicate offline state
 
   Serial.begin(115200);
   Serial.println("ESP32 Web Server for Vertiv CAN Control");
+  logSetLevel(LOG_DEFAULT_LEVEL);
 
-  // Initialize MCP2515 running at 8MHz with a baudrate of 125kb/s and the masks and filters disabled.
-  if(CAN0.begin(MCP_ANY, CAN_125KBPS, MCP_8MHZ) == CAN_OK) {
-    Serial.println("MCP2515 Initialized Successfully!");
+  // Start the CAN controller at 125kb/s in normal mode, with the masks and filters enabled.
+  if (canDriver.begin()) {
+    Serial.println("CAN Controller Initialized Successfully!");
   } else {
-    Serial.println("Error Initializing MCP2515...");
+    Serial.println("Error Initializing CAN Controller...");
     // blink default LED 3 times to indicate error and restart
     for (int i = 0; i < 3; i++) {
       digitalWrite(LED_BUILTIN, LOW);
@@ -341,545 +171,648 @@ void setup() {
     ESP.restart();
   }
  
-  // The Adafruit library's begin() function handles setting the bitrate.
   Serial.println("CAN init OK!");
  
-  // Set to normal mode to allow messages to be transmitted.
-  CAN0.setMode(MCP_NORMAL);
+  // Only let the frames we actually parse through the hardware filters: the answers of every rectifier, tracked or
+  // not yet discovered. The set never changes, so the filters are programmed once here.
+  canFilterBegin(canDriver);
+  canFilterAdd(r48ResponseId(0), DISCOVERY_FILTER_MASK);
+  canFilterSetPromiscuous(CAN_PROMISCUOUS_MODE);
+  canFilterService();
+
+  // Receive frames into the ring from loop(); the MCP2515 backend is woken by its INT pin.
+  canRxBegin(canDriver);
+
+  // --- File System ---
+  // Holds the configuration, the CAN capture files and the energy journal; LittleFS formats the partition if it
+  // cannot mount it.
+  if (!LittleFS.begin()) {
+    Serial.println("Error mounting LittleFS, the configuration and CAN capture will not be saved.");
+  }
+
+  // --- Configuration ---
+  // Read from flash in one go; the constants above are the defaults
+  ConfigValues defaults = {};
+  defaults.wifiApMode = WIFI_AP_MODE;
+  strncpy(defaults.ssid, ssid, sizeof(defaults.ssid) - 1);
+  strncpy(defaults.password, password, sizeof(defaults.password) - 1);
+  strncpy(defaults.apSsid, ap_ssid, sizeof(defaults.apSsid) - 1);
+  strncpy(defaults.apPassword, ap_password, sizeof(defaults.apPassword) - 1);
+  defaults.pollPeriods[measurementSlot(OUTPUT_VOLTAGE)] = OUTPUT_VOLTAGE_PERIOD;
+  defaults.pollPeriods[measurementSlot(OUTPUT_CURRENT)] = OUTPUT_CURRENT_PERIOD;
+  defaults.pollPeriods[measurementSlot(OUTPUT_CURRENT_LIMIT)] = OUTPUT_CURRENT_LIMIT_PERIOD;
+  defaults.pollPeriods[measurementSlot(TEMPERATURE)] = TEMPERATURE_PERIOD;
+  defaults.pollPeriods[measurementSlot(SUPPLY_VOLTAGE)] = SUPPLY_VOLTAGE_PERIOD;
+  configStoreBegin(defaults, onConfigChange);
+  const ConfigValues &config = configStoreGet();
 
   // --- WiFi Setup ---
-  if (WIFI_AP_MODE) {
-    WiFi.softAP(ap_ssid, ap_password);
+  // Connects in the background from loop(), retrying with backoff and opening ap_ssid if the network stays away
+  wifiLinkBegin(config.wifiApMode, config.ssid, config.password, config.apSsid, config.apPassword, onWifiChange);
+  if (config.wifiApMode) {
     Serial.print("Access Point created! IP Address: ");
     Serial.println(WiFi.softAPIP());
-  } else {
-    WiFi.begin(ssid, password);
-    while (WiFi.status() != WL_CONNECTED) {
-      delay(500);
-      Serial.print(".");
-    }
-    Serial.println("");
-    Serial.print("Connected to WiFi! IP Address: ");
-    Serial.println(WiFi.localIP());
+    digitalWrite(LED_BUILTIN, LOW); // Turn the LED on to indicate we are now online
   }
 
-  digitalWrite(LED_BUILTIN, LOW); // Turn the LED on to indicate we are now online
+  // Set the clock from SNTP in the background (UTC)
+  configTime(0, 0, NTP_SERVER);
+
+  canCaptureBegin();
+
+  // Restore the Wh/Ah counters from their journal in LittleFS
+  energyBegin(wallClockSeconds);
+  energyFollowPollPeriods();
  
   // --- Web Server Routes Setup ---
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send_P(200, "text/html", html_page);
-  });
+  // The page, stylesheet and script are embedded gzipped from web/ (see web_ui.h)
+  webUiBegin(server);
  
-  server.on("/data", HTTP_GET, [](AsyncWebServerRequest *request){
-    String jsonResponse = "{\"outputVoltage\":";
-    jsonResponse += String(outputVoltage, 2);
-    jsonResponse += ",\"outputCurrent\":";
-    jsonResponse += String(outputCurrent, 2);
-    jsonResponse += ",\"outputCurrentLimit\":";
-    jsonResponse += String(outputCurrentLimit, 2);
-    jsonResponse += ",\"temperature\":";
-    jsonResponse += String(temperature, 2);
-    jsonResponse += ",\"supplyVoltage\":";
-    jsonResponse += String(supplyVoltage, 2);
-    jsonResponse += ",\"isCommandPending\":";
-    jsonResponse += isCommandPending ? "true" : "false";
-    jsonResponse += ",\"remainingTime\":";
-   
-    // Calculate the remaining time in seconds for the countdown
-    if (isCommandPending) {
-        unsigned long elapsedTime = millis() - commandSentTime;
-        long remaining = (long)PERMANENT_COMMAND_DELAY - (long)elapsedTime;
-        jsonResponse += String(remaining > 0 ? remaining / 1000 : 0);
-    } else {
-        jsonResponse += "0";
-    }
+  metricsRoute(server, "/data", HTTP_GET, [](AsyncWebServerRequest *request){
+    dataSnapshotHandleRequest(request);
+  });
+
+  // The same values as fixed-layout little-endian frames, polled or streamed with ?interval=ms (see data_binary.h)
+  metricsRoute(server, "/data.bin", HTTP_GET, [](AsyncWebServerRequest *request){
+    dataBinaryHandleRequest(request);
+  });
+
+  // Bank history for trend graphs: ?res=fine|coarse&format=csv|bin (see history.h)
+  metricsRoute(server, "/history", HTTP_GET, [](AsyncWebServerRequest *request){
+    historyHandleRequest(request);
+  });
+
+  metricsRoute(server, "/can_stats", HTTP_GET, [](AsyncWebServerRequest *request){
+    CanRxStats stats = canRxGetStats();
+    String jsonResponse = "{\"interrupts\":";
+    jsonResponse += String(stats.interrupts);
+    jsonResponse += ",\"received\":";
+    jsonResponse += String(stats.received);
+    jsonResponse += ",\"overruns\":";
+    jsonResponse += String(stats.overruns);
+    jsonResponse += ",\"highWater\":";
+    jsonResponse += String(stats.highWater);
+    jsonResponse += ",\"ringSize\":";
+    jsonResponse += String(CAN_RX_RING_SIZE);
+    jsonResponse += ",\"hwOverflow\":";
+    jsonResponse += stats.hwOverflows > 0 ? "true" : "false";
+    jsonResponse += ",\"hwOverflows\":";
+    jsonResponse += String(stats.hwOverflows);
     jsonResponse += "}";
 
     request->send(200, "application/json", jsonResponse);
   });
- 
-  server.on("/set_perm_v", HTTP_POST, [](AsyncWebServerRequest *request){
-    float voltage = request->getParam(0)->value().toFloat();
-    if (voltage > 0) {
-      setVertivVoltagePermanent(voltage);
-      // Dynamic alert message
-      String message = "Command sent: set_perm_v " + String(voltage) + ". Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-      request->send(200, "text/plain", message);
-    } else {
-      request->send(400, "text/plain", "Invalid voltage value.");
-    }
+
+  metricsRoute(server, "/scheduler", HTTP_GET, [](AsyncWebServerRequest *request){
+    request->send(200, "application/json", pollSchedulerToJson());
   });
 
-  server.on("/set_online_v", HTTP_POST, [](AsyncWebServerRequest *request){
-    float voltage = request->getParam(0)->value().toFloat();
-    if (voltage > 0) {
-      setVertivVoltageOnline(voltage);
-      request->send(200, "text/plain", "Command sent: set_online_v " + String(voltage));
-    } else {
-      request->send(400, "text/plain", "Invalid voltage value.");
-    }
+  // Every register the rectifiers answer, the discovery sweep, and polling the ones found (see register_cache.h)
+  metricsRoute(server, "/reg/*", HTTP_GET, [](AsyncWebServerRequest *request){
+    registerCacheHandleRegister(request);
   });
 
-  server.on("/set_perm_c", HTTP_POST, [](AsyncWebServerRequest *request){
-    float currentPercentage = request->getParam(0)->value().toFloat();
-    if (currentPercentage >= 0.1 && currentPercentage <= 1.21) {
-      setVertivCurrentPermanent(currentPercentage);
-      // Dynamic alert message
-      String message = "Command sent: set_perm_c " + String(currentPercentage) + ". Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-      request->send(200, "text/plain", message);
-    } else {
-      request->send(400, "text/plain", "Invalid current percentage.");
-    }
+  metricsRoute(server, "/reg", HTTP_GET, [](AsyncWebServerRequest *request){
+    registerCacheHandleStatus(request);
   });
 
-  server.on("/set_online_c", HTTP_POST, [](AsyncWebServerRequest *request){
-    float currentPercentage = request->getParam(0)->value().toFloat();
-    if (currentPercentage >= 0.1 && currentPercentage <= 1.21) {
-      setVertivCurrentOnline(currentPercentage);
-      request->send(200, "text/plain", "Command sent: set_online_c " + String(currentPercentage));
-    } else {
-      request->send(400, "text/plain", "Invalid current percentage.");
-    }
+  metricsRoute(server, "/reg", HTTP_POST, [](AsyncWebServerRequest *request){
+    registerCacheHandleControl(request);
   });
 
-  server.on("/set_diesel_input_c", HTTP_POST, [](AsyncWebServerRequest *request){
-    float current = request->getParam(0)->value().toFloat();
-    if (current >= 3 && current <= 13) {
-      setVertivMaxInputCurrent(current);
-      request->send(200, "text/plain", "Command sent: set_diesel_input_c " + String(current));
-    } else {
-      request->send(400, "text/plain", "Invalid current, valid values between 3 and 13.");
-    }
+  metricsRoute(server, "/commands", HTTP_GET, [](AsyncWebServerRequest *request){
+    request->send(200, "application/json", commandTrackerToJson());
   });
- 
-  server.on("/set_fan_speed", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (request->hasParam("speed", true)) {
-        String speed = request->getParam("speed", true)->value();
-        if (speed == "full") {
-          setVertivFanSpeed(true);
-          String message = "Command sent: set fan to full speed. Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-          request->send(200, "text/plain", message);
-        } else if (speed == "auto") {
-          setVertivFanSpeed(false);
-          String message = "Command sent: set fan to auto. Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-          request->send(200, "text/plain", message);
-        } else {
-          request->send(400, "text/plain", "Invalid fan speed command.");
-        }
-    } else {
-        request->send(400, "text/plain", "Missing fan speed parameter.");
+
+  metricsRoute(server, "/log", HTTP_GET, [](AsyncWebServerRequest *request){
+    LogStats stats = logGetStats();
+    char mask[11];
+    snprintf(mask, sizeof(mask), "0x%08lX", (unsigned long)logMask);
+    String jsonResponse = "{\"level\":\"";
+    jsonResponse += logLevelName(logLevel);
+    jsonResponse += "\",\"mask\":\"";
+    jsonResponse += mask;
+    jsonResponse += "\",\"written\":";
+    jsonResponse += String(stats.written);
+    jsonResponse += ",\"dropped\":";
+    jsonResponse += String(stats.dropped);
+    jsonResponse += ",\"pending\":";
+    jsonResponse += String(stats.pending);
+    jsonResponse += "}";
+
+    request->send(200, "application/json", jsonResponse);
+  });
+
+  metricsRoute(server, "/log", HTTP_POST, [](AsyncWebServerRequest *request){
+    uint8_t level = logLevel;
+    if (request->hasParam("level", true) && !logParseLevel(request->getParam("level", true)->value(), level)) {
+      request->send(400, "text/plain", "Invalid log level, use error, warn, info or debug.");
+      return;
     }
+    uint32_t mask = logMask;
+    if (request->hasParam("mask", true)) {
+      mask = strtoul(request->getParam("mask", true)->value().c_str(), nullptr, 0);
+    }
+    logSetLevel(level);
+    logSetMask(mask);
+    logEvent(LOG_WARN, EV_SYS_LOG_CONFIG, logString(logLevelName(logLevel)), logMask);
+    request->send(200, "text/plain", "Log configuration updated.");
   });
- 
-  server.on("/set_walk_in", HTTP_POST, [](AsyncWebServerRequest *request){
-    if (request->hasParam("state", true)) {
-        String state = request->getParam("state", true)->value();
-        if (state == "on") {
-          setVertivWalkIn(true);
-          String message = "Command sent: set walk-in to ON. Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-          request->send(200, "text/plain", message);
-        } else if (state == "off") {
-          setVertivWalkIn(false);
-          String message = "Command sent: set walk-in to OFF. Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-          request->send(200, "text/plain", message);
+
+  // On-device CC/CV charging through the online setpoints: GET state, POST action=start|stop and the stage settings (see charger.h)
+  metricsRoute(server, "/charger", HTTP_GET, [](AsyncWebServerRequest *request){
+    chargerHandleStatus(request);
+  });
+
+  metricsRoute(server, "/charger", HTTP_POST, [](AsyncWebServerRequest *request){
+    chargerHandleControl(request);
+  });
+
+#ifdef R48_PROFILE
+  // Cycle-counter profile of loop(), the CAN driver and every route since the last request, then reset (see profiler.h)
+  metricsRoute(server, "/profile", HTTP_GET, [](AsyncWebServerRequest *request){
+    profileHandleRequest(request);
+  });
+#endif
+
+  // Station state, reconnect counters and boot milestones (see wifi_link.h)
+  metricsRoute(server, "/wifi", HTTP_GET, [](AsyncWebServerRequest *request){
+    wifiLinkHandleStatus(request);
+  });
+
+  // Wh and Ah per rectifier: lifetime, today and the last days (see energy.h)
+  metricsRoute(server, "/energy", HTTP_GET, [](AsyncWebServerRequest *request){
+    energyHandleRequest(request);
+  });
+
+  // Refreshes of the online setpoints: GET the kept setpoints and their age, POST period, group or clear (see setpoint_keepalive.h)
+  metricsRoute(server, "/keepalive", HTTP_GET, [](AsyncWebServerRequest *request){
+    setpointKeepaliveHandleStatus(request);
+  });
+
+  metricsRoute(server, "/keepalive", HTTP_POST, [](AsyncWebServerRequest *request){
+    setpointKeepaliveHandleControl(request);
+  });
+
+  // Binary UDP setpoint stream: GET counters, POST timeout and safe_limit of the watchdog (see udp_setpoint.h)
+  metricsRoute(server, "/udp", HTTP_GET, [](AsyncWebServerRequest *request){
+    udpSetpointHandleStatus(request);
+  });
+
+  metricsRoute(server, "/udp", HTTP_POST, [](AsyncWebServerRequest *request){
+    udpSetpointHandleControl(request);
+  });
+
+  // Binary capture of every CAN frame to LittleFS: GET state, POST enabled=on|off or clear=1 (see can_capture.h)
+  metricsRoute(server, "/capture", HTTP_GET, [](AsyncWebServerRequest *request){
+    canCaptureHandleStatus(request);
+  });
+
+  metricsRoute(server, "/capture", HTTP_POST, [](AsyncWebServerRequest *request){
+    canCaptureHandleControl(request);
+  });
+
+  metricsRoute(server, "/capture.bin", HTTP_GET, [](AsyncWebServerRequest *request){
+    canCaptureHandleDownload(request);
+  });
+
+  // Configuration kept in flash: WiFi, poll periods, safe ranges of the settings (see config_store.h)
+  metricsRoute(server, "/config", HTTP_GET, [](AsyncWebServerRequest *request){
+    configStoreHandleStatus(request);
+  });
+
+  metricsRoute(server, "/config", HTTP_POST, [](AsyncWebServerRequest *request){
+    configStoreHandleControl(request);
+  });
+
+  metricsRoute(server, "/can_filter", HTTP_GET, [](AsyncWebServerRequest *request){
+    request->send(200, "application/json", canFilterToJson());
+  });
+
+  metricsRoute(server, "/can_filter", HTTP_POST, [](AsyncWebServerRequest *request){
+    if (request->hasParam("promiscuous", true)) {
+        String mode = request->getParam("promiscuous", true)->value();
+        if (mode == "on") {
+          canFilterSetPromiscuous(true);
+          request->send(200, "text/plain", "CAN filters disabled: receiving every frame on the bus.");
+        } else if (mode == "off") {
+          canFilterSetPromiscuous(false);
+          request->send(200, "text/plain", "CAN filters enabled.");
         } else {
-          request->send(400, "text/plain", "Invalid walk-in state command.");
+          request->send(400, "text/plain", "Invalid promiscuous mode.");
         }
     } else {
-        request->send(400, "text/plain", "Missing walk-in state parameter.");
+        request->send(400, "text/plain", "Missing promiscuous parameter.");
     }
   });
  
-  server.on("/set_walk_in_time", HTTP_POST, [](AsyncWebServerRequest *request){
-    float seconds = request->getParam(0)->value().toFloat();
-    if (seconds >= 0) {
-      setVertivWalkInTime(seconds);
-      String message = "Command sent: set walk-in time to " + String(seconds) + ". Please wait " + String(PERMANENT_COMMAND_DELAY / 1000) + " seconds for confirmation.";
-      request->send(200, "text/plain", message);
-    } else {
-      request->send(400, "text/plain", "Invalid walk-in time value.");
+  // One POST endpoint per writable setting (see r48_registers.cpp); the frames are sent from loop()
+  for (uint8_t i = 0; i < SETTING_COUNT; i++) {
+    R48SettingId setting = (R48SettingId)i;
+    metricsRoute(server, R48_SETTINGS[i].route, HTTP_POST, [setting](AsyncWebServerRequest *request){
+      handleSettingRequest(request, setting);
+    });
+  }
+
+  // Several settings in one request, checked together and confirmed write by write (see settings_batch.h)
+  metricsRoute(server, "/settings", HTTP_POST, [](AsyncWebServerRequest *request){
+    byte targets[MAX_RECTIFIERS];
+    uint8_t targetCount;
+    if (commandTargets(request, targets, targetCount)) {
+      settingsBatchHandleRequest(request, targets, targetCount);
     }
   });
- 
+
+  metricsRoute(server, "/settings", HTTP_GET, [](AsyncWebServerRequest *request){
+    settingsBatchHandleStatus(request);
+  });
+
+  // Serve /data from a shared snapshot and push value changes to the page over Server-Sent Events
+  dataSnapshotBegin();
+  historyBegin();
+  liveEventsBegin(server);
+
+  // Counters and latency histograms for Prometheus; also counts requests that match no route
+  metricsBegin(server);
+
   // Start the web server
   server.begin();
  
-  // Initial request for data from the power supply
-  readVertivSetting(OUTPUT_VOLTAGE);
-  readVertivSetting(OUTPUT_CURRENT);
-  readVertivSetting(OUTPUT_CURRENT_LIMIT);
-  readVertivSetting(TEMPERATURE);
-  readVertivSetting(SUPPLY_VOLTAGE);
+  // Poll every rectifier found on the bus; the first discovery request goes out on the first loop() pass
+  pollSchedulerBegin(readVertivSetting);
+  commandTrackerBegin(readVertivSetting);
+  registerCacheBegin(readVertivSetting);
+  commandQueueBegin(sendVertivFrame);
+  rectifiersBegin(onRectifierChange);
+  chargerBegin();
+  udpSetpointBegin(UDP_SETPOINT_PORT);
+
+  // List the units with their last values until they answer, and write the online setpoints again
+  configStoreRestoreState();
+  lastDiscoveryTime = millis() - DISCOVERY_INTERVAL;
 }
 
-// State machine variables for sequenced reading
-unsigned long lastRequestTime = 0;
-int readState = 0; // 0: Idle, 1: Request sent, 2: Waiting for 1s delay
-const unsigned long POLLING_INTERVAL = 5000;
-const unsigned long CURRENT_LIMIT_DELAY = 1000; // 1 second delay
-
 void loop() {
+  PROFILE_SCOPE(PROFILE_LOOP);
+  unsigned long loopStart = micros();
+
+  // Bring the WiFi up or reconnect it, without waiting
+  wifiLinkService();
+
+  // Reprogram the acceptance filters if the set of consumed IDs changed
+  canFilterService();
+
   // Check for incoming CAN messages from the power supply
   processIncomingCanMessages();
  
-  // Sequentially request new data if no command is pending
-  if (!isCommandPending) {
-    switch (readState) {
-      case 0: // Check if it's time to start the sequence
-        if (millis() - lastRequestTime > POLLING_INTERVAL) {
-          readVertivSetting(OUTPUT_VOLTAGE);
-          readState = 1;
-          lastRequestTime = millis();
-        }
-        break;
-      case 1: // Request OUTPUT_CURRENT, then set a 1-second delay
-        if (millis() - lastRequestTime > 100) { // Small delay between requests
-          readVertivSetting(OUTPUT_CURRENT);
-          readVertivSetting(OUTPUT_CURRENT_LIMIT);
-          readState = 2;
-          lastRequestTime = millis();
-        }
-        break;
-      case 2: // Wait for 1 second after requesting current limit
-        if (millis() - lastRequestTime > CURRENT_LIMIT_DELAY) {
-          readVertivSetting(TEMPERATURE);
-          readVertivSetting(SUPPLY_VOLTAGE);
-          readState = 0; // Reset state for the next cycle
-          lastRequestTime = millis(); // Reset main polling timer
-        }
-        break;
-    }
-  }
+  // Queue the setpoints that came in over UDP, so they go out with this pass's command frame
+  udpSetpointService();
 
-  // Check if the fixed delay for the permanent command has elapsed
-  if (isCommandPending && millis() - commandSentTime > PERMANENT_COMMAND_DELAY) {
-    Serial.println("45-second command delay complete. Resuming normal operation.");
-    isCommandPending = false;
-    readState = 0; // Reset the read state machine
-  }
+  // Write the online setpoints again before the rectifiers let them lapse
+  setpointKeepaliveService();
+
+  // Hand the next writes of a settings batch to the queue and collect the confirmed ones
+  settingsBatchService();
+
+  // Send the queued setting writes, then read back the permanent ones that were just written
+  commandQueueService();
+  commandTrackerService();
+
+  // Look for new rectifiers and forget the ones that went silent
+  discoverRectifiers();
+  rectifiersExpire();
+
+  // Ask for the next register of a discovery sweep
+  registerCacheService();
+
+  // Request the measurements that are due
+  pollSchedulerService();
+
+  // Run a charge control step on the fresh measurements; its setpoint writes go out through the command queue
+  chargerService();
+
+  // Record the bank values into the history rings
+  historyService();
+
+  // Roll the energy day over and journal the counters when due
+  energyService();
+
+  // Save a changed configuration, and the measurements and setpoints to boot from
+  configStoreService();
+
+  // Re-serialize the /data snapshot after changes, then push them to the live page subscribers
+  bool commandPending = commandTrackerPending();
+  const char *commandResult = commandResultName(commandTrackerResult());
+  dataSnapshotSetStatus(commandPending, commandRemainingSeconds(), commandResult);
+  dataSnapshotService();
+  liveEventsSetStatus(commandPending, commandRemainingSeconds(), commandResult);
+  liveEventsService();
+
+  // Write queued log records while the UART has room
+  logService();
+
+  // Append the captured frames to the capture file when due
+  canCaptureService();
+
+  metricsObserveLoop(micros() - loopStart);
 }
 
 /**
- * @brief Sends a CAN message to set the output voltage of the Vertiv R48-2000e3 permanently.
- * @param voltage The desired voltage in Volts (float).
+ * @brief Sends a CAN message to request a specific measurement from the Vertiv R48-2000e3.
+ * @param address The address of the rectifier to ask, or R48_BROADCAST_ADDRESS to ask every rectifier.
+ * @param measurementNo The measurement number to request (e.g., 0x01 for output voltage).
  *
- * This function constructs the 8-byte data payload:
- * [0x03, 0xF0, 0x00, 0x24, (4 bytes IEEE 754 float)]
- * The float voltage is converted to its 4-byte IEEE 754 single-precision representation.
+ * Request format: Send to 0x06000783 (broadcast) or to the rectifier's point-to-point ID
+ * => [0x01, 0xF0, 0x00, xx, 0x00, 0x00, 0x00, 0x00]
+ * @return true if the request was put on the bus.
  */
-void setVertivVoltagePermanent(float voltage) {
+bool readVertivSetting(byte address, byte measurementNo) {
   byte data[8];
-  data[0] = 0x03;
+  data[0] = 0x01;
   data[1] = 0xF0;
   data[2] = 0x00;
-  data[3] = SET_PERMANENT_VOLTAGE_CMD;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = voltage;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
-
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent permanent voltage command. Value: "); Serial.println(voltage);
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
+  data[3] = measurementNo;
+  data[4] = 0x00;
+  data[5] = 0x00;
+  data[6] = 0x00;
+  data[7] = 0x00;
 
-  } else {
-    Serial.println("Error sending voltage command.");
+  unsigned long id = address == R48_BROADCAST_ADDRESS ? VERTIV_READ_REQUEST_ID : r48RequestId(address);
+  if (sendVertivFrame(id, data)) {
+    logEvent(LOG_DEBUG, EV_CAN_TX_READ, address, measurementNo);
+    return true;
   }
+  logEvent(LOG_ERROR, EV_CAN_TX_ERROR, logString("read request"));
+  return false;
+}
+
+/**
+ * @brief Most seconds left until the pending commands are confirmed or given up, for the countdown on the page.
+ */
+unsigned long commandRemainingSeconds() {
+  return (commandTrackerRemaining() + 999) / 1000;
 }
 
 /**
- * @brief Sends a CAN message to set the output voltage of the Vertiv R48-2000e3 temporarily (online).
- * @param voltage The desired voltage in Volts (float).
+ * @brief UTC seconds since 1970 once SNTP set the clock, else 0.
+ */
+uint32_t wallClockSeconds() {
+  time_t now = time(nullptr);
+  return now >= WALL_CLOCK_VALID ? (uint32_t)now : 0;
+}
+
+/**
+ * @brief Sends a broadcast read request every DISCOVERY_INTERVAL to find new rectifiers.
  *
- * This function constructs the 8-byte data payload:
- * [0x03, 0xF0, 0x00, 0x21, (4 bytes IEEE 754 float)]
+ * The hardware filters always accept answers from any source address, so this
+ * never touches them.
  */
-void setVertivVoltageOnline(float voltage) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = 0x21;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = voltage;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent online voltage command. Value: "); Serial.println(voltage);
-  } else {
-    Serial.println("Error sending voltage command.");
+void discoverRectifiers() {
+  unsigned long now = millis();
+  if (now - lastDiscoveryTime < DISCOVERY_INTERVAL) {
+    return;
   }
+  readVertivSetting(R48_BROADCAST_ADDRESS, OUTPUT_VOLTAGE);
+  lastDiscoveryTime = now;
 }
 
 /**
- * @brief Sends a CAN message to set the output current limit of the Vertiv R48-2000e3 permanently.
- * @param currentPercentage The desired current as a percentage of rated value (e.g., 0.1 for 10%, 1.21 for 121%).
- *
- * This function constructs the 8-byte data payload:
- * [0x03, 0xF0, 0x00, 0x19, (4 bytes IEEE 754 float)]
+ * @brief Starts or stops polling a rectifier when it joins or leaves the table.
+ * @param address The rectifier's address.
+ * @param added true when the rectifier was discovered, false when it went silent.
  */
-void setVertivCurrentPermanent(float currentPercentage) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = SET_PERMANENT_CURRENT_LIMIT_CMD;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = currentPercentage;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent permanent current limit command. Value: "); Serial.println(currentPercentage);
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
-   
+void onRectifierChange(byte address, bool added) {
+  if (added) {
+    schedulePolling(address);
   } else {
-    Serial.println("Error sending current command.");
+    pollSchedulerRemoveUnit(address);
   }
+  dataSnapshotMarkChanged();
+  liveEventsMarkTopology();
+  logEvent(LOG_INFO, EV_SYS_RECTIFIER_CHANGE, address, logString(added ? "found" : "lost"));
 }
 
 /**
- * @brief Sends a CAN message to set the output current limit of the Vertiv R48-2000e3 online.
- * @param currentPercentage The desired current as a percentage of rated value (e.g., 0.1 for 10%, 1.21 for 121%).
- *
- * This function constructs the 8-byte data payload:
- * [0x03, 0xF0, 0x00, 0x22, (4 bytes IEEE 754 float)]
+ * @brief Adds the measurements of a rectifier to the poll schedule, with the configured periods, and the polled
+ * registers after them.
  */
-void setVertivCurrentOnline(float currentPercentage) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = 0x22;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = currentPercentage;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent online current limit command. Value: "); Serial.println(currentPercentage);
-  } else {
-    Serial.println("Error sending current command.");
+void schedulePolling(byte address) {
+  // The schedule has room for every register of a full bank; an add that does not fit is logged by the scheduler
+  const ConfigValues &config = configStoreGet();
+  pollSchedulerAdd(address, OUTPUT_CURRENT, config.pollPeriods[measurementSlot(OUTPUT_CURRENT)], 0);
+  pollSchedulerAdd(address, OUTPUT_VOLTAGE, config.pollPeriods[measurementSlot(OUTPUT_VOLTAGE)], 1);
+  pollSchedulerAdd(address, OUTPUT_CURRENT_LIMIT, config.pollPeriods[measurementSlot(OUTPUT_CURRENT_LIMIT)], 2);
+  pollSchedulerAdd(address, SUPPLY_VOLTAGE, config.pollPeriods[measurementSlot(SUPPLY_VOLTAGE)], 3);
+  pollSchedulerAdd(address, TEMPERATURE, config.pollPeriods[measurementSlot(TEMPERATURE)], 4);
+  registerCacheSchedulePolling(address);
+}
+
+/**
+ * @brief Lets the energy meter bridge the gaps between samples at the configured poll periods.
+ */
+void energyFollowPollPeriods() {
+  // A unit delivers a sample with each voltage and each current answer
+  const ConfigValues &config = configStoreGet();
+  energySetSamplePeriod(min(config.pollPeriods[measurementSlot(OUTPUT_VOLTAGE)],
+                            config.pollPeriods[measurementSlot(OUTPUT_CURRENT)]));
+}
+
+/**
+ * @brief Reschedules the tracked rectifiers after the poll periods may have changed through /config.
+ */
+void onConfigChange() {
+  energyFollowPollPeriods();
+  for (uint8_t i = 0; i < rectifierCount(); i++) {
+    byte address = rectifierAt(i).address;
+    pollSchedulerRemoveUnit(address);
+    schedulePolling(address);
   }
 }
 
 /**
- * @brief Sends a CAN message to set the (Diesel power limit) max input current of the Vertiv R48-2000e3 permanently.
- * @param current The desired current in Amps (float).
- *
- * This function constructs the 8-byte data payload:
- * [0x03, 0xF0, 0x00, 0x1A, (4 bytes IEEE 754 float)]
- * The float current is converted to its 4-byte IEEE 754 single-precision representation.
+ * @brief Shows the station's connection on the LED.
+ * @param connected true when the station connected, false when it lost the connection.
  */
-void setVertivMaxInputCurrent(float current) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = SET_PERMANENT_MAX_INPUT_CURRENT_CMD;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = current;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
-
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent (Diesel) AC input current limit command. Value: "); Serial.println(current);
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
+void onWifiChange(bool connected) {
+  if (connected) {
+    Serial.print("Connected to WiFi! IP Address: ");
+    Serial.println(WiFi.localIP());
+  }
+  digitalWrite(LED_BUILTIN, connected ? LOW : HIGH); // LED on while online
+}
 
+/**
+ * @brief Resolves which rectifiers a command request is for.
+ *
+ * An optional "unit" parameter selects one tracked rectifier by address.
+ * Without it the command goes to every tracked rectifier, or to address 0x00
+ * (the original VERTIV_COMMAND_ID) while none has been discovered yet.
+ * Sends a 400 response when the requested unit is unknown.
+ * @return false if the request was rejected.
+ */
+bool commandTargets(AsyncWebServerRequest *request, byte targets[MAX_RECTIFIERS], uint8_t &count) {
+  count = 0;
+  if (request->hasParam("unit", true)) {
+    long address = strtol(request->getParam("unit", true)->value().c_str(), nullptr, 0);
+    if (address < 0 || address > 0xFF || rectifierFind(address) == nullptr) {
+      request->send(400, "text/plain", "Unknown rectifier unit.");
+      return false;
+    }
+    targets[count++] = address;
+  } else if (rectifierCount() == 0) {
+    targets[count++] = 0x00;
   } else {
-    Serial.println("Error sending (Diesel) AC input current limit command.");
+    for (uint8_t i = 0; i < rectifierCount(); i++) {
+      targets[count++] = rectifierAt(i).address;
+    }
   }
+  return true;
 }
 
 /**
- * @brief Sends a CAN message to request a specific measurement from the Vertiv R48-2000e3.
- * @param measurementNo The measurement number to request (e.g., 0x01 for output voltage).
+ * @brief Reads the value of a setting from its form field.
  *
- * Request format: Send to 0x06000783 => [0x01, 0xF0, 0x00, xx, 0x00, 0x00, 0x00, 0x00]
+ * Float settings take a number; state settings take one of their two words (e.g. "on"/"off").
+ * @return The value, or NAN if it is missing or not understood (which fails every range check).
  */
-void readVertivSetting(byte measurementNo) {
-  byte data[8];
-  data[0] = 0x01;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = measurementNo;
-  data[4] = 0x00;
-  data[5] = 0x00;
-  data[6] = 0x00;
-  data[7] = 0x00;
-
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_READ_REQUEST_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent read request command. Measurement #: "); Serial.println(measurementNo, HEX);
-  } else {
-    Serial.println("Error requesting measurement.");
+float settingValue(AsyncWebServerRequest *request, const R48Setting &setting) {
+  if (!request->hasParam(setting.param, true)) {
+    return NAN;
+  }
+  const String &text = request->getParam(setting.param, true)->value();
+  if (setting.type == R48_VALUE_FLOAT) {
+    return text.toFloat();
   }
+  if (text == setting.onWord) return 1;
+  if (text == setting.offWord) return 0;
+  return NAN;
 }
 
 /**
- * @brief Sends a CAN message to set the fan speed.
- * @param fullSpeed A boolean flag: true for full speed, false for auto.
+ * @brief Validates a setting write and queues it for every target unit.
  */
-void setVertivFanSpeed(bool fullSpeed) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = 0x33;
-  data[4] = fullSpeed ? 0x01 : 0x00;
-  data[5] = 0x00;
-  data[6] = 0x00;
-  data[7] = 0x00;
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent fan speed command. Value: ");
-    Serial.println(fullSpeed ? "Full Speed" : "Auto");
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
+void handleSettingRequest(AsyncWebServerRequest *request, R48SettingId id) {
+  const R48Setting &setting = R48_SETTINGS[id];
+  byte targets[MAX_RECTIFIERS];
+  uint8_t targetCount;
+  if (!commandTargets(request, targets, targetCount)) return;
+
+  if (setting.writeClass == R48_WRITE_ONLINE && chargerRunning()) {
+    request->send(409, "text/plain", "The charger is driving the online setpoints, stop it first.");
+    return;
+  }
 
-  } else {
-    Serial.println("Error sending fan speed command.");
+  float value = settingValue(request, setting);
+  if (!r48SettingValid(setting, value)) {
+    String message = "Invalid " + String(setting.label) + " value, ";
+    if (setting.type == R48_VALUE_FLOAT) {
+      message += "valid values between " + String(r48SettingMin(setting)) + " and " + String(r48SettingMax(setting)) + ".";
+    } else {
+      message += "expected " + String(setting.onWord) + " or " + String(setting.offWord) + ".";
+    }
+    request->send(400, "text/plain", message);
+    return;
+  }
+
+  for (uint8_t i = 0; i < targetCount; i++) {
+    if (commandQueuePush(targets[i], id, value) == COMMAND_QUEUE_FULL) {
+      request->send(503, "text/plain", "Command queue full, try again.");
+      return;
+    }
   }
+
+  String message = "Command sent: " + String(setting.name) + " ";
+  message += setting.type == R48_VALUE_FLOAT ? String(value) : String(value != 0 ? setting.onWord : setting.offWord);
+  if (setting.writeClass == R48_WRITE_PERMANENT) {
+    message += ". Waiting for the rectifier to confirm it.";
+  }
+  request->send(200, "text/plain", message);
 }
 
 /**
- * @brief Sends a CAN message to enable or disable the walk-in feature.
- * @param on A boolean flag: true to enable walk-in, false to disable.
+ * @brief Sends an 8-byte extended frame to the power supply and logs it.
+ * @param id The extended CAN ID to send to.
+ * @param data The 8-byte payload.
+ * @return false if the CAN driver could not queue the frame.
  */
-void setVertivWalkIn(bool on) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = 0x32;
-  data[4] = on ? 0x01 : 0x00;
-  data[5] = 0x00;
-  data[6] = 0x00;
-  data[7] = 0x00;
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent walk-in command. Value: ");
-    Serial.println(on ? "On" : "Off");
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
-
-  } else {
-    Serial.println("Error sending walk-in command.");
+bool sendVertivFrame(unsigned long id, byte data[8]) {
+  logFrame(LOG_DEBUG, EV_CAN_TX_FRAME, id, 8, data);
+  metricsIncrement(METRIC_CAN_TX_FRAMES);
+  if (!canDriver.send(id, 8, data)) {
+    metricsCountSendFailure(data);
+    return false;
   }
+  canCaptureFrame(true, id | CAN_EXTENDED_FLAG, 8, data);
+  return true;
 }
 
 /**
- * @brief Sends a CAN message to set the walk-in ramp-up time.
- * @param seconds The desired ramp-up time in seconds (float).
+ * @brief Drains the CAN driver and processes every frame waiting in the receive ring.
  */
-void setVertivWalkInTime(float seconds) {
-  byte data[8];
-  data[0] = 0x03;
-  data[1] = 0xF0;
-  data[2] = 0x00;
-  data[3] = 0x29;
-  union FloatBytes { float f; byte b[4]; } converter;
-  converter.f = seconds;
-  data[4] = converter.b[3];
-  data[5] = converter.b[2];
-  data[6] = converter.b[1];
-  data[7] = converter.b[0];
- 
-  byte sndStat = CAN0.sendMsgBuf(VERTIV_COMMAND_ID, 1, 8, data);
-  if (sndStat == CAN_OK) {
-    Serial.print("Sent walk-in time command. Value: ");
-    Serial.println(seconds);
-   
-    // Set command pending flag and start the timer
-    isCommandPending = true;
-    commandSentTime = millis();
+void processIncomingCanMessages() {
+  PROFILE_SCOPE(PROFILE_CAN_RX);
+  canRxService();
 
-  } else {
-    Serial.println("Error sending walk-in time command.");
+  CanFrame frame;
+  while (canRxPop(frame)) {
+    handleCanFrame(frame);
   }
 }
 
 /**
- * @brief Checks for and processes incoming CAN messages from the Vertiv R48-2000e3.
+ * @brief Logs and parses a single CAN frame received from the bus.
+ * @param frame The frame as taken out of the CAN driver.
  */
-void processIncomingCanMessages() {
-  long unsigned int rxId;
-  unsigned char len;
-  unsigned char rxBuf[8];
- 
-  // Check if a message has been received
-  if(CAN0.checkReceive() == CAN_MSGAVAIL) {
-    // Read the message
-    CAN0.readMsgBuf(&rxId, &len, rxBuf);
-   
-    // Log every received message to the Serial Monitor
-    Serial.print("RX ID: 0x");
-    if (rxId < 0x10000000) Serial.print("0"); // Manual padding for 32-bit ID
-    Serial.print(rxId, HEX);
-    Serial.print(" Length: ");
-    Serial.print(len);
-    Serial.print(" Data: ");
-    for (int i = 0; i < len; i++) {
-      Serial.print("0x");
-      if (rxBuf[i] < 0x10) Serial.print("0");
-      Serial.print(rxBuf[i], HEX);
-      Serial.print(" ");
+void handleCanFrame(const CanFrame &frame) {
+  unsigned long rxId = frame.id;
+  unsigned char len = frame.len;
+  const unsigned char *rxBuf = frame.data;
+
+  // Log every received message (formatted later by logService())
+  logFrame(LOG_DEBUG, EV_CAN_RX_FRAME, rxId, len, rxBuf);
+  metricsIncrement(METRIC_CAN_RX_FRAMES);
+  canCaptureFrame(false, rxId, len, rxBuf);
+
+  // Parse the message if it's a standard Vertiv response addressed to us; the rectifier's address is the ID's source field
+  R48Id id;
+  if (r48DecodeId(rxId, id) && id.pointToPoint && id.destination == R48_CONTROLLER_ADDRESS &&
+      len == 8 && rxBuf[0] == 0x41 && rxBuf[1] == 0xF0 && rxBuf[2] == 0x00) {
+    byte receivedMeasurementNo = rxBuf[3];
+    // Create a temporary buffer for the float bytes from the CAN message
+    byte floatBytes[4] = {rxBuf[4], rxBuf[5], rxBuf[6], rxBuf[7]};
+    float receivedValue = r48GetFloat(floatBytes);
+
+    // Log the converted value to the serial monitor for debugging
+    logEvent(LOG_INFO, EV_CAN_RX_VALUE, id.source, receivedMeasurementNo, logFloat(receivedValue));
+
+    // Every answer goes to the register cache, read-backs included
+    registerCacheStore(id.source, receivedMeasurementNo, floatBytes);
+
+    // Read-backs of a command being confirmed are not measurements
+    if (commandTrackerOnResponse(id.source, receivedMeasurementNo, floatBytes)) {
+      return;
     }
-    Serial.println();
-   
-    // Parse the message if it's a standard Vertiv response
-    if (rxId == (unsigned long) VERTIV_RESPONSE_ID && len == 8 && rxBuf[0] == 0x41 && rxBuf[1] == 0xF0 && rxBuf[2] == 0x00) {
-      byte receivedMeasurementNo = rxBuf[3];
-      // Create a temporary buffer for the float bytes from the CAN message
-      byte floatBytes[4] = {rxBuf[4], rxBuf[5], rxBuf[6], rxBuf[7]};
-      float receivedValue = bytesToFloat(floatBytes);
-     
-      // Log the converted value to the serial monitor for debugging
-      Serial.printf("Vertiv response ID = value: 0x%02x = %.2f\n", receivedMeasurementNo, receivedValue);
-
-      // Update global variables
-      switch (receivedMeasurementNo) {
-        case OUTPUT_VOLTAGE: outputVoltage = receivedValue; break;
-        case OUTPUT_CURRENT: outputCurrent = receivedValue; break;
-        case OUTPUT_CURRENT_LIMIT: outputCurrentLimit = receivedValue; break;
-        case TEMPERATURE: temperature = receivedValue; break;
-        case SUPPLY_VOLTAGE: supplyVoltage = receivedValue; break;
-        default: 
-            Serial.printf("Unknown ID 0x%02x = %.2f\n", receivedMeasurementNo, receivedValue);
-            break;
-      }
+
+    // Let the scheduler match the answer to its request and note the value's age
+    pollSchedulerOnResponse(id.source, receivedMeasurementNo);
+
+    // Update the rectifier's entry (a rectifier answering for the first time is added to the table)
+    bool changed;
+    if (!rectifierStore(id.source, receivedMeasurementNo, receivedValue, &changed)) {
+      // Not a measurement: only kept in the register cache
+      logEvent(LOG_DEBUG, EV_CAN_RX_UNKNOWN, id.source, receivedMeasurementNo, logFloat(receivedValue));
+      metricsIncrement(METRIC_CAN_RX_UNKNOWN);
+      return;
+    }
+    metricsIncrement(METRIC_CAN_RX_PARSED);
+    metricsMarkBoot(BOOT_FIRST_MEASUREMENT);
+    // Meter the energy since the unit's previous voltage or current sample
+    if (receivedMeasurementNo == OUTPUT_VOLTAGE || receivedMeasurementNo == OUTPUT_CURRENT) {
+      energyOnSample(id.source, frame.timestamp);
+    }
+    if (changed) {
+      dataSnapshotMarkChanged();
+      liveEventsMarkValue(id.source, measurementSlot(receivedMeasurementNo));
     }
   }
 }
-
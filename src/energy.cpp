@@ -0,0 +1,389 @@
+#include "energy.h"
+#include "checksum.h"
+#include "log.h"
+
+#include <LittleFS.h>
+
+static const char *const JOURNAL_PATHS[2] = {"/energy0.jnl", "/energy1.jnl"};
+static const char *const DAYS_PATH = "/energy_days.bin";
+static const char *const DAYS_TEMP_PATH = "/energy_days.tmp";
+
+// Version 2 added the used flag of the day units.
+const uint8_t ENERGY_DAYS_VERSION = 2;
+
+// Layout of /energy_days.bin, little-endian.
+struct __attribute__((packed)) EnergyDaysFile {
+  char magic[4];              // "R48D"
+  uint8_t version;            // ENERGY_DAYS_VERSION
+  uint8_t reserved[3];
+  EnergyDay days[ENERGY_DAYS];  // oldest first
+  uint32_t crc;
+};
+
+// Last sample of a unit, the left edge of the next trapezoid.
+struct Integrator {
+  bool valid;
+  unsigned long timestamp;
+  float power;    // W
+  float current;  // A
+};
+
+static EnergyClockFunction wallClock = nullptr;
+static EnergyUnit units[MAX_RECTIFIERS];
+static Integrator integrators[MAX_RECTIFIERS];
+static EnergyDay days[ENERGY_DAYS];
+static uint8_t newestDay = ENERGY_DAYS - 1;  // ring index of the most recent finished day
+static uint32_t today = 0;
+static bool dirty = false;
+static unsigned long lastCheckpoint = 0;
+static uint8_t journalFile = 0;              // file the next record is appended to
+static uint8_t journalRecords = 0;           // records already in it
+static unsigned long maxGap = ENERGY_MAX_GAP;  // longest gap between two samples that is integrated
+static EnergyStats stats;
+
+// --- Restore ---
+
+/**
+ * @brief Loads the newest valid checkpoint of both journal files.
+ */
+static void restoreJournal() {
+  bool found = false;
+  EnergyCheckpoint newest;
+  for (uint8_t f = 0; f < 2; f++) {
+    File file = LittleFS.open(JOURNAL_PATHS[f], "r");
+    if (!file) {
+      continue;
+    }
+    EnergyCheckpoint record;
+    uint8_t count = 0;
+    while (file.read((uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+      count++;
+      if (memcmp(record.magic, "R48J", 4) != 0 || checksumCrc32(&record, offsetof(EnergyCheckpoint, crc)) != record.crc) {
+        continue;
+      }
+      if (!found || (int32_t)(record.sequence - newest.sequence) > 0) {
+        newest = record;
+        found = true;
+        journalFile = f;
+        // A partly written record at the end means the next one must start the other file
+        journalRecords = file.size() % sizeof(record) == 0 ? count : ENERGY_JOURNAL_RECORDS;
+      }
+    }
+  }
+  if (!found) {
+    return;
+  }
+  stats.sequence = newest.sequence;
+  today = newest.day;
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    units[i].used = newest.units[i].used != 0;
+    units[i].address = newest.units[i].address;
+    units[i].wh = newest.units[i].wh;
+    units[i].ah = newest.units[i].ah;
+    units[i].todayWh = newest.units[i].todayWh;
+    units[i].todayAh = newest.units[i].todayAh;
+  }
+}
+
+static void restoreDays() {
+  File file = LittleFS.open(DAYS_PATH, "r");
+  EnergyDaysFile content;
+  if (!file || file.read((uint8_t *)&content, sizeof(content)) != sizeof(content) ||
+      memcmp(content.magic, "R48D", 4) != 0 || content.version != ENERGY_DAYS_VERSION ||
+      checksumCrc32(&content, offsetof(EnergyDaysFile, crc)) != content.crc) {
+    return;
+  }
+  memcpy(days, content.days, sizeof(days));
+  newestDay = ENERGY_DAYS - 1;
+}
+
+void energyBegin(EnergyClockFunction clock) {
+  wallClock = clock;
+  memset(units, 0, sizeof(units));
+  memset(integrators, 0, sizeof(integrators));
+  memset(days, 0, sizeof(days));
+  memset(&stats, 0, sizeof(stats));
+  newestDay = ENERGY_DAYS - 1;
+  today = 0;
+  journalFile = 0;
+  journalRecords = 0;
+  dirty = false;
+  restoreJournal();
+  restoreDays();
+  lastCheckpoint = millis();
+}
+
+// --- Integration ---
+
+static int8_t unitSlot(byte address, bool create) {
+  int8_t unused = -1;
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    if (units[i].used && units[i].address == address) {
+      return i;
+    }
+    if (!units[i].used && unused < 0) {
+      unused = i;
+    }
+  }
+  if (!create || unused < 0) {
+    return -1;
+  }
+  // A fresh slot starts without a previous sample to integrate from
+  units[unused] = {true, address, 0, 0, 0, 0};
+  integrators[unused] = {};
+  return unused;
+}
+
+void energySetSamplePeriod(unsigned long periodMs) {
+  maxGap = max(ENERGY_MAX_GAP, ENERGY_GAP_PERIODS * periodMs);
+}
+
+void energyOnSample(byte address, unsigned long timestamp) {
+  const Rectifier *rectifier = rectifierFind(address);
+  uint8_t voltageSlot = measurementSlot(OUTPUT_VOLTAGE);
+  uint8_t currentSlot = measurementSlot(OUTPUT_CURRENT);
+  uint8_t needed = (1 << voltageSlot) | (1 << currentSlot);
+  // A value restored at boot is hours old, not the other edge of this sample
+  if (rectifier == nullptr || (rectifier->validMask & ~rectifier->cachedMask & needed) != needed) {
+    return;
+  }
+  int8_t slot = unitSlot(address, true);
+  if (slot < 0) {
+    return;
+  }
+
+  float current = rectifier->values[currentSlot];
+  float power = rectifier->values[voltageSlot] * current;
+  Integrator &integrator = integrators[slot];
+  if (integrator.valid) {
+    unsigned long elapsed = timestamp - integrator.timestamp;
+    if (elapsed > maxGap) {
+      stats.gaps++;
+    } else if (elapsed > 0) {
+      float hours = elapsed / 3600000.0f;
+      float wh = (integrator.power + power) / 2 * hours;
+      float ah = (integrator.current + current) / 2 * hours;
+      EnergyUnit &unit = units[slot];
+      unit.wh += wh;
+      unit.ah += ah;
+      unit.todayWh += wh;
+      unit.todayAh += ah;
+      dirty = true;
+      stats.samples++;
+    }
+  }
+  integrator = {true, timestamp, power, current};
+}
+
+// --- Persistence ---
+
+void energyCheckpoint() {
+  if (!dirty) {
+    return;
+  }
+  EnergyCheckpoint record;
+  memcpy(record.magic, "R48J", 4);
+  record.sequence = stats.sequence + 1;
+  record.day = today;
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    record.units[i].address = units[i].address;
+    record.units[i].used = units[i].used;
+    record.units[i].wh = units[i].wh;
+    record.units[i].ah = units[i].ah;
+    record.units[i].todayWh = units[i].todayWh;
+    record.units[i].todayAh = units[i].todayAh;
+  }
+  record.crc = checksumCrc32(&record, offsetof(EnergyCheckpoint, crc));
+
+  // Starting the other file over is safe: the newest valid record is in this one.
+  const char *mode = "a";
+  if (journalRecords >= ENERGY_JOURNAL_RECORDS) {
+    journalFile ^= 1;
+    journalRecords = 0;
+    mode = "w";
+  }
+  lastCheckpoint = millis();
+  File file = LittleFS.open(JOURNAL_PATHS[journalFile], mode);
+  if (!file || file.write((const uint8_t *)&record, sizeof(record)) != sizeof(record)) {
+    // Records sit at fixed offsets, so continue in the other file rather than after a partial one
+    journalRecords = ENERGY_JOURNAL_RECORDS;
+    stats.writeErrors++;
+    logEvent(LOG_ERROR, EV_SYS_ENERGY_ERROR, logString(JOURNAL_PATHS[journalFile]));
+    return;
+  }
+  journalRecords++;
+  stats.sequence = record.sequence;
+  stats.checkpoints++;
+  dirty = false;
+}
+
+/**
+ * @brief Rewrites /energy_days.bin through a temporary file, so a power cut keeps the old one.
+ */
+static void writeDays() {
+  EnergyDaysFile content;
+  memcpy(content.magic, "R48D", 4);
+  content.version = ENERGY_DAYS_VERSION;
+  memset(content.reserved, 0, sizeof(content.reserved));
+  for (uint8_t i = 0; i < ENERGY_DAYS; i++) {
+    content.days[i] = days[(newestDay + 1 + i) % ENERGY_DAYS];
+  }
+  content.crc = checksumCrc32(&content, offsetof(EnergyDaysFile, crc));
+  File file = LittleFS.open(DAYS_TEMP_PATH, "w");
+  if (!file || file.write((const uint8_t *)&content, sizeof(content)) != sizeof(content)) {
+    stats.writeErrors++;
+    logEvent(LOG_ERROR, EV_SYS_ENERGY_ERROR, logString(DAYS_TEMP_PATH));
+    return;
+  }
+  file.close();
+  LittleFS.rename(DAYS_TEMP_PATH, DAYS_PATH);
+}
+
+/**
+ * @brief Moves today's totals into the ring of finished days when the wall clock reaches a new day.
+ */
+static void rollDay() {
+  uint32_t now = wallClock != nullptr ? wallClock() : 0;
+  if (now == 0) {
+    return;
+  }
+  uint32_t day = now / 86400;
+  if (today == 0) {
+    // What was metered before the clock was set counts for the day it is now
+    today = day;
+    dirty = true;
+    return;
+  }
+  if ((int32_t)(day - today) <= 0) {
+    return;
+  }
+
+  newestDay = (newestDay + 1) % ENERGY_DAYS;
+  EnergyDay &finished = days[newestDay];
+  finished.day = today;
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    finished.units[i] = {units[i].address, units[i].used, units[i].todayWh, units[i].todayAh};
+    units[i].todayWh = 0;
+    units[i].todayAh = 0;
+  }
+  today = day;
+  writeDays();
+  dirty = true;
+  energyCheckpoint();
+}
+
+void energyService() {
+  rollDay();
+  if (dirty && millis() - lastCheckpoint >= ENERGY_CHECKPOINT_INTERVAL) {
+    energyCheckpoint();
+  }
+}
+
+const EnergyUnit *energyFind(byte address) {
+  int8_t slot = unitSlot(address, false);
+  return slot >= 0 ? &units[slot] : nullptr;
+}
+
+const EnergyUnit &energyUnitAt(uint8_t index) {
+  return units[index];
+}
+
+const EnergyDay &energyDayAt(uint8_t index) {
+  return days[(newestDay + ENERGY_DAYS - index % ENERGY_DAYS) % ENERGY_DAYS];
+}
+
+uint32_t energyToday() {
+  return today;
+}
+
+EnergyStats energyGetStats() {
+  return stats;
+}
+
+// --- HTTP ---
+
+/**
+ * @brief Formats a day number as YYYY-MM-DD (proleptic Gregorian, UTC).
+ */
+static void formatDay(uint32_t day, char *out, size_t size) {
+  // Howard Hinnant's civil_from_days
+  int32_t z = day + 719468;
+  int32_t era = z / 146097;
+  uint32_t dayOfEra = z - era * 146097;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  uint32_t d = dayOfYear - (153 * mp + 2) / 5 + 1;
+  uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+  int32_t y = yearOfEra + era * 400 + (m <= 2);
+  snprintf(out, size, "%04d-%02u-%02u", (int)y, (unsigned)m, (unsigned)d);
+}
+
+static void appendDay(String &json, uint32_t day) {
+  if (day == 0) {
+    json += "null";
+    return;
+  }
+  char date[32];
+  formatDay(day, date, sizeof(date));
+  json += "\"";
+  json += date;
+  json += "\"";
+}
+
+void energyHandleRequest(AsyncWebServerRequest *request) {
+  String json = "{\"today\":";
+  appendDay(json, today);
+  json += ",\"units\":[";
+  bool first = true;
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    const EnergyUnit &unit = units[i];
+    if (!unit.used) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"address\":";
+    json += String(unit.address);
+    json += ",\"wh\":";
+    json += String(unit.wh, 2);
+    json += ",\"ah\":";
+    json += String(unit.ah, 3);
+    json += ",\"todayWh\":";
+    json += String(unit.todayWh, 2);
+    json += ",\"todayAh\":";
+    json += String(unit.todayAh, 3);
+    json += "}";
+  }
+  json += "],\"days\":[";
+  first = true;
+  for (uint8_t d = 0; d < ENERGY_DAYS; d++) {
+    const EnergyDay &day = energyDayAt(d);
+    if (day.day == 0) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"day\":";
+    appendDay(json, day.day);
+    json += ",\"units\":[";
+    bool firstUnit = true;
+    for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+      if (!day.units[i].used) continue;
+      if (!firstUnit) json += ",";
+      firstUnit = false;
+      json += "{\"address\":";
+      json += String(day.units[i].address);
+      json += ",\"wh\":";
+      json += String(day.units[i].wh, 2);
+      json += ",\"ah\":";
+      json += String(day.units[i].ah, 3);
+      json += "}";
+    }
+    json += "]}";
+  }
+  json += "],\"checkpoints\":";
+  json += String(stats.checkpoints);
+  json += ",\"sequence\":";
+  json += String(stats.sequence);
+  json += ",\"writeErrors\":";
+  json += String(stats.writeErrors);
+  json += "}";
+  request->send(200, "application/json", json);
+}
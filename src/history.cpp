@@ -0,0 +1,236 @@
+#include "history.h"
+#include "rectifiers.h"
+
+// Units of the stored values, per channel in MeasurementType order.
+static const float scales[HISTORY_CHANNELS] = {0.01f, 0.1f, 0.0001f, 0.01f, 0.1f};
+static const uint8_t decimals[HISTORY_CHANNELS] = {2, 1, 4, 2, 1};
+static const char *const channelNames[HISTORY_CHANNELS] = {
+  "outputVoltage", "outputCurrent", "outputCurrentLimit", "temperature", "supplyVoltage"
+};
+static const char *const bucketSuffixes[3] = {"_min", "_max", "_avg"};
+
+// An evenly spaced ring of fixed-point records.
+struct HistoryRing {
+  int16_t *data;
+  uint16_t capacity;
+  uint8_t valuesPerRecord;
+  uint8_t resolution;
+  uint32_t intervalMs;
+  uint32_t total;          // records ever written; the next one goes to total % capacity
+  unsigned long newestAt;  // millis() of the last record
+};
+
+static int16_t fineData[HISTORY_FINE_SAMPLES][HISTORY_CHANNELS];
+static int16_t coarseData[HISTORY_BUCKETS][HISTORY_CHANNELS][3];
+
+static HistoryRing fine = {&fineData[0][0], HISTORY_FINE_SAMPLES, 1, 0, HISTORY_SAMPLE_INTERVAL, 0, 0};
+static HistoryRing coarse = {&coarseData[0][0][0], HISTORY_BUCKETS, 3, 1, HISTORY_BUCKET_INTERVAL, 0, 0};
+
+// The coarse bucket being accumulated from the fine samples.
+static float bucketMin[HISTORY_CHANNELS];
+static float bucketMax[HISTORY_CHANNELS];
+static float bucketSum[HISTORY_CHANNELS];
+static uint16_t bucketCount[HISTORY_CHANNELS];
+static uint16_t bucketSamples = 0;
+
+static unsigned long lastSampleAt = 0;
+
+static int16_t encode(float value, uint8_t channel) {
+  if (isnan(value)) {
+    return HISTORY_MISSING;
+  }
+  float scaled = roundf(value / scales[channel]);
+  if (scaled > INT16_MAX) return INT16_MAX;
+  if (scaled < -INT16_MAX) return -INT16_MAX;
+  return (int16_t)scaled;
+}
+
+static int16_t *ringRecord(const HistoryRing &ring, uint32_t sequence) {
+  return ring.data + (size_t)(sequence % ring.capacity) * HISTORY_CHANNELS * ring.valuesPerRecord;
+}
+
+static int16_t *ringPush(HistoryRing &ring, unsigned long now) {
+  int16_t *record = ringRecord(ring, ring.total);
+  ring.total++;
+  ring.newestAt = now;
+  return record;
+}
+
+static void resetBucket() {
+  for (uint8_t c = 0; c < HISTORY_CHANNELS; c++) {
+    bucketSum[c] = 0;
+    bucketCount[c] = 0;
+  }
+  bucketSamples = 0;
+}
+
+void historyBegin() {
+  fine.total = 0;
+  coarse.total = 0;
+  resetBucket();
+  lastSampleAt = millis();
+}
+
+void historyService() {
+  unsigned long now = millis();
+  if (now - lastSampleAt < HISTORY_SAMPLE_INTERVAL) {
+    return;
+  }
+  lastSampleAt = now;
+
+  float values[HISTORY_CHANNELS];
+  BankTotals bank = rectifiersBankTotals();
+  if (bank.units == 0) {
+    for (uint8_t c = 0; c < HISTORY_CHANNELS; c++) values[c] = NAN;
+  } else {
+    values[OUTPUT_VOLTAGE - 1] = bank.outputVoltage;
+    values[OUTPUT_CURRENT - 1] = bank.outputCurrent;
+    values[OUTPUT_CURRENT_LIMIT - 1] = bank.outputCurrentLimit;
+    values[TEMPERATURE - 1] = bank.temperature;
+    values[SUPPLY_VOLTAGE - 1] = bank.supplyVoltage;
+  }
+
+  int16_t *sample = ringPush(fine, now);
+  for (uint8_t c = 0; c < HISTORY_CHANNELS; c++) {
+    sample[c] = encode(values[c], c);
+    if (isnan(values[c])) {
+      continue;
+    }
+    if (bucketCount[c] == 0 || values[c] < bucketMin[c]) bucketMin[c] = values[c];
+    if (bucketCount[c] == 0 || values[c] > bucketMax[c]) bucketMax[c] = values[c];
+    bucketSum[c] += values[c];
+    bucketCount[c]++;
+  }
+
+  // Close the coarse bucket once it spans HISTORY_BUCKET_INTERVAL worth of samples.
+  if (++bucketSamples * HISTORY_SAMPLE_INTERVAL >= HISTORY_BUCKET_INTERVAL) {
+    int16_t *bucket = ringPush(coarse, now);
+    for (uint8_t c = 0; c < HISTORY_CHANNELS; c++) {
+      bool empty = bucketCount[c] == 0;
+      bucket[c * 3 + 0] = empty ? HISTORY_MISSING : encode(bucketMin[c], c);
+      bucket[c * 3 + 1] = empty ? HISTORY_MISSING : encode(bucketMax[c], c);
+      bucket[c * 3 + 2] = empty ? HISTORY_MISSING : encode(bucketSum[c] / bucketCount[c], c);
+    }
+    resetBucket();
+  }
+}
+
+// --- Streaming ---
+
+// Position of one /history response in its ring. Records are numbered by
+// their write sequence, so entries overwritten while the response is being
+// sent are detected and reported as missing instead of out of order.
+struct HistoryStream {
+  const HistoryRing *ring;
+  bool binary;
+  bool headerSent;
+  uint32_t next;
+  uint32_t end;
+  uint32_t newestAgeMs;
+};
+
+static size_t formatHeader(const HistoryStream &stream, char *out, size_t size) {
+  const HistoryRing &ring = *stream.ring;
+  if (stream.binary) {
+    HistoryHeader header = {{'R', '4', '8', 'H'}, 1, ring.resolution, HISTORY_CHANNELS, ring.valuesPerRecord,
+                            ring.intervalMs, stream.end - stream.next, stream.newestAgeMs, {}};
+    memcpy(header.scales, scales, sizeof(scales));
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header);
+  }
+
+  size_t pos = snprintf(out, size, "age_s");
+  for (uint8_t c = 0; c < HISTORY_CHANNELS; c++) {
+    for (uint8_t v = 0; v < ring.valuesPerRecord && pos < size; v++) {
+      pos += snprintf(out + pos, size - pos, ",%s%s", channelNames[c], ring.valuesPerRecord > 1 ? bucketSuffixes[v] : "");
+    }
+  }
+  if (pos < size) {
+    pos += snprintf(out + pos, size - pos, "\n");
+  }
+  return pos;
+}
+
+static size_t formatRecord(const HistoryStream &stream, uint32_t sequence, char *out, size_t size) {
+  const HistoryRing &ring = *stream.ring;
+  size_t count = HISTORY_CHANNELS * ring.valuesPerRecord;
+  bool overwritten = sequence + ring.capacity < ring.total;
+  const int16_t *record = ringRecord(ring, sequence);
+
+  if (stream.binary) {
+    for (size_t i = 0; i < count; i++) {
+      int16_t value = overwritten ? HISTORY_MISSING : record[i];
+      memcpy(out + i * sizeof(value), &value, sizeof(value));
+    }
+    return count * sizeof(int16_t);
+  }
+
+  unsigned long age = stream.newestAgeMs + (stream.end - 1 - sequence) * ring.intervalMs;
+  size_t pos = snprintf(out, size, "%lu", age / 1000);
+  for (size_t i = 0; i < count && pos < size; i++) {
+    uint8_t channel = i / ring.valuesPerRecord;
+    if (overwritten || record[i] == HISTORY_MISSING) {
+      pos += snprintf(out + pos, size - pos, ",");
+    } else {
+      pos += snprintf(out + pos, size - pos, ",%.*f", decimals[channel], record[i] * scales[channel]);
+    }
+  }
+  if (pos < size) {
+    pos += snprintf(out + pos, size - pos, "\n");
+  }
+  return pos;
+}
+
+/**
+ * @brief Fills one chunk with whole lines/records; a record is never split across chunks.
+ */
+static size_t fillChunk(HistoryStream &stream, uint8_t *buffer, size_t maxLen) {
+  char line[384];
+  size_t written = 0;
+
+  if (!stream.headerSent) {
+    size_t length = formatHeader(stream, line, sizeof(line));
+    if (length > maxLen) {
+      return RESPONSE_TRY_AGAIN;
+    }
+    memcpy(buffer, line, length);
+    written = length;
+    stream.headerSent = true;
+  }
+
+  while (stream.next < stream.end) {
+    size_t length = formatRecord(stream, stream.next, line, sizeof(line));
+    if (written + length > maxLen) {
+      break;
+    }
+    memcpy(buffer + written, line, length);
+    written += length;
+    stream.next++;
+  }
+
+  // 0 ends the response, so only return it once everything has been sent.
+  if (written == 0 && stream.next < stream.end) {
+    return RESPONSE_TRY_AGAIN;
+  }
+  return written;
+}
+
+void historyHandleRequest(AsyncWebServerRequest *request) {
+  bool useFine = request->hasParam("res") && request->getParam("res")->value() == "fine";
+  bool binary = request->hasParam("format") && request->getParam("format")->value() == "bin";
+
+  HistoryStream stream;
+  stream.ring = useFine ? &fine : &coarse;
+  stream.binary = binary;
+  stream.headerSent = false;
+  stream.end = stream.ring->total;
+  stream.next = stream.end > stream.ring->capacity ? stream.end - stream.ring->capacity : 0;
+  stream.newestAgeMs = stream.end ? millis() - stream.ring->newestAt : 0;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(binary ? "application/octet-stream" : "text/csv",
+    [stream](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+      return fillChunk(stream, buffer, maxLen);
+    });
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
@@ -0,0 +1,32 @@
+#include "json_util.h"
+
+void jsonAppendString(String &json, const char *text) {
+  json += "\"";
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      json += '\\';
+      json += *c;
+    } else if ((uint8_t)*c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)*c);
+      json += escaped;
+    } else {
+      json += *c;
+    }
+  }
+  json += "\"";
+}
+
+void jsonAppendError(String &errors, const String &field, const String &message) {
+  if (errors.length() > 0) {
+    errors += ",";
+  }
+  // Field names come from the request, so they are escaped like any other text
+  jsonAppendString(errors, field.c_str());
+  errors += ":";
+  jsonAppendString(errors, message.c_str());
+}
+
+String jsonErrorBody(const String &errors) {
+  return "{\"errors\":{" + errors + "}}";
+}
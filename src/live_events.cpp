@@ -0,0 +1,209 @@
+#include <stdarg.h>
+
+#include "data_snapshot.h"
+#include "live_events.h"
+#include "rectifiers.h"
+
+static AsyncEventSource events("/events");
+
+// Changed measurement slots per rectifier address, and the bank values they affect.
+static byte dirtyAddress[MAX_RECTIFIERS];
+static uint8_t dirtyMask[MAX_RECTIFIERS];
+static uint8_t dirtyCount = 0;
+static uint8_t bankDirtyMask = 0;
+static bool topologyDirty = false;
+static bool statusDirty = false;
+
+static bool commandPending = false;
+static unsigned long remainingSeconds = 0;
+static const char *commandResult = "none";
+
+static unsigned long lastPush = 0;
+static uint32_t eventId = 0;
+
+// Connected subscribers; `stale` once one missed a delta, until it got a snapshot.
+struct LiveClient {
+  AsyncEventSourceClient *client;
+  bool stale;
+};
+static LiveClient clients[LIVE_MAX_CLIENTS];
+static uint8_t clientCount = 0;
+
+// Large enough for every value of MAX_RECTIFIERS units plus the bank totals.
+static char deltaBuffer[1664];
+
+static const char *const valueNames[MEASUREMENT_COUNT] = {
+  "outputVoltage", "outputCurrent", "outputCurrentLimit", "temperature", "supplyVoltage"
+};
+
+void liveEventsBegin(AsyncWebServer &server) {
+  events.onConnect([](AsyncEventSourceClient *client) {
+    if (clientCount >= LIVE_MAX_CLIENTS) {
+      client->close();
+      return;
+    }
+    clients[clientCount++] = {client, false};
+    client->send(dataSnapshotJson(), "snapshot", ++eventId, 2000);
+  });
+  events.onDisconnect([](AsyncEventSourceClient *client) {
+    for (uint8_t i = 0; i < clientCount; i++) {
+      if (clients[i].client == client) {
+        clients[i] = clients[--clientCount];
+        return;
+      }
+    }
+  });
+  server.addHandler(&events);
+}
+
+void liveEventsMarkValue(byte address, uint8_t slot) {
+  bankDirtyMask |= 1 << slot;
+  for (uint8_t i = 0; i < dirtyCount; i++) {
+    if (dirtyAddress[i] == address) {
+      dirtyMask[i] |= 1 << slot;
+      return;
+    }
+  }
+  if (dirtyCount < MAX_RECTIFIERS) {
+    dirtyAddress[dirtyCount] = address;
+    dirtyMask[dirtyCount] = 1 << slot;
+    dirtyCount++;
+  } else {
+    topologyDirty = true;
+  }
+}
+
+void liveEventsMarkTopology() {
+  topologyDirty = true;
+}
+
+void liveEventsSetStatus(bool pending, unsigned long remaining, const char *result) {
+  if (pending != commandPending || remaining != remainingSeconds || strcmp(result, commandResult) != 0) {
+    commandPending = pending;
+    remainingSeconds = remaining;
+    commandResult = result;
+    statusDirty = true;
+  }
+}
+
+/**
+ * @brief Appends printf-style text to the delta buffer, never past its end.
+ */
+static void append(size_t &pos, const char *format, ...) {
+  if (pos >= sizeof(deltaBuffer)) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(deltaBuffer + pos, sizeof(deltaBuffer) - pos, format, args);
+  va_end(args);
+  if (n > 0) {
+    pos += n;
+  }
+}
+
+static void clearDirty() {
+  dirtyCount = 0;
+  bankDirtyMask = 0;
+  topologyDirty = false;
+  statusDirty = false;
+}
+
+/**
+ * @brief Serializes the pending changes into deltaBuffer.
+ * @return false if they did not fit.
+ */
+static bool buildDelta() {
+  size_t pos = 0;
+  append(pos, "{\"isCommandPending\":%s,\"remainingTime\":%lu,\"commandResult\":\"%s\"",
+         commandPending ? "true" : "false", remainingSeconds, commandResult);
+
+  if (bankDirtyMask) {
+    BankTotals bank = rectifiersBankTotals();
+    const float bankValues[MEASUREMENT_COUNT] = {
+      bank.outputVoltage, bank.outputCurrent, bank.outputCurrentLimit, bank.temperature, bank.supplyVoltage
+    };
+    for (uint8_t slot = 0; slot < MEASUREMENT_COUNT; slot++) {
+      if (bankDirtyMask & (1 << slot)) {
+        append(pos, ",\"%s\":%.2f", valueNames[slot], bankValues[slot]);
+      }
+    }
+  }
+
+  if (dirtyCount) {
+    append(pos, ",\"units\":[");
+    bool first = true;
+    for (uint8_t i = 0; i < dirtyCount; i++) {
+      const Rectifier *rectifier = rectifierFind(dirtyAddress[i]);
+      if (rectifier == nullptr) {
+        continue;
+      }
+      append(pos, "%s{\"address\":%u", first ? "" : ",", rectifier->address);
+      for (uint8_t slot = 0; slot < MEASUREMENT_COUNT; slot++) {
+        if (dirtyMask[i] & (1 << slot)) {
+          append(pos, ",\"%s\":%.2f", valueNames[slot], rectifier->values[slot]);
+        }
+      }
+      append(pos, ",\"cached\":%s}", rectifier->cachedMask ? "true" : "false");
+      first = false;
+    }
+    append(pos, "]");
+  }
+  append(pos, "}");
+  return pos < sizeof(deltaBuffer);
+}
+
+static bool anyStale() {
+  for (uint8_t i = 0; i < clientCount; i++) {
+    if (clients[i].stale) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void liveEventsService() {
+  bool changed = topologyDirty || statusDirty || dirtyCount > 0;
+  if (!changed && !anyStale()) {
+    return;
+  }
+  if (clientCount == 0) {
+    clearDirty();
+    return;
+  }
+
+  unsigned long now = millis();
+  if (now - lastPush < LIVE_PUSH_INTERVAL) {
+    return;
+  }
+  // A snapshot must include every change so far; until it has been serialized only deltas go out.
+  bool snapshotReady = dataSnapshotIsCurrent();
+  if (topologyDirty && !snapshotReady) {
+    return;
+  }
+  lastPush = now;
+
+  // Should not overflow with MAX_RECTIFIERS units, but never send truncated JSON.
+  bool snapshot = topologyDirty || (changed && !buildDelta());
+  uint32_t id = ++eventId;
+  for (uint8_t i = 0; i < clientCount; i++) {
+    LiveClient &live = clients[i];
+    if (live.client->packetsWaiting() > LIVE_PUSH_MAX_BACKLOG) {
+      // Skipped: this client now needs the whole document to catch up
+      live.stale |= changed;
+    } else if (snapshot || live.stale) {
+      // Without a current snapshot the client stays behind until a later pass
+      if (snapshotReady) {
+        live.client->send(dataSnapshotJson(), "snapshot", id);
+      }
+      live.stale = !snapshotReady;
+    } else if (changed) {
+      live.client->send(deltaBuffer, "delta", id);
+    }
+  }
+  clearDirty();
+}
+
+size_t liveEventsClients() {
+  return clientCount;
+}
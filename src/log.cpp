@@ -0,0 +1,270 @@
+#include "log.h"
+
+// Number of records the ring can hold. Must be a power of two.
+const uint8_t LOG_RING_SIZE = 64;
+// Upper bound on records formatted per logService() call.
+const uint8_t LOG_MAX_PER_SERVICE = 8;
+
+struct LogRecord {
+  uint32_t timestamp;
+  uint8_t event;
+  uint8_t level;
+  uint8_t len; // payload length of a frame record
+  union {
+    LogArg args[3];
+    struct {
+      uint32_t id;
+      uint8_t data[8];
+    } frame;
+  };
+};
+
+struct LogEventInfo {
+  LogSubsystem subsystem;
+  bool isFrame;        // the record carries a CAN frame instead of arguments
+  const char *format;  // printf-style text, or the direction prefix of a frame
+};
+
+// Indexed by LogEventId.
+static const LogEventInfo eventTable[LOG_EVENT_COUNT] = {
+  {LOG_CAN_RX, true, "RX"},
+  {LOG_CAN_RX, false, "Vertiv response unit 0x%02x ID = value: 0x%02x = %.2f"},
+  {LOG_CAN_RX, false, "Register response unit 0x%02x 0x%02x = %.2f"},
+  {LOG_CAN_TX, true, "TX"},
+  {LOG_CAN_TX, false, "Sent %s command to unit 0x%02x. Value: %.2f"},
+  {LOG_CAN_TX, false, "Sent %s command to unit 0x%02x. Value: %s"},
+  {LOG_CAN_TX, false, "Sent read request command to unit 0x%02x. Measurement #: %X"},
+  {LOG_CAN_TX, false, "Error sending %s command."},
+  {LOG_SYS, false, "Command 0x%02x to unit 0x%02x confirmed after %u ms."},
+  {LOG_SYS, false, "Command 0x%02x to unit 0x%02x not confirmed after %u read-backs."},
+  {LOG_SYS, false, "Log level %s, subsystem mask 0x%08X"},
+  {LOG_SYS, false, "Rectifier 0x%02x %s"},
+  {LOG_SYS, false, "Capture file %s could not be written."},
+  {LOG_SYS, false, "No UDP setpoint for %u ms, online current limit set to %.2f."},
+  {LOG_SYS, false, "Energy file %s could not be written."},
+  {LOG_SYS, false, "WiFi connected after %u attempts, RSSI %d dBm."},
+  {LOG_SYS, false, "WiFi attempt failed (%u in a row), retrying in %u ms."},
+  {LOG_SYS, false, "WiFi connection lost (%u since boot), reconnecting."},
+  {LOG_SYS, false, "WiFi fallback access point %s."},
+  {LOG_SYS, false, "Config loaded from %s, write %u."},
+  {LOG_SYS, false, "Config file %s could not be written."},
+  {LOG_SYS, false, "Register sweep finished, %u registers answer."},
+  {LOG_SYS, false, "Poll schedule full, register 0x%02x of unit 0x%02x not polled."},
+  {LOG_SYS, false, "Route table full, %s %s counted as other."},
+};
+
+static const char *const levelNames[] = {"error", "warn", "info", "debug"};
+
+uint8_t logLevel = LOG_INFO;
+uint32_t logMask = LOG_ALL_SUBSYSTEMS;
+
+static LogRecord ring[LOG_RING_SIZE];
+static uint8_t ringHead = 0;
+static uint8_t ringTail = 0;
+static uint32_t written = 0;
+static uint32_t dropped = 0;
+
+// The line being written to the UART, kept across calls when the FIFO fills up.
+static char outLine[128];
+static uint8_t outLen = 0;
+static uint8_t outPos = 0;
+
+/**
+ * @brief Claims the next free record, or counts a drop when the ring is full.
+ */
+static LogRecord *logClaim(LogLevel level, LogEventId event) {
+  uint8_t next = (ringHead + 1) & (LOG_RING_SIZE - 1);
+  if (next == ringTail) {
+    dropped++;
+    return nullptr;
+  }
+  LogRecord *record = &ring[ringHead];
+  record->timestamp = millis();
+  record->event = event;
+  record->level = level;
+  return record;
+}
+
+static void logCommit() {
+  ringHead = (ringHead + 1) & (LOG_RING_SIZE - 1);
+  written++;
+}
+
+void logEvent(LogLevel level, LogEventId event, LogArg a, LogArg b, LogArg c) {
+  if (!logEnabled(level, eventTable[event].subsystem)) {
+    return;
+  }
+  LogRecord *record = logClaim(level, event);
+  if (record == nullptr) {
+    return;
+  }
+  record->len = 0;
+  record->args[0] = a;
+  record->args[1] = b;
+  record->args[2] = c;
+  logCommit();
+}
+
+void logFrame(LogLevel level, LogEventId event, unsigned long id, uint8_t len, const uint8_t *data) {
+  if (!logEnabled(level, eventTable[event].subsystem)) {
+    return;
+  }
+  LogRecord *record = logClaim(level, event);
+  if (record == nullptr) {
+    return;
+  }
+  if (len > 8) {
+    len = 8;
+  }
+  record->len = len;
+  record->frame.id = id;
+  memcpy(record->frame.data, data, len);
+  logCommit();
+}
+
+/**
+ * @brief Expands a printf-style format, taking each conversion's value from
+ * the record arguments in order.
+ */
+static int formatArgs(char *out, size_t size, const char *format, const LogArg *args) {
+  size_t pos = 0;
+  uint8_t argIndex = 0;
+
+  while (*format && pos + 1 < size) {
+    if (*format != '%') {
+      out[pos++] = *format++;
+      continue;
+    }
+    if (format[1] == '%') {
+      out[pos++] = '%';
+      format += 2;
+      continue;
+    }
+
+    // Copy one conversion specification, e.g. "%.2f" or "%08X".
+    char spec[12];
+    uint8_t specLen = 0;
+    spec[specLen++] = *format++;
+    while (*format && strchr("-+ #0123456789.l", *format) && specLen < sizeof(spec) - 2) {
+      spec[specLen++] = *format++;
+    }
+    char conversion = *format ? *format++ : 'u';
+    spec[specLen++] = conversion;
+    spec[specLen] = '\0';
+
+    LogArg arg = argIndex < 3 ? args[argIndex++] : 0;
+    int n;
+    switch (conversion) {
+      case 'f':
+      case 'g':
+      case 'e': {
+        uint32_t bits = (uint32_t)arg;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        n = snprintf(out + pos, size - pos, spec, (double)value);
+        break;
+      }
+      case 's':
+        n = snprintf(out + pos, size - pos, spec, arg ? (const char *)arg : "");
+        break;
+      case 'd':
+      case 'i':
+        n = snprintf(out + pos, size - pos, spec, (int)(int32_t)arg);
+        break;
+      default:
+        n = snprintf(out + pos, size - pos, spec, (unsigned)(uint32_t)arg);
+        break;
+    }
+    if (n < 0) {
+      break;
+    }
+    pos += n;
+  }
+
+  if (pos >= size) {
+    pos = size - 1;
+  }
+  out[pos] = '\0';
+  return pos;
+}
+
+static void formatRecord(const LogRecord &record) {
+  const LogEventInfo &info = eventTable[record.event];
+  size_t size = sizeof(outLine) - 2; // room for "\r\n"
+  int pos = snprintf(outLine, size, "[%5lu.%03lu] ",
+                     (unsigned long)(record.timestamp / 1000), (unsigned long)(record.timestamp % 1000));
+
+  if (info.isFrame) {
+    pos += snprintf(outLine + pos, size - pos, "%s ID: 0x%08lX Length: %u Data: ",
+                    info.format, (unsigned long)record.frame.id, record.len);
+    for (uint8_t i = 0; i < record.len && pos + 6 < (int)size; i++) {
+      pos += snprintf(outLine + pos, size - pos, "0x%02X ", record.frame.data[i]);
+    }
+  } else {
+    pos += formatArgs(outLine + pos, size - pos, info.format, record.args);
+  }
+
+  if (pos > (int)size - 1) {
+    pos = size - 1;
+  }
+  outLine[pos++] = '\r';
+  outLine[pos++] = '\n';
+  outLen = pos;
+  outPos = 0;
+}
+
+void logService() {
+  for (uint8_t i = 0; i <= LOG_MAX_PER_SERVICE; i++) {
+    if (outPos < outLen) {
+      int room = Serial.availableForWrite();
+      if (room <= 0) {
+        return;
+      }
+      size_t chunk = outLen - outPos;
+      if ((size_t)room < chunk) {
+        chunk = room;
+      }
+      Serial.write((const uint8_t *)outLine + outPos, chunk);
+      outPos += chunk;
+      if (outPos < outLen) {
+        return;
+      }
+    }
+
+    if (ringTail == ringHead) {
+      return;
+    }
+    formatRecord(ring[ringTail]);
+    ringTail = (ringTail + 1) & (LOG_RING_SIZE - 1);
+  }
+}
+
+void logSetLevel(uint8_t level) {
+  logLevel = level > LOG_DEBUG ? (uint8_t)LOG_DEBUG : level;
+}
+
+void logSetMask(uint32_t mask) {
+  logMask = mask;
+}
+
+LogStats logGetStats() {
+  LogStats stats;
+  stats.written = written;
+  stats.dropped = dropped;
+  stats.pending = (ringHead - ringTail) & (LOG_RING_SIZE - 1);
+  return stats;
+}
+
+bool logParseLevel(const String &name, uint8_t &level) {
+  for (uint8_t i = 0; i <= LOG_DEBUG; i++) {
+    if (name == levelNames[i]) {
+      level = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *logLevelName(uint8_t level) {
+  return levelNames[level > LOG_DEBUG ? (uint8_t)LOG_DEBUG : level];
+}
@@ -0,0 +1,300 @@
+#include "metrics.h"
+#include "can_capture.h"
+#include "can_filter.h"
+#include "can_rx.h"
+#include "command_queue.h"
+#include "energy.h"
+#include "log.h"
+#include "poll_scheduler.h"
+#include "profiler.h"
+#include "r48_registers.h"
+#include "register_cache.h"
+#include "setpoint_keepalive.h"
+
+// Most bounds a histogram can have.
+static const uint8_t HISTOGRAM_MAX_BOUNDS = 10;
+
+// A histogram with fixed upper bounds; counts[i] holds observations <= bounds[i]
+// (not cumulative), counts[boundCount] the ones above the last bound.
+struct Histogram {
+  const uint32_t *bounds;
+  uint8_t boundCount;
+  uint32_t counts[HISTOGRAM_MAX_BOUNDS + 1];
+  uint32_t count;
+  uint64_t sum;
+};
+
+static const uint32_t LATENCY_BOUNDS_MS[] = {2, 5, 10, 20, 50, 100, 250};
+static const uint32_t LOOP_BOUNDS_US[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000};
+
+#define HISTOGRAM(bounds) {bounds, sizeof(bounds) / sizeof(bounds[0]), {}, 0, 0}
+
+static Histogram pollLatency[MEASUREMENT_COUNT] = {
+  HISTOGRAM(LATENCY_BOUNDS_MS), HISTOGRAM(LATENCY_BOUNDS_MS), HISTOGRAM(LATENCY_BOUNDS_MS),
+  HISTOGRAM(LATENCY_BOUNDS_MS), HISTOGRAM(LATENCY_BOUNDS_MS)
+};
+static Histogram loopTime = HISTOGRAM(LOOP_BOUNDS_US);
+
+static uint32_t counters[METRIC_COUNTER_COUNT];
+static long bootTimes[BOOT_MILESTONE_COUNT] = {-1, -1};
+
+// Send failures are counted per writable setting (R48_SETTINGS order); reads share one label.
+static const uint8_t COMMAND_READ = SETTING_COUNT;
+static const uint8_t COMMAND_OTHER = SETTING_COUNT + 1;
+static uint32_t sendFailures[SETTING_COUNT + 2];
+
+struct RouteCounter {
+  const char *uri;
+  WebRequestMethodComposite method;
+  uint32_t requests;
+};
+
+static RouteCounter routes[METRICS_MAX_ROUTES];
+static_assert(PROFILE_MAX_PROBES >= PROFILE_FIXED_PROBES + METRICS_MAX_ROUTES + 1,
+              "every route with its own request counter needs its own profiler probe");
+static uint8_t routeCount = 0;
+// Requests to routes registered after the table filled up, and to no route at all.
+static uint32_t otherRequests = 0;
+static uint32_t unmatchedRequests = 0;
+
+static const char *const measurementLabels[MEASUREMENT_COUNT] = {
+  "output_voltage", "output_current", "output_current_limit", "temperature", "supply_voltage"
+};
+
+static const char *methodName(WebRequestMethodComposite method);
+
+static void observe(Histogram &histogram, uint32_t value) {
+  uint8_t i = 0;
+  while (i < histogram.boundCount && value > histogram.bounds[i]) {
+    i++;
+  }
+  histogram.counts[i]++;
+  histogram.count++;
+  histogram.sum += value;
+}
+
+void metricsIncrement(MetricCounter counter) {
+  counters[counter]++;
+}
+
+void metricsCountSendFailure(const byte *data) {
+  if (data[0] == 0x01) {
+    sendFailures[COMMAND_READ]++;
+    return;
+  }
+  const R48Setting *setting = r48FindSetting(data[3]);
+  sendFailures[setting ? setting - R48_SETTINGS : COMMAND_OTHER]++;
+}
+
+void metricsObservePollLatency(byte measurementNo, unsigned long milliseconds) {
+  int8_t slot = measurementSlot(measurementNo);
+  if (slot >= 0) {
+    observe(pollLatency[slot], milliseconds);
+  }
+}
+
+void metricsObserveLoop(unsigned long microseconds) {
+  observe(loopTime, microseconds);
+}
+
+void metricsMarkBoot(BootMilestone milestone) {
+  if (bootTimes[milestone] < 0) {
+    bootTimes[milestone] = millis();
+  }
+}
+
+long metricsBootTime(BootMilestone milestone) {
+  return bootTimes[milestone];
+}
+
+void metricsRoute(AsyncWebServer &server, const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction handler) {
+  uint32_t *requests = &otherRequests;
+  if (routeCount < METRICS_MAX_ROUTES) {
+    routes[routeCount] = {uri, method, 0};
+    requests = &routes[routeCount].requests;
+    routeCount++;
+  } else {
+    logEvent(LOG_ERROR, EV_SYS_ROUTES_FULL, logString(methodName(method)), logString(uri));
+  }
+#ifdef R48_PROFILE
+  ProfileProbe probe = profileAddProbe(uri, methodName(method));
+#else
+  ProfileProbe probe = 0;
+#endif
+  server.on(uri, method, [requests, handler, probe](AsyncWebServerRequest *request) {
+    PROFILE_SCOPE(probe);
+    (*requests)++;
+    handler(request);
+  });
+}
+
+// --- Exposition ---
+
+static const char *methodName(WebRequestMethodComposite method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_DELETE: return "DELETE";
+    default: return "ANY";
+  }
+}
+
+static void printHeader(AsyncResponseStream *out, const char *name, const char *type, const char *help) {
+  out->printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Prints one histogram series; bounds and sum are divided by `unit` to get seconds.
+ */
+static void printHistogram(AsyncResponseStream *out, const char *name, const char *labels,
+                           const Histogram &histogram, float unit) {
+  const char *separator = labels[0] ? "," : "";
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < histogram.boundCount; i++) {
+    cumulative += histogram.counts[i];
+    out->printf("%s_bucket{%s%sle=\"%g\"} %u\n", name, labels, separator, histogram.bounds[i] / unit, (unsigned)cumulative);
+  }
+  out->printf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, separator, (unsigned)histogram.count);
+  if (labels[0]) {
+    out->printf("%s_sum{%s} %g\n%s_count{%s} %u\n", name, labels, histogram.sum / unit, name, labels, (unsigned)histogram.count);
+  } else {
+    out->printf("%s_sum %g\n%s_count %u\n", name, histogram.sum / unit, name, (unsigned)histogram.count);
+  }
+}
+
+static void sendMetrics(AsyncWebServerRequest *request) {
+  AsyncResponseStream *out = request->beginResponseStream("text/plain; version=0.0.4");
+
+  printHeader(out, "r48_can_rx_frames_total", "counter", "CAN frames taken from the receive ring.");
+  out->printf("r48_can_rx_frames_total %u\n", (unsigned)counters[METRIC_CAN_RX_FRAMES]);
+  printHeader(out, "r48_can_rx_parsed_total", "counter", "R48 responses stored as a measurement.");
+  out->printf("r48_can_rx_parsed_total %u\n", (unsigned)counters[METRIC_CAN_RX_PARSED]);
+  printHeader(out, "r48_can_rx_unknown_total", "counter", "R48 responses for a register that is not a measurement (kept in the register cache).");
+  out->printf("r48_can_rx_unknown_total %u\n", (unsigned)counters[METRIC_CAN_RX_UNKNOWN]);
+
+  CanRxStats rx = canRxGetStats();
+  printHeader(out, "r48_can_rx_ring_overruns_total", "counter", "Frames lost because the receive ring was full.");
+  out->printf("r48_can_rx_ring_overruns_total %u\n", (unsigned)rx.overruns);
+  printHeader(out, "r48_can_rx_hw_overflows_total", "counter", "Frames the CAN driver lost (MCP2515 buffer overflows, each one or more frames; socket queue drops).");
+  out->printf("r48_can_rx_hw_overflows_total %u\n", (unsigned)rx.hwOverflows);
+  printHeader(out, "r48_can_filter_reprograms_total", "counter", "Acceptance filter writes (the MCP2515 drops frames while it is reprogrammed).");
+  out->printf("r48_can_filter_reprograms_total %u\n", (unsigned)canFilterReprograms());
+
+  printHeader(out, "r48_can_tx_frames_total", "counter", "CAN frames handed to the CAN driver.");
+  out->printf("r48_can_tx_frames_total %u\n", (unsigned)counters[METRIC_CAN_TX_FRAMES]);
+  printHeader(out, "r48_can_tx_failures_total", "counter", "Frames sendMsgBuf refused, by command.");
+  for (uint8_t i = 0; i < SETTING_COUNT; i++) {
+    out->printf("r48_can_tx_failures_total{command=\"%s\"} %u\n", R48_SETTINGS[i].name, (unsigned)sendFailures[i]);
+  }
+  out->printf("r48_can_tx_failures_total{command=\"read\"} %u\n", (unsigned)sendFailures[COMMAND_READ]);
+  out->printf("r48_can_tx_failures_total{command=\"other\"} %u\n", (unsigned)sendFailures[COMMAND_OTHER]);
+
+  CommandQueueStats queue = commandQueueGetStats();
+  printHeader(out, "r48_command_queue_coalesced_total", "counter", "Setting writes merged into a queued write of the same register.");
+  out->printf("r48_command_queue_coalesced_total %u\n", (unsigned)queue.coalesced);
+  printHeader(out, "r48_command_queue_rejected_total", "counter", "Setting writes refused because the queue was full.");
+  out->printf("r48_command_queue_rejected_total %u\n", (unsigned)queue.rejected);
+  printHeader(out, "r48_command_queue_dropped_total", "counter", "Queued writes given up after repeated send failures.");
+  out->printf("r48_command_queue_dropped_total %u\n", (unsigned)queue.dropped);
+  printHeader(out, "r48_command_queue_pending", "gauge", "Setting writes waiting to be sent.");
+  out->printf("r48_command_queue_pending %u\n", (unsigned)commandQueuePending());
+
+  printHeader(out, "r48_setpoint_refreshes_total", "counter", "Online setpoints written again by the keepalive.");
+  out->printf("r48_setpoint_refreshes_total %u\n", (unsigned)setpointKeepaliveGetStats().refreshes);
+  printHeader(out, "r48_setpoint_age_seconds", "gauge", "Time since an online setpoint was last written.");
+  for (uint8_t i = 0; i < setpointKeepaliveCount(); i++) {
+    const KeptSetpoint &setpoint = setpointKeepaliveAt(i);
+    out->printf("r48_setpoint_age_seconds{unit=\"%u\",setting=\"%s\"} %.3f\n", (unsigned)setpoint.unit,
+                R48_SETTINGS[setpoint.setting].name, (millis() - setpoint.writtenAt) / 1000.0f);
+  }
+
+  RegisterCacheStats registers = registerCacheGetStats();
+  printHeader(out, "r48_register_sweep_requests_total", "counter", "Broadcast reads sent by the register discovery sweeps.");
+  out->printf("r48_register_sweep_requests_total %u\n", (unsigned)registers.requests);
+  printHeader(out, "r48_registers_answering", "gauge", "Registers that answered a read at least once.");
+  out->printf("r48_registers_answering %u\n", (unsigned)registers.registers);
+  printHeader(out, "r48_register_value", "gauge", "Last value of a polled register, a float or the unsigned word.");
+  for (uint8_t i = 0; i < registerCacheValueCount(); i++) {
+    const RegisterValue &value = registerCacheValueAt(i);
+    if (registerCachePollPeriod(value.registerNo) != 0) {
+      out->printf("r48_register_value{unit=\"%u\",register=\"0x%02X\"} %.3f\n", (unsigned)value.unit,
+                  (unsigned)value.registerNo, registerCacheDecode(value.registerNo, value.raw));
+    }
+  }
+
+  PollStats poll = pollSchedulerGetStats();
+  printHeader(out, "r48_poll_timeouts_total", "counter", "Read requests that were never answered.");
+  out->printf("r48_poll_timeouts_total %u\n", (unsigned)poll.timeouts);
+  printHeader(out, "r48_poll_latency_seconds", "histogram", "Time from a read request to its answer.");
+  char labels[40];
+  for (uint8_t i = 0; i < MEASUREMENT_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "measurement=\"%s\"", measurementLabels[i]);
+    printHistogram(out, "r48_poll_latency_seconds", labels, pollLatency[i], 1000.0f);
+  }
+
+  printHeader(out, "r48_loop_duration_seconds", "histogram", "Duration of one loop() iteration.");
+  printHistogram(out, "r48_loop_duration_seconds", "", loopTime, 1000000.0f);
+
+  printHeader(out, "r48_http_requests_total", "counter", "HTTP requests by route.");
+  for (uint8_t i = 0; i < routeCount; i++) {
+    out->printf("r48_http_requests_total{route=\"%s\",method=\"%s\"} %u\n",
+                routes[i].uri, methodName(routes[i].method), (unsigned)routes[i].requests);
+  }
+  out->printf("r48_http_requests_total{route=\"other\",method=\"ANY\"} %u\n", (unsigned)otherRequests);
+  out->printf("r48_http_requests_total{route=\"unmatched\",method=\"ANY\"} %u\n", (unsigned)unmatchedRequests);
+
+  CaptureStats capture = canCaptureGetStats();
+  printHeader(out, "r48_capture_records_total", "counter", "CAN frames written to the capture buffer.");
+  out->printf("r48_capture_records_total %u\n", (unsigned)capture.records);
+  printHeader(out, "r48_capture_dropped_total", "counter", "CAN frames lost because the capture buffer was full.");
+  out->printf("r48_capture_dropped_total %u\n", (unsigned)capture.dropped);
+
+  // Units stay listed after they were dropped from the table, so the counters never go back
+  printHeader(out, "r48_energy_wh_total", "counter", "Output energy metered per rectifier.");
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    const EnergyUnit &unit = energyUnitAt(i);
+    if (unit.used) {
+      out->printf("r48_energy_wh_total{unit=\"%u\"} %.2f\n", (unsigned)unit.address, unit.wh);
+    }
+  }
+  printHeader(out, "r48_energy_ah_total", "counter", "Output charge metered per rectifier.");
+  for (uint8_t i = 0; i < MAX_RECTIFIERS; i++) {
+    const EnergyUnit &unit = energyUnitAt(i);
+    if (unit.used) {
+      out->printf("r48_energy_ah_total{unit=\"%u\"} %.3f\n", (unsigned)unit.address, unit.ah);
+    }
+  }
+  printHeader(out, "r48_energy_checkpoint_errors_total", "counter", "Energy journal and day file writes that failed.");
+  out->printf("r48_energy_checkpoint_errors_total %u\n", (unsigned)energyGetStats().writeErrors);
+
+  LogStats log = logGetStats();
+  printHeader(out, "r48_log_dropped_total", "counter", "Log records dropped because the log buffer was full.");
+  out->printf("r48_log_dropped_total %u\n", (unsigned)log.dropped);
+
+  printHeader(out, "r48_heap_free_bytes", "gauge", "Free heap.");
+  out->printf("r48_heap_free_bytes %u\n", (unsigned)ESP.getFreeHeap());
+  printHeader(out, "r48_heap_max_block_bytes", "gauge", "Largest free heap block.");
+  out->printf("r48_heap_max_block_bytes %u\n", (unsigned)ESP.getMaxFreeBlockSize());
+  printHeader(out, "r48_uptime_seconds", "gauge", "Time since boot.");
+  out->printf("r48_uptime_seconds %lu\n", millis() / 1000);
+  // Left out until reached
+  if (bootTimes[BOOT_FIRST_MEASUREMENT] >= 0) {
+    printHeader(out, "r48_boot_first_measurement_seconds", "gauge", "Time from power-on to the first rectifier measurement.");
+    out->printf("r48_boot_first_measurement_seconds %.3f\n", bootTimes[BOOT_FIRST_MEASUREMENT] / 1000.0f);
+  }
+  if (bootTimes[BOOT_NETWORK] >= 0) {
+    printHeader(out, "r48_boot_network_seconds", "gauge", "Time from power-on to the network being up.");
+    out->printf("r48_boot_network_seconds %.3f\n", bootTimes[BOOT_NETWORK] / 1000.0f);
+  }
+
+  request->send(out);
+}
+
+void metricsBegin(AsyncWebServer &server) {
+  metricsRoute(server, "/metrics", HTTP_GET, sendMetrics);
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    unmatchedRequests++;
+    request->send(404, "text/plain", "Not found");
+  });
+}
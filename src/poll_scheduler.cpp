@@ -0,0 +1,269 @@
+#include "log.h"
+#include "metrics.h"
+#include "poll_scheduler.h"
+
+struct PollEntry {
+  byte unit;
+  byte registerNo;
+  uint8_t priority;
+  uint8_t retries;       // retries used by the outstanding request
+  bool inFlight;
+  bool retryDue;         // timed out, to be re-sent before any new request
+  bool requested;        // at least one refresh cycle started
+  bool answered;         // at least one answer received
+  unsigned long periodMs;
+  unsigned long lastRequest; // start of the current refresh cycle
+  unsigned long sentAt;      // when the outstanding request (or retry) was sent
+  unsigned long lastUpdate;  // when the last answer arrived
+};
+
+static PollSendFunction sendRequest = nullptr;
+static PollEntry entries[POLL_MAX_ENTRIES];
+static uint8_t entryCount = 0;
+static bool paused = false;
+static unsigned long lastSend = 0;
+static PollStats stats = {};
+
+struct PeriodCap {
+  byte registerNo;
+  unsigned long maxPeriodMs;  // 0 for a free slot
+};
+static PeriodCap caps[POLL_MAX_PERIOD_CAPS] = {};
+
+static PollEntry *findEntry(byte unit, byte registerNo) {
+  for (uint8_t i = 0; i < entryCount; i++) {
+    if (entries[i].unit == unit && entries[i].registerNo == registerNo) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief The entry's period, shortened by a cap on its register.
+ */
+static unsigned long effectivePeriod(const PollEntry &entry) {
+  for (uint8_t i = 0; i < POLL_MAX_PERIOD_CAPS; i++) {
+    if (caps[i].maxPeriodMs != 0 && caps[i].registerNo == entry.registerNo) {
+      return min(entry.periodMs, caps[i].maxPeriodMs);
+    }
+  }
+  return entry.periodMs;
+}
+
+static bool isDue(const PollEntry &entry, unsigned long now) {
+  return entry.retryDue || (!entry.inFlight && (!entry.requested || now - entry.lastRequest >= effectivePeriod(entry)));
+}
+
+static bool sendEntry(PollEntry &entry, unsigned long now) {
+  if (!sendRequest(entry.unit, entry.registerNo)) {
+    return false;
+  }
+  entry.inFlight = true;
+  entry.sentAt = now;
+  lastSend = now;
+  stats.requests++;
+  stats.inFlight++;
+  return true;
+}
+
+void pollSchedulerBegin(PollSendFunction send) {
+  sendRequest = send;
+}
+
+bool pollSchedulerAdd(byte unit, byte registerNo, unsigned long periodMs, uint8_t priority) {
+  if (findEntry(unit, registerNo) != nullptr) {
+    return false;
+  }
+  if (entryCount >= POLL_MAX_ENTRIES) {
+    stats.rejected++;
+    logEvent(LOG_ERROR, EV_SYS_POLL_FULL, registerNo, unit);
+    return false;
+  }
+  PollEntry &entry = entries[entryCount++];
+  entry = {};
+  entry.unit = unit;
+  entry.registerNo = registerNo;
+  entry.periodMs = periodMs;
+  entry.priority = priority;
+  return true;
+}
+
+void pollSchedulerRemoveUnit(byte unit) {
+  uint8_t i = 0;
+  while (i < entryCount) {
+    if (entries[i].unit != unit) {
+      i++;
+      continue;
+    }
+    if (entries[i].inFlight) {
+      stats.inFlight--;
+    }
+    entries[i] = entries[--entryCount];
+  }
+}
+
+void pollSchedulerRemove(byte unit, byte registerNo) {
+  PollEntry *entry = findEntry(unit, registerNo);
+  if (entry == nullptr) {
+    return;
+  }
+  if (entry->inFlight) {
+    stats.inFlight--;
+  }
+  *entry = entries[--entryCount];
+}
+
+void pollSchedulerService() {
+  if (sendRequest == nullptr) {
+    return;
+  }
+  unsigned long now = millis();
+
+  // Expire requests that were never answered; the ones with retries left are sent again below, under the same
+  // gap and in-flight limits as new requests.
+  for (uint8_t i = 0; i < entryCount; i++) {
+    PollEntry &entry = entries[i];
+    if (!entry.inFlight || now - entry.sentAt < POLL_RESPONSE_TIMEOUT) {
+      continue;
+    }
+    entry.inFlight = false;
+    stats.inFlight--;
+    if (entry.retries < POLL_MAX_RETRIES && !paused) {
+      entry.retries++;
+      entry.retryDue = true;
+    } else {
+      stats.timeouts++;
+    }
+  }
+
+  if (paused || stats.inFlight >= POLL_MAX_IN_FLIGHT || now - lastSend < POLL_MIN_REQUEST_GAP) {
+    return;
+  }
+
+  // Pick the most urgent due register: retries first, then the lowest priority value, then the longest waiting.
+  PollEntry *next = nullptr;
+  for (uint8_t i = 0; i < entryCount; i++) {
+    PollEntry &entry = entries[i];
+    if (!isDue(entry, now)) {
+      continue;
+    }
+    if (next == nullptr || entry.retryDue > next->retryDue ||
+        (entry.retryDue == next->retryDue &&
+         (entry.priority < next->priority ||
+          (entry.priority == next->priority && now - entry.lastRequest > now - next->lastRequest)))) {
+      next = &entry;
+    }
+  }
+  if (next == nullptr) {
+    return;
+  }
+
+  if (next->retryDue) {
+    // A retry stays in the refresh cycle it belongs to.
+    next->retryDue = false;
+    stats.retries++;
+  } else {
+    next->retries = 0;
+    next->requested = true;
+    next->lastRequest = now;
+  }
+  sendEntry(*next, now);
+}
+
+bool pollSchedulerOnResponse(byte unit, byte registerNo) {
+  PollEntry *entry = findEntry(unit, registerNo);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->answered = true;
+  entry->lastUpdate = millis();
+  // A late answer makes a pending retry pointless.
+  entry->retryDue = false;
+  if (!entry->inFlight) {
+    stats.unsolicited++;
+    return false;
+  }
+  metricsObservePollLatency(registerNo, entry->lastUpdate - entry->sentAt);
+  entry->inFlight = false;
+  stats.inFlight--;
+  stats.responses++;
+  return true;
+}
+
+bool pollSchedulerCapPeriod(byte registerNo, unsigned long maxPeriodMs) {
+  PeriodCap *slot = nullptr;
+  for (uint8_t i = 0; i < POLL_MAX_PERIOD_CAPS; i++) {
+    if (caps[i].maxPeriodMs != 0 && caps[i].registerNo == registerNo) {
+      slot = &caps[i];
+      break;
+    }
+    if (caps[i].maxPeriodMs == 0 && slot == nullptr) {
+      slot = &caps[i];
+    }
+  }
+  if (slot == nullptr) {
+    return false;
+  }
+  slot->registerNo = registerNo;
+  slot->maxPeriodMs = maxPeriodMs;
+  return true;
+}
+
+void pollSchedulerSetPaused(bool state) {
+  paused = state;
+}
+
+unsigned long pollSchedulerAge(byte unit, byte registerNo) {
+  PollEntry *entry = findEntry(unit, registerNo);
+  if (entry == nullptr || !entry->answered) {
+    return POLL_AGE_NEVER;
+  }
+  return millis() - entry->lastUpdate;
+}
+
+PollStats pollSchedulerGetStats() {
+  return stats;
+}
+
+String pollSchedulerToJson() {
+  char hex[5];
+  String json = "{\"requests\":";
+  json += String(stats.requests);
+  json += ",\"responses\":";
+  json += String(stats.responses);
+  json += ",\"unsolicited\":";
+  json += String(stats.unsolicited);
+  json += ",\"retries\":";
+  json += String(stats.retries);
+  json += ",\"timeouts\":";
+  json += String(stats.timeouts);
+  json += ",\"rejected\":";
+  json += String(stats.rejected);
+  json += ",\"inFlight\":";
+  json += String(stats.inFlight);
+  json += ",\"paused\":";
+  json += paused ? "true" : "false";
+  json += ",\"registers\":[";
+  for (uint8_t i = 0; i < entryCount; i++) {
+    const PollEntry &entry = entries[i];
+    unsigned long age = pollSchedulerAge(entry.unit, entry.registerNo);
+    snprintf(hex, sizeof(hex), "0x%02X", entry.registerNo);
+    if (i) json += ",";
+    json += "{\"unit\":";
+    json += String(entry.unit);
+    json += ",\"register\":\"";
+    json += hex;
+    json += "\",\"periodMs\":";
+    json += String(effectivePeriod(entry));
+    json += ",\"priority\":";
+    json += String(entry.priority);
+    json += ",\"ageMs\":";
+    json += age == POLL_AGE_NEVER ? String("null") : String(age);
+    json += ",\"inFlight\":";
+    json += entry.inFlight ? "true" : "false";
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
@@ -0,0 +1,137 @@
+#include "profiler.h"
+
+#ifdef R48_PROFILE
+
+struct ProbeName {
+  const char *method;   // nullptr for the fixed probes
+  const char *name;
+};
+
+static ProfileStats probes[PROFILE_MAX_PROBES];
+static ProbeName names[PROFILE_MAX_PROBES] = {
+  {nullptr, "loop"}, {nullptr, "can_rx"}, {nullptr, "can_send"}, {nullptr, "can_read"}
+};
+static uint8_t probeCount = PROFILE_FIXED_PROBES;
+static unsigned long lastReset = 0;
+
+bool profileInLoop = false;
+
+// Shared by the routes registered after the table filled up.
+static const ProfileProbe OVERFLOW_PROBE = PROFILE_MAX_PROBES - 1;
+
+ProfileProbe profileAddProbe(const char *uri, const char *method) {
+  if (probeCount >= OVERFLOW_PROBE) {
+    names[OVERFLOW_PROBE] = {nullptr, "other_routes"};
+    return OVERFLOW_PROBE;
+  }
+  names[probeCount] = {method, uri};
+  return probeCount++;
+}
+
+/**
+ * @brief Bucket of a cycle count: 0 and 1 get their own, then two per power of two.
+ */
+static uint8_t bucketOf(uint32_t cycles) {
+  if (cycles < 2) {
+    return cycles;
+  }
+  uint8_t msb = 31 - __builtin_clz(cycles);
+  return 2 * msb + ((cycles >> (msb - 1)) & 1);
+}
+
+static uint32_t bucketUpperBound(uint8_t bucket) {
+  if (bucket < 2) {
+    return bucket;
+  }
+  uint8_t msb = bucket / 2;
+  uint32_t lower = (uint32_t)(2 | (bucket & 1)) << (msb - 1);
+  return lower + ((1UL << (msb - 1)) - 1);
+}
+
+void profileRecord(ProfileProbe probe, uint32_t cycles) {
+  ProfileStats &stats = probes[probe];
+  if (stats.count == 0 || cycles < stats.minCycles) stats.minCycles = cycles;
+  if (cycles > stats.maxCycles) stats.maxCycles = cycles;
+  stats.count++;
+  stats.totalCycles += cycles;
+  if (!profileInLoop) {
+    stats.outsideLoop++;
+  }
+  uint16_t &bucket = stats.buckets[bucketOf(cycles)];
+  if (bucket == UINT16_MAX) {
+    for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+      stats.buckets[i] /= 2;
+    }
+  }
+  bucket++;
+}
+
+uint32_t profilePercentile(const ProfileStats &stats, float fraction) {
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+    total += stats.buckets[i];
+  }
+  uint32_t target = (uint32_t)ceilf(total * fraction);
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+    seen += stats.buckets[i];
+    if (seen >= target && seen > 0) {
+      return min(bucketUpperBound(i), stats.maxCycles);
+    }
+  }
+  return stats.maxCycles;
+}
+
+const ProfileStats &profileGetStats(ProfileProbe probe) {
+  return probes[probe];
+}
+
+void profileReset() {
+  memset(probes, 0, sizeof(probes));
+  lastReset = millis();
+}
+
+// --- HTTP ---
+
+void profileHandleRequest(AsyncWebServerRequest *request) {
+  float mhz = ESP.getCpuFreqMHz();
+  String json = "{\"seconds\":";
+  json += String((millis() - lastReset) / 1000.0f, 1);
+  json += ",\"cpuMHz\":";
+  json += String((unsigned)mhz);
+  json += ",\"probes\":[";
+  bool first = true;
+  for (uint8_t i = 0; i < PROFILE_MAX_PROBES; i++) {
+    const ProfileStats &stats = probes[i];
+    // Routes that were not requested are left out
+    if (names[i].name == nullptr || (i >= PROFILE_FIXED_PROBES && stats.count == 0)) {
+      continue;
+    }
+    if (!first) json += ",";
+    first = false;
+    json += "{\"name\":\"";
+    if (names[i].method != nullptr) {
+      json += names[i].method;
+      json += " ";
+    }
+    json += names[i].name;
+    json += "\",\"count\":";
+    json += String(stats.count);
+    json += ",\"outsideLoop\":";
+    json += String(stats.outsideLoop);
+    json += ",\"minUs\":";
+    json += String(stats.minCycles / mhz, 1);
+    json += ",\"meanUs\":";
+    json += String(stats.count > 0 ? stats.totalCycles / stats.count / mhz : 0.0f, 1);
+    json += ",\"p99Us\":";
+    json += String(profilePercentile(stats, 0.99f) / mhz, 1);
+    json += ",\"maxUs\":";
+    json += String(stats.maxCycles / mhz, 1);
+    json += "}";
+  }
+  json += "]}";
+  profileReset();
+  request->send(200, "application/json", json);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "r48_registers.h"
+
+const R48Setting R48_SETTINGS[SETTING_COUNT] = {
+  // name, label, route, register, type, class, min, max, param, off, on
+  {"permanent_voltage", "permanent voltage", "/set_perm_v", SET_PERMANENT_VOLTAGE_CMD,
+   R48_VALUE_FLOAT, R48_WRITE_PERMANENT, 41.0f, 58.5f, "value", nullptr, nullptr},
+  {"online_voltage", "online voltage", "/set_online_v", 0x21,
+   R48_VALUE_FLOAT, R48_WRITE_ONLINE, 41.0f, 58.5f, "value", nullptr, nullptr},
+  {"permanent_current_limit", "permanent current limit", "/set_perm_c", SET_PERMANENT_CURRENT_LIMIT_CMD,
+   R48_VALUE_FLOAT, R48_WRITE_PERMANENT, 0.1f, 1.21f, "value", nullptr, nullptr},
+  {"online_current_limit", "online current limit", "/set_online_c", 0x22,
+   R48_VALUE_FLOAT, R48_WRITE_ONLINE, 0.1f, 1.21f, "value", nullptr, nullptr},
+  {"max_input_current", "(Diesel) AC input current limit", "/set_diesel_input_c", SET_PERMANENT_MAX_INPUT_CURRENT_CMD,
+   R48_VALUE_FLOAT, R48_WRITE_PERMANENT, 3.0f, 13.0f, "value", nullptr, nullptr},
+  {"fan_speed", "fan speed", "/set_fan_speed", 0x33,
+   R48_VALUE_STATE, R48_WRITE_PERMANENT, 0, 1, "speed", "auto", "full"},
+  {"walk_in", "walk-in", "/set_walk_in", 0x32,
+   R48_VALUE_STATE, R48_WRITE_PERMANENT, 0, 1, "state", "off", "on"},
+  {"walk_in_time", "walk-in time", "/set_walk_in_time", 0x29,
+   R48_VALUE_FLOAT, R48_WRITE_PERMANENT, 0.0f, 200.0f, "value", nullptr, nullptr},
+};
+
+const R48Setting *r48FindSetting(byte registerNo) {
+  for (uint8_t i = 0; i < SETTING_COUNT; i++) {
+    if (R48_SETTINGS[i].registerNo == registerNo) {
+      return &R48_SETTINGS[i];
+    }
+  }
+  return nullptr;
+}
+
+const R48Setting *r48FindSettingByName(const char *name) {
+  for (uint8_t i = 0; i < SETTING_COUNT; i++) {
+    if (strcmp(R48_SETTINGS[i].name, name) == 0) {
+      return &R48_SETTINGS[i];
+    }
+  }
+  return nullptr;
+}
+
+// Safe ranges set at run time, used where narrowed[] is set.
+static bool narrowed[SETTING_COUNT] = {};
+static float rangeMin[SETTING_COUNT];
+static float rangeMax[SETTING_COUNT];
+
+bool r48SetSettingRange(R48SettingId id, float minValue, float maxValue) {
+  const R48Setting &setting = R48_SETTINGS[id];
+  // Also false for NAN
+  if (setting.type != R48_VALUE_FLOAT || !(minValue >= setting.minValue && maxValue <= setting.maxValue && minValue <= maxValue)) {
+    return false;
+  }
+  narrowed[id] = true;
+  rangeMin[id] = minValue;
+  rangeMax[id] = maxValue;
+  return true;
+}
+
+float r48SettingMin(const R48Setting &setting) {
+  uint8_t id = &setting - R48_SETTINGS;
+  return narrowed[id] ? rangeMin[id] : setting.minValue;
+}
+
+float r48SettingMax(const R48Setting &setting) {
+  uint8_t id = &setting - R48_SETTINGS;
+  return narrowed[id] ? rangeMax[id] : setting.maxValue;
+}
+
+bool r48SettingValid(const R48Setting &setting, float value) {
+  if (setting.type == R48_VALUE_STATE) {
+    return value == 0 || value == 1;
+  }
+  // NAN fails both comparisons
+  return value >= r48SettingMin(setting) && value <= r48SettingMax(setting);
+}
+
+void r48EncodeWrite(const R48Setting &setting, float value, byte data[8]) {
+  data[0] = 0x03;
+  data[1] = R48_CONTROLLER_ADDRESS;
+  data[2] = 0x00;
+  data[3] = setting.registerNo;
+  if (setting.type == R48_VALUE_FLOAT) {
+    r48PutFloat(&data[4], value);
+  } else {
+    data[4] = value != 0 ? 0x01 : 0x00;
+    data[5] = 0x00;
+    data[6] = 0x00;
+    data[7] = 0x00;
+  }
+}
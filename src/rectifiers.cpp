@@ -0,0 +1,159 @@
+#include "rectifiers.h"
+
+static Rectifier table[MAX_RECTIFIERS];
+static uint8_t count = 0;
+static RectifierChangeFunction changeCallback = nullptr;
+
+void rectifiersBegin(RectifierChangeFunction onChange) {
+  changeCallback = onChange;
+  count = 0;
+}
+
+Rectifier *rectifierFind(byte address) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (table[i].address == address) {
+      return &table[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief The entry of a rectifier, added to the table if it is new; nullptr if the table is full.
+ */
+static Rectifier *track(byte address) {
+  Rectifier *rectifier = rectifierFind(address);
+  if (rectifier != nullptr) {
+    return rectifier;
+  }
+  if (count >= MAX_RECTIFIERS) {
+    return nullptr;
+  }
+  // Keep the table sorted by address so the API lists units in a stable order.
+  uint8_t pos = count;
+  while (pos > 0 && table[pos - 1].address > address) {
+    table[pos] = table[pos - 1];
+    pos--;
+  }
+  rectifier = &table[pos];
+  *rectifier = {};
+  rectifier->address = address;
+  count++;
+  if (changeCallback != nullptr) {
+    changeCallback(address, true);
+  }
+  return rectifierFind(address);
+}
+
+bool rectifierStore(byte address, byte measurementNo, float value, bool *changed) {
+  int8_t slot = measurementSlot(measurementNo);
+  if (slot < 0) {
+    return false;
+  }
+
+  unsigned long now = millis();
+  Rectifier *rectifier = track(address);
+  if (rectifier == nullptr) {
+    return false;
+  }
+
+  if (changed != nullptr) {
+    *changed = !(rectifier->validMask & (1 << slot)) || rectifier->values[slot] != value;
+  }
+  rectifier->values[slot] = value;
+  rectifier->updatedAt[slot] = now;
+  rectifier->validMask |= 1 << slot;
+  rectifier->cachedMask &= ~(1 << slot);
+  rectifier->lastSeen = now;
+  return true;
+}
+
+bool rectifierRestore(byte address, uint8_t validMask, const float values[MEASUREMENT_COUNT]) {
+  if (rectifierFind(address) != nullptr) {
+    return false;
+  }
+  Rectifier *rectifier = track(address);
+  if (rectifier == nullptr) {
+    return false;
+  }
+  unsigned long now = millis();
+  validMask &= (1 << MEASUREMENT_COUNT) - 1;
+  for (uint8_t slot = 0; slot < MEASUREMENT_COUNT; slot++) {
+    rectifier->values[slot] = values[slot];
+    rectifier->updatedAt[slot] = now;
+  }
+  rectifier->validMask = validMask;
+  rectifier->cachedMask = validMask;
+  rectifier->lastSeen = now;
+  return true;
+}
+
+void rectifiersExpire() {
+  unsigned long now = millis();
+  uint8_t i = 0;
+  while (i < count) {
+    if (now - table[i].lastSeen <= RECTIFIER_TIMEOUT) {
+      i++;
+      continue;
+    }
+    byte address = table[i].address;
+    for (uint8_t j = i + 1; j < count; j++) {
+      table[j - 1] = table[j];
+    }
+    count--;
+    if (changeCallback != nullptr) {
+      changeCallback(address, false);
+    }
+  }
+}
+
+uint8_t rectifierCount() {
+  return count;
+}
+
+const Rectifier &rectifierAt(uint8_t index) {
+  return table[index];
+}
+
+unsigned long rectifierValueAge(const Rectifier &rectifier, uint8_t slot) {
+  if (!(rectifier.validMask & (1 << slot)) || (rectifier.cachedMask & (1 << slot))) {
+    return 0xFFFFFFFF;
+  }
+  return millis() - rectifier.updatedAt[slot];
+}
+
+BankTotals rectifiersBankTotals() {
+  BankTotals totals = {};
+  uint8_t samples[MEASUREMENT_COUNT] = {};
+
+  for (uint8_t i = 0; i < count; i++) {
+    const Rectifier &r = table[i];
+    if (r.validMask & (1 << (OUTPUT_VOLTAGE - 1))) {
+      totals.outputVoltage += r.values[OUTPUT_VOLTAGE - 1];
+      samples[OUTPUT_VOLTAGE - 1]++;
+    }
+    if (r.validMask & (1 << (OUTPUT_CURRENT - 1))) {
+      totals.outputCurrent += r.values[OUTPUT_CURRENT - 1];
+    }
+    if (r.validMask & (1 << (OUTPUT_CURRENT_LIMIT - 1))) {
+      totals.outputCurrentLimit += r.values[OUTPUT_CURRENT_LIMIT - 1];
+      samples[OUTPUT_CURRENT_LIMIT - 1]++;
+    }
+    if (r.validMask & (1 << (TEMPERATURE - 1))) {
+      float t = r.values[TEMPERATURE - 1];
+      if (samples[TEMPERATURE - 1]++ == 0 || t > totals.temperature) {
+        totals.temperature = t;
+      }
+    }
+    if (r.validMask & (1 << (SUPPLY_VOLTAGE - 1))) {
+      totals.supplyVoltage += r.values[SUPPLY_VOLTAGE - 1];
+      samples[SUPPLY_VOLTAGE - 1]++;
+    }
+  }
+
+  totals.units = count;
+  if (samples[OUTPUT_VOLTAGE - 1]) totals.outputVoltage /= samples[OUTPUT_VOLTAGE - 1];
+  if (samples[OUTPUT_CURRENT_LIMIT - 1]) totals.outputCurrentLimit /= samples[OUTPUT_CURRENT_LIMIT - 1];
+  if (samples[SUPPLY_VOLTAGE - 1]) totals.supplyVoltage /= samples[SUPPLY_VOLTAGE - 1];
+  return totals;
+}
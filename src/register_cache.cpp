@@ -0,0 +1,376 @@
+#include "register_cache.h"
+#include "log.h"
+#include "r48_protocol.h"
+#include "rectifiers.h"
+
+// Register number sent after the last one of a sweep.
+const uint16_t SWEEP_END = 0x100;
+
+struct RegisterPoll {
+  byte registerNo;
+  unsigned long periodMs;
+};
+
+static PollSendFunction sendRequest = nullptr;
+static RegisterInfo infos[256] = {};
+static RegisterValue values[REGISTER_CACHE_MAX_VALUES];
+static uint8_t valueCount = 0;
+static RegisterPoll polls[REGISTER_CACHE_MAX_POLLED];
+static uint8_t pollCount = 0;
+
+static bool sweeping = false;
+static uint16_t sweepNext = 0;       // next register to ask for, SWEEP_END once all were
+static unsigned long sweepGap = REGISTER_DISCOVERY_DEFAULT_GAP;
+static unsigned long lastSweepRequest = 0;
+static uint32_t sweepRequests = 0;
+static uint32_t sweeps = 0;
+
+static const char *const typeNames[] = {"unknown", "float", "word"};
+
+/**
+ * @brief What the value bytes look like: zero tells nothing, a float with a sensible magnitude is a float.
+ */
+static RegisterType classify(const byte raw[4]) {
+  if ((raw[0] | raw[1] | raw[2] | raw[3]) == 0) {
+    return REGISTER_TYPE_UNKNOWN;
+  }
+  // NaN and the infinities fail both comparisons
+  float value = fabsf(r48GetFloat(raw));
+  if (value >= 1e-3f && value < 1e6f) {
+    return REGISTER_TYPE_FLOAT;
+  }
+  return REGISTER_TYPE_WORD;
+}
+
+static uint32_t rawWord(const byte raw[4]) {
+  return ((uint32_t)raw[0] << 24) | ((uint32_t)raw[1] << 16) | ((uint32_t)raw[2] << 8) | raw[3];
+}
+
+static RegisterValue *findValue(byte unit, byte registerNo) {
+  for (uint8_t i = 0; i < valueCount; i++) {
+    if (values[i].unit == unit && values[i].registerNo == registerNo) {
+      return &values[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief A free entry of the value pool, or the least recently answered one.
+ */
+static RegisterValue &allocateValue(unsigned long now) {
+  if (valueCount < REGISTER_CACHE_MAX_VALUES) {
+    return values[valueCount++];
+  }
+  RegisterValue *oldest = &values[0];
+  for (uint8_t i = 1; i < valueCount; i++) {
+    if (now - values[i].answeredAt > now - oldest->answeredAt) {
+      oldest = &values[i];
+    }
+  }
+  return *oldest;
+}
+
+static RegisterPoll *findPoll(byte registerNo) {
+  for (uint8_t i = 0; i < pollCount; i++) {
+    if (polls[i].registerNo == registerNo) {
+      return &polls[i];
+    }
+  }
+  return nullptr;
+}
+
+void registerCacheBegin(PollSendFunction send) {
+  sendRequest = send;
+}
+
+void registerCacheStore(byte unit, byte registerNo, const byte raw[4]) {
+  unsigned long now = millis();
+  RegisterInfo &info = infos[registerNo];
+  RegisterType type = classify(raw);
+  if (type == REGISTER_TYPE_WORD || info.type == REGISTER_TYPE_UNKNOWN) {
+    info.type = type;
+  }
+  if (info.answers < 0xFFFF) {
+    info.answers++;
+  }
+  info.answeredAt = now;
+
+  RegisterValue *value = findValue(unit, registerNo);
+  if (value == nullptr) {
+    value = &allocateValue(now);
+    value->unit = unit;
+    value->registerNo = registerNo;
+  }
+  memcpy(value->raw, raw, 4);
+  value->answeredAt = now;
+}
+
+const RegisterInfo &registerCacheInfo(byte registerNo) {
+  return infos[registerNo];
+}
+
+void registerCacheSchedulePolling(byte unit) {
+  for (uint8_t i = 0; i < pollCount; i++) {
+    pollSchedulerAdd(unit, polls[i].registerNo, polls[i].periodMs, REGISTER_POLL_PRIORITY);
+  }
+}
+
+void registerCacheService() {
+  if (!sweeping || sendRequest == nullptr) {
+    return;
+  }
+  unsigned long now = millis();
+  if (sweepNext == SWEEP_END) {
+    // Give the answers to the last request time to arrive
+    if (now - lastSweepRequest >= POLL_RESPONSE_TIMEOUT) {
+      sweeping = false;
+      sweeps++;
+      logEvent(LOG_INFO, EV_SYS_REGISTER_SWEEP, registerCacheGetStats().registers);
+    }
+    return;
+  }
+  if (now - lastSweepRequest < sweepGap) {
+    return;
+  }
+  // A request the bus refused is tried again after the next gap
+  if (sendRequest(R48_BROADCAST_ADDRESS, sweepNext)) {
+    sweepNext++;
+    sweepRequests++;
+  }
+  lastSweepRequest = now;
+}
+
+uint8_t registerCacheValueCount() {
+  return valueCount;
+}
+
+const RegisterValue &registerCacheValueAt(uint8_t index) {
+  return values[index];
+}
+
+unsigned long registerCachePollPeriod(byte registerNo) {
+  const RegisterPoll *poll = findPoll(registerNo);
+  return poll == nullptr ? 0 : poll->periodMs;
+}
+
+double registerCacheDecode(byte registerNo, const byte raw[4]) {
+  if (infos[registerNo].type == REGISTER_TYPE_FLOAT) {
+    return r48GetFloat(raw);
+  }
+  return rawWord(raw);
+}
+
+RegisterCacheStats registerCacheGetStats() {
+  RegisterCacheStats stats = {};
+  stats.sweeping = sweeping;
+  stats.requests = sweepRequests;
+  stats.sweeps = sweeps;
+  for (uint16_t i = 0; i < 256; i++) {
+    if (infos[i].answers > 0) stats.registers++;
+  }
+  stats.polled = pollCount;
+  return stats;
+}
+
+// --- HTTP ---
+
+/**
+ * @brief Parses a register number, decimal or 0x hex. Returns -1 if it is not one.
+ */
+static int parseRegister(const String &text) {
+  const char *start = text.c_str();
+  int base = 10;
+  if (text.startsWith("0x") || text.startsWith("0X")) {
+    start += 2;
+    base = 16;
+  }
+  char *end;
+  long value = strtol(start, &end, base);
+  if (end == start || *end != '\0' || value < 0 || value > 0xFF) {
+    return -1;
+  }
+  return value;
+}
+
+static void appendRegister(String &json, byte registerNo) {
+  char hex[5];
+  snprintf(hex, sizeof(hex), "0x%02X", registerNo);
+  json += "\"";
+  json += hex;
+  json += "\"";
+}
+
+static void appendValue(String &json, byte registerNo, const RegisterValue &value) {
+  if (infos[registerNo].type == REGISTER_TYPE_FLOAT) {
+    json += String(r48GetFloat(value.raw), 3);
+  } else {
+    json += String(rawWord(value.raw));
+  }
+}
+
+void registerCacheHandleStatus(AsyncWebServerRequest *request) {
+  unsigned long now = millis();
+  String json = "{\"sweeping\":";
+  json += sweeping ? "true" : "false";
+  json += ",\"next\":";
+  json += String(sweepNext);
+  json += ",\"gap\":";
+  json += String(sweepGap);
+  json += ",\"requests\":";
+  json += String(sweepRequests);
+  json += ",\"sweeps\":";
+  json += String(sweeps);
+  json += ",\"registers\":[";
+  bool first = true;
+  for (uint16_t i = 0; i < 256; i++) {
+    const RegisterInfo &info = infos[i];
+    if (info.answers == 0) continue;
+    json += first ? "{\"id\":" : ",{\"id\":";
+    first = false;
+    appendRegister(json, i);
+    json += ",\"type\":\"";
+    json += typeNames[info.type];
+    json += "\",\"answers\":";
+    json += String(info.answers);
+    json += ",\"ageMs\":";
+    json += String(now - info.answeredAt);
+    json += ",\"pollMs\":";
+    json += String(registerCachePollPeriod(i));
+    json += "}";
+  }
+  json += "]}";
+  request->send(200, "application/json", json);
+}
+
+void registerCacheHandleRegister(AsyncWebServerRequest *request) {
+  int registerNo = parseRegister(request->url().substring(strlen("/reg/")));
+  if (registerNo < 0) {
+    request->send(400, "text/plain", "Invalid register, expected 0 to 255 or 0x00 to 0xFF.");
+    return;
+  }
+  const RegisterInfo &info = infos[registerNo];
+  if (info.answers == 0) {
+    request->send(404, "text/plain", "The register never answered.");
+    return;
+  }
+
+  unsigned long now = millis();
+  String json = "{\"id\":";
+  appendRegister(json, registerNo);
+  json += ",\"type\":\"";
+  json += typeNames[info.type];
+  json += "\",\"answers\":";
+  json += String(info.answers);
+  json += ",\"pollMs\":";
+  json += String(registerCachePollPeriod(registerNo));
+  json += ",\"values\":[";
+  bool first = true;
+  char raw[11];
+  for (uint8_t i = 0; i < valueCount; i++) {
+    const RegisterValue &value = values[i];
+    if (value.registerNo != registerNo) continue;
+    snprintf(raw, sizeof(raw), "0x%08X", (unsigned)rawWord(value.raw));
+    json += first ? "{\"unit\":" : ",{\"unit\":";
+    first = false;
+    json += String(value.unit);
+    json += ",\"raw\":\"";
+    json += raw;
+    json += "\",\"value\":";
+    appendValue(json, registerNo, value);
+    json += ",\"ageMs\":";
+    json += String(now - value.answeredAt);
+    json += "}";
+  }
+  json += "]}";
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Starts, changes or stops polling a register on every tracked unit.
+ * @return false when the schedule had no room for every unit; nothing changed then.
+ */
+static bool setPoll(byte registerNo, unsigned long periodMs) {
+  RegisterPoll *poll = findPoll(registerNo);
+  if (poll != nullptr) {
+    for (uint8_t i = 0; i < rectifierCount(); i++) {
+      pollSchedulerRemove(rectifierAt(i).address, registerNo);
+    }
+    *poll = polls[--pollCount];
+  }
+  if (periodMs == 0) {
+    return true;
+  }
+  for (uint8_t i = 0; i < rectifierCount(); i++) {
+    if (!pollSchedulerAdd(rectifierAt(i).address, registerNo, periodMs, REGISTER_POLL_PRIORITY)) {
+      while (i-- > 0) {
+        pollSchedulerRemove(rectifierAt(i).address, registerNo);
+      }
+      return false;
+    }
+  }
+  polls[pollCount++] = {registerNo, periodMs};
+  return true;
+}
+
+void registerCacheHandleControl(AsyncWebServerRequest *request) {
+  String action;
+  long gap = sweepGap;
+  if (request->hasParam("discover", true)) {
+    action = request->getParam("discover", true)->value();
+    if (action != "start" && action != "stop") {
+      request->send(400, "text/plain", "Invalid discover action, expected start or stop.");
+      return;
+    }
+  }
+  if (request->hasParam("gap", true)) {
+    gap = request->getParam("gap", true)->value().toInt();
+    if (gap < (long)REGISTER_DISCOVERY_MIN_GAP || gap > (long)REGISTER_DISCOVERY_MAX_GAP) {
+      request->send(400, "text/plain", "Invalid gap, in ms: " + String(REGISTER_DISCOVERY_MIN_GAP) + " to " +
+                                       String(REGISTER_DISCOVERY_MAX_GAP) + ".");
+      return;
+    }
+  }
+
+  int registerNo = -1;
+  long period = 0;
+  if (request->hasParam("poll", true)) {
+    registerNo = parseRegister(request->getParam("poll", true)->value());
+    if (registerNo < 0) {
+      request->send(400, "text/plain", "Invalid register, expected 0 to 255 or 0x00 to 0xFF.");
+      return;
+    }
+    if (measurementSlot(registerNo) >= 0) {
+      request->send(400, "text/plain", "The measurements are always polled, see /config.");
+      return;
+    }
+    if (infos[registerNo].answers == 0) {
+      request->send(400, "text/plain", "The register never answered, run a discovery sweep first.");
+      return;
+    }
+    period = request->hasParam("period", true) ? request->getParam("period", true)->value().toInt() : -1;
+    if (period != 0 && (period < (long)REGISTER_POLL_MIN_PERIOD || period > (long)REGISTER_POLL_MAX_PERIOD)) {
+      request->send(400, "text/plain", "Invalid period, in ms: 0 (stop) or " + String(REGISTER_POLL_MIN_PERIOD) +
+                                       " to " + String(REGISTER_POLL_MAX_PERIOD) + ".");
+      return;
+    }
+    if (period != 0 && findPoll(registerNo) == nullptr && pollCount == REGISTER_CACHE_MAX_POLLED) {
+      request->send(507, "text/plain", "Already polling " + String(REGISTER_CACHE_MAX_POLLED) + " registers.");
+      return;
+    }
+  }
+
+  sweepGap = gap;
+  if (action == "start") {
+    sweeping = true;
+    sweepNext = 0;
+    lastSweepRequest = millis() - sweepGap;
+  } else if (action == "stop") {
+    sweeping = false;
+  }
+  if (registerNo >= 0 && !setPoll(registerNo, period)) {
+    request->send(507, "text/plain", "The poll schedule is full.");
+    return;
+  }
+  request->send(200, "text/plain", "Register cache configuration updated.");
+}
@@ -0,0 +1,198 @@
+#include "setpoint_keepalive.h"
+#include "command_queue.h"
+#include "poll_scheduler.h"
+
+static const R48SettingId ONLINE_SETTINGS[] = {SETTING_ONLINE_VOLTAGE, SETTING_ONLINE_CURRENT_LIMIT};
+
+static KeptSetpoint kept[SETPOINT_KEEPALIVE_MAX];
+static uint8_t keptCount = 0;
+static unsigned long period = SETPOINT_KEEPALIVE_DEFAULT_PERIOD;
+static bool group = true;
+static SetpointKeepaliveStats stats = {};
+
+static KeptSetpoint *find(byte unit, R48SettingId setting) {
+  for (uint8_t i = 0; i < keptCount; i++) {
+    if (kept[i].unit == unit && kept[i].setting == setting) {
+      return &kept[i];
+    }
+  }
+  return nullptr;
+}
+
+static void record(byte unit, R48SettingId setting, float value, unsigned long now) {
+  KeptSetpoint *setpoint = find(unit, setting);
+  if (setpoint == nullptr) {
+    if (keptCount == SETPOINT_KEEPALIVE_MAX) {
+      return;
+    }
+    setpoint = &kept[keptCount++];
+    setpoint->unit = unit;
+    setpoint->setting = setting;
+  }
+  setpoint->value = value;
+  setpoint->writtenAt = now;
+}
+
+void setpointKeepaliveOnWrite(byte unit, R48SettingId setting, float value) {
+  unsigned long now = millis();
+  if (unit != R48_BROADCAST_ADDRESS) {
+    record(unit, setting, value, now);
+    return;
+  }
+  for (uint8_t i = 0; i < rectifierCount(); i++) {
+    record(rectifierAt(i).address, setting, value, now);
+  }
+}
+
+/**
+ * @brief Drops the setpoints of units that left the table. Address 0x00 is kept while no unit is tracked.
+ */
+static void dropLostUnits() {
+  bool none = rectifierCount() == 0;
+  for (uint8_t i = 0; i < keptCount;) {
+    byte unit = kept[i].unit;
+    if (rectifierFind(unit) == nullptr && !(none && unit == 0x00)) {
+      kept[i] = kept[--keptCount];
+    } else {
+      i++;
+    }
+  }
+}
+
+/**
+ * @brief True when every tracked unit, and no other, holds the same value for the setting.
+ */
+static bool sameOnEveryUnit(R48SettingId setting, float &value) {
+  uint8_t units = rectifierCount();
+  if (units < 2) {
+    return false;
+  }
+  uint8_t holding = 0;
+  for (uint8_t i = 0; i < keptCount; i++) {
+    if (kept[i].setting != setting) continue;
+    if (holding > 0 && kept[i].value != value) return false;
+    value = kept[i].value;
+    holding++;
+  }
+  return holding == units;
+}
+
+void setpointKeepaliveService() {
+  if (period == 0 || keptCount == 0) {
+    return;
+  }
+  dropLostUnits();
+
+  unsigned long now = millis();
+  bool quiet = pollSchedulerGetStats().inFlight == 0;
+  for (R48SettingId setting : ONLINE_SETTINGS) {
+    bool due = false;
+    bool forced = false;
+    bool waiting = false;
+    for (uint8_t i = 0; i < keptCount; i++) {
+      const KeptSetpoint &setpoint = kept[i];
+      if (setpoint.setting != setting) continue;
+      unsigned long age = now - setpoint.writtenAt;
+      due |= age >= period - period / 4;
+      forced |= age >= period;
+      waiting |= commandQueueWaiting(setpoint.unit, setting);
+    }
+    if (!due || (!quiet && !forced)) {
+      continue;
+    }
+
+    float value = 0;
+    if (group && !waiting && sameOnEveryUnit(setting, value)) {
+      if (!commandQueueWaiting(R48_BROADCAST_ADDRESS, setting) &&
+          commandQueuePush(R48_BROADCAST_ADDRESS, setting, value) == COMMAND_QUEUED) {
+        stats.refreshes++;
+        stats.broadcasts++;
+        if (!quiet) stats.forced++;
+      }
+      continue;
+    }
+    for (uint8_t i = 0; i < keptCount; i++) {
+      const KeptSetpoint &setpoint = kept[i];
+      if (setpoint.setting != setting || now - setpoint.writtenAt < period - period / 4 ||
+          commandQueueWaiting(setpoint.unit, setting)) {
+        continue;
+      }
+      // A full queue is tried again on the next pass
+      if (commandQueuePush(setpoint.unit, setting, setpoint.value) == COMMAND_QUEUED) {
+        stats.refreshes++;
+        if (!quiet) stats.forced++;
+      }
+    }
+  }
+}
+
+uint8_t setpointKeepaliveCount() {
+  return keptCount;
+}
+
+const KeptSetpoint &setpointKeepaliveAt(uint8_t index) {
+  return kept[index];
+}
+
+SetpointKeepaliveStats setpointKeepaliveGetStats() {
+  return stats;
+}
+
+// --- HTTP ---
+
+void setpointKeepaliveHandleStatus(AsyncWebServerRequest *request) {
+  unsigned long now = millis();
+  String json = "{\"period\":";
+  json += String(period);
+  json += ",\"group\":";
+  json += group ? "true" : "false";
+  json += ",\"refreshes\":";
+  json += String(stats.refreshes);
+  json += ",\"broadcasts\":";
+  json += String(stats.broadcasts);
+  json += ",\"forced\":";
+  json += String(stats.forced);
+  json += ",\"setpoints\":[";
+  for (uint8_t i = 0; i < keptCount; i++) {
+    const KeptSetpoint &setpoint = kept[i];
+    if (i) json += ",";
+    json += "{\"unit\":";
+    json += String(setpoint.unit);
+    json += ",\"setting\":\"";
+    json += R48_SETTINGS[setpoint.setting].name;
+    json += "\",\"value\":";
+    json += String(setpoint.value, 3);
+    json += ",\"ageMs\":";
+    json += String(now - setpoint.writtenAt);
+    json += "}";
+  }
+  json += "]}";
+  request->send(200, "application/json", json);
+}
+
+void setpointKeepaliveHandleControl(AsyncWebServerRequest *request) {
+  long newPeriod = period;
+  bool newGroup = group;
+  if (request->hasParam("period", true)) {
+    newPeriod = request->getParam("period", true)->value().toInt();
+  }
+  if (request->hasParam("group", true)) {
+    const String &mode = request->getParam("group", true)->value();
+    if (mode != "on" && mode != "off") {
+      request->send(400, "text/plain", "Invalid group mode, expected on or off.");
+      return;
+    }
+    newGroup = mode == "on";
+  }
+  if (newPeriod != 0 && newPeriod < (long)SETPOINT_KEEPALIVE_MIN_PERIOD) {
+    request->send(400, "text/plain", "Invalid period, in ms: 0 (off) or at least " +
+                                     String(SETPOINT_KEEPALIVE_MIN_PERIOD) + ".");
+    return;
+  }
+  period = newPeriod;
+  group = newGroup;
+  if (request->hasParam("clear", true)) {
+    keptCount = 0;
+  }
+  request->send(200, "text/plain", "Keepalive configuration updated.");
+}
@@ -0,0 +1,217 @@
+#include "settings_batch.h"
+#include "charger.h"
+#include "command_queue.h"
+#include "command_tracker.h"
+#include "json_util.h"
+
+enum WriteState : uint8_t {
+  WRITE_WAITING,     // not handed to the command queue yet
+  WRITE_QUEUED,
+  WRITE_CONFIRMING,  // sent, being read back
+  WRITE_CONFIRMED,
+  WRITE_SENT,
+  WRITE_FAILED
+};
+
+struct BatchWrite {
+  byte unit;
+  R48SettingId setting;
+  WriteState state;
+  float value;
+  unsigned long queuedAt;
+};
+
+static BatchWrite writes[SETTINGS_BATCH_MAX];
+static uint8_t writeCount = 0;
+static SettingsBatchState state = SETTINGS_BATCH_IDLE;
+static unsigned long startedAt = 0;
+static unsigned long finishedAt = 0;
+
+static const char *const writeStateNames[] = {"waiting", "queued", "confirming", "confirmed", "sent", "failed"};
+static const char *const batchStateNames[] = {"idle", "running", "confirmed", "failed"};
+
+static bool permanent(const BatchWrite &write) {
+  return R48_SETTINGS[write.setting].writeClass == R48_WRITE_PERMANENT;
+}
+
+/**
+ * @brief Follows a write handed to the queue: still waiting, being read back, or done.
+ */
+static void track(BatchWrite &write) {
+  if (write.state == WRITE_QUEUED && commandQueueWaiting(write.unit, write.setting)) {
+    return;
+  }
+  if (!permanent(write)) {
+    // Gone from the queue without a tracker entry to tell; a refused frame is logged by the queue
+    write.state = WRITE_SENT;
+    return;
+  }
+  switch (commandTrackerState(write.unit, R48_SETTINGS[write.setting].registerNo, write.queuedAt)) {
+    case COMMAND_PENDING: write.state = WRITE_CONFIRMING; break;
+    case COMMAND_CONFIRMED: write.state = WRITE_CONFIRMED; break;
+    // Dropped by the queue after its send retries, or the tracker had no room
+    default: write.state = WRITE_FAILED; break;
+  }
+}
+
+void settingsBatchService() {
+  if (state != SETTINGS_BATCH_RUNNING) {
+    return;
+  }
+
+  uint8_t queued = 0;
+  uint8_t permanentInFlight = 0;  // queued, not yet in the tracker
+  bool running = false;
+  for (uint8_t i = 0; i < writeCount; i++) {
+    BatchWrite &write = writes[i];
+    if (write.state == WRITE_QUEUED || write.state == WRITE_CONFIRMING) {
+      track(write);
+    }
+    if (write.state == WRITE_QUEUED) {
+      queued++;
+      if (permanent(write)) permanentInFlight++;
+    }
+    if (write.state <= WRITE_CONFIRMING) {
+      running = true;
+    }
+  }
+
+  // Hand over the next writes, in order, while the queue and the tracker have room
+  for (uint8_t i = 0; i < writeCount && queued < SETTINGS_BATCH_MAX_QUEUED; i++) {
+    BatchWrite &write = writes[i];
+    if (write.state != WRITE_WAITING) {
+      continue;
+    }
+    if (permanent(write) && commandTrackerPendingCount() + permanentInFlight >= COMMAND_TRACKER_MAX) {
+      break;
+    }
+    if (commandQueuePush(write.unit, write.setting, write.value) == COMMAND_QUEUE_FULL) {
+      break;
+    }
+    write.state = WRITE_QUEUED;
+    write.queuedAt = millis();
+    queued++;
+    if (permanent(write)) permanentInFlight++;
+  }
+
+  if (!running) {
+    state = SETTINGS_BATCH_CONFIRMED;
+    for (uint8_t i = 0; i < writeCount; i++) {
+      if (writes[i].state == WRITE_FAILED) {
+        state = SETTINGS_BATCH_FAILED;
+      }
+    }
+    finishedAt = millis();
+  }
+}
+
+SettingsBatchState settingsBatchState() {
+  return state;
+}
+
+// --- HTTP ---
+
+static void appendValue(String &json, R48SettingId id, float value) {
+  const R48Setting &setting = R48_SETTINGS[id];
+  if (setting.type == R48_VALUE_FLOAT) {
+    json += String(value, 3);
+  } else {
+    json += "\"";
+    json += value != 0 ? setting.onWord : setting.offWord;
+    json += "\"";
+  }
+}
+
+static String batchToJson() {
+  unsigned long now = millis();
+  String json = "{\"state\":\"";
+  json += batchStateNames[state];
+  json += "\",\"elapsedMs\":";
+  json += String(state == SETTINGS_BATCH_IDLE ? 0 : (state == SETTINGS_BATCH_RUNNING ? now : finishedAt) - startedAt);
+  json += ",\"writes\":[";
+  for (uint8_t i = 0; i < writeCount; i++) {
+    const BatchWrite &write = writes[i];
+    if (i) json += ",";
+    json += "{\"unit\":";
+    json += String(write.unit);
+    json += ",\"setting\":\"";
+    json += R48_SETTINGS[write.setting].name;
+    json += "\",\"value\":";
+    appendValue(json, write.setting, write.value);
+    json += ",\"state\":\"";
+    json += writeStateNames[write.state];
+    json += "\"}";
+  }
+  json += "]}";
+  return json;
+}
+
+void settingsBatchHandleRequest(AsyncWebServerRequest *request, const byte targets[], uint8_t targetCount) {
+  if (state == SETTINGS_BATCH_RUNNING) {
+    request->send(409, "text/plain", "A settings batch is still running.");
+    return;
+  }
+
+  // Check every field before anything is queued
+  float values[SETTING_COUNT];
+  bool present[SETTING_COUNT] = {};
+  String errors;
+  for (size_t p = 0; p < request->params(); p++) {
+    const AsyncWebParameter *param = request->getParam(p);
+    if (!param->isPost() || param->name() == "unit") {
+      continue;
+    }
+    const R48Setting *setting = r48FindSettingByName(param->name().c_str());
+    if (setting == nullptr) {
+      jsonAppendError(errors, param->name(), "unknown setting");
+      continue;
+    }
+    uint8_t id = setting - R48_SETTINGS;
+    const String &text = param->value();
+    float value = NAN;
+    if (setting->type == R48_VALUE_FLOAT) {
+      char *end;
+      value = strtof(text.c_str(), &end);
+      if (end == text.c_str() || *end != '\0') value = NAN;
+    } else if (text == setting->onWord) {
+      value = 1;
+    } else if (text == setting->offWord) {
+      value = 0;
+    }
+
+    if (!r48SettingValid(*setting, value)) {
+      String message = setting->type == R48_VALUE_FLOAT
+        ? "expected a value between " + String(r48SettingMin(*setting)) + " and " + String(r48SettingMax(*setting))
+        : "expected " + String(setting->offWord) + " or " + String(setting->onWord);
+      jsonAppendError(errors, param->name(), message);
+    } else if (setting->writeClass == R48_WRITE_ONLINE && chargerRunning()) {
+      jsonAppendError(errors, param->name(), "the charger is driving the online setpoints");
+    } else {
+      values[id] = value;
+      present[id] = true;
+    }
+  }
+  if (errors.length() > 0) {
+    request->send(400, "application/json", jsonErrorBody(errors));
+    return;
+  }
+
+  // One write per setting and unit; a setting goes to every unit before the next one starts
+  writeCount = 0;
+  for (uint8_t id = 0; id < SETTING_COUNT; id++) {
+    for (uint8_t t = 0; present[id] && t < targetCount; t++) {
+      writes[writeCount++] = {targets[t], (R48SettingId)id, WRITE_WAITING, values[id], 0};
+    }
+  }
+  if (writeCount == 0) {
+    request->send(400, "text/plain", "No settings given.");
+    return;
+  }
+  state = SETTINGS_BATCH_RUNNING;
+  startedAt = millis();
+  request->send(202, "application/json", batchToJson());
+}
+
+void settingsBatchHandleStatus(AsyncWebServerRequest *request) {
+  request->send(200, "application/json", batchToJson());
+}
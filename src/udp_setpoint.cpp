@@ -0,0 +1,201 @@
+#include "udp_setpoint.h"
+#include "charger.h"
+#include "command_queue.h"
+#include "log.h"
+#include "rectifiers.h"
+
+#include <WiFiUdp.h>
+
+static WiFiUDP udp;
+static uint16_t localPort = 0;
+static UdpSetpointStats stats;
+
+static unsigned long timeout = UDP_SETPOINT_DEFAULT_TIMEOUT;
+static float safeLimit = UDP_SETPOINT_DEFAULT_SAFE_LIMIT;
+
+// Sequence of the stream being followed; `following` is false until the first packet and after the watchdog fired.
+static bool following = false;
+static uint32_t lastSequence = 0;
+static uint64_t lastSource = 0;
+static unsigned long lastAccepted = 0;
+static bool safeLimitPending = false;  // the watchdog fired and the safe limit is not queued yet
+
+void udpSetpointBegin(uint16_t port) {
+  memset(&stats, 0, sizeof(stats));
+  following = false;
+  safeLimitPending = false;
+  localPort = udp.begin(port) ? port : 0;
+}
+
+/**
+ * @brief Checks a packet and queues its setpoints.
+ * @param source Sender's address and port; the sequence restarts when it changes.
+ */
+static UdpSetpointResult handlePacket(const UdpSetpointPacket &packet, uint64_t source) {
+  unsigned long now = millis();
+  if (packet.deadline != 0 && (long)(now - packet.deadline) > 0) {
+    stats.stale++;
+    return UDP_SETPOINT_STALE;
+  }
+  // Serial number arithmetic, so the sequence may wrap
+  if (following && source == lastSource && (int32_t)(packet.sequence - lastSequence) <= 0) {
+    stats.outOfOrder++;
+    return UDP_SETPOINT_OUT_OF_ORDER;
+  }
+
+  bool hasLimit = packet.flags & UDP_SETPOINT_HAS_LIMIT;
+  bool hasVoltage = packet.flags & UDP_SETPOINT_HAS_VOLTAGE;
+  if ((!hasLimit && !hasVoltage) ||
+      (hasLimit && !r48SettingValid(R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT], packet.currentLimit)) ||
+      (hasVoltage && !r48SettingValid(R48_SETTINGS[SETTING_ONLINE_VOLTAGE], packet.voltage)) ||
+      (packet.unit != UDP_SETPOINT_ALL_UNITS && rectifierFind(packet.unit) == nullptr)) {
+    stats.invalid++;
+    return UDP_SETPOINT_INVALID;
+  }
+  if (chargerRunning()) {
+    stats.refused++;
+    return UDP_SETPOINT_REFUSED;
+  }
+
+  // One broadcast frame per setting reaches the whole bank in a single command tick
+  byte target = packet.unit == UDP_SETPOINT_ALL_UNITS ? R48_BROADCAST_ADDRESS : packet.unit;
+  R48SettingId settings[2];
+  uint8_t settingCount = 0;
+  if (hasLimit) settings[settingCount++] = SETTING_ONLINE_CURRENT_LIMIT;
+  if (hasVoltage) settings[settingCount++] = SETTING_ONLINE_VOLTAGE;
+  if (!commandQueueHasRoom(target, settings, settingCount)) {
+    // Nothing queued and not recorded as accepted, so the sender may repeat the sequence number
+    stats.refused++;
+    return UDP_SETPOINT_QUEUE_FULL;
+  }
+  if (hasLimit) {
+    commandQueuePush(target, SETTING_ONLINE_CURRENT_LIMIT, packet.currentLimit);
+  }
+  if (hasVoltage) {
+    commandQueuePush(target, SETTING_ONLINE_VOLTAGE, packet.voltage);
+  }
+
+  following = true;
+  lastSequence = packet.sequence;
+  lastSource = source;
+  lastAccepted = now;
+  safeLimitPending = false;
+  stats.accepted++;
+  return UDP_SETPOINT_ACCEPTED;
+}
+
+static void sendAck(const UdpSetpointPacket &packet, UdpSetpointResult result) {
+  UdpSetpointAck ack;
+  ack.magic[0] = 'R';
+  ack.magic[1] = 'A';
+  ack.version = UDP_SETPOINT_VERSION;
+  ack.result = result;
+  ack.sequence = packet.sequence;
+  ack.now = millis();
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write((const uint8_t *)&ack, sizeof(ack));
+  udp.endPacket();
+}
+
+/**
+ * @brief Queues the safe limit for every unit, in one broadcast frame, once the stream went silent for longer than the timeout.
+ */
+static void watchdogService() {
+  if (following && timeout > 0 && millis() - lastAccepted >= timeout) {
+    following = false;
+    safeLimitPending = true;
+    stats.watchdogTrips++;
+    logEvent(LOG_WARN, EV_SYS_UDP_WATCHDOG, millis() - lastAccepted, logFloat(safeLimit));
+  }
+  if (!safeLimitPending) {
+    return;
+  }
+  // The charger sets its own limits; otherwise retry each pass until the queue takes the writes.
+  if (chargerRunning()) {
+    safeLimitPending = false;
+    return;
+  }
+  if (commandQueuePush(R48_BROADCAST_ADDRESS, SETTING_ONLINE_CURRENT_LIMIT, safeLimit) == COMMAND_QUEUE_FULL) {
+    return;
+  }
+  safeLimitPending = false;
+}
+
+void udpSetpointService() {
+  if (localPort == 0) {
+    return;
+  }
+  for (uint8_t i = 0; i < UDP_SETPOINT_MAX_PER_SERVICE; i++) {
+    int size = udp.parsePacket();
+    if (size <= 0) {
+      break;
+    }
+    stats.received++;
+    UdpSetpointPacket packet;
+    if (size != sizeof(packet) || udp.read((uint8_t *)&packet, sizeof(packet)) != sizeof(packet) ||
+        packet.magic[0] != 'R' || packet.magic[1] != 'S' || packet.version != UDP_SETPOINT_VERSION) {
+      stats.invalid++;
+      continue;
+    }
+    uint64_t source = ((uint64_t)(uint32_t)udp.remoteIP() << 16) | udp.remotePort();
+    sendAck(packet, handlePacket(packet, source));
+  }
+  watchdogService();
+}
+
+UdpSetpointStats udpSetpointGetStats() {
+  return stats;
+}
+
+// --- HTTP ---
+
+void udpSetpointHandleStatus(AsyncWebServerRequest *request) {
+  String json = "{\"port\":";
+  json += String(localPort);
+  json += ",\"received\":";
+  json += String(stats.received);
+  json += ",\"accepted\":";
+  json += String(stats.accepted);
+  json += ",\"stale\":";
+  json += String(stats.stale);
+  json += ",\"outOfOrder\":";
+  json += String(stats.outOfOrder);
+  json += ",\"invalid\":";
+  json += String(stats.invalid);
+  json += ",\"refused\":";
+  json += String(stats.refused);
+  json += ",\"watchdogTrips\":";
+  json += String(stats.watchdogTrips);
+  json += ",\"following\":";
+  json += following ? "true" : "false";
+  json += ",\"lastSequence\":";
+  json += String(lastSequence);
+  json += ",\"lastAge\":";
+  json += stats.accepted > 0 ? String(millis() - lastAccepted) : String("null");
+  json += ",\"timeout\":";
+  json += String(timeout);
+  json += ",\"safeLimit\":";
+  json += String(safeLimit, 2);
+  json += "}";
+  request->send(200, "application/json", json);
+}
+
+void udpSetpointHandleControl(AsyncWebServerRequest *request) {
+  long newTimeout = timeout;
+  float newSafeLimit = safeLimit;
+  if (request->hasParam("timeout", true)) {
+    newTimeout = request->getParam("timeout", true)->value().toInt();
+  }
+  if (request->hasParam("safe_limit", true)) {
+    newSafeLimit = request->getParam("safe_limit", true)->value().toFloat();
+  }
+  const R48Setting &limit = R48_SETTINGS[SETTING_ONLINE_CURRENT_LIMIT];
+  if (newTimeout < 0 || !r48SettingValid(limit, newSafeLimit)) {
+    request->send(400, "text/plain", "Invalid value, timeout is in ms (0 = off), safe_limit between " +
+                                     String(r48SettingMin(limit)) + " and " + String(r48SettingMax(limit)) + ".");
+    return;
+  }
+  timeout = newTimeout;
+  safeLimit = newSafeLimit;
+  request->send(200, "text/plain", "UDP setpoint configuration updated.");
+}
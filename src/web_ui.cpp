@@ -0,0 +1,35 @@
+#include "metrics.h"
+#include "web_ui.h"
+#include "web_assets.h"
+
+/**
+ * @brief Sends one asset, or 304 when the client already has this version.
+ */
+static void sendAsset(AsyncWebServerRequest *request, const WebAsset &asset) {
+  AsyncWebServerResponse *response;
+  const AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+  if (ifNoneMatch != nullptr && strstr(ifNoneMatch->value().c_str(), asset.etag) != nullptr) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse(200, asset.contentType, asset.data, asset.length);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("ETag", asset.etag);
+  if (asset.immutable) {
+    char cacheControl[48];
+    snprintf(cacheControl, sizeof(cacheControl), "public, max-age=%lu, immutable", WEB_ASSET_MAX_AGE);
+    response->addHeader("Cache-Control", cacheControl);
+  } else {
+    response->addHeader("Cache-Control", "no-cache");
+  }
+  request->send(response);
+}
+
+void webUiBegin(AsyncWebServer &server) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset *asset = &WEB_ASSETS[i];
+    metricsRoute(server, asset->path, HTTP_GET, [asset](AsyncWebServerRequest *request) {
+      sendAsset(request, *asset);
+    });
+  }
+}
@@ -0,0 +1,166 @@
+#include "wifi_link.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <ESP8266WiFi.h>
+
+static const char *stationSsid = nullptr;
+static const char *stationPassword = nullptr;
+static const char *accessPointSsid = nullptr;
+static const char *accessPointPassword = nullptr;
+static WifiLinkChangeFunction changeFunction = nullptr;
+
+static WifiLinkState state = WIFI_LINK_CONNECTING;
+static bool fallbackAp = false;
+static uint8_t failures = 0;
+static uint32_t attempts = 0;
+static uint32_t disconnects = 0;
+static unsigned long stateSince = 0;   // millis() when the attempt or the backoff started
+static unsigned long backoff = 0;      // ms of the current backoff
+
+static void startAttempt() {
+  attempts++;
+  state = WIFI_LINK_CONNECTING;
+  stateSince = millis();
+  WiFi.begin(stationSsid, stationPassword);
+}
+
+static void attemptFailed() {
+  WiFi.disconnect();
+  if (failures < UINT8_MAX) {
+    failures++;
+  }
+  uint8_t shift = min<uint8_t>(failures - 1, 16);
+  backoff = min(WIFI_LINK_BACKOFF_MIN << shift, WIFI_LINK_BACKOFF_MAX);
+  state = WIFI_LINK_BACKOFF;
+  stateSince = millis();
+  logEvent(LOG_WARN, EV_SYS_WIFI_RETRY, failures, backoff);
+
+  if (!fallbackAp && failures >= WIFI_LINK_AP_FALLBACK_FAILURES) {
+    fallbackAp = WiFi.softAP(accessPointSsid, accessPointPassword);
+    logEvent(LOG_WARN, EV_SYS_WIFI_ACCESS_POINT, logString(fallbackAp ? "opened" : "could not be opened"));
+  }
+}
+
+void wifiLinkBegin(bool accessPoint, const char *ssid, const char *password,
+                   const char *apSsid, const char *apPassword, WifiLinkChangeFunction onChange) {
+  stationSsid = ssid;
+  stationPassword = password;
+  accessPointSsid = apSsid;
+  accessPointPassword = apPassword;
+  changeFunction = onChange;
+
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  if (accessPoint) {
+    WiFi.mode(WIFI_AP);
+    WiFi.softAP(apSsid, apPassword);
+    state = WIFI_LINK_ACCESS_POINT;
+    metricsMarkBoot(BOOT_NETWORK);
+    return;
+  }
+  WiFi.mode(WIFI_STA);
+  startAttempt();
+}
+
+void wifiLinkService() {
+  wl_status_t status = WiFi.status();
+  switch (state) {
+    case WIFI_LINK_ACCESS_POINT:
+      break;
+
+    case WIFI_LINK_CONNECTING:
+      if (status == WL_CONNECTED) {
+        logEvent(LOG_INFO, EV_SYS_WIFI_CONNECTED, attempts, WiFi.RSSI());
+        state = WIFI_LINK_CONNECTED;
+        failures = 0;
+        metricsMarkBoot(BOOT_NETWORK);
+        if (fallbackAp) {
+          WiFi.softAPdisconnect(true);
+          fallbackAp = false;
+          logEvent(LOG_INFO, EV_SYS_WIFI_ACCESS_POINT, logString("closed"));
+        }
+        if (changeFunction != nullptr) {
+          changeFunction(true);
+        }
+      } else if (status == WL_WRONG_PASSWORD || status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED ||
+                 millis() - stateSince >= WIFI_LINK_CONNECT_TIMEOUT) {
+        attemptFailed();
+      }
+      break;
+
+    case WIFI_LINK_BACKOFF:
+      if (millis() - stateSince >= backoff) {
+        startAttempt();
+      }
+      break;
+
+    case WIFI_LINK_CONNECTED:
+      if (status != WL_CONNECTED) {
+        disconnects++;
+        logEvent(LOG_WARN, EV_SYS_WIFI_LOST, disconnects);
+        if (changeFunction != nullptr) {
+          changeFunction(false);
+        }
+        startAttempt();
+      }
+      break;
+  }
+}
+
+bool wifiLinkConnected() {
+  return state == WIFI_LINK_CONNECTED;
+}
+
+WifiLinkStatus wifiLinkGetStatus() {
+  WifiLinkStatus status = {state, fallbackAp, failures, attempts, disconnects, 0};
+  if (state == WIFI_LINK_BACKOFF) {
+    unsigned long waited = millis() - stateSince;
+    status.retryIn = waited < backoff ? backoff - waited : 0;
+  }
+  return status;
+}
+
+const char *wifiLinkStateName(WifiLinkState value) {
+  switch (value) {
+    case WIFI_LINK_ACCESS_POINT: return "access_point";
+    case WIFI_LINK_CONNECTING: return "connecting";
+    case WIFI_LINK_BACKOFF: return "backoff";
+    case WIFI_LINK_CONNECTED: return "connected";
+  }
+  return "unknown";
+}
+
+// --- HTTP ---
+
+static void appendBootTime(String &json, const char *name, BootMilestone milestone) {
+  long time = metricsBootTime(milestone);
+  json += ",\"";
+  json += name;
+  json += "\":";
+  json += time >= 0 ? String(time) : String("null");
+}
+
+void wifiLinkHandleStatus(AsyncWebServerRequest *request) {
+  WifiLinkStatus status = wifiLinkGetStatus();
+  String json = "{\"state\":\"";
+  json += wifiLinkStateName(status.state);
+  json += "\",\"fallbackAp\":";
+  json += status.fallbackAp ? "true" : "false";
+  json += ",\"ip\":\"";
+  json += status.state == WIFI_LINK_ACCESS_POINT ? WiFi.softAPIP().toString() : WiFi.localIP().toString();
+  json += "\",\"rssi\":";
+  json += status.state == WIFI_LINK_CONNECTED ? String(WiFi.RSSI()) : String("null");
+  json += ",\"attempts\":";
+  json += String(status.attempts);
+  json += ",\"failures\":";
+  json += String(status.failures);
+  json += ",\"disconnects\":";
+  json += String(status.disconnects);
+  json += ",\"retryInMs\":";
+  json += String(status.retryIn);
+  appendBootTime(json, "networkMs", BOOT_NETWORK);
+  appendBootTime(json, "firstMeasurementMs", BOOT_FIRST_MEASUREMENT);
+  json += "}";
+  request->send(200, "application/json", json);
+}
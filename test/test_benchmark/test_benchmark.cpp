@@ -0,0 +1,321 @@
+// Host benchmarks of the controller's hot paths, run against the simulated R48 bank.
+//
+// Each benchmark prints one "BENCH <name> <ns/op> <op/s>" line. The host is
+// far faster than the ESP8266, so the absolute numbers only mean something
+// relative to earlier runs on the same machine; the budgets asserted here
+// are an order of magnitude above the expected cost and only catch gross
+// regressions (an accidental O(n^2), a heap allocation per frame, ...).
+//
+// Eight units are simulated so /data is at its largest.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <WiFiUdp.h>
+#include <algorithm>
+#include <chrono>
+#include <unity.h>
+#include <vector>
+
+#include "can_capture.h"
+#include "can_rx.h"
+#include "command_queue.h"
+#include "data_binary.h"
+#include "data_snapshot.h"
+#include "r48_simulator.h"
+#include "rectifiers.h"
+#include "udp_setpoint.h"
+
+void setup();
+void loop();
+void processIncomingCanMessages();
+void handleCanFrame(const CanFrame &frame);
+extern MCP_CAN CAN0;
+extern AsyncWebServer server;
+
+/**
+ * @brief The simulated bank, built on first use: its constructor attaches to CAN0 and sets the INT pin reader,
+ * which live in other translation units and must be constructed first.
+ */
+static R48Simulator &bank() {
+  static R48Simulator simulator(CAN0, D1);
+  return simulator;
+}
+
+// Host-side budgets per operation, in nanoseconds.
+static const double LOOP_BUDGET_NS = 50000;
+static const double FRAME_BUDGET_NS = 20000;
+static const double DATA_BUILD_BUDGET_NS = 100000;
+static const double DATA_REQUEST_BUDGET_NS = 200000;
+static const double DATA_BINARY_ENCODE_BUDGET_NS = 10000;
+
+static double hostNanoseconds() {
+  using namespace std::chrono;
+  return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Prints one result line and returns the cost per operation in nanoseconds.
+ */
+static double report(const char *name, uint32_t ops, double elapsedNs) {
+  double perOp = elapsedNs / ops;
+  printf("BENCH %-20s %10.0f ns/op %12.0f op/s\n", name, perOp, 1e9 / perOp);
+  return perOp;
+}
+
+static void runFor(unsigned long ms, unsigned long stepUs) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    loop();
+    nativeClockAdvance(stepUs);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void bench_loop_steady_state() {
+  // 100 us per pass is about what the ESP8266 spends in an idle loop() plus the WiFi stack.
+  const uint32_t passes = 200000;
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < passes; i++) {
+    loop();
+    nativeClockAdvance(100);
+  }
+  double perPass = report("loop", passes, hostNanoseconds() - start);
+  TEST_ASSERT_EQUAL(MAX_RECTIFIERS, rectifierCount());
+  TEST_ASSERT_LESS_THAN(LOOP_BUDGET_NS, perPass);
+}
+
+void bench_loop_with_live_subscriber() {
+  AsyncEventSourceClient *client = server.nativeConnectEvents("/events");
+  TEST_ASSERT_NOT_NULL(client);
+  for (byte address = 1; address <= MAX_RECTIFIERS; address++) {
+    bank().setLoad(address, 5.0f + address);
+  }
+
+  const uint32_t passes = 200000;
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < passes; i++) {
+    // A changing load keeps the deltas coming.
+    if (i % 1000 == 0) {
+      bank().setLoad(1 + (i / 1000) % MAX_RECTIFIERS, (i / 1000) % 40);
+    }
+    loop();
+    nativeClockAdvance(100);
+  }
+  double perPass = report("loop_sse", passes, hostNanoseconds() - start);
+  TEST_ASSERT_TRUE(client->nativeEvents.size() > 1);
+  TEST_ASSERT_LESS_THAN(LOOP_BUDGET_NS, perPass);
+}
+
+void bench_frame_processing() {
+  CanRxStats before = canRxGetStats();
+  const uint32_t frames = 200000;
+  byte data[8] = {0x41, R48_CONTROLLER_ADDRESS, 0x00, OUTPUT_CURRENT};
+
+  // Frames follow each other on the bus at least a frame time apart, so each
+  // one is drained on its own; values change every time so the whole update
+  // path (table, snapshot invalidation, live deltas) runs.
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < frames; i++) {
+    r48PutFloat(&data[4], (float)(i % 400) / 10.0f);
+    CAN0.nativeInject(r48ResponseId(1 + i % MAX_RECTIFIERS), 8, data);
+    processIncomingCanMessages();
+  }
+  double perFrame = report("frames", frames, hostNanoseconds() - start);
+
+  CanRxStats after = canRxGetStats();
+  TEST_ASSERT_EQUAL(frames, after.received - before.received);
+  TEST_ASSERT_EQUAL(before.overruns, after.overruns);
+  TEST_ASSERT_LESS_THAN(FRAME_BUDGET_NS, perFrame);
+}
+
+void bench_data_serialization() {
+  const uint32_t builds = 50000;
+  uint32_t firstVersion = dataSnapshotVersion();
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < builds; i++) {
+    dataSnapshotMarkChanged();
+    dataSnapshotService();
+  }
+  double perBuild = report("data_build", builds, hostNanoseconds() - start);
+  TEST_ASSERT_EQUAL(builds, dataSnapshotVersion() - firstVersion);
+  printf("      /data is %u bytes\n", (unsigned)strlen(dataSnapshotJson()));
+  TEST_ASSERT_LESS_THAN(DATA_BUILD_BUDGET_NS, perBuild);
+}
+
+void bench_data_request() {
+  const uint32_t requests = 50000;
+  size_t bytes = 0;
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < requests; i++) {
+    NativeResponse response = server.nativeRequest(HTTP_GET, "/data");
+    bytes += response.body.size();
+  }
+  double perRequest = report("data_request", requests, hostNanoseconds() - start);
+  TEST_ASSERT_EQUAL(requests * strlen(dataSnapshotJson()), bytes);
+  TEST_ASSERT_LESS_THAN(DATA_REQUEST_BUDGET_NS, perRequest);
+}
+
+void bench_data_binary_vs_json() {
+  // Encoding: a /data.bin frame straight from the table against a /data snapshot rebuild (bench_data_serialization)
+  const uint32_t encodes = 200000;
+  uint8_t frame[sizeof(DataBinaryHeader) + MAX_RECTIFIERS * sizeof(DataBinaryUnit)];
+  size_t length = 0;
+  double start = hostNanoseconds();
+  for (uint32_t i = 0; i < encodes; i++) {
+    length = dataBinaryEncode(frame, sizeof(frame));
+  }
+  double perEncode = report("data_bin_encode", encodes, hostNanoseconds() - start);
+  TEST_ASSERT_EQUAL(sizeof(frame), length);
+
+  const uint32_t requests = 50000;
+  size_t bytes = 0;
+  start = hostNanoseconds();
+  for (uint32_t i = 0; i < requests; i++) {
+    NativeResponse response = server.nativeRequest(HTTP_GET, "/data.bin");
+    bytes += response.body.size();
+  }
+  double perRequest = report("data_bin_request", requests, hostNanoseconds() - start);
+  TEST_ASSERT_EQUAL(requests * sizeof(frame), bytes);
+
+  // Parsing on the consumer's side: every number of /data through strtod, against copying the frame's floats
+  std::string json = dataSnapshotJson();
+  const uint32_t parses = 20000;
+  double sum = 0;
+  start = hostNanoseconds();
+  for (uint32_t i = 0; i < parses; i++) {
+    for (const char *p = json.c_str(); *p; p++) {
+      if (*p == ':' && (p[1] == '-' || isdigit((unsigned char)p[1]))) {
+        char *end;
+        sum += strtod(p + 1, &end);
+        p = end - 1;
+      }
+    }
+  }
+  double perJsonParse = report("data_json_parse", parses, hostNanoseconds() - start);
+  start = hostNanoseconds();
+  for (uint32_t i = 0; i < parses; i++) {
+    DataBinaryHeader header;
+    memcpy(&header, frame, sizeof(header));
+    for (uint8_t u = 0; u < header.unitCount; u++) {
+      DataBinaryUnit unit;
+      memcpy(&unit, frame + header.headerSize + u * header.unitSize, sizeof(unit));
+      for (uint8_t m = 0; m < MEASUREMENT_COUNT; m++) {
+        sum += unit.values[m] + unit.ageMs[m];
+      }
+    }
+  }
+  double perBinaryParse = report("data_bin_parse", parses, hostNanoseconds() - start);
+  printf("      /data.bin is %u bytes, /data %u bytes; parse %.0fx faster (checksum %.0f)\n",
+         (unsigned)sizeof(frame), (unsigned)json.size(), perJsonParse / perBinaryParse, sum);
+  TEST_ASSERT_TRUE(sizeof(frame) < json.size());
+  TEST_ASSERT_LESS_THAN(DATA_BINARY_ENCODE_BUDGET_NS, perEncode);
+  TEST_ASSERT_LESS_THAN(DATA_REQUEST_BUDGET_NS, perRequest);
+}
+
+void bench_capture_replay() {
+  // Record 20 s of the bank's traffic, then replay the received frames through the parser as fast as possible.
+  server.nativeRequest(HTTP_POST, "/capture", {{"enabled", "on"}, {"clear", "1"}});
+  runFor(20000, 500);
+  server.nativeRequest(HTTP_POST, "/capture", {{"flush", "1"}});
+  runFor(1, 500);
+  NativeResponse file = server.nativeRequest(HTTP_GET, "/capture.bin?file=0");
+  server.nativeRequest(HTTP_POST, "/capture", {{"enabled", "off"}, {"clear", "1"}});
+  runFor(1, 500);
+  TEST_ASSERT_EQUAL(200, file.code);
+  const uint8_t *data = (const uint8_t *)file.body.data();
+  size_t start = ((const CaptureFileHeader *)data)->headerSize;
+
+  const uint32_t frames = 200000;
+  uint32_t replayed = 0;
+  double began = hostNanoseconds();
+  while (replayed < frames) {
+    size_t offset = start;
+    CaptureRecord record;
+    while (replayed < frames && canCaptureDecode(data, file.body.size(), offset, record)) {
+      if (record.sent) continue;
+      CanFrame frame;
+      frame.id = record.id;
+      frame.timestamp = millis();
+      frame.len = record.len;
+      memcpy(frame.data, record.data, record.len);
+      handleCanFrame(frame);
+      replayed++;
+    }
+  }
+  double perFrame = report("replay", frames, hostNanoseconds() - began);
+  printf("      capture is %u bytes for 20 s\n", (unsigned)file.body.size());
+  TEST_ASSERT_LESS_THAN(FRAME_BUDGET_NS, perFrame);
+}
+
+/**
+ * @brief Streams current limit packets and measures how long each takes to reach the bus as write frames.
+ * @param unit Target of the packets; UDP_SETPOINT_ALL_UNITS waits for the frame to the last unit.
+ */
+static void measureSetpointLatency(const char *name, byte unit, uint8_t frames, unsigned long periodUs,
+                                   unsigned long budgetUs) {
+  const uint32_t packets = 400;
+  const unsigned long stepUs = 100;
+  uint32_t acceptedBefore = udpSetpointGetStats().accepted;
+  static uint32_t sequence = 0;
+  std::vector<unsigned long> latencies;
+  double hostNs = 0;
+
+  for (uint32_t i = 0; i < packets; i++) {
+    UdpSetpointPacket packet = {{'R', 'S'}, UDP_SETPOINT_VERSION, UDP_SETPOINT_HAS_LIMIT, unit,
+                                {0, 0, 0}, ++sequence, 0, i % 2 ? 0.6f : 0.5f, 0};
+    unsigned long sentAt = micros();
+    uint32_t target = bank().writes + frames;
+    WiFiUDP::nativeSend(4848, &packet, sizeof(packet));
+    // Host cost of the pass that reads the packet and sends the first frame
+    double start = hostNanoseconds();
+    loop();
+    hostNs += hostNanoseconds() - start;
+    while (bank().writes < target && micros() - sentAt < periodUs) {
+      nativeClockAdvance(stepUs);
+      loop();
+    }
+    latencies.push_back(micros() - sentAt);
+    TEST_ASSERT_EQUAL(target, bank().writes);
+    runFor((periodUs - (micros() - sentAt)) / 1000, stepUs);
+  }
+  WiFiUDP::nativeOutbox.clear();
+
+  double perPacket = report(name, packets, hostNs);
+  std::sort(latencies.begin(), latencies.end());
+  unsigned long p99 = latencies[packets * 99 / 100];
+  printf("      packet to frame: p50 %lu us, p99 %lu us, max %lu us of virtual time (%lu us per loop pass)\n",
+         latencies[packets / 2], p99, latencies.back(), stepUs);
+  TEST_ASSERT_EQUAL(packets, udpSetpointGetStats().accepted - acceptedBefore);
+  TEST_ASSERT_LESS_OR_EQUAL(budgetUs, p99);
+  TEST_ASSERT_LESS_THAN(LOOP_BUDGET_NS, perPacket);
+}
+
+void bench_udp_setpoint_latency() {
+  // One unit at 8 Hz: the packet becomes a frame in the loop() pass that reads it.
+  measureSetpointLatency("udp_to_frame", 1, 1, 125000, 0);
+  // Every unit at 4 Hz: the command queue spaces the frames COMMAND_QUEUE_TICK apart.
+  measureSetpointLatency("udp_to_frame_all", UDP_SETPOINT_ALL_UNITS, MAX_RECTIFIERS, 250000,
+                         (MAX_RECTIFIERS - 1) * COMMAND_QUEUE_TICK * 1000 + 100);
+}
+
+int main(int argc, char **argv) {
+  for (byte address = 1; address <= MAX_RECTIFIERS; address++) {
+    bank().addUnit(address);
+  }
+  setup();
+  // Discover the bank and let every measurement be polled once.
+  runFor(15000, 500);
+
+  UNITY_BEGIN();
+  RUN_TEST(bench_loop_steady_state);
+  RUN_TEST(bench_loop_with_live_subscriber);
+  RUN_TEST(bench_frame_processing);
+  RUN_TEST(bench_data_serialization);
+  RUN_TEST(bench_data_request);
+  RUN_TEST(bench_data_binary_vs_json);
+  RUN_TEST(bench_capture_replay);
+  RUN_TEST(bench_udp_setpoint_latency);
+  return UNITY_END();
+}
@@ -0,0 +1,1014 @@
+// End-to-end tests of the sketch against the simulated R48 bank.
+//
+// setup() and loop() run unchanged; the MCP2515, the clock and the web
+// server are the host stand-ins from lib/r48_native. The tests share one
+// running controller and build on each other in order, like a device that
+// stays powered through the session.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <unity.h>
+
+#include "can_capture.h"
+#include "can_filter.h"
+#include "can_rx.h"
+#include "checksum.h"
+#include "charger.h"
+#include "command_queue.h"
+#include "command_tracker.h"
+#include "config_store.h"
+#include "data_binary.h"
+#include "data_snapshot.h"
+#include "energy.h"
+#include "live_events.h"
+#include "metrics.h"
+#include "poll_scheduler.h"
+#include "profiler.h"
+#include "r48_simulator.h"
+#include "rectifiers.h"
+#include "register_cache.h"
+#include "settings_batch.h"
+#include "setpoint_keepalive.h"
+#include "udp_setpoint.h"
+#include "wifi_link.h"
+
+void setup();
+void loop();
+uint32_t wallClockSeconds();
+void onConfigChange();
+extern MCP_CAN CAN0;
+extern AsyncWebServer server;
+
+/**
+ * @brief The simulated bank, built on first use: its constructor attaches to CAN0 and sets the INT pin reader,
+ * which live in other translation units and must be constructed first.
+ */
+static R48Simulator &bank() {
+  static R48Simulator simulator(CAN0, D1);
+  return simulator;
+}
+
+/**
+ * @brief Runs loop() for `ms` of virtual time, one pass per `stepUs`.
+ */
+static void runFor(unsigned long ms, unsigned long stepUs = 500) {
+  unsigned long end = millis() + ms;
+  while ((long)(millis() - end) < 0) {
+    loop();
+    nativeClockAdvance(stepUs);
+  }
+}
+
+static float bankValue(byte address, MeasurementType measurement) {
+  Rectifier *rectifier = rectifierFind(address);
+  TEST_ASSERT_NOT_NULL(rectifier);
+  return rectifier->values[measurementSlot(measurement)];
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_discovery_finds_every_unit() {
+  runFor(1500);
+  TEST_ASSERT_EQUAL(3, rectifierCount());
+  TEST_ASSERT_NOT_NULL(rectifierFind(0x01));
+  TEST_ASSERT_NOT_NULL(rectifierFind(0x02));
+  TEST_ASSERT_NOT_NULL(rectifierFind(0x03));
+}
+
+void test_measurements_follow_the_load() {
+  bank().setLoad(0x01, 20.0f);
+  bank().setLoad(0x02, 10.0f);
+  runFor(3000);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 20.0f, bankValue(0x01, OUTPUT_CURRENT));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, bankValue(0x02, OUTPUT_CURRENT));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 53.5f, bankValue(0x03, OUTPUT_VOLTAGE));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 30.0f, rectifiersBankTotals().outputCurrent);
+
+  PollStats stats = pollSchedulerGetStats();
+  TEST_ASSERT_EQUAL(0, stats.timeouts);
+  TEST_ASSERT_EQUAL(0, CAN0.nativeOverflows);
+}
+
+void test_data_is_served_with_an_etag() {
+  NativeResponse first = server.nativeRequest(HTTP_GET, "/data");
+  TEST_ASSERT_EQUAL(200, first.code);
+  TEST_ASSERT_TRUE(first.body.find("\"unitCount\":3") != std::string::npos);
+  TEST_ASSERT_TRUE(first.body.find("\"outputCurrent\":30.00") != std::string::npos);
+  const char *etag = first.header("ETag");
+  TEST_ASSERT_NOT_NULL(etag);
+
+  NativeResponse again = server.nativeRequest(HTTP_GET, "/data", {}, {{"If-None-Match", etag}});
+  TEST_ASSERT_EQUAL(304, again.code);
+  TEST_ASSERT_TRUE(again.body.empty());
+}
+
+void test_online_voltage_is_applied() {
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/set_online_v", {{"value", "50.0"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(1500);
+  for (byte address = 0x01; address <= 0x03; address++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f, bank().setpointVoltage(*bank().unit(address)));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f, bankValue(address, OUTPUT_VOLTAGE));
+  }
+}
+
+void test_out_of_range_setting_is_rejected() {
+  uint32_t writes = bank().writes;
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/set_perm_v", {{"value", "80"}});
+  TEST_ASSERT_EQUAL(400, response.code);
+  runFor(100);
+  TEST_ASSERT_EQUAL(writes, bank().writes);
+}
+
+void test_permanent_setting_is_confirmed_by_read_back() {
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/set_perm_c", {{"value", "0.5"}, {"unit", "2"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(100);
+  TEST_ASSERT_TRUE(commandTrackerPending());
+
+  // The simulated EEPROM write takes bank().storeMs; the read-backs keep going until it is done.
+  runFor(5000);
+  TEST_ASSERT_FALSE(commandTrackerPending());
+  TEST_ASSERT_EQUAL(COMMAND_RESULT_CONFIRMED, commandTrackerResult());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, bank().currentLimit(*bank().unit(0x02)));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.0f, bank().currentLimit(*bank().unit(0x01)));
+}
+
+void test_current_limit_caps_the_output() {
+  // 0.5 of 41.7 A is below a 30 A load: unit 2 runs into its limit.
+  bank().setLoad(0x02, 30.0f);
+  runFor(3000);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.5f * R48_SIM_RATED_CURRENT, bankValue(0x02, OUTPUT_CURRENT));
+  TEST_ASSERT_LESS_THAN(50.0f, bankValue(0x02, OUTPUT_VOLTAGE));
+}
+
+void test_live_events_start_with_a_snapshot() {
+  AsyncEventSourceClient *client = server.nativeConnectEvents("/events");
+  TEST_ASSERT_NOT_NULL(client);
+  TEST_ASSERT_TRUE(client->nativeEvents.size() >= 1);
+  TEST_ASSERT_EQUAL_STRING("snapshot", client->nativeEvents[0].event.c_str());
+
+  bank().setLoad(0x01, 5.0f);
+  runFor(1000);
+  bool sawDelta = false;
+  for (const auto &event : client->nativeEvents) {
+    sawDelta |= event.event == "delta";
+  }
+  TEST_ASSERT_TRUE(sawDelta);
+}
+
+void test_silent_unit_is_dropped() {
+  bank().setAnswering(0x03, false);
+  runFor(RECTIFIER_TIMEOUT + 2000, 2000);
+  TEST_ASSERT_EQUAL(2, rectifierCount());
+  TEST_ASSERT_NULL(rectifierFind(0x03));
+}
+
+void test_metrics_are_exported() {
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/metrics");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find("r48_can_rx_parsed_total") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("r48_http_requests_total{route=\"/data\",method=\"GET\"} 2") != std::string::npos);
+  // The routes registered last still get their own label.
+  TEST_ASSERT_TRUE(response.body.find("r48_http_requests_total{route=\"/settings\",method=\"GET\"}") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("r48_http_requests_total{route=\"/metrics\",method=\"GET\"} 1") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("r48_http_requests_total{route=\"other\",method=\"ANY\"} 0") != std::string::npos);
+
+  NativeResponse missing = server.nativeRequest(HTTP_GET, "/nope");
+  TEST_ASSERT_EQUAL(404, missing.code);
+}
+
+void test_capture_records_the_traffic() {
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/capture", {{"enabled", "on"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(3000);
+
+  // The download serves what is in flash; loop() writes out the buffer first
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/capture", {{"flush", "1"}}).code);
+  TEST_ASSERT_TRUE(canCaptureGetStats().buffered > 0);
+  runFor(1);
+  TEST_ASSERT_EQUAL(0, canCaptureGetStats().buffered);
+  NativeResponse file = server.nativeRequest(HTTP_GET, "/capture.bin?file=0");
+  TEST_ASSERT_EQUAL(200, file.code);
+  const uint8_t *data = (const uint8_t *)file.body.data();
+  TEST_ASSERT_TRUE(file.body.size() > sizeof(CaptureFileHeader));
+  TEST_ASSERT_EQUAL_MEMORY("R48C", data, 4);
+
+  size_t offset = ((const CaptureFileHeader *)data)->headerSize;
+  CaptureRecord record;
+  uint32_t requests = 0, answers = 0;
+  uint64_t span = 0;
+  while (canCaptureDecode(data, file.body.size(), offset, record)) {
+    span += record.deltaMicros;
+    if (record.sent && record.id == (r48RequestId(0x01) | CAN_EXTENDED_FLAG) && record.data[0] == 0x01) requests++;
+    if (!record.sent && record.id == (r48ResponseId(0x01) | CAN_EXTENDED_FLAG) && record.data[0] == 0x41) answers++;
+  }
+  TEST_ASSERT_EQUAL(file.body.size(), offset);
+  TEST_ASSERT_TRUE(requests > 10);
+  TEST_ASSERT_TRUE(answers + 2 >= requests);
+  TEST_ASSERT_TRUE(span > 2900000 && span <= 3000000);
+}
+
+void test_capture_rotates_by_size() {
+  for (int minutes = 0; minutes < 30 && canCaptureGetStats().rotations == 0; minutes++) {
+    runFor(60000, 2000);
+  }
+  CaptureStats stats = canCaptureGetStats();
+  TEST_ASSERT_EQUAL(1, stats.rotations);
+  TEST_ASSERT_EQUAL(0, stats.dropped);
+
+  NativeResponse older = server.nativeRequest(HTTP_GET, "/capture.bin?file=1");
+  TEST_ASSERT_EQUAL(200, older.code);
+  TEST_ASSERT_TRUE(older.body.size() <= CAPTURE_FILE_SIZE && older.body.size() > CAPTURE_FILE_SIZE - CAPTURE_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL(404, server.nativeRequest(HTTP_GET, "/capture.bin?file=2").code);
+
+  server.nativeRequest(HTTP_POST, "/capture", {{"enabled", "off"}, {"clear", "1"}});
+  TEST_ASSERT_TRUE(canCaptureGetStats().enabled);
+  runFor(1);
+  TEST_ASSERT_FALSE(canCaptureGetStats().enabled);
+  TEST_ASSERT_EQUAL(404, server.nativeRequest(HTTP_GET, "/capture.bin?file=0").code);
+}
+
+void test_charger_runs_cc_cv_and_float() {
+  bank().setBattery(0x01, 50.0f, 0.05f);
+  bank().setBattery(0x02, 50.0f, 0.05f);
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/charger",
+    {{"cc_current", "30"}, {"cv_voltage", "53.0"}, {"tail_current", "6"}, {"absorption_time", "5"},
+     {"float_voltage", "52.0"}, {"action", "start"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+
+  // Bulk: the battery would take far more than 30 A at 53 V, so the current loop holds it.
+  runFor(10000);
+  TEST_ASSERT_EQUAL(CHARGER_CC, chargerGetStatus().stage);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 30.0f, rectifiersBankTotals().outputCurrent);
+  TEST_ASSERT_EQUAL(409, server.nativeRequest(HTTP_POST, "/set_online_v", {{"value", "50"}}).code);
+
+  // Nearly full: the voltage reaches cv and the current tapers below the tail current.
+  bank().setBattery(0x01, 52.9f, 0.05f);
+  bank().setBattery(0x02, 52.9f, 0.05f);
+  runFor(3000);
+  TEST_ASSERT_EQUAL(CHARGER_ABSORPTION, chargerGetStatus().stage);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 53.0f, rectifiersBankTotals().outputVoltage);
+
+  runFor(5000);
+  ChargerStatus status = chargerGetStatus();
+  TEST_ASSERT_EQUAL(CHARGER_FLOAT, status.stage);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 52.0f, bank().setpointVoltage(*bank().unit(0x01)));
+
+  // Settled: no more writes.
+  runFor(5000);
+  TEST_ASSERT_EQUAL(status.writes, chargerGetStatus().writes);
+
+  response = server.nativeRequest(HTTP_GET, "/charger");
+  TEST_ASSERT_TRUE(response.body.find("\"stage\":\"float\"") != std::string::npos);
+  server.nativeRequest(HTTP_POST, "/charger", {{"action", "stop"}});
+  TEST_ASSERT_FALSE(chargerRunning());
+  bank().setLoad(0x01, 5.0f);
+  bank().setLoad(0x02, 30.0f);
+}
+
+/**
+ * @brief Sends a packet to the controller's UDP port and returns the result of its ack.
+ */
+static uint8_t sendPacket(const UdpSetpointPacket &packet) {
+  uint32_t sequence = packet.sequence;
+  WiFiUDP::nativeOutbox.clear();
+  TEST_ASSERT_TRUE(WiFiUDP::nativeSend(4848, &packet, sizeof(packet)));
+  runFor(100);
+  TEST_ASSERT_EQUAL(1, WiFiUDP::nativeOutbox.size());
+  UdpSetpointAck ack;
+  TEST_ASSERT_EQUAL(sizeof(ack), WiFiUDP::nativeOutbox.front().data.size());
+  memcpy(&ack, WiFiUDP::nativeOutbox.front().data.data(), sizeof(ack));
+  TEST_ASSERT_EQUAL(sequence, ack.sequence);
+  return ack.result;
+}
+
+/**
+ * @brief Sends a current limit packet for every unit.
+ */
+static uint8_t sendSetpoint(uint32_t sequence, float limit, uint32_t deadline = 0) {
+  UdpSetpointPacket packet = {{'R', 'S'}, UDP_SETPOINT_VERSION, UDP_SETPOINT_HAS_LIMIT, UDP_SETPOINT_ALL_UNITS,
+                              {0, 0, 0}, sequence, deadline, limit, 0};
+  return sendPacket(packet);
+}
+
+void test_udp_setpoints_and_watchdog() {
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_ACCEPTED, sendSetpoint(10, 0.5f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, bank().currentLimit(*bank().unit(0x01)));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, bank().currentLimit(*bank().unit(0x02)));
+
+  // Late and expired packets change nothing
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_OUT_OF_ORDER, sendSetpoint(9, 0.3f));
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_STALE, sendSetpoint(11, 0.3f, millis() - 1));
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_INVALID, sendSetpoint(11, 2.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, bank().currentLimit(*bank().unit(0x01)));
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_ACCEPTED, sendSetpoint(11, 0.6f, millis() + 50));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.6f, bank().currentLimit(*bank().unit(0x02)));
+
+  // Silence: the watchdog falls back to the safe limit, and the stream may restart at any sequence
+  runFor(2000);
+  TEST_ASSERT_EQUAL(1, udpSetpointGetStats().watchdogTrips);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, UDP_SETPOINT_DEFAULT_SAFE_LIMIT, bank().currentLimit(*bank().unit(0x01)));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, UDP_SETPOINT_DEFAULT_SAFE_LIMIT, bank().currentLimit(*bank().unit(0x02)));
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_ACCEPTED, sendSetpoint(1, 0.8f));
+
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/udp", {{"timeout", "0"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_ACCEPTED, sendSetpoint(2, 1.21f));
+  runFor(3000);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.21f, bank().currentLimit(*bank().unit(0x01)));
+  response = server.nativeRequest(HTTP_GET, "/udp");
+  TEST_ASSERT_TRUE(response.body.find("\"accepted\":4,\"stale\":1,\"outOfOrder\":1,\"invalid\":1") != std::string::npos);
+
+  // A packet whose writes do not all fit queues none of them
+  for (byte unit = 0x20; unit < 0x20 + COMMAND_QUEUE_SIZE - 1; unit++) {
+    TEST_ASSERT_EQUAL(COMMAND_QUEUED, commandQueuePush(unit, SETTING_ONLINE_VOLTAGE, 53.5f));
+  }
+  UdpSetpointPacket both = {{'R', 'S'}, UDP_SETPOINT_VERSION, UDP_SETPOINT_HAS_LIMIT | UDP_SETPOINT_HAS_VOLTAGE, 0x01,
+                            {0, 0, 0}, 3, 0, 0.7f, 53.0f};
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_QUEUE_FULL, sendPacket(both));
+  TEST_ASSERT_FALSE(commandQueueWaiting(0x01, SETTING_ONLINE_CURRENT_LIMIT));
+  runFor(1000);
+
+  // The same sequence is taken once there is room; an all-units packet is a single broadcast frame
+  uint32_t sent = commandQueueGetStats().sent;
+  TEST_ASSERT_EQUAL(UDP_SETPOINT_ACCEPTED, sendSetpoint(3, 0.9f));
+  TEST_ASSERT_EQUAL(sent + 1, commandQueueGetStats().sent);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.9f, bank().currentLimit(*bank().unit(0x01)));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.9f, bank().currentLimit(*bank().unit(0x02)));
+}
+
+void test_profile_covers_loop_can_and_routes() {
+  server.nativeRequest(HTTP_GET, "/profile");
+  runFor(2000);
+  server.nativeRequest(HTTP_GET, "/data");
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/profile");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find("{\"name\":\"loop\",\"count\":4000,\"outsideLoop\":0,") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"name\":\"can_send\"") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("{\"name\":\"GET /data\",\"count\":1,\"outsideLoop\":1,") != std::string::npos);
+
+  // Dumping resets every probe
+  response = server.nativeRequest(HTTP_GET, "/profile");
+  TEST_ASSERT_TRUE(response.body.find("{\"name\":\"loop\",\"count\":0,") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("GET /data") == std::string::npos);
+
+  // Percentiles are bucket upper bounds, capped at the maximum; halving the full buckets keeps them
+  profileReset();
+  for (uint32_t cycles = 1; cycles <= 1000; cycles++) {
+    profileRecord(PROFILE_CAN_READ, cycles);
+  }
+  const ProfileStats &stats = profileGetStats(PROFILE_CAN_READ);
+  TEST_ASSERT_EQUAL(511, profilePercentile(stats, 0.5f));
+  TEST_ASSERT_EQUAL(1000, profilePercentile(stats, 0.99f));
+  for (uint32_t i = 0; i < 200000; i++) {
+    profileRecord(PROFILE_CAN_READ, 10);
+  }
+  TEST_ASSERT_EQUAL(201000, stats.count);
+  TEST_ASSERT_EQUAL(11, profilePercentile(stats, 0.99f));
+  TEST_ASSERT_EQUAL(1000, profilePercentile(stats, 1.0f));
+  profileReset();
+}
+
+static uint32_t fakeSeconds = 20000UL * 86400 + 3600;  // 2024-10-04 01:00 UTC
+static uint32_t fakeClock() {
+  return fakeSeconds;
+}
+
+void test_energy_is_metered_and_journaled() {
+  LittleFS.remove("/energy0.jnl");
+  LittleFS.remove("/energy1.jnl");
+  LittleFS.remove("/energy_days.bin");
+  energyBegin(fakeClock);
+  runFor(2000);
+  float voltage = bankValue(0x01, OUTPUT_VOLTAGE);
+  float current = bankValue(0x01, OUTPUT_CURRENT);
+  double wh = energyFind(0x01)->wh, ah = energyFind(0x01)->ah;
+  runFor(60000, 2000);
+  TEST_ASSERT_FLOAT_WITHIN(voltage * current / 60 * 0.01f, voltage * current / 60, energyFind(0x01)->wh - wh);
+  TEST_ASSERT_FLOAT_WITHIN(current / 60 * 0.01f, current / 60, energyFind(0x01)->ah - ah);
+  TEST_ASSERT_EQUAL(1, energyGetStats().checkpoints);
+
+  // Midnight closes the day
+  float todayWh = energyFind(0x01)->todayWh;
+  fakeSeconds += 86400;
+  runFor(1000);
+  TEST_ASSERT_EQUAL(20000, energyDayAt(0).day);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, todayWh, energyDayAt(0).units[0].wh);
+  TEST_ASSERT_TRUE(energyFind(0x01)->todayWh < 0.1f);
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/energy");
+  TEST_ASSERT_TRUE(response.body.find("{\"today\":\"2024-10-05\",") == 0);
+  TEST_ASSERT_TRUE(response.body.find("\"days\":[{\"day\":\"2024-10-04\",") != std::string::npos);
+
+  // Checkpoints are only appended, alternating between the two files
+  uint32_t written = LittleFS.nativeBytesWritten;
+  for (int i = 0; i < 40; i++) {
+    runFor(200);
+    energyCheckpoint();
+  }
+  TEST_ASSERT_EQUAL(40 * sizeof(EnergyCheckpoint), LittleFS.nativeBytesWritten - written);
+  File journal = LittleFS.open("/energy0.jnl", "r");
+  TEST_ASSERT_TRUE(journal.size() <= ENERGY_JOURNAL_RECORDS * sizeof(EnergyCheckpoint));
+
+  // A reboot restores the newest record, also past a torn write
+  wh = energyFind(0x01)->wh;
+  uint32_t sequence = energyGetStats().sequence;
+  for (const char *path : {"/energy0.jnl", "/energy1.jnl"}) {
+    // Half a record after whichever file was written last
+    File torn = LittleFS.open(path, "a");
+    torn.write((const uint8_t *)"R48J\xff\xff", 6);
+  }
+  energyBegin(fakeClock);
+  TEST_ASSERT_EQUAL(sequence, energyGetStats().sequence);
+  TEST_ASSERT_TRUE(wh == energyFind(0x01)->wh);
+  TEST_ASSERT_EQUAL(20000, energyDayAt(0).day);
+  // The integration restarts after the reboot and needs two samples of a unit before anything is metered
+  runFor(2000);
+  energyCheckpoint();
+  energyBegin(fakeClock);
+  TEST_ASSERT_EQUAL(sequence + 1, energyGetStats().sequence);
+
+  energyBegin(wallClockSeconds);
+}
+
+void test_wifi_reconnects_with_backoff() {
+  // Polling started before the network was up, within the first few loop passes
+  TEST_ASSERT_TRUE(metricsBootTime(BOOT_NETWORK) >= 0 && metricsBootTime(BOOT_NETWORK) < 10);
+  TEST_ASSERT_TRUE(metricsBootTime(BOOT_FIRST_MEASUREMENT) >= 0 && metricsBootTime(BOOT_FIRST_MEASUREMENT) < 100);
+  TEST_ASSERT_TRUE(wifiLinkConnected());
+
+  // The access point goes away: each attempt times out, the wait doubles, then the fallback AP opens
+  WiFi.nativeNetworkUp = false;
+  WiFi.nativeStatus = WL_CONNECTION_LOST;
+  uint32_t answered = pollSchedulerGetStats().responses;
+  runFor(100);
+  WifiLinkStatus status = wifiLinkGetStatus();
+  TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTING, status.state);
+  TEST_ASSERT_EQUAL(1, status.disconnects);
+  TEST_ASSERT_EQUAL(HIGH, digitalRead(LED_BUILTIN));
+  runFor(WIFI_LINK_CONNECT_TIMEOUT);
+  status = wifiLinkGetStatus();
+  TEST_ASSERT_EQUAL(WIFI_LINK_BACKOFF, status.state);
+  TEST_ASSERT_EQUAL(WIFI_LINK_BACKOFF_MIN - 100, status.retryIn);
+  runFor(2 * WIFI_LINK_CONNECT_TIMEOUT + 3 * WIFI_LINK_BACKOFF_MIN, 2000);
+  status = wifiLinkGetStatus();
+  TEST_ASSERT_EQUAL(WIFI_LINK_AP_FALLBACK_FAILURES, status.failures);
+  TEST_ASSERT_EQUAL(4 * WIFI_LINK_BACKOFF_MIN - 100, status.retryIn);
+  TEST_ASSERT_TRUE(status.fallbackAp);
+  TEST_ASSERT_EQUAL(WIFI_AP_STA, WiFi.getMode());
+  TEST_ASSERT_TRUE(pollSchedulerGetStats().responses > answered + 200);
+
+  // Back: the next attempt connects and closes the fallback AP
+  WiFi.nativeNetworkUp = true;
+  runFor(4 * WIFI_LINK_BACKOFF_MIN);
+  status = wifiLinkGetStatus();
+  TEST_ASSERT_EQUAL(WIFI_LINK_CONNECTED, status.state);
+  TEST_ASSERT_FALSE(status.fallbackAp);
+  TEST_ASSERT_EQUAL(WIFI_STA, WiFi.getMode());
+  TEST_ASSERT_EQUAL(5, status.attempts);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(LED_BUILTIN));
+
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/wifi");
+  TEST_ASSERT_TRUE(response.body.find("{\"state\":\"connected\",\"fallbackAp\":false,") == 0);
+  response = server.nativeRequest(HTTP_GET, "/metrics");
+  TEST_ASSERT_TRUE(response.body.find("r48_boot_first_measurement_seconds 0.0") != std::string::npos);
+}
+
+void test_data_bin_carries_raw_values() {
+  runFor(1000);
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/data.bin");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_EQUAL(sizeof(DataBinaryHeader) + 2 * sizeof(DataBinaryUnit), response.body.size());
+  DataBinaryHeader header;
+  memcpy(&header, response.body.data(), sizeof(header));
+  TEST_ASSERT_EQUAL_MEMORY("R48T", header.magic, 4);
+  TEST_ASSERT_EQUAL(DATA_BINARY_VERSION, header.version);
+  TEST_ASSERT_EQUAL(2, header.unitCount);
+  TEST_ASSERT_EQUAL(dataSnapshotVersion(), header.sequence);
+  TEST_ASSERT_EQUAL(millis(), header.uptimeMs);
+  TEST_ASSERT_EQUAL(0, header.flags);
+
+  // Bit-exact, unlike the two decimals of /data
+  DataBinaryUnit unit;
+  memcpy(&unit, response.body.data() + header.headerSize + header.unitSize, sizeof(unit));
+  const Rectifier *rectifier = rectifierFind(unit.address);
+  TEST_ASSERT_NOT_NULL(rectifier);
+  TEST_ASSERT_EQUAL_MEMORY(rectifier->values, unit.values, sizeof(unit.values));
+  TEST_ASSERT_EQUAL(0x1F, unit.validMask);
+  TEST_ASSERT_EQUAL(rectifierValueAge(*rectifier, 0), unit.ageMs[0]);
+  TEST_ASSERT_TRUE(unit.ageMs[measurementSlot(OUTPUT_CURRENT)] < 250);
+
+  // Streamed: whole frames, one per interval
+  unsigned long start = millis();
+  response = server.nativeRequest(HTTP_GET, "/data.bin?interval=500&count=3");
+  TEST_ASSERT_EQUAL(3 * (sizeof(DataBinaryHeader) + 2 * sizeof(DataBinaryUnit)), response.body.size());
+  TEST_ASSERT_EQUAL(3, response.chunks);
+  memcpy(&header, response.body.data() + 2 * (sizeof(DataBinaryHeader) + 2 * sizeof(DataBinaryUnit)), sizeof(header));
+  TEST_ASSERT_EQUAL(start + 1000, header.uptimeMs);
+
+  // A negative or non-numeric interval or count would wrap to a stream that never ends
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_GET, "/data.bin?interval=-500").code);
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_GET, "/data.bin?interval=500&count=-1").code);
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_GET, "/data.bin?interval=fast").code);
+}
+
+void test_settings_batch_is_applied_and_confirmed() {
+  // One bad field rejects the whole profile
+  uint32_t writes = bank().writes;
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/settings",
+    {{"permanent_voltage", "54.0"}, {"walk_in_time", "300"}, {"fan_speed", "fast"}, {"colour", "red"}});
+  TEST_ASSERT_EQUAL(400, response.code);
+  TEST_ASSERT_TRUE(response.body.find("\"walk_in_time\":") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"fan_speed\":") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"colour\":\"unknown setting\"") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("permanent_voltage") == std::string::npos);
+  runFor(100);
+  TEST_ASSERT_EQUAL(writes, bank().writes);
+
+  // Field names from the request are escaped, in the same body /config answers with
+  response = server.nativeRequest(HTTP_POST, "/settings", {{"a\"b", "1"}});
+  TEST_ASSERT_EQUAL(400, response.code);
+  TEST_ASSERT_EQUAL_STRING("{\"errors\":{\"a\\\"b\":\"unknown setting\"}}", response.body.c_str());
+  TEST_ASSERT_EQUAL(SETTINGS_BATCH_IDLE, settingsBatchState());
+
+  // Six permanent settings for both units: more writes than the tracker holds at once
+  uint32_t sent = commandQueueGetStats().sent - setpointKeepaliveGetStats().refreshes;
+  response = server.nativeRequest(HTTP_POST, "/settings",
+    {{"permanent_voltage", "54.0"}, {"permanent_current_limit", "0.9"}, {"max_input_current", "10"},
+     {"fan_speed", "full"}, {"walk_in", "on"}, {"walk_in_time", "60"}});
+  TEST_ASSERT_EQUAL(202, response.code);
+  TEST_ASSERT_EQUAL(SETTINGS_BATCH_RUNNING, settingsBatchState());
+  TEST_ASSERT_EQUAL(409, server.nativeRequest(HTTP_POST, "/settings", {{"walk_in", "off"}}).code);
+
+  runFor(5000);
+  TEST_ASSERT_EQUAL(SETTINGS_BATCH_CONFIRMED, settingsBatchState());
+  TEST_ASSERT_EQUAL(sent + 12, commandQueueGetStats().sent - setpointKeepaliveGetStats().refreshes);
+  for (byte address = 0x01; address <= 0x02; address++) {
+    // Stored, under the online setpoints left by the earlier tests
+    float value;
+    TEST_ASSERT_TRUE(bank().readRegister(address, SET_PERMANENT_VOLTAGE_CMD, value));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 54.0f, value);
+    TEST_ASSERT_TRUE(bank().readRegister(address, SET_PERMANENT_CURRENT_LIMIT_CMD, value));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.9f, value);
+    TEST_ASSERT_TRUE(bank().readRegister(address, 0x29, value));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 60.0f, value);
+  }
+
+  response = server.nativeRequest(HTTP_GET, "/settings");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find("\"state\":\"confirmed\",") == 1);
+  TEST_ASSERT_TRUE(response.body.find("\"value\":\"full\",\"state\":\"confirmed\"") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("failed") == std::string::npos);
+}
+
+void test_online_setpoints_are_kept_alive() {
+  // The simulated units now drop an online setpoint they have not heard for 3 s
+  bank().onlineHoldMs = 3000;
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_POST, "/keepalive", {{"period", "500"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/keepalive", {{"period", "2000"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/set_online_v", {{"value", "51.0"}}).code);
+
+  // Both units hold the same voltage: one broadcast frame refreshes them
+  SetpointKeepaliveStats before = setpointKeepaliveGetStats();
+  runFor(10000);
+  SetpointKeepaliveStats after = setpointKeepaliveGetStats();
+  for (byte address = 0x01; address <= 0x02; address++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 51.0f, bank().setpointVoltage(*bank().unit(address)));
+  }
+  TEST_ASSERT_TRUE(after.broadcasts - before.broadcasts >= 5);
+  TEST_ASSERT_EQUAL(4, setpointKeepaliveCount());
+  for (uint8_t i = 0; i < setpointKeepaliveCount(); i++) {
+    TEST_ASSERT_TRUE(millis() - setpointKeepaliveAt(i).writtenAt < 2000);
+  }
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/keepalive");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find("\"setting\":\"online_voltage\",\"value\":51.000,\"ageMs\":") != std::string::npos);
+
+  // Without grouping every unit gets its own frame
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/keepalive", {{"group", "off"}}).code);
+  before = setpointKeepaliveGetStats();
+  runFor(4000);
+  after = setpointKeepaliveGetStats();
+  TEST_ASSERT_EQUAL(before.broadcasts, after.broadcasts);
+  TEST_ASSERT_TRUE(after.refreshes - before.refreshes >= 8);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 51.0f, bank().setpointVoltage(*bank().unit(0x01)));
+
+  // Switched off, the units fall back to the permanent voltage of the settings batch
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/keepalive", {{"period", "0"}}).code);
+  runFor(5000);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 54.0f, bank().setpointVoltage(*bank().unit(0x01)));
+
+  server.nativeRequest(HTTP_POST, "/keepalive", {{"period", "10000"}, {"group", "on"}});
+  bank().onlineHoldMs = 0;
+}
+
+static bool readConfigSlot(const char *path, ConfigBlob &blob) {
+  File file = LittleFS.open(path, "r");
+  return file && file.read((uint8_t *)&blob, sizeof(blob)) == sizeof(blob);
+}
+
+static void writeConfigSlot(const char *path, const ConfigBlob &blob) {
+  File file = LittleFS.open(path, "w");
+  TEST_ASSERT_EQUAL(sizeof(blob), file.write((const uint8_t *)&blob, sizeof(blob)));
+}
+
+void test_config_is_stored_and_restored() {
+  // One bad field rejects the whole request
+  ConfigValues before = configStoreGet();
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/config",
+    {{"poll_temperature", "10"}, {"online_voltage_max", "70"}, {"ap_password", "short"}, {"wifi_mode", "mesh"}});
+  TEST_ASSERT_EQUAL(400, response.code);
+  TEST_ASSERT_EQUAL(0, response.body.find("{\"errors\":{"));
+  for (const char *field : {"poll_temperature", "online_voltage_min", "ap_password", "wifi_mode"}) {
+    TEST_ASSERT_TRUE(response.body.find("\"" + std::string(field) + "\":") != std::string::npos);
+  }
+  TEST_ASSERT_EQUAL_MEMORY(&before, &configStoreGet(), sizeof(before));
+
+  // Applied at once: the safe range, the poll schedule; then written to the other slot
+  ConfigStoreStats stats = configStoreGetStats();
+  response = server.nativeRequest(HTTP_POST, "/config",
+    {{"online_voltage_min", "48"}, {"online_voltage_max", "54"}, {"poll_temperature", "2000"}, {"ssid", "lab \"2\""}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(50);
+  ConfigStoreStats after = configStoreGetStats();
+  TEST_ASSERT_EQUAL(stats.writes + 1, after.writes);
+  TEST_ASSERT_EQUAL(stats.sequence + 1, after.sequence);
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_POST, "/set_online_v", {{"value", "47"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/set_online_v", {{"value", "50"}}).code);
+  TEST_ASSERT_TRUE(pollSchedulerToJson().indexOf("\"register\":\"0x04\",\"periodMs\":2000,") >= 0);
+  response = server.nativeRequest(HTTP_GET, "/config");
+  TEST_ASSERT_TRUE(response.body.find("\"ssid\":\"lab \\\"2\\\"\"") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"online_voltage\":{\"min\":48.000,\"max\":54.000}") != std::string::npos);
+
+  // The blob in flash carries the state to boot from
+  const char *newest = after.slot ? "/config1.bin" : "/config0.bin";
+  const char *older = after.slot ? "/config0.bin" : "/config1.bin";
+  ConfigBlob blob;
+  TEST_ASSERT_TRUE(readConfigSlot(newest, blob));
+  TEST_ASSERT_EQUAL_MEMORY("R48C", blob.magic, 4);
+  TEST_ASSERT_EQUAL(after.sequence, blob.sequence);
+  TEST_ASSERT_EQUAL(2, blob.unitCount);
+  TEST_ASSERT_EQUAL(setpointKeepaliveCount(), blob.setpointCount);
+
+  // A torn write of the next blob leaves this one in place
+  runFor(60000);
+  server.nativeRequest(HTTP_POST, "/config", {{"poll_temperature", "3000"}});
+  runFor(50);
+  ConfigBlob torn;
+  TEST_ASSERT_TRUE(readConfigSlot(older, torn));
+  TEST_ASSERT_TRUE(torn.sequence > blob.sequence);
+  torn.config.pollPeriods[0] ^= 1;
+  writeConfigSlot(older, torn);
+  ConfigValues defaults = configStoreGet();
+  configStoreBegin(defaults, onConfigChange);
+  TEST_ASSERT_EQUAL(blob.sequence, configStoreGetStats().sequence);
+  TEST_ASSERT_EQUAL(2000, configStoreGet().pollPeriods[measurementSlot(TEMPERATURE)]);
+
+  // Booting from a blob that lists a unit: shown with its last values until it would have answered
+  blob.units[blob.unitCount] = {0x07, 0x1F, {53.25f, 12.5f, 0.8f, 31.0f, 230.0f}};
+  blob.unitCount++;
+  blob.setpoints[blob.setpointCount++] = {0x07, SETTING_ONLINE_VOLTAGE, 52.0f};
+  blob.sequence = torn.sequence + 1;
+  blob.crc = checksumCrc32(&blob, offsetof(ConfigBlob, crc));
+  writeConfigSlot(older, blob);
+  configStoreBegin(defaults, onConfigChange);
+  configStoreRestoreState();
+  TEST_ASSERT_EQUAL(blob.sequence, configStoreGetStats().sequence);
+  Rectifier *cached = rectifierFind(0x07);
+  TEST_ASSERT_NOT_NULL(cached);
+  TEST_ASSERT_EQUAL(0x1F, cached->cachedMask);
+  TEST_ASSERT_EQUAL(0, rectifierFind(0x01)->cachedMask);
+  // Shown, but without an age: neither the charger nor /data.bin take them for fresh
+  TEST_ASSERT_EQUAL(0xFFFFFFFF, rectifierValueAge(*cached, measurementSlot(OUTPUT_VOLTAGE)));
+  runFor(500);
+  response = server.nativeRequest(HTTP_GET, "/data.bin");
+  DataBinaryHeader binaryHeader;
+  memcpy(&binaryHeader, response.body.data(), sizeof(binaryHeader));
+  bool found = false;
+  for (uint8_t u = 0; u < binaryHeader.unitCount; u++) {
+    DataBinaryUnit unit;
+    memcpy(&unit, response.body.data() + binaryHeader.headerSize + u * binaryHeader.unitSize, sizeof(unit));
+    if (unit.address == 0x07) {
+      found = true;
+      TEST_ASSERT_EQUAL(0x1F, unit.cachedMask);
+      TEST_ASSERT_EQUAL(DATA_BINARY_NO_AGE, unit.ageMs[measurementSlot(OUTPUT_CURRENT)]);
+    } else {
+      TEST_ASSERT_EQUAL(0, unit.cachedMask);
+    }
+  }
+  TEST_ASSERT_TRUE(found);
+  response = server.nativeRequest(HTTP_GET, "/data");
+  TEST_ASSERT_TRUE(response.body.find("{\"address\":7,\"outputVoltage\":53.25,") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"cached\":true") != std::string::npos);
+  bool kept = false;
+  for (uint8_t i = 0; i < setpointKeepaliveCount(); i++) {
+    kept |= setpointKeepaliveAt(i).unit == 0x07;
+  }
+  TEST_ASSERT_TRUE(kept);
+  runFor(RECTIFIER_TIMEOUT + 1000);
+  TEST_ASSERT_NULL(rectifierFind(0x07));
+  TEST_ASSERT_EQUAL(2, rectifierCount());
+
+  // A change whose write failed is written once the flash takes writes again
+  ConfigStoreStats beforeFailure = configStoreGetStats();
+  LittleFS.nativeWriteFails = true;
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/config", {{"poll_temperature", "3000"}}).code);
+  runFor(3000);
+  TEST_ASSERT_TRUE(configStoreGetStats().writeErrors > beforeFailure.writeErrors);
+  TEST_ASSERT_EQUAL(beforeFailure.sequence, configStoreGetStats().sequence);
+  LittleFS.nativeWriteFails = false;
+  runFor(CONFIG_STORE_RETRY_DELAY + 100);
+  TEST_ASSERT_EQUAL(beforeFailure.sequence + 1, configStoreGetStats().sequence);
+  ConfigBlob retried;
+  TEST_ASSERT_TRUE(readConfigSlot(configStoreGetStats().slot == 0 ? "/config0.bin" : "/config1.bin", retried));
+  TEST_ASSERT_EQUAL(3000, retried.config.pollPeriods[measurementSlot(TEMPERATURE)]);
+
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/config", {{"reset", "1"}}).code);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 41.0f, r48SettingMin(R48_SETTINGS[SETTING_ONLINE_VOLTAGE]));
+}
+
+void test_registers_are_discovered_and_polled() {
+  // A status word the firmware has no name for, different on each unit
+  const byte STATUS = 0x40;
+  for (byte address = 0x01; address <= 0x02; address++) {
+    R48SimUnit &unit = *bank().unit(address);
+    const byte word[4] = {0x00, 0x00, 0x00, address == 0x01 ? (byte)0x05 : (byte)0x00};
+    memcpy(unit.stored[STATUS], word, 4);
+    unit.known[STATUS] = true;
+  }
+  bank().unit(0x02)->stored[STATUS][2] = 0x10;
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x40"}, {"period", "200"}}).code);
+  TEST_ASSERT_EQUAL(404, server.nativeRequest(HTTP_GET, "/reg/0x40").code);
+
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_POST, "/reg", {{"discover", "start"}, {"gap", "1"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/reg", {{"discover", "start"}, {"gap", "20"}}).code);
+  runFor(256 * 20 + 1000);
+  RegisterCacheStats stats = registerCacheGetStats();
+  TEST_ASSERT_FALSE(stats.sweeping);
+  TEST_ASSERT_EQUAL(1, stats.sweeps);
+  TEST_ASSERT_EQUAL(256, stats.requests);
+  TEST_ASSERT_EQUAL(REGISTER_TYPE_WORD, registerCacheInfo(STATUS).type);
+  TEST_ASSERT_EQUAL(REGISTER_TYPE_FLOAT, registerCacheInfo(0x29).type);
+  TEST_ASSERT_EQUAL(REGISTER_TYPE_FLOAT, registerCacheInfo(OUTPUT_VOLTAGE).type);
+  TEST_ASSERT_EQUAL(0, registerCacheInfo(0x80).answers);
+
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/reg");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find("{\"id\":\"0x40\",\"type\":\"word\",") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("\"0x80\"") == std::string::npos);
+  // The walk-in time, as the settings batch left it
+  const byte *walkIn = bank().unit(0x01)->stored[0x29];
+  char expected[64];
+  snprintf(expected, sizeof(expected), "{\"unit\":1,\"raw\":\"0x%02X%02X%02X%02X\",\"value\":%.3f,",
+           walkIn[0], walkIn[1], walkIn[2], walkIn[3], r48GetFloat(walkIn));
+  response = server.nativeRequest(HTTP_GET, "/reg/0x29");
+  TEST_ASSERT_EQUAL(200, response.code);
+  TEST_ASSERT_TRUE(response.body.find(expected) != std::string::npos);
+  response = server.nativeRequest(HTTP_GET, "/reg/64");
+  TEST_ASSERT_TRUE(response.body.find("{\"unit\":1,\"raw\":\"0x00000005\",\"value\":5,") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("{\"unit\":2,\"raw\":\"0x00001000\",\"value\":4096,") != std::string::npos);
+  TEST_ASSERT_EQUAL(404, server.nativeRequest(HTTP_GET, "/reg/0x80").code);
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_GET, "/reg/0x100").code);
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_GET, "/reg/status").code);
+
+  // Polled on every unit, after the measurements
+  TEST_ASSERT_EQUAL(400, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "1"}, {"period", "200"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x40"}, {"period", "200"}}).code);
+  bank().unit(0x01)->stored[STATUS][3] = 0x07;
+  runFor(1000);
+  response = server.nativeRequest(HTTP_GET, "/reg/0x40");
+  TEST_ASSERT_TRUE(response.body.find("\"pollMs\":200,") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("{\"unit\":1,\"raw\":\"0x00000007\",\"value\":7,\"ageMs\":") != std::string::npos);
+  std::string schedule = pollSchedulerToJson().c_str();
+  TEST_ASSERT_TRUE(schedule.find("{\"unit\":2,\"register\":\"0x40\",\"periodMs\":200,\"priority\":5,") != std::string::npos);
+  response = server.nativeRequest(HTTP_GET, "/metrics");
+  TEST_ASSERT_TRUE(response.body.find("r48_register_value{unit=\"1\",register=\"0x40\"} 7.000") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("r48_register_sweep_requests_total 256") != std::string::npos);
+
+  // A unit found later polls it too; period 0 stops
+  onConfigChange();
+  TEST_ASSERT_TRUE(std::string(pollSchedulerToJson().c_str()).find("\"register\":\"0x40\"") != std::string::npos);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x40"}, {"period", "0"}}).code);
+  TEST_ASSERT_TRUE(std::string(pollSchedulerToJson().c_str()).find("\"register\":\"0x40\"") == std::string::npos);
+  TEST_ASSERT_EQUAL(0, registerCacheGetStats().polled);
+}
+
+void test_energy_counts_unit_zero() {
+  // 0x00 is the rectifiers' default address, not a free slot
+  LittleFS.remove("/energy0.jnl");
+  LittleFS.remove("/energy1.jnl");
+  energyBegin(wallClockSeconds);
+  bank().addUnit(0x00).loadCurrent = 10.0f;
+  bank().unit(0x01)->loadCurrent = 5.0f;
+  runFor(15000, 2000);
+  TEST_ASSERT_NOT_NULL(rectifierFind(0x00));
+  const EnergyUnit *zero = energyFind(0x00);
+  const EnergyUnit *one = energyFind(0x01);
+  TEST_ASSERT_NOT_NULL(zero);
+  TEST_ASSERT_NOT_NULL(one);
+  TEST_ASSERT_TRUE(zero != one);
+  TEST_ASSERT_EQUAL(0x00, zero->address);
+  TEST_ASSERT_TRUE(zero->wh > 0);
+  double wh = zero->wh;
+  runFor(5000, 2000);
+  TEST_ASSERT_TRUE(energyFind(0x00)->wh > wh);
+
+  NativeResponse response = server.nativeRequest(HTTP_GET, "/energy");
+  TEST_ASSERT_TRUE(response.body.find("{\"address\":0,\"wh\":") != std::string::npos);
+  TEST_ASSERT_TRUE(response.body.find("{\"address\":1,\"wh\":") != std::string::npos);
+  response = server.nativeRequest(HTTP_GET, "/metrics");
+  TEST_ASSERT_TRUE(response.body.find("r48_energy_wh_total{unit=\"0\"}") != std::string::npos);
+
+  // And it comes back from the journal
+  wh = energyFind(0x00)->wh;
+  energyCheckpoint();
+  energyBegin(wallClockSeconds);
+  TEST_ASSERT_NOT_NULL(energyFind(0x00));
+  TEST_ASSERT_TRUE(wh == energyFind(0x00)->wh);
+
+  bank().setAnswering(0x00, false);
+  runFor(RECTIFIER_TIMEOUT + 1000, 2000);
+  TEST_ASSERT_NULL(rectifierFind(0x00));
+}
+
+void test_full_bank_polls_every_register() {
+  // Eight units, each polling two registers on top of its five measurements
+  for (byte address = 0x04; address <= 0x09; address++) {
+    bank().addUnit(address);
+  }
+  runFor(12000, 2000);
+  TEST_ASSERT_EQUAL(MAX_RECTIFIERS, rectifierCount());
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x24"}, {"period", "1000"}}).code);
+  TEST_ASSERT_EQUAL(200, server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x29"}, {"period", "1000"}}).code);
+  // Rescheduled unit by unit, the earlier units' registers leave room for the later units' measurements
+  onConfigChange();
+  runFor(3000);
+  TEST_ASSERT_EQUAL(0, pollSchedulerGetStats().rejected);
+  for (uint8_t i = 0; i < rectifierCount(); i++) {
+    byte address = rectifierAt(i).address;
+    for (byte measurement = OUTPUT_VOLTAGE; measurement <= SUPPLY_VOLTAGE; measurement++) {
+      TEST_ASSERT_TRUE(pollSchedulerAge(address, measurement) < 3000);
+    }
+    TEST_ASSERT_TRUE(pollSchedulerAge(address, 0x24) < 2000);
+    TEST_ASSERT_TRUE(pollSchedulerAge(address, 0x29) < 2000);
+  }
+
+  server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x24"}, {"period", "0"}});
+  server.nativeRequest(HTTP_POST, "/reg", {{"poll", "0x29"}, {"period", "0"}});
+  for (byte address = 0x04; address <= 0x09; address++) {
+    bank().setAnswering(address, false);
+  }
+  runFor(RECTIFIER_TIMEOUT + 1000, 2000);
+  TEST_ASSERT_EQUAL(2, rectifierCount());
+}
+
+void test_hw_overflows_are_counted() {
+  uint32_t before = canRxGetStats().hwOverflows;
+  byte data[8] = {0x41, R48_CONTROLLER_ADDRESS, 0x00, OUTPUT_VOLTAGE};
+  r48PutFloat(&data[4], 53.5f);
+  // Three answers at once: the third finds both receive buffers full.
+  for (uint8_t burst = 0; burst < 2; burst++) {
+    for (uint8_t i = 0; i < 3; i++) {
+      CAN0.nativeInject(r48ResponseId(0x01), 8, data);
+    }
+    runFor(100);
+  }
+  TEST_ASSERT_EQUAL(before + 2, canRxGetStats().hwOverflows);
+
+  NativeResponse metrics = server.nativeRequest(HTTP_GET, "/metrics");
+  char expected[48];
+  snprintf(expected, sizeof(expected), "r48_can_rx_hw_overflows_total %u\n", (unsigned)(before + 2));
+  TEST_ASSERT_TRUE(metrics.body.find(expected) != std::string::npos);
+}
+
+void test_slow_event_client_catches_up() {
+  AsyncEventSourceClient *fast = server.nativeConnectEvents("/events");
+  AsyncEventSourceClient *slow = server.nativeConnectEvents("/events");
+  TEST_ASSERT_NOT_NULL(slow);
+  runFor(500);
+
+  // A client with a backlog is skipped without holding back the others
+  slow->nativePacketsWaiting = LIVE_PUSH_MAX_BACKLOG + 1;
+  size_t fastEvents = fast->nativeEvents.size();
+  size_t slowEvents = slow->nativeEvents.size();
+  bank().setLoad(0x01, 6.0f);
+  runFor(1000);
+  TEST_ASSERT_TRUE(fast->nativeEvents.size() > fastEvents);
+  TEST_ASSERT_EQUAL_STRING("delta", fast->nativeEvents.back().event.c_str());
+  TEST_ASSERT_EQUAL(slowEvents, slow->nativeEvents.size());
+
+  // Once it has drained it catches up with a snapshot
+  slow->nativePacketsWaiting = 0;
+  runFor(500);
+  TEST_ASSERT_TRUE(slow->nativeEvents.size() > slowEvents);
+  TEST_ASSERT_EQUAL_STRING("snapshot", slow->nativeEvents[slowEvents].event.c_str());
+  TEST_ASSERT_TRUE(slow->nativeEvents[slowEvents].data.find("\"outputCurrent\":6.00") != std::string::npos);
+}
+
+void test_energy_follows_slow_polling() {
+  NativeResponse response = server.nativeRequest(HTTP_POST, "/config",
+                                                 {{"poll_output_voltage", "10000"}, {"poll_output_current", "10000"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(12000, 2000);
+  double wh = energyFind(0x01)->wh;
+  uint32_t gaps = energyGetStats().gaps;
+  runFor(30000, 2000);
+  TEST_ASSERT_TRUE(energyFind(0x01)->wh > wh);
+  TEST_ASSERT_EQUAL(gaps, energyGetStats().gaps);
+
+  response = server.nativeRequest(HTTP_POST, "/config", {{"poll_output_voltage", "1000"}, {"poll_output_current", "200"}});
+  TEST_ASSERT_EQUAL(200, response.code);
+  runFor(2000);
+}
+
+void test_discovery_leaves_the_filters_alone() {
+  uint32_t reprograms = canFilterReprograms();
+  uint8_t count = rectifierCount();
+  // Two discovery requests, each answered by every unit
+  runFor(25000, 2000);
+  TEST_ASSERT_EQUAL(reprograms, canFilterReprograms());
+  TEST_ASSERT_EQUAL(count, rectifierCount());
+}
+
+// Records when the controller sends point-to-point read requests.
+class ReadRequestLog : public NativeCanNode {
+public:
+  void onFrame(unsigned long id, byte len, const byte *data) override {
+    R48Id decoded;
+    if (recording && r48DecodeId(id, decoded) && decoded.pointToPoint && len == 8 && data[0] == 0x01) {
+      times.push_back(millis());
+    }
+  }
+  bool recording = false;
+  std::vector<unsigned long> times;
+};
+
+void test_retries_keep_the_request_gap() {
+  static ReadRequestLog requests;
+  static bool attached = false;
+  if (!attached) {
+    CAN0.nativeAttach(&requests);
+    attached = true;
+  }
+  uint32_t retries = pollSchedulerGetStats().retries;
+  // Keep the bus busy, so answers free request slots just before unanswered requests expire
+  pollSchedulerCapPeriod(OUTPUT_CURRENT_LIMIT, 10);
+  pollSchedulerCapPeriod(SUPPLY_VOLTAGE, 10);
+  bank().setAnswering(0x02, false);
+  requests.recording = true;
+  runFor(3000, 2000);
+  requests.recording = false;
+  bank().setAnswering(0x02, true);
+  pollSchedulerCapPeriod(OUTPUT_CURRENT_LIMIT, 0);
+  pollSchedulerCapPeriod(SUPPLY_VOLTAGE, 0);
+  runFor(2000);
+
+  TEST_ASSERT_TRUE(pollSchedulerGetStats().retries > retries);
+  TEST_ASSERT_TRUE(requests.times.size() > 10);
+  for (size_t i = 1; i < requests.times.size(); i++) {
+    TEST_ASSERT_TRUE(requests.times[i] - requests.times[i - 1] >= POLL_MIN_REQUEST_GAP);
+  }
+}
+
+int main(int argc, char **argv) {
+  bank().addUnit(0x01);
+  bank().addUnit(0x02);
+  bank().addUnit(0x03);
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_discovery_finds_every_unit);
+  RUN_TEST(test_measurements_follow_the_load);
+  RUN_TEST(test_data_is_served_with_an_etag);
+  RUN_TEST(test_online_voltage_is_applied);
+  RUN_TEST(test_out_of_range_setting_is_rejected);
+  RUN_TEST(test_permanent_setting_is_confirmed_by_read_back);
+  RUN_TEST(test_current_limit_caps_the_output);
+  RUN_TEST(test_live_events_start_with_a_snapshot);
+  RUN_TEST(test_silent_unit_is_dropped);
+  RUN_TEST(test_metrics_are_exported);
+  RUN_TEST(test_capture_records_the_traffic);
+  RUN_TEST(test_capture_rotates_by_size);
+  RUN_TEST(test_charger_runs_cc_cv_and_float);
+  RUN_TEST(test_udp_setpoints_and_watchdog);
+  RUN_TEST(test_profile_covers_loop_can_and_routes);
+  RUN_TEST(test_energy_is_metered_and_journaled);
+  RUN_TEST(test_wifi_reconnects_with_backoff);
+  RUN_TEST(test_data_bin_carries_raw_values);
+  RUN_TEST(test_settings_batch_is_applied_and_confirmed);
+  RUN_TEST(test_online_setpoints_are_kept_alive);
+  RUN_TEST(test_config_is_stored_and_restored);
+  RUN_TEST(test_registers_are_discovered_and_polled);
+  RUN_TEST(test_energy_counts_unit_zero);
+  RUN_TEST(test_full_bank_polls_every_register);
+  RUN_TEST(test_hw_overflows_are_counted);
+  RUN_TEST(test_slow_event_client_catches_up);
+  RUN_TEST(test_energy_follows_slow_polling);
+  RUN_TEST(test_discovery_leaves_the_filters_alone);
+  RUN_TEST(test_retries_keep_the_request_gap);
+  return UNITY_END();
+}
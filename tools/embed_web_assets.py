@@ -0,0 +1,119 @@
+"""Embeds the web UI in web/ into the firmware as gzipped PROGMEM arrays.
+
+Runs as a PlatformIO pre-build script (see extra_scripts in platformio.ini)
+and can also be run by hand: python tools/embed_web_assets.py
+
+Every file in web/ is gzipped and written to include/web_assets.h together
+with its content type and a content hash. References to style.css and
+app.js in index.html are rewritten to hashed names (style.<hash>.css), so
+those assets can be cached forever; the page itself is revalidated with
+its ETag.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "include", "web_assets.h")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+
+# Served from a fixed URL and revalidated; everything else gets a hashed, immutable URL.
+ENTRY_PAGE = "index.html"
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def hashed_name(name, digest):
+    stem, ext = os.path.splitext(name)
+    return "%s.%s%s" % (stem, digest, ext)
+
+
+def load_assets():
+    names = sorted(n for n in os.listdir(WEB_DIR) if os.path.splitext(n)[1] in CONTENT_TYPES)
+    if ENTRY_PAGE not in names:
+        raise SystemExit("embed_web_assets: %s not found in %s" % (ENTRY_PAGE, WEB_DIR))
+
+    assets = []
+    renames = {}
+    for name in names:
+        if name == ENTRY_PAGE:
+            continue
+        with open(os.path.join(WEB_DIR, name), "rb") as f:
+            data = f.read()
+        digest = content_hash(data)
+        renames[name] = hashed_name(name, digest)
+        assets.append(("/" + renames[name], name, data, digest))
+
+    # The page changes whenever an asset it references changes, through the rewritten names.
+    with open(os.path.join(WEB_DIR, ENTRY_PAGE), "rb") as f:
+        page = f.read().decode("utf-8")
+    for name, renamed in renames.items():
+        page = re.sub(r'(href|src)="/?%s"' % re.escape(name), r'\1="/%s"' % renamed, page)
+    page = page.encode("utf-8")
+    assets.insert(0, ("/", ENTRY_PAGE, page, content_hash(page)))
+    return assets
+
+
+def c_array(symbol, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static const uint8_t %s[] PROGMEM = {\n%s\n};\n" % (symbol, "\n".join(lines))
+
+
+def render(assets):
+    out = [
+        "// Generated by tools/embed_web_assets.py from web/. Do not edit.\n",
+        "\n",
+        "#pragma once\n",
+        "\n",
+        "#include \"web_ui.h\"\n",
+        "\n",
+    ]
+    entries = []
+    for index, (path, name, data, digest) in enumerate(assets):
+        # mtime=0 keeps the output identical between builds of the same sources.
+        compressed = gzip.compress(data, compresslevel=9, mtime=0)
+        symbol = "WEB_ASSET_%d" % index
+        out.append("// %s: %d bytes, %d gzipped\n" % (name, len(data), len(compressed)))
+        out.append(c_array(symbol, compressed))
+        out.append("\n")
+        content_type = CONTENT_TYPES[os.path.splitext(name)[1]]
+        entries.append('  {"%s", "%s", %s, sizeof(%s), "\\"%s\\"", %s},\n' % (
+            path, content_type, symbol, symbol, digest, "false" if name == ENTRY_PAGE else "true"))
+    out.append("static const WebAsset WEB_ASSETS[] = {\n")
+    out.extend(entries)
+    out.append("};\n")
+    out.append("\n")
+    out.append("static const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);\n")
+    return "".join(out)
+
+
+def main():
+    text = render(load_assets())
+    # Only touch the header when the UI changed, so unrelated builds stay incremental.
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT) as f:
+            if f.read() == text:
+                return
+    with open(OUTPUT, "w") as f:
+        f.write(text)
+    print("embed_web_assets: wrote %s" % os.path.relpath(OUTPUT, PROJECT_DIR))
+
+
+main()
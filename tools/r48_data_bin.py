@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Reads the controller's binary telemetry from /data.bin.
+
+A reference decoder of the frame layout in include/data_binary.h: takes
+the header and unit sizes from each frame and skips fields it does not
+know, so it keeps working when later versions append fields.
+
+    python3 tools/r48_data_bin.py --host 192.168.1.50
+    python3 tools/r48_data_bin.py --host 192.168.1.50 --interval 1000
+    python3 tools/r48_data_bin.py --file frame.bin
+
+Only the Python standard library is needed.
+"""
+
+import argparse
+import struct
+import urllib.request
+
+HEADER = struct.Struct("<4sBBBBIIHH5f")
+UNIT = struct.Struct("<BB2x5f5I")
+CACHED = struct.Struct("<B")  # appended after UNIT
+VERSION = 1
+NO_AGE = 0xFFFFFFFF
+MEASUREMENTS = ["outputVoltage", "outputCurrent", "outputCurrentLimit", "temperature", "supplyVoltage"]
+FLAGS = {0x0001: "command pending", 0x0002: "command failed", 0x0004: "charger running"}
+
+
+def decode(buffer, offset=0):
+    """Decodes the frame at `offset`; returns (frame dict, offset after it), or (None, offset) if incomplete."""
+    if len(buffer) - offset < HEADER.size:
+        return None, offset
+    magic, version, header_size, unit_size, unit_count, sequence, uptime, flags, remaining, *bank = \
+        HEADER.unpack_from(buffer, offset)
+    if magic != b"R48T":
+        raise ValueError(f"not a /data.bin frame at offset {offset}")
+    if version != VERSION:
+        raise ValueError(f"frame version {version}, this decoder knows {VERSION}")
+    end = offset + header_size + unit_count * unit_size
+    if len(buffer) < end:
+        return None, offset
+    units = []
+    for u in range(unit_count):
+        start = offset + header_size + u * unit_size
+        address, valid, *rest = UNIT.unpack_from(buffer, start)
+        values, ages = rest[:5], rest[5:]
+        cached = CACHED.unpack_from(buffer, start + UNIT.size)[0] if unit_size > UNIT.size else 0
+        units.append({
+            "address": address,
+            "values": {name: values[i] for i, name in enumerate(MEASUREMENTS) if valid & (1 << i)},
+            "ageMs": {name: ages[i] for i, name in enumerate(MEASUREMENTS) if ages[i] != NO_AGE},
+            "cached": [name for i, name in enumerate(MEASUREMENTS) if cached & (1 << i)],
+        })
+    return {
+        "sequence": sequence,
+        "uptimeMs": uptime,
+        "flags": [name for bit, name in FLAGS.items() if flags & bit],
+        "remainingSeconds": remaining,
+        "bank": dict(zip(MEASUREMENTS, bank)),
+        "units": units,
+    }, end
+
+
+def show(frame):
+    flags = ", ".join(frame["flags"]) or "-"
+    print(f"#{frame['sequence']} at {frame['uptimeMs'] / 1000:.3f} s, flags: {flags}")
+    print("  bank  " + "  ".join(f"{name} {value:.4f}" for name, value in frame["bank"].items()))
+    for unit in frame["units"]:
+        values = "  ".join(f"{name} {value:.4f} ({unit['ageMs'].get(name, '-')} ms)"
+                           for name, value in unit["values"].items())
+        cached = " (cached: " + ", ".join(unit["cached"]) + ")" if unit["cached"] else ""
+        print(f"  0x{unit['address']:02x}  {values}{cached}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--host")
+    source.add_argument("--file", help="a saved frame or stream")
+    parser.add_argument("--interval", type=int, help="stream a frame every INTERVAL ms")
+    parser.add_argument("--count", type=int, default=0, help="frames to stream, 0 = until interrupted")
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            buffer, offset = f.read(), 0
+        while True:
+            frame, offset = decode(buffer, offset)
+            if frame is None:
+                break
+            show(frame)
+        return
+
+    url = f"http://{args.host}/data.bin"
+    if args.interval:
+        url += f"?interval={args.interval}&count={args.count}"
+    with urllib.request.urlopen(url) as response:
+        buffer = b""
+        while True:
+            chunk = response.read1(4096) if args.interval else response.read()
+            if not chunk:
+                break
+            buffer += chunk
+            while True:
+                frame, offset = decode(buffer)
+                if frame is None:
+                    break
+                show(frame)
+                buffer = buffer[offset:]
+
+
+if __name__ == "__main__":
+    main()
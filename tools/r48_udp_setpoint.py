@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Sends online setpoints to the controller over its UDP setpoint stream.
+
+A minimal energy manager: repeats a current limit (and optionally an
+online voltage) at a fixed rate, with increasing sequence numbers and a
+deadline in the controller's clock, learnt from its acks. The packet and
+ack layouts are described in include/udp_setpoint.h.
+
+    python3 tools/r48_udp_setpoint.py --host 192.168.1.50 --limit 0.4 --rate 5
+
+Stop it and the controller's watchdog falls back to its safe limit.
+Only the Python standard library is needed.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+PACKET = struct.Struct("<2sBBB3xIIff")
+ACK = struct.Struct("<2sBBII")
+VERSION = 1
+HAS_LIMIT, HAS_VOLTAGE = 0x01, 0x02
+ALL_UNITS = 0xFF
+RESULTS = ["accepted", "stale", "out of order", "invalid", "refused", "queue full"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=4848)
+    parser.add_argument("--limit", type=float, help="online current limit, fraction of the rated current")
+    parser.add_argument("--voltage", type=float, help="online voltage in V")
+    parser.add_argument("--unit", type=lambda text: int(text, 0), default=ALL_UNITS, help="rectifier address, default all")
+    parser.add_argument("--rate", type=float, default=5.0, help="packets per second")
+    parser.add_argument("--ttl", type=int, default=200, help="ms a packet stays valid once the clock is known")
+    args = parser.parse_args()
+    if args.limit is None and args.voltage is None:
+        parser.error("give --limit, --voltage or both")
+
+    flags = (HAS_LIMIT if args.limit is not None else 0) | (HAS_VOLTAGE if args.voltage is not None else 0)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1.0 / args.rate)
+    # Controller millis() minus our monotonic ms, from the latest ack; None until the first one.
+    offset = None
+    sequence = 0  # a new socket has a new source port, so the controller starts a new stream
+    while True:
+        sequence = (sequence + 1) & 0xFFFFFFFF
+        now = int(time.monotonic() * 1000)
+        deadline = (now + offset + args.ttl) & 0xFFFFFFFF if offset is not None else 0
+        packet = PACKET.pack(b"RS", VERSION, flags, args.unit, sequence, deadline,
+                             args.limit or 0.0, args.voltage or 0.0)
+        sent = time.monotonic()
+        sock.sendto(packet, (args.host, args.port))
+        try:
+            magic, _, result, acked, device_now = ACK.unpack(sock.recv(64))
+            round_trip = time.monotonic() - sent
+            if magic == b"RA" and acked == sequence:
+                offset = device_now - int((sent + round_trip / 2) * 1000)
+                print(f"#{sequence} {RESULTS[result] if result < len(RESULTS) else result}, "
+                      f"round trip {round_trip * 1000:.1f} ms")
+        except socket.timeout:
+            print(f"#{sequence} no ack")
+        time.sleep(max(0.0, 1.0 / args.rate - (time.monotonic() - sent)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Simulated bank of R48 rectifiers on a SocketCAN interface.
+
+Answers the controller's read requests and applies its setting writes the
+way lib/r48_native/r48_simulator.cpp does for the host tests, but on a real
+(usually virtual) CAN interface, so the [env:linux] daemon can be run
+end to end without hardware:
+
+    sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+    python3 tools/r48_vcan_sim.py --interface vcan0 --units 3 --load 20
+
+Only the Python standard library is needed (Linux, Python 3.3+).
+"""
+
+import argparse
+import heapq
+import random
+import select
+import socket
+import struct
+import time
+
+CAN_FRAME = struct.Struct("=IB3x8s")
+CAN_EFF_FLAG = 0x80000000
+CAN_EFF_MASK = 0x1FFFFFFF
+
+PROTOCOL_NO = 0x060
+CONTROLLER = 0xF0
+RATED_CURRENT = 41.7
+
+OUTPUT_VOLTAGE, OUTPUT_CURRENT, OUTPUT_CURRENT_LIMIT, TEMPERATURE, SUPPLY_VOLTAGE = 0x01, 0x02, 0x03, 0x04, 0x05
+ONLINE_VOLTAGE, ONLINE_CURRENT_LIMIT = 0x21, 0x22
+PERMANENT_VOLTAGE, PERMANENT_CURRENT_LIMIT, PERMANENT_MAX_INPUT_CURRENT = 0x24, 0x19, 0x1A
+
+ANSWER_DELAY = 0.002   # seconds from request to answer, plus up to ANSWER_JITTER
+ANSWER_JITTER = 0.001
+ONLINE_APPLY = 0.020   # online settings take effect after this
+STORE = 0.400          # permanent settings are stored after this
+
+
+def make_id(point_to_point, destination, source):
+    return (PROTOCOL_NO << 20) | (int(point_to_point) << 19) | (destination << 11) | (source << 3) | 0x03
+
+
+class Unit:
+    def __init__(self, address, load):
+        self.address = address
+        self.load = load
+        self.stored = {
+            PERMANENT_VOLTAGE: 53.5,
+            PERMANENT_CURRENT_LIMIT: 1.0,
+            PERMANENT_MAX_INPUT_CURRENT: 13.0,
+            0x29: 8.0,   # walk-in time
+            0x32: 0.0,   # walk-in off
+            0x33: 0.0,   # fan auto
+        }
+        self.online_voltage = None
+        self.online_current_limit = None
+
+    def setpoint(self):
+        return self.stored[PERMANENT_VOLTAGE] if self.online_voltage is None else self.online_voltage
+
+    def current_limit(self):
+        return self.stored[PERMANENT_CURRENT_LIMIT] if self.online_current_limit is None else self.online_current_limit
+
+    def output_current(self):
+        return min(self.load, self.current_limit() * RATED_CURRENT)
+
+    def value(self, register):
+        current = self.output_current()
+        if register == OUTPUT_VOLTAGE:
+            return self.setpoint() * (current / self.load if 0 < current < self.load else 1.0)
+        if register == OUTPUT_CURRENT:
+            return current
+        if register == OUTPUT_CURRENT_LIMIT:
+            return self.current_limit()
+        if register == TEMPERATURE:
+            return 25.0 + current * 0.3
+        if register == SUPPLY_VOLTAGE:
+            return 230.0
+        return self.stored.get(register)
+
+    def apply(self, register, value):
+        if register == ONLINE_VOLTAGE:
+            self.online_voltage = value
+        elif register == ONLINE_CURRENT_LIMIT:
+            self.online_current_limit = value
+        else:
+            self.stored[register] = value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--interface", default="vcan0")
+    parser.add_argument("--units", type=int, default=2, help="number of rectifiers, at addresses 1..N")
+    parser.add_argument("--load", type=float, default=10.0, help="load current per rectifier in A")
+    args = parser.parse_args()
+
+    units = [Unit(address, args.load) for address in range(1, args.units + 1)]
+    bus = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    bus.bind((args.interface,))
+    print("%d simulated R48 on %s" % (len(units), args.interface))
+
+    events = []  # (due, sequence, action)
+    sequence = 0
+
+    def schedule(delay, action):
+        nonlocal sequence
+        sequence += 1
+        heapq.heappush(events, (time.monotonic() + delay, sequence, action))
+
+    def answer(unit, register):
+        value = unit.value(register)
+        if value is None:
+            return
+        payload = bytes([0x41, CONTROLLER, 0x00, register]) + struct.pack(">f", value)
+        bus.send(CAN_FRAME.pack(make_id(True, CONTROLLER, unit.address) | CAN_EFF_FLAG, 8, payload))
+
+    while True:
+        timeout = max(0.0, events[0][0] - time.monotonic()) if events else None
+        readable, _, _ = select.select([bus], [], [], timeout)
+        while events and events[0][0] <= time.monotonic():
+            heapq.heappop(events)[2]()
+        if not readable:
+            continue
+
+        can_id, length, data = CAN_FRAME.unpack(bus.recv(CAN_FRAME.size))
+        if not can_id & CAN_EFF_FLAG or length != 8:
+            continue
+        can_id &= CAN_EFF_MASK
+        if can_id >> 20 != PROTOCOL_NO or (can_id >> 3) & 0xFF != CONTROLLER:
+            continue
+        point_to_point = (can_id >> 19) & 1
+        destination = (can_id >> 11) & 0xFF
+        register = data[3]
+        for unit in units:
+            if point_to_point and destination != unit.address:
+                continue
+            if data[0] == 0x01:
+                schedule(ANSWER_DELAY + random.uniform(0, ANSWER_JITTER), lambda u=unit, r=register: answer(u, r))
+            elif data[0] == 0x03:
+                value = struct.unpack(">f", data[4:8])[0]
+                delay = ONLINE_APPLY if register in (ONLINE_VOLTAGE, ONLINE_CURRENT_LIMIT) else STORE
+                schedule(delay, lambda u=unit, r=register, v=value: u.apply(r, v))
+
+
+if __name__ == "__main__":
+    main()
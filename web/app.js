@@ -0,0 +1,144 @@
+// Latest copy of the /data document, kept up to date by the /events stream
+let state = null;
+
+// Function to update the data display and button states
+function render(data) {
+  document.getElementById('outputVoltage').innerText = data.outputVoltage.toFixed(2);
+  document.getElementById('outputCurrent').innerText = data.outputCurrent.toFixed(2);
+  document.getElementById('currentLimit').innerText = (data.outputCurrentLimit * 100).toFixed(2);
+  document.getElementById('temperature').innerText = data.temperature.toFixed(2);
+  document.getElementById('supplyVoltage').innerText = data.supplyVoltage.toFixed(2);
+  document.getElementById('unitCount').innerText = data.unitCount;
+  // Values restored from flash after a restart are greyed out until the unit answers
+  document.getElementById('units').innerHTML = data.units.map(unit =>
+    '<tr' + (unit.cached ? ' class="cached"' : '') + '><td>#' + unit.address + '</td><td>' +
+    unit.outputVoltage.toFixed(2) + ' V</td><td>' +
+    unit.outputCurrent.toFixed(2) + ' A</td><td>' + unit.temperature.toFixed(1) + ' C</td></tr>').join('');
+
+  const buttons = document.querySelectorAll('.command-button');
+  const messageBox = document.getElementById('statusMessage');
+
+  if (data.isCommandPending) {
+    buttons.forEach(button => button.disabled = true);
+    messageBox.style.display = 'block';
+    messageBox.innerText = 'Waiting for the rectifier to confirm the command... at most ' + data.remainingTime + ' seconds';
+  } else if (data.commandResult === 'failed') {
+    buttons.forEach(button => button.disabled = false);
+    messageBox.style.display = 'block';
+    messageBox.innerText = 'The rectifier did not confirm the last command. Check /commands and try again.';
+  } else {
+    buttons.forEach(button => button.disabled = false);
+    messageBox.style.display = 'none';
+  }
+}
+
+// Merges a delta event (changed top-level values plus changed unit values) into the state
+function applyDelta(delta) {
+  Object.keys(delta).forEach(key => {
+    if (key !== 'units') state[key] = delta[key];
+  });
+  (delta.units || []).forEach(changed => {
+    const unit = state.units.find(u => u.address === changed.address);
+    if (unit) Object.assign(unit, changed);
+  });
+}
+
+// Fallback for browsers without EventSource: poll /data
+function updateData() {
+  fetch('/data')
+    .then(response => response.json())
+    .then(data => { state = data; render(state); })
+    .catch(error => console.error('Error fetching data:', error));
+}
+
+// Set up form submission handlers
+document.getElementById('permVoltageForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_perm_v', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+document.getElementById('onlineVoltageForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_online_v', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+document.getElementById('permCurrentForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_perm_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+document.getElementById('onlineCurrentForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_online_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+document.getElementById('dieselCurrentForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_diesel_input_c', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+// New handler for fan speed form submission
+document.getElementById('fanSpeedForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const speed = event.submitter.value;
+  fetch('/set_fan_speed', { method: 'POST', body: 'speed=' + speed, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+// New handler for walk-in state form submission (on/off)
+document.getElementById('walkInStateForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const state = event.submitter.value;
+  fetch('/set_walk_in', { method: 'POST', body: 'state=' + state, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+// New form handler for walk-in time using a POST request
+document.getElementById('walkInTimeForm').addEventListener('submit', function(event) {
+  event.preventDefault();
+  const value = this.elements.value.value;
+  fetch('/set_walk_in_time', { method: 'POST', body: 'value=' + value, headers: { 'Content-Type': 'application/x-www-form-urlencoded' } })
+    .then(response => response.text())
+    .then(text => alert(text))
+    .catch(error => console.error('Error:', error));
+});
+
+if (window.EventSource) {
+  // The controller sends a full snapshot on connect and after units join or leave, then deltas
+  const events = new EventSource('/events');
+  events.addEventListener('snapshot', event => { state = JSON.parse(event.data); render(state); });
+  events.addEventListener('delta', event => {
+    if (!state) return;
+    applyDelta(JSON.parse(event.data));
+    render(state);
+  });
+} else {
+  // Request data every 1 second to keep the countdown live
+  setInterval(updateData, 1000);
+  // Initial data fetch on page load
+  updateData();
+}